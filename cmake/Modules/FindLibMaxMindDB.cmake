@@ -0,0 +1,67 @@
+#############################################################################
+# Copyright (c) 2017 Balabit
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+
+# - Try to find libmaxminddb headers and libraries
+#
+# Usage of this module as follows:
+#
+#     find_package(LibMaxMindDB)
+#
+# Variables used by this module, they can change the default behaviour and need
+# to be set before calling find_package:
+#
+#  LibMaxMindDB_ROOT_DIR     Set this variable to the root installation of
+#                            libmaxminddb if the module has problems finding the
+#                            proper installation path.
+#
+# Variables defined by this module:
+#
+#  LIBMAXMINDDB_FOUND        System has libmaxminddb libraries and headers
+#  LibMaxMindDB_LIBRARY      The libmaxminddb library
+#  LibMaxMindDB_INCLUDE_DIR  The location of libmaxminddb headers
+
+find_path(LibMaxMindDB_ROOT_DIR
+    NAMES include/maxminddb.h
+)
+
+find_library(LibMaxMindDB_LIBRARY
+    NAMES maxminddb
+    HINTS ${LibMaxMindDB_ROOT_DIR}/lib
+)
+
+find_path(LibMaxMindDB_INCLUDE_DIR
+    NAMES maxminddb.h
+    HINTS ${LibMaxMindDB_ROOT_DIR}/include
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibMaxMindDB DEFAULT_MSG
+    LibMaxMindDB_LIBRARY
+    LibMaxMindDB_INCLUDE_DIR
+)
+
+mark_as_advanced(
+    LibMaxMindDB_ROOT_DIR
+    LibMaxMindDB_LIBRARY
+    LibMaxMindDB_INCLUDE_DIR
+)
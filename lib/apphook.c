@@ -26,6 +26,7 @@
 #include "messages.h"
 #include "children.h"
 #include "dnscache.h"
+#include "dnsresolver.h"
 #include "alarms.h"
 #include "stats/stats-registry.h"
 #include "logmsg/logmsg.h"
@@ -40,6 +41,7 @@
 #include "crypto.h"
 #include "value-pairs/value-pairs.h"
 #include "scratch-buffers.h"
+#include "pcre-utils.h"
 
 #include <iv.h>
 #include <iv_work.h>
@@ -124,6 +126,7 @@ app_startup(void)
   hostname_global_init();
   dns_caching_global_init();
   dns_caching_thread_init();
+  dns_resolver_global_init();
   afinter_global_init();
   child_manager_init();
   alarm_init();
@@ -144,6 +147,7 @@ app_finish_app_startup_after_cfg_init(void)
   log_tags_reinit_stats();
   log_msg_stats_global_init();
   scratch_buffers_global_init();
+  dns_caching_register_stats();
 }
 
 void
@@ -169,8 +173,11 @@ void
 app_shutdown(void)
 {
   run_application_hook(AH_SHUTDOWN);
+  pcre_utils_thread_deinit();
+  timeutils_thread_deinit();
   scratch_buffers_allocator_deinit();
   scratch_buffers_global_deinit();
+  dns_caching_unregister_stats();
   value_pairs_global_deinit();
   log_template_global_deinit();
   log_tags_global_deinit();
@@ -180,6 +187,7 @@ app_shutdown(void)
   child_manager_deinit();
   g_list_foreach(application_hooks, (GFunc) g_free, NULL);
   g_list_free(application_hooks);
+  dns_resolver_global_deinit();
   dns_caching_thread_deinit();
   dns_caching_global_deinit();
   hostname_global_deinit();
@@ -211,6 +219,8 @@ app_thread_start(void)
 void
 app_thread_stop(void)
 {
+  pcre_utils_thread_deinit();
+  timeutils_thread_deinit();
   main_loop_call_thread_deinit();
   dns_caching_thread_deinit();
   scratch_buffers_allocator_deinit();
@@ -211,6 +211,9 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_DNS_CACHE_EXPIRE            10130
 %token KW_DNS_CACHE_EXPIRE_FAILED     10131
 %token KW_DNS_CACHE_HOSTS             10132
+%token KW_DNS_RESOLVER_THREADS        10133
+%token KW_DNS_RESOLVER_TIMEOUT        10134
+%token KW_DNS_CACHE_SHARED            10135
 
 %token KW_PERSIST_ONLY                10140
 %token KW_USE_RCPTID                  10141
@@ -935,6 +938,11 @@ dns_cache_option
 	| KW_DNS_CACHE_EXPIRE_FAILED '(' positive_integer ')'
 	                                        { last_dns_cache_options->expire_failed = $3; }
 	| KW_DNS_CACHE_HOSTS '(' string ')'     { last_dns_cache_options->hosts = g_strdup($3); free($3); }
+	| KW_DNS_CACHE_SHARED '(' yesno ')'     { last_dns_cache_options->shared = $3; }
+	| KW_DNS_RESOLVER_THREADS '(' nonnegative_integer ')'
+	                                        { last_dns_cache_options->resolver_threads = $3; }
+	| KW_DNS_RESOLVER_TIMEOUT '(' nonnegative_integer ')'
+	                                        { last_dns_cache_options->resolver_timeout = $3; }
         ;
 
 
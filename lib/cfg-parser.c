@@ -150,6 +150,9 @@ static CfgLexerKeyword main_keywords[] =
   { "dns_cache_size",     KW_DNS_CACHE_SIZE },
   { "dns_cache_expire",   KW_DNS_CACHE_EXPIRE },
   { "dns_cache_expire_failed", KW_DNS_CACHE_EXPIRE_FAILED },
+  { "dns_cache_shared",   KW_DNS_CACHE_SHARED },
+  { "dns_resolver_threads",    KW_DNS_RESOLVER_THREADS },
+  { "dns_resolver_timeout",    KW_DNS_RESOLVER_TIMEOUT },
   { "pass_unix_credentials",   KW_PASS_UNIX_CREDENTIALS },
   { "persist_name",            KW_PERSIST_NAME, VERSION_VALUE_3_8 },
 
@@ -125,6 +125,7 @@ struct _LogExprNode
 gint log_expr_node_lookup_flag(const gchar *flag);
 
 LogExprNode *log_expr_node_append_tail(LogExprNode *a, LogExprNode *b);
+LogExprNode *log_expr_node_get_container_rule(LogExprNode *self, gint content);
 void log_expr_node_set_object(LogExprNode *self, gpointer object, GDestroyNotify destroy);
 const gchar *log_expr_node_format_location(LogExprNode *self, gchar *buf, gsize buf_len);
 EVTTAG *log_expr_node_location_tag(LogExprNode *self);
@@ -157,6 +158,8 @@ typedef struct _CfgTree
   /* list of top-level rules */
   GPtrArray *rules;
   GHashTable *templates;
+  /* number of per-message filter result slots handed out to named filters */
+  gint filter_memo_slots;
   gboolean compiled;
 } CfgTree;
 
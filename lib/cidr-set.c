@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "cidr-set.h"
+#include "messages.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _CIDRSetKey
+{
+  guint64 hi;
+  guint64 lo;
+} CIDRSetKey;
+
+typedef struct _CIDRSetRange
+{
+  CIDRSetKey first;
+  CIDRSetKey last;
+} CIDRSetRange;
+
+typedef struct _CIDRSetIndexEntry
+{
+  guint32 lo;
+  guint32 hi;
+} CIDRSetIndexEntry;
+
+/*
+ * IPv4 lookups are narrowed down by the top 16 bits of the address: the
+ * index tells which ranges may contain an address in that /16, so the
+ * binary search runs on a handful of ranges at most.  Only built for
+ * larger sets, as it costs 512kB.
+ */
+#define CIDR_SET_IPV4_INDEX_BITS 16
+#define CIDR_SET_IPV4_INDEX_SIZE (1 << CIDR_SET_IPV4_INDEX_BITS)
+#define CIDR_SET_IPV4_INDEX_MIN_RANGES 64
+
+struct _CIDRSet
+{
+  GArray *ranges;
+  CIDRSetIndexEntry *ipv4_index;
+  gboolean compiled;
+};
+
+#define CIDR_SET_IPV4_MAPPED_PREFIX G_GUINT64_CONSTANT(0x0000FFFF00000000)
+
+static inline gboolean
+_key_is_ipv4(const CIDRSetKey *key)
+{
+  return key->hi == 0 && (key->lo >> 32) == 0x0000FFFF;
+}
+
+static inline gint
+_key_compare(const CIDRSetKey *a, const CIDRSetKey *b)
+{
+  if (a->hi != b->hi)
+    return a->hi < b->hi ? -1 : 1;
+  if (a->lo != b->lo)
+    return a->lo < b->lo ? -1 : 1;
+  return 0;
+}
+
+static inline guint64
+_load_be64(const guint8 *p)
+{
+  guint64 v;
+
+  memcpy(&v, p, sizeof(v));
+  return GUINT64_FROM_BE(v);
+}
+
+static inline void
+_key_from_in_addr(CIDRSetKey *key, const struct in_addr *addr)
+{
+  key->hi = 0;
+  key->lo = CIDR_SET_IPV4_MAPPED_PREFIX | ntohl(addr->s_addr);
+}
+
+static inline void
+_key_from_bytes(CIDRSetKey *key, const guint8 *address)
+{
+  key->hi = _load_be64(&address[0]);
+  key->lo = _load_be64(&address[8]);
+}
+
+#if SYSLOG_NG_ENABLE_IPV6
+static inline void
+_key_from_in6_addr(CIDRSetKey *key, const struct in6_addr *addr)
+{
+  _key_from_bytes(key, addr->s6_addr);
+}
+#endif
+
+/* returns the prefix length in bits covering the whole address or -1 */
+static gint
+_parse_address(const gchar *address, guint8 *result)
+{
+  struct in_addr ina;
+
+  if (inet_pton(AF_INET, address, &ina) == 1)
+    {
+      memset(result, 0, 10);
+      result[10] = result[11] = 0xFF;
+      memcpy(&result[12], &ina.s_addr, 4);
+      return 32;
+    }
+#if SYSLOG_NG_ENABLE_IPV6
+  if (inet_pton(AF_INET6, address, result) == 1)
+    return 128;
+#endif
+  return -1;
+}
+
+static gint
+_parse_prefix(const gchar *prefix_str, gint max_prefix)
+{
+  struct in_addr netmask;
+  gchar *end;
+  gint prefix;
+
+  if (max_prefix == 32 && strchr(prefix_str, '.'))
+    {
+      guint32 mask;
+
+      if (inet_pton(AF_INET, prefix_str, &netmask) != 1)
+        return -1;
+
+      mask = ntohl(netmask.s_addr);
+      /* only contiguous netmasks are supported */
+      if ((~mask & (~mask + 1)) != 0)
+        return -1;
+      for (prefix = 0; mask; mask <<= 1)
+        prefix++;
+      return prefix;
+    }
+
+  prefix = strtol(prefix_str, &end, 10);
+  if (*end || end == prefix_str || prefix < 0 || prefix > max_prefix)
+    return -1;
+  return prefix;
+}
+
+static inline guint64
+_mask_bits(gint bits)
+{
+  if (bits <= 0)
+    return 0;
+  if (bits >= 64)
+    return G_MAXUINT64;
+  return G_MAXUINT64 << (64 - bits);
+}
+
+gboolean
+cidr_parse_address(const gchar *address, guint8 result[16])
+{
+  return _parse_address(address, result) >= 0;
+}
+
+gboolean
+cidr_parse_network(const gchar *cidr, guint8 result[16], gint *prefix_len)
+{
+  gchar address[INET6_ADDRSTRLEN];
+  const gchar *slash = strchr(cidr, '/');
+  gsize address_len = slash ? slash - cidr : strlen(cidr);
+  gint max_prefix, prefix;
+
+  if (address_len >= sizeof(address))
+    return FALSE;
+  memcpy(address, cidr, address_len);
+  address[address_len] = 0;
+
+  max_prefix = _parse_address(address, result);
+  if (max_prefix < 0)
+    return FALSE;
+
+  prefix = slash ? _parse_prefix(slash + 1, max_prefix) : max_prefix;
+  if (prefix < 0)
+    return FALSE;
+
+  /* IPv4 networks live in the ::ffff:0:0/96 range */
+  *prefix_len = max_prefix == 32 ? prefix + 96 : prefix;
+  return TRUE;
+}
+
+gboolean
+cidr_set_add(CIDRSet *self, const gchar *cidr)
+{
+  guint8 address[16];
+  CIDRSetRange range;
+  CIDRSetKey key;
+  gint prefix;
+  guint64 mask_hi, mask_lo;
+
+  if (!cidr_parse_network(cidr, address, &prefix))
+    return FALSE;
+  _key_from_bytes(&key, address);
+
+  mask_hi = _mask_bits(prefix);
+  mask_lo = _mask_bits(prefix - 64);
+  range.first.hi = key.hi & mask_hi;
+  range.first.lo = key.lo & mask_lo;
+  range.last.hi = key.hi | ~mask_hi;
+  range.last.lo = key.lo | ~mask_lo;
+
+  g_array_append_val(self->ranges, range);
+  self->compiled = FALSE;
+  return TRUE;
+}
+
+static gint
+_range_compare(gconstpointer a, gconstpointer b)
+{
+  return _key_compare(&((const CIDRSetRange *) a)->first, &((const CIDRSetRange *) b)->first);
+}
+
+static inline gboolean
+_key_is_adjacent(const CIDRSetKey *last, const CIDRSetKey *next)
+{
+  CIDRSetKey succ = *last;
+
+  if (++succ.lo == 0)
+    {
+      if (++succ.hi == 0)
+        return FALSE;
+    }
+  return _key_compare(&succ, next) == 0;
+}
+
+/*
+ * For each /16 bucket [start, end], lo is the first range that ends at or
+ * after start and hi is the first range that begins after end.  Both
+ * only move forward, so this is a single sweep over the ranges.
+ */
+static void
+_build_ipv4_index(CIDRSet *self)
+{
+  const CIDRSetRange *ranges = (const CIDRSetRange *) self->ranges->data;
+  guint32 lo = 0, hi = 0, bucket;
+  CIDRSetKey start, end;
+
+  self->ipv4_index = g_new(CIDRSetIndexEntry, CIDR_SET_IPV4_INDEX_SIZE);
+  for (bucket = 0; bucket < CIDR_SET_IPV4_INDEX_SIZE; bucket++)
+    {
+      start.hi = end.hi = 0;
+      start.lo = CIDR_SET_IPV4_MAPPED_PREFIX | (bucket << (32 - CIDR_SET_IPV4_INDEX_BITS));
+      end.lo = start.lo | ((1 << (32 - CIDR_SET_IPV4_INDEX_BITS)) - 1);
+
+      while (lo < self->ranges->len && _key_compare(&ranges[lo].last, &start) < 0)
+        lo++;
+      while (hi < self->ranges->len && _key_compare(&ranges[hi].first, &end) <= 0)
+        hi++;
+
+      self->ipv4_index[bucket].lo = lo;
+      self->ipv4_index[bucket].hi = MAX(lo, hi);
+    }
+}
+
+/*
+ * Sort the ranges and merge the overlapping or adjacent ones, so that
+ * lookups can stop at the first range that starts at or before the
+ * address.
+ */
+void
+cidr_set_compile(CIDRSet *self)
+{
+  CIDRSetRange *ranges;
+  guint i, merged = 0;
+
+  if (self->compiled)
+    return;
+
+  g_array_sort(self->ranges, _range_compare);
+  ranges = (CIDRSetRange *) self->ranges->data;
+  for (i = 0; i < self->ranges->len; i++)
+    {
+      if (merged > 0 &&
+          (_key_compare(&ranges[i].first, &ranges[merged - 1].last) <= 0 ||
+           _key_is_adjacent(&ranges[merged - 1].last, &ranges[i].first)))
+        {
+          if (_key_compare(&ranges[i].last, &ranges[merged - 1].last) > 0)
+            ranges[merged - 1].last = ranges[i].last;
+          continue;
+        }
+      ranges[merged++] = ranges[i];
+    }
+  g_array_set_size(self->ranges, merged);
+
+  g_free(self->ipv4_index);
+  self->ipv4_index = NULL;
+  if (merged >= CIDR_SET_IPV4_INDEX_MIN_RANGES)
+    _build_ipv4_index(self);
+
+  self->compiled = TRUE;
+}
+
+/*
+ * Load networks from a file, one per line.  Empty lines and lines
+ * starting with '#' are ignored, invalid networks are reported and
+ * skipped.  The set needs to be compiled afterwards.
+ */
+gboolean
+cidr_set_load_file(CIDRSet *self, const gchar *filename)
+{
+  FILE *stream;
+  gchar line[256];
+  gint lineno = 0;
+
+  stream = fopen(filename, "r");
+  if (!stream)
+    {
+      msg_error("Error opening network list file",
+                evt_tag_str("file", filename),
+                evt_tag_errno("errno", errno));
+      return FALSE;
+    }
+
+  while (fgets(line, sizeof(line), stream) != NULL)
+    {
+      lineno++;
+      g_strstrip(line);
+      if (line[0] == 0 || line[0] == '#')
+        continue;
+
+      if (!cidr_set_add(self, line))
+        msg_warning("Invalid network in network list file, ignoring",
+                    evt_tag_str("file", filename),
+                    evt_tag_int("line", lineno),
+                    evt_tag_str("network", line));
+    }
+  fclose(stream);
+  return TRUE;
+}
+
+gsize
+cidr_set_get_size(CIDRSet *self)
+{
+  return self->ranges->len;
+}
+
+static gboolean
+_contains_key(CIDRSet *self, const CIDRSetKey *key)
+{
+  const CIDRSetRange *ranges = (const CIDRSetRange *) self->ranges->data;
+  gint l = 0, h = (gint) self->ranges->len - 1, m;
+
+  g_assert(self->compiled);
+
+  if (self->ipv4_index && _key_is_ipv4(key))
+    {
+      const CIDRSetIndexEntry *bucket = &self->ipv4_index[(key->lo & 0xFFFFFFFF) >> (32 - CIDR_SET_IPV4_INDEX_BITS)];
+
+      l = bucket->lo;
+      h = (gint) bucket->hi - 1;
+    }
+
+  /* find the last range starting at or before key */
+  while (l <= h)
+    {
+      m = (l + h) >> 1;
+      if (_key_compare(&ranges[m].first, key) <= 0)
+        l = m + 1;
+      else
+        h = m - 1;
+    }
+  return h >= 0 && _key_compare(key, &ranges[h].last) <= 0;
+}
+
+gboolean
+cidr_set_contains(CIDRSet *self, const gchar *address)
+{
+  guint8 bytes[16];
+  CIDRSetKey key;
+
+  if (!cidr_parse_address(address, bytes))
+    return FALSE;
+  _key_from_bytes(&key, bytes);
+  return _contains_key(self, &key);
+}
+
+gboolean
+cidr_set_contains_sockaddr(CIDRSet *self, GSockAddr *saddr)
+{
+  CIDRSetKey key;
+
+  if (g_sockaddr_inet_check(saddr))
+    _key_from_in_addr(&key, &((struct sockaddr_in *) &saddr->sa)->sin_addr);
+#if SYSLOG_NG_ENABLE_IPV6
+  else if (g_sockaddr_inet6_check(saddr))
+    _key_from_in6_addr(&key, &((struct sockaddr_in6 *) &saddr->sa)->sin6_addr);
+#endif
+  else
+    return FALSE;
+  return _contains_key(self, &key);
+}
+
+CIDRSet *
+cidr_set_new(void)
+{
+  CIDRSet *self = g_new0(CIDRSet, 1);
+
+  self->ranges = g_array_new(FALSE, FALSE, sizeof(CIDRSetRange));
+  return self;
+}
+
+void
+cidr_set_free(CIDRSet *self)
+{
+  g_free(self->ipv4_index);
+  g_array_free(self->ranges, TRUE);
+  g_free(self);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef CIDR_SET_H_INCLUDED
+#define CIDR_SET_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "gsockaddr.h"
+
+/*
+ * A set of IPv4 and IPv6 networks, optimized for "is this address in any
+ * of them" queries against a large number of networks.  Networks are
+ * added one-by-one, then cidr_set_compile() turns them into a sorted
+ * array of disjoint address ranges, looked up using binary search.
+ *
+ * IPv4 addresses are stored as IPv4-mapped IPv6 addresses, so the two
+ * families share the same key space.
+ */
+typedef struct _CIDRSet CIDRSet;
+
+/*
+ * Parse an address or a network ("address/prefix", or "address/netmask"
+ * for IPv4) into 16 bytes in network order.  IPv4 addresses are returned
+ * as IPv4-mapped IPv6 addresses, with the prefix length adjusted
+ * accordingly, so "10.0.0.0/8" and "::ffff:10.0.0.0/104" are the same.
+ */
+gboolean cidr_parse_address(const gchar *address, guint8 result[16]);
+gboolean cidr_parse_network(const gchar *cidr, guint8 result[16], gint *prefix_len);
+
+CIDRSet *cidr_set_new(void);
+void cidr_set_free(CIDRSet *self);
+
+gboolean cidr_set_add(CIDRSet *self, const gchar *cidr);
+gboolean cidr_set_load_file(CIDRSet *self, const gchar *filename);
+void cidr_set_compile(CIDRSet *self);
+gsize cidr_set_get_size(CIDRSet *self);
+
+gboolean cidr_set_contains(CIDRSet *self, const gchar *address);
+gboolean cidr_set_contains_sockaddr(CIDRSet *self, GSockAddr *saddr);
+
+#endif
@@ -26,6 +26,7 @@
 #include "messages.h"
 #include "timeutils.h"
 #include "tls-support.h"
+#include "stats/stats-registry.h"
 
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -74,8 +75,16 @@ struct _DNSCache
   gint persistent_count;
   time_t hosts_mtime;
   time_t hosts_checktime;
+  /* when used as a shard of the shared cache, only the entries hashing to
+   * this shard are stored and the size limit is divided between shards */
+  guint shard;
+  guint num_shards;
 };
 
+static StatsCounterItem *stats_dns_cache_hits;
+static StatsCounterItem *stats_dns_cache_misses;
+static StatsCounterItem *stats_dns_cache_evictions;
+
 
 
 static gboolean
@@ -143,6 +152,20 @@ dns_cache_fill_key(DNSCacheKey *key, gint family, void *addr)
     }
 }
 
+static inline gint
+dns_cache_max_size(DNSCache *self)
+{
+  return (self->options->cache_size + self->num_shards - 1) / self->num_shards;
+}
+
+static inline guint
+dns_cache_key_shard(DNSCacheKey *key, guint num_shards)
+{
+  guint hash = dns_cache_key_hash(key);
+
+  return (hash ^ (hash >> 16)) % num_shards;
+}
+
 static void
 dns_cache_store(DNSCache *self, gboolean persistent, gint family, void *addr, const gchar *hostname, gboolean positive)
 {
@@ -159,7 +182,7 @@ dns_cache_store(DNSCache *self, gboolean persistent, gint family, void *addr, co
   if (!persistent)
     {
       entry->resolved = cached_g_current_time_sec();
-      iv_list_add(&entry->list, &self->cache_list);
+      iv_list_add_tail(&entry->list, &self->cache_list);
     }
   else
     {
@@ -173,12 +196,13 @@ dns_cache_store(DNSCache *self, gboolean persistent, gint family, void *addr, co
     self->persistent_count++;
 
   /* persistent elements are not counted */
-  if ((gint) (g_hash_table_size(self->cache) - self->persistent_count) > self->options->cache_size)
+  if ((gint) (g_hash_table_size(self->cache) - self->persistent_count) > dns_cache_max_size(self))
     {
       DNSCacheEntry *entry_to_remove = iv_list_entry(self->cache_list.next, DNSCacheEntry, list);
 
       /* remove oldest element */
       g_hash_table_remove(self->cache, &entry_to_remove->key);
+      stats_counter_inc(stats_dns_cache_evictions);
     }
 }
 
@@ -272,6 +296,14 @@ dns_cache_check_hosts(DNSCache *self, glong t)
               if (!p)
                 continue;
               inet_pton(family, ip, &ia);
+              if (self->num_shards > 1)
+                {
+                  DNSCacheKey key;
+
+                  dns_cache_fill_key(&key, family, &ia);
+                  if (dns_cache_key_shard(&key, self->num_shards) != self->shard)
+                    continue;
+                }
               dns_cache_store_persistent(self, family, &ia, p);
             }
           fclose(hosts);
@@ -312,23 +344,28 @@ dns_cache_lookup(DNSCache *self, gint family, void *addr, const gchar **hostname
           ((entry->positive && entry->resolved < now - self->options->expire) ||
            (!entry->positive && entry->resolved < now - self->options->expire_failed)))
         {
-          /* the entry is not persistent and is too old */
+          /* the entry is not persistent and is too old, drop it right
+           * away instead of waiting for it to age out of the LRU list */
+          g_hash_table_remove(self->cache, &key);
+          stats_counter_inc(stats_dns_cache_evictions);
         }
       else
         {
           *hostname = entry->hostname;
           *hostname_len = entry->hostname_len;
           *positive = entry->positive;
+          stats_counter_inc(stats_dns_cache_hits);
           return TRUE;
         }
     }
+  stats_counter_inc(stats_dns_cache_misses);
   *hostname = NULL;
   *positive = FALSE;
   return FALSE;
 }
 
-DNSCache *
-dns_cache_new(const DNSCacheOptions *options)
+static DNSCache *
+dns_cache_new_shard(const DNSCacheOptions *options, guint shard, guint num_shards)
 {
   DNSCache *self = g_new0(DNSCache, 1);
 
@@ -340,9 +377,17 @@ dns_cache_new(const DNSCacheOptions *options)
   self->hosts_checktime = 0;
   self->persistent_count = 0;
   self->options = options;
+  self->shard = shard;
+  self->num_shards = num_shards;
   return self;
 }
 
+DNSCache *
+dns_cache_new(const DNSCacheOptions *options)
+{
+  return dns_cache_new_shard(options, 0, 1);
+}
+
 void
 dns_cache_free(DNSCache *self)
 {
@@ -357,6 +402,9 @@ dns_cache_options_defaults(DNSCacheOptions *options)
   options->expire = 3600;
   options->expire_failed = 60;
   options->hosts = NULL;
+  options->shared = FALSE;
+  options->resolver_threads = 0;
+  options->resolver_timeout = 0;
 }
 
 void
@@ -383,6 +431,30 @@ TLS_BLOCK_END;
 
 #define dns_cache __tls_deref(dns_cache)
 
+/* With dns-cache-shared(yes), a single cache is used by all threads, so
+ * that each address is only resolved once in the process.  It is split
+ * into shards, each protected by its own lock.  As entries may be evicted
+ * by other threads once the lock is released, the returned hostname is
+ * copied into a per-thread buffer.
+ */
+#define DNS_CACHE_SHARDS 16
+
+typedef struct _DNSCacheShard
+{
+  GStaticMutex lock;
+  DNSCache *cache;
+} DNSCacheShard;
+
+static DNSCacheShard shared_dns_cache[DNS_CACHE_SHARDS];
+
+TLS_BLOCK_START
+{
+  gchar shared_dns_cache_hostname[256];
+}
+TLS_BLOCK_END;
+
+#define shared_dns_cache_hostname __tls_deref(shared_dns_cache_hostname)
+
 /* DNS cache related options are global, independent of the configuration
  * (e.g.  GlobalConfig instance), and they are stored in the
  * "effective_dns_cache_options" variable below.
@@ -420,15 +492,66 @@ static DNSCacheOptions effective_dns_cache_options;
 G_LOCK_DEFINE_STATIC(unused_dns_caches);
 static GList *unused_dns_caches;
 
+static DNSCacheShard *
+dns_caching_lookup_shard(gint family, void *addr)
+{
+  DNSCacheKey key;
+
+  dns_cache_fill_key(&key, family, addr);
+  return &shared_dns_cache[dns_cache_key_shard(&key, DNS_CACHE_SHARDS)];
+}
+
+static gboolean
+dns_caching_lookup_shared(gint family, void *addr, const gchar **hostname, gsize *hostname_len, gboolean *positive)
+{
+  DNSCacheShard *shard = dns_caching_lookup_shard(family, addr);
+  gboolean found;
+
+  g_static_mutex_lock(&shard->lock);
+  found = dns_cache_lookup(shard->cache, family, addr, hostname, hostname_len, positive);
+  if (found)
+    {
+      g_strlcpy(shared_dns_cache_hostname, *hostname, sizeof(shared_dns_cache_hostname));
+      *hostname = shared_dns_cache_hostname;
+      *hostname_len = MIN(*hostname_len, sizeof(shared_dns_cache_hostname) - 1);
+    }
+  g_static_mutex_unlock(&shard->lock);
+  return found;
+}
+
 gboolean
 dns_caching_lookup(gint family, void *addr, const gchar **hostname, gsize *hostname_len, gboolean *positive)
 {
+  if (effective_dns_cache_options.shared)
+    return dns_caching_lookup_shared(family, addr, hostname, hostname_len, positive);
   return dns_cache_lookup(dns_cache, family, addr, hostname, hostname_len, positive);
 }
 
+/*
+ * Stores an entry into the shared cache, if it is enabled.  Unlike
+ * dns_caching_store() it can be called from threads without a DNS cache
+ * of their own.  Returns FALSE if the shared cache is not in use.
+ */
+gboolean
+dns_caching_store_shared(gint family, void *addr, const gchar *hostname, gboolean positive)
+{
+  DNSCacheShard *shard;
+
+  if (!effective_dns_cache_options.shared)
+    return FALSE;
+
+  shard = dns_caching_lookup_shard(family, addr);
+  g_static_mutex_lock(&shard->lock);
+  dns_cache_store_dynamic(shard->cache, family, addr, hostname, positive);
+  g_static_mutex_unlock(&shard->lock);
+  return TRUE;
+}
+
 void
 dns_caching_store(gint family, void *addr, const gchar *hostname, gboolean positive)
 {
+  if (dns_caching_store_shared(family, addr, hostname, positive))
+    return;
   dns_cache_store_dynamic(dns_cache, family, addr, hostname, positive);
 }
 
@@ -444,6 +567,33 @@ dns_caching_update_options(const DNSCacheOptions *new_options)
   options->expire = new_options->expire;
   options->expire_failed = new_options->expire_failed;
   options->hosts = g_strdup(new_options->hosts);
+  options->shared = new_options->shared;
+}
+
+void
+dns_caching_register_stats(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_GLOBAL, "dns_cache", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_MATCHED, &stats_dns_cache_hits);
+  stats_register_counter(0, &sc_key, SC_TYPE_NOT_MATCHED, &stats_dns_cache_misses);
+  stats_register_counter(0, &sc_key, SC_TYPE_DROPPED, &stats_dns_cache_evictions);
+  stats_unlock();
+}
+
+void
+dns_caching_unregister_stats(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_GLOBAL, "dns_cache", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_MATCHED, &stats_dns_cache_hits);
+  stats_unregister_counter(&sc_key, SC_TYPE_NOT_MATCHED, &stats_dns_cache_misses);
+  stats_unregister_counter(&sc_key, SC_TYPE_DROPPED, &stats_dns_cache_evictions);
+  stats_unlock();
 }
 
 void
@@ -477,16 +627,31 @@ dns_caching_thread_deinit(void)
 void
 dns_caching_global_init(void)
 {
+  gint i;
+
   dns_cache_options_defaults(&effective_dns_cache_options);
+  for (i = 0; i < DNS_CACHE_SHARDS; i++)
+    {
+      g_static_mutex_init(&shared_dns_cache[i].lock);
+      shared_dns_cache[i].cache = dns_cache_new_shard(&effective_dns_cache_options, i, DNS_CACHE_SHARDS);
+    }
 }
 
 void
 dns_caching_global_deinit(void)
 {
+  gint i;
+
   G_LOCK(unused_dns_caches);
   g_list_foreach(unused_dns_caches, (GFunc) dns_cache_free, NULL);
   g_list_free(unused_dns_caches);
   unused_dns_caches = NULL;
   G_UNLOCK(unused_dns_caches);
+  for (i = 0; i < DNS_CACHE_SHARDS; i++)
+    {
+      dns_cache_free(shared_dns_cache[i].cache);
+      shared_dns_cache[i].cache = NULL;
+      g_static_mutex_free(&shared_dns_cache[i].lock);
+    }
   dns_cache_options_destroy(&effective_dns_cache_options);
 }
@@ -34,6 +34,10 @@ typedef struct
   gint expire;
   gint expire_failed;
   gchar *hosts;
+  gboolean shared;
+  /* asynchronous resolution, 0 threads means synchronous lookups */
+  gint resolver_threads;
+  gint resolver_timeout;
 } DNSCacheOptions;
 
 typedef struct _DNSCache DNSCache;
@@ -49,7 +53,10 @@ void dns_cache_options_destroy(DNSCacheOptions *options);
 
 gboolean dns_caching_lookup(gint family, void *addr, const gchar **hostname, gsize *hostname_len, gboolean *positive);
 void dns_caching_store(gint family, void *addr, const gchar *hostname, gboolean positive);
+gboolean dns_caching_store_shared(gint family, void *addr, const gchar *hostname, gboolean positive);
 void dns_caching_update_options(const DNSCacheOptions *dns_cache_options);
+void dns_caching_register_stats(void);
+void dns_caching_unregister_stats(void);
 
 void dns_caching_thread_init(void);
 void dns_caching_thread_deinit(void);
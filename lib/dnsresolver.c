@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "dnsresolver.h"
+#include "host-resolve.h"
+#include "messages.h"
+#include "tls-support.h"
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <string.h>
+
+/* the number of completed lookups kept around for threads that haven't
+ * fetched them yet, threads lagging behind more than this miss results */
+#define DNS_RESOLVER_MAX_RESULTS 1024
+
+/* lookups submitted beyond this limit are not queued, the callers
+ * continue with the IP address right away */
+#define DNS_RESOLVER_MAX_PENDING 4096
+
+typedef struct _DNSResolverKey
+{
+  gint family;
+  union
+  {
+    struct in_addr ip;
+#if SYSLOG_NG_ENABLE_IPV6
+    struct in6_addr ip6;
+#endif
+  } addr;
+} DNSResolverKey;
+
+typedef struct _DNSResolverRequest
+{
+  DNSResolverKey key;
+  GSockAddr *saddr;
+  gint ref_cnt;
+  gboolean done;
+  gboolean positive;
+  gchar hostname[256];
+} DNSResolverRequest;
+
+typedef struct _DNSResolverResult
+{
+  DNSResolverKey key;
+  gboolean positive;
+  gchar hostname[256];
+} DNSResolverResult;
+
+/* everything below is protected by "lock", except for results_head, which
+ * is also read without the lock to check if there's anything to fetch */
+static GMutex *lock;
+static GCond *request_pending;
+static GCond *request_done;
+static GQueue *request_queue;
+static GHashTable *requests;
+static GThread **resolver_threads;
+static gint num_resolver_threads;
+static gint resolve_timeout;
+static gboolean quit;
+
+static DNSResolverResult *results;
+static volatile gint results_head;
+
+TLS_BLOCK_START
+{
+  guint results_fetched;
+}
+TLS_BLOCK_END;
+
+#define results_fetched __tls_deref(results_fetched)
+
+static gboolean
+dns_resolver_key_equal(DNSResolverKey *k1, DNSResolverKey *k2)
+{
+  if (k1->family != k2->family)
+    return FALSE;
+  if (k1->family == AF_INET)
+    return memcmp(&k1->addr.ip, &k2->addr.ip, sizeof(k1->addr.ip)) == 0;
+#if SYSLOG_NG_ENABLE_IPV6
+  if (k1->family == AF_INET6)
+    return memcmp(&k1->addr.ip6, &k2->addr.ip6, sizeof(k1->addr.ip6)) == 0;
+#endif
+  return FALSE;
+}
+
+static guint
+dns_resolver_key_hash(DNSResolverKey *k)
+{
+#if SYSLOG_NG_ENABLE_IPV6
+  if (k->family == AF_INET6)
+    {
+      guint32 *a32 = (guint32 *) &k->addr.ip6.s6_addr;
+      return (0x80000000 | (a32[0] ^ a32[1] ^ a32[2] ^ a32[3]));
+    }
+#endif
+  return ntohl(k->addr.ip.s_addr);
+}
+
+static void
+dns_resolver_fill_key(DNSResolverKey *key, GSockAddr *saddr)
+{
+  memset(key, 0, sizeof(*key));
+  key->family = saddr->sa.sa_family;
+#if SYSLOG_NG_ENABLE_IPV6
+  if (key->family == AF_INET6)
+    {
+      key->addr.ip6 = ((struct sockaddr_in6 *) &saddr->sa)->sin6_addr;
+      return;
+    }
+#endif
+  key->addr.ip = ((struct sockaddr_in *) &saddr->sa)->sin_addr;
+}
+
+static DNSResolverRequest *
+dns_resolver_request_new(GSockAddr *saddr, DNSResolverKey *key)
+{
+  DNSResolverRequest *self = g_new0(DNSResolverRequest, 1);
+
+  self->key = *key;
+  self->saddr = g_sockaddr_ref(saddr);
+  self->ref_cnt = 1;
+  return self;
+}
+
+static void
+dns_resolver_request_unref(DNSResolverRequest *self)
+{
+  if (--self->ref_cnt == 0)
+    {
+      g_sockaddr_unref(self->saddr);
+      g_free(self);
+    }
+}
+
+static void
+dns_resolver_publish_result(DNSResolverRequest *request)
+{
+  guint head = (guint) results_head;
+  DNSResolverResult *result = &results[head % DNS_RESOLVER_MAX_RESULTS];
+
+  result->key = request->key;
+  result->positive = request->positive;
+  g_strlcpy(result->hostname, request->hostname, sizeof(result->hostname));
+  g_atomic_int_set(&results_head, (gint) (head + 1));
+}
+
+/* must be called with the lock held, drops the reference of the queue */
+static void
+dns_resolver_complete_request(DNSResolverRequest *request, gboolean positive, gboolean publish)
+{
+  request->positive = positive;
+  request->done = TRUE;
+
+  if (publish)
+    dns_resolver_publish_result(request);
+  g_hash_table_remove(requests, &request->key);
+  g_cond_broadcast(request_done);
+  dns_resolver_request_unref(request);
+}
+
+static gpointer
+dns_resolver_thread(gpointer user_data)
+{
+  DNSResolverRequest *request;
+  gboolean positive, stored;
+
+  g_mutex_lock(lock);
+  while (!quit)
+    {
+      request = g_queue_pop_head(request_queue);
+      if (!request)
+        {
+          g_cond_wait(request_pending, lock);
+          continue;
+        }
+      g_mutex_unlock(lock);
+
+      positive = resolve_sockaddr_to_dns_name(request->saddr, request->hostname, sizeof(request->hostname)) != NULL;
+      if (!positive)
+        g_sockaddr_format(request->saddr, request->hostname, sizeof(request->hostname), GSA_ADDRESS_ONLY);
+
+      /* a shared cache is filled once, here, the result is only published
+       * to the threads if each of them has a cache of its own */
+      stored = dns_caching_store_shared(request->key.family, &request->key.addr, request->hostname, positive);
+
+      g_mutex_lock(lock);
+      dns_resolver_complete_request(request, positive, !stored);
+    }
+  g_mutex_unlock(lock);
+  return NULL;
+}
+
+/* must be called with the lock held */
+static void
+dns_resolver_stop_threads(void)
+{
+  DNSResolverRequest *request;
+  gint i;
+
+  quit = TRUE;
+  g_cond_broadcast(request_pending);
+  g_mutex_unlock(lock);
+  for (i = 0; i < num_resolver_threads; i++)
+    g_thread_join(resolver_threads[i]);
+  g_mutex_lock(lock);
+  quit = FALSE;
+
+  g_free(resolver_threads);
+  resolver_threads = NULL;
+  num_resolver_threads = 0;
+
+  /* wake up anyone waiting for a lookup that will never happen, without
+   * caching it as a failure */
+  while ((request = g_queue_pop_head(request_queue)))
+    dns_resolver_complete_request(request, FALSE, FALSE);
+}
+
+/* must be called with the lock held */
+static void
+dns_resolver_start_threads(gint num_threads)
+{
+  gint i;
+
+  resolver_threads = g_new0(GThread *, num_threads);
+  for (i = 0; i < num_threads; i++)
+    {
+      resolver_threads[i] = g_thread_create(dns_resolver_thread, NULL, TRUE, NULL);
+      if (!resolver_threads[i])
+        {
+          msg_error("Error starting DNS resolver thread");
+          break;
+        }
+    }
+  num_resolver_threads = i;
+}
+
+gboolean
+dns_resolver_is_running(void)
+{
+  return num_resolver_threads > 0;
+}
+
+/*
+ * Submits a reverse lookup of @saddr and waits for its completion for
+ * resolve_timeout milliseconds at most.  Concurrent lookups of the same
+ * address are merged.
+ *
+ * Returns TRUE if the lookup completed in time, in which case @hostname is
+ * set to @buf containing the name, or NULL if the address has no name.
+ */
+gboolean
+dns_resolver_resolve(GSockAddr *saddr, gchar *buf, gsize buf_len, const gchar **hostname)
+{
+  DNSResolverRequest *request;
+  DNSResolverKey key;
+  GTimeVal deadline;
+  gboolean completed = FALSE;
+
+  dns_resolver_fill_key(&key, saddr);
+
+  g_mutex_lock(lock);
+  if (!num_resolver_threads)
+    goto exit;
+
+  request = g_hash_table_lookup(requests, &key);
+  if (!request)
+    {
+      if (request_queue->length >= DNS_RESOLVER_MAX_PENDING)
+        goto exit;
+
+      request = dns_resolver_request_new(saddr, &key);
+      g_hash_table_insert(requests, &request->key, request);
+      g_queue_push_tail(request_queue, request);
+      g_cond_signal(request_pending);
+    }
+
+  if (resolve_timeout > 0)
+    {
+      request->ref_cnt++;
+      g_get_current_time(&deadline);
+      g_time_val_add(&deadline, resolve_timeout * 1000L);
+      while (!request->done && g_cond_timed_wait(request_done, lock, &deadline))
+        ;
+
+      if (request->done)
+        {
+          completed = TRUE;
+          *hostname = NULL;
+          if (request->positive)
+            {
+              g_strlcpy(buf, request->hostname, buf_len);
+              *hostname = buf;
+            }
+        }
+      dns_resolver_request_unref(request);
+    }
+exit:
+  g_mutex_unlock(lock);
+  return completed;
+}
+
+/*
+ * Calls @func for each lookup that completed since the last invocation in
+ * the current thread.  Failed lookups are reported with the IP address as
+ * hostname and positive set to FALSE.
+ */
+void
+dns_resolver_fetch_results(DNSResolverResultFunc func, gpointer user_data)
+{
+  guint head;
+
+  if (G_LIKELY((guint) g_atomic_int_get(&results_head) == results_fetched))
+    return;
+
+  g_mutex_lock(lock);
+  head = (guint) results_head;
+  if (head - results_fetched > DNS_RESOLVER_MAX_RESULTS)
+    results_fetched = head - DNS_RESOLVER_MAX_RESULTS;
+
+  for (; results_fetched != head; results_fetched++)
+    {
+      DNSResolverResult *result = &results[results_fetched % DNS_RESOLVER_MAX_RESULTS];
+
+      func(result->key.family, &result->key.addr, result->hostname, result->positive, user_data);
+    }
+  g_mutex_unlock(lock);
+}
+
+void
+dns_resolver_update_options(const DNSCacheOptions *options)
+{
+  g_mutex_lock(lock);
+  resolve_timeout = options->resolver_timeout;
+  if (options->resolver_threads != num_resolver_threads)
+    {
+      if (num_resolver_threads)
+        dns_resolver_stop_threads();
+      if (options->resolver_threads > 0)
+        dns_resolver_start_threads(options->resolver_threads);
+    }
+  g_mutex_unlock(lock);
+}
+
+void
+dns_resolver_global_init(void)
+{
+  lock = g_mutex_new();
+  request_pending = g_cond_new();
+  request_done = g_cond_new();
+  request_queue = g_queue_new();
+  requests = g_hash_table_new((GHashFunc) dns_resolver_key_hash, (GEqualFunc) dns_resolver_key_equal);
+  results = g_new0(DNSResolverResult, DNS_RESOLVER_MAX_RESULTS);
+  results_head = 0;
+  resolve_timeout = 0;
+}
+
+void
+dns_resolver_global_deinit(void)
+{
+  g_mutex_lock(lock);
+  if (num_resolver_threads)
+    dns_resolver_stop_threads();
+  g_mutex_unlock(lock);
+
+  g_free(results);
+  results = NULL;
+  g_hash_table_destroy(requests);
+  g_queue_free(request_queue);
+  g_cond_free(request_done);
+  g_cond_free(request_pending);
+  g_mutex_free(lock);
+}
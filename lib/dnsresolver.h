@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef DNSRESOLVER_H_INCLUDED
+#define DNSRESOLVER_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "gsockaddr.h"
+#include "dnscache.h"
+
+/*
+ * The DNS resolver is a pool of threads doing reverse lookups on behalf of
+ * the worker threads, so that a slow DNS server doesn't stall message
+ * processing.  Callers submit an address and wait for the answer at most
+ * for the configured timeout, after which they continue with the IP
+ * address.  With a shared DNS cache, the resolver thread stores completed
+ * lookups into it.  Otherwise they are published to every thread, which
+ * store them into their own DNS cache by calling
+ * dns_resolver_fetch_results().
+ */
+
+typedef void (*DNSResolverResultFunc)(gint family, void *addr, const gchar *hostname, gboolean positive,
+                                      gpointer user_data);
+
+gboolean dns_resolver_is_running(void);
+gboolean dns_resolver_resolve(GSockAddr *saddr, gchar *buf, gsize buf_len, const gchar **hostname);
+void dns_resolver_fetch_results(DNSResolverResultFunc func, gpointer user_data);
+
+void dns_resolver_update_options(const DNSCacheOptions *options);
+void dns_resolver_global_init(void);
+void dns_resolver_global_deinit(void);
+
+#endif
@@ -57,11 +57,13 @@ static CfgLexerKeyword filter_expr_keywords[] =
   { "netmask",      KW_NETMASK },
   { "tags",     KW_TAGS },
   { "in_list",            KW_IN_LIST },
+  { "netmask_set",        KW_NETMASK_SET },
 #if SYSLOG_NG_ENABLE_IPV6
   { "netmask6",     KW_NETMASK6 },
 #endif
 
   { "value",              KW_VALUE },
+  { "file",               KW_FILE },
   { "flags",              KW_FLAGS },
 
   { NULL }
@@ -24,6 +24,7 @@
 
 #include "filter/filter-expr.h"
 #include "messages.h"
+#include "cfg.h"
 
 /****************************************************************
  * Filter expression nodes
@@ -33,6 +34,32 @@ void
 filter_expr_node_init_instance(FilterExprNode *self)
 {
   self->ref_cnt = 1;
+  self->memo_slot = -1;
+}
+
+/*
+ * Named filters may be referenced from a lot of log paths, each of them
+ * evaluating the very same expression on the very same message.  Once
+ * memoization is enabled, the result is stored in the message, which
+ * returns it as long as it is write protected (e.g. while being
+ * multiplexed to the log paths), as in that state it cannot change.
+ *
+ * Filters that modify the message are never memoized, as we would lose
+ * their side effects.
+ */
+void
+filter_expr_enable_memoization(FilterExprNode *self, GlobalConfig *cfg)
+{
+  if (self->modify || self->memo_slot >= 0)
+    return;
+
+  if (cfg->tree.filter_memo_slots >= LOGMSG_MAX_MEMOIZED_FILTERS)
+    {
+      msg_debug("Too many named filters, not memoizing filter results",
+                evt_tag_str("type", self->type));
+      return;
+    }
+  self->memo_slot = cfg->tree.filter_memo_slots++;
 }
 
 /*
@@ -46,7 +73,20 @@ filter_expr_eval_with_context(FilterExprNode *self, LogMessage **msg, gint num_m
 {
   gboolean res;
 
+  if (self->memo_slot >= 0 && num_msg == 1 &&
+      log_msg_lookup_filter_result(msg[0], self->memo_slot, &res))
+    {
+      msg_debug("Filter node evaluation result (memoized)",
+                evt_tag_printf("msg", "%p", *msg),
+                evt_tag_str("result", res ? "match" : "not-match"),
+                evt_tag_str("type", self->type));
+      return res;
+    }
+
   res = self->eval(self, msg, num_msg);
+  if (self->memo_slot >= 0 && num_msg == 1)
+    log_msg_store_filter_result(msg[0], self->memo_slot, res);
+
   msg_debug("Filter node evaluation result",
             evt_tag_printf("msg", "%p", *msg),
             evt_tag_str("result", res ? "match" : "not-match"),
@@ -38,6 +38,8 @@ struct _FilterExprNode
   guint32 ref_cnt;
   guint32 comp:1,   /* this not is negated */
           modify:1; /* this filter changes the log message */
+  /* slot in the per-message result cache, -1 if results are not memoized */
+  gint memo_slot;
   const gchar *type;
   void (*init)(FilterExprNode *self, GlobalConfig *cfg);
   gboolean (*eval)(FilterExprNode *self, LogMessage **msg, gint num_msg);
@@ -58,6 +60,7 @@ gboolean filter_expr_eval_with_context(FilterExprNode *self, LogMessage **msgs,
 gboolean filter_expr_eval_root(FilterExprNode *self, LogMessage **msg, const LogPathOptions *path_options);
 gboolean filter_expr_eval_root_with_context(FilterExprNode *self, LogMessage **msgs, gint num_msg, const LogPathOptions *path_options);
 void filter_expr_node_init_instance(FilterExprNode *self);
+void filter_expr_enable_memoization(FilterExprNode *self, GlobalConfig *cfg);
 FilterExprNode *filter_expr_ref(FilterExprNode *self);
 void filter_expr_unref(FilterExprNode *self);
 
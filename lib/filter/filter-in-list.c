@@ -22,22 +22,129 @@
  *
  */
 
+
 #include "filter-in-list.h"
 #include "logmsg/logmsg.h"
 #include "str-utils.h"
+#include "cidr-set.h"
 
-#include <errno.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
+/*
+ * The list file is mapped into memory and the entries point into the
+ * mapping, so loading a list costs a single sort instead of an allocation
+ * per line.
+ */
+typedef struct _FilterInListEntry
+{
+  guint32 offset;
+  guint32 length;
+} FilterInListEntry;
+
 typedef struct _FilterInList
 {
   FilterExprNode super;
   NVHandle value_handle;
-  GTree *tree;
+  gint match_type;
+  GMappedFile *list;
+  const gchar *contents;
+  GArray *entries;
+  CIDRSet *networks;
 } FilterInList;
 
+static const gchar *match_type_names[] =
+{
+  [FIL_MATCH_EXACT] = "exact",
+  [FIL_MATCH_PREFIX] = "prefix",
+  [FIL_MATCH_CIDR] = "cidr",
+};
+
+gint
+filter_in_list_lookup_match_type(const gchar *match_type)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(match_type_names); i++)
+    {
+      if (strcmp(match_type, match_type_names[i]) == 0)
+        return i;
+    }
+  return -1;
+}
+
+static inline gint
+_compare_value(const gchar *a, gsize a_len, const gchar *b, gsize b_len)
+{
+  gint r = memcmp(a, b, MIN(a_len, b_len));
+
+  if (r != 0)
+    return r;
+  if (a_len != b_len)
+    return a_len < b_len ? -1 : 1;
+  return 0;
+}
+
+static gint
+_compare_entries(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const FilterInListEntry *entry_a = (const FilterInListEntry *) a;
+  const FilterInListEntry *entry_b = (const FilterInListEntry *) b;
+  const gchar *contents = (const gchar *) user_data;
+
+  return _compare_value(contents + entry_a->offset, entry_a->length,
+                        contents + entry_b->offset, entry_b->length);
+}
+
+/* returns the index of the last entry that sorts at or before value, or -1 */
+static gint
+_find_last_entry_at_or_before(FilterInList *self, const gchar *value, gsize value_len)
+{
+  const FilterInListEntry *entries = (const FilterInListEntry *) self->entries->data;
+  gint l = 0, h = (gint) self->entries->len - 1, m;
+
+  while (l <= h)
+    {
+      m = (l + h) >> 1;
+      if (_compare_value(self->contents + entries[m].offset, entries[m].length, value, value_len) <= 0)
+        l = m + 1;
+      else
+        h = m - 1;
+    }
+  return h;
+}
+
+static gboolean
+_lookup_exact(FilterInList *self, const gchar *value, gsize value_len)
+{
+  gint ndx = _find_last_entry_at_or_before(self, value, value_len);
+  const FilterInListEntry *entry;
+
+  if (ndx < 0)
+    return FALSE;
+
+  entry = &g_array_index(self->entries, FilterInListEntry, ndx);
+  return entry->length == value_len && memcmp(self->contents + entry->offset, value, value_len) == 0;
+}
+
+/*
+ * The prefix list is kept prefix-free (see _remove_redundant_prefixes()),
+ * in which case the only entry that can be a prefix of value is the last
+ * one that sorts at or before it.
+ */
+static gboolean
+_lookup_prefix(FilterInList *self, const gchar *value, gsize value_len)
+{
+  gint ndx = _find_last_entry_at_or_before(self, value, value_len);
+  const FilterInListEntry *entry;
+
+  if (ndx < 0)
+    return FALSE;
+
+  entry = &g_array_index(self->entries, FilterInListEntry, ndx);
+  return entry->length <= value_len && memcmp(self->contents + entry->offset, value, entry->length) == 0;
+}
+
 static gboolean
 filter_in_list_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
@@ -45,57 +152,145 @@ filter_in_list_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   LogMessage *msg = msgs[0];
   const gchar *value;
   gssize len = 0;
+  gboolean result;
 
   value = log_msg_get_value(msg, self->value_handle, &len);
-  APPEND_ZERO(value, value, len);
 
-  gboolean result = (g_tree_lookup(self->tree, value) != NULL) ^ s->comp;
+  switch (self->match_type)
+    {
+    case FIL_MATCH_EXACT:
+      result = _lookup_exact(self, value, len);
+      break;
+    case FIL_MATCH_PREFIX:
+      result = _lookup_prefix(self, value, len);
+      break;
+    case FIL_MATCH_CIDR:
+      APPEND_ZERO(value, value, len);
+      result = cidr_set_contains(self->networks, value);
+      break;
+    default:
+      g_assert_not_reached();
+    }
+  result ^= s->comp;
+
   msg_debug("Filter in-list node evaluation result",
             evt_tag_printf("msg", "%p", msg),
-            evt_tag_str("value", value),
+            evt_tag_printf("value", "%.*s", (gint) len, value),
+            evt_tag_str("match_type", match_type_names[self->match_type]),
             evt_tag_str("result", result ? "match" : "not-match"));
 
   return result;
 }
 
 static void
-filter_in_list_free(FilterExprNode *s)
+_remove_redundant_prefixes(FilterInList *self)
 {
-  FilterInList *self = (FilterInList *)s;
+  FilterInListEntry *entries = (FilterInListEntry *) self->entries->data;
+  guint i, kept = 0;
 
-  g_tree_destroy(self->tree);
+  for (i = 0; i < self->entries->len; i++)
+    {
+      if (kept > 0 &&
+          entries[kept - 1].length <= entries[i].length &&
+          memcmp(self->contents + entries[kept - 1].offset, self->contents + entries[i].offset,
+                 entries[kept - 1].length) == 0)
+        continue;
+      entries[kept++] = entries[i];
+    }
+  g_array_set_size(self->entries, kept);
 }
 
-FilterExprNode *
-filter_in_list_new(const gchar *list_file, const gchar *property)
+static gboolean
+_load_list(FilterInList *self, const gchar *list_file)
 {
-  FilterInList *self;
-  FILE *stream;
-  gchar line[16384];
+  GError *error = NULL;
+  const gchar *line, *eol, *end;
+  gsize length;
+
+  if (self->match_type == FIL_MATCH_CIDR)
+    {
+      if (!cidr_set_load_file(self->networks, list_file))
+        return FALSE;
+      cidr_set_compile(self->networks);
+      return TRUE;
+    }
 
-  stream = fopen(list_file, "r");
-  if (!stream)
+  self->list = g_mapped_file_new(list_file, FALSE, &error);
+  if (!self->list)
     {
       msg_error("Error opening in-list filter list file",
                 evt_tag_str("file", list_file),
-                evt_tag_errno("errno", errno));
-      return NULL;
+                evt_tag_str("error", error->message));
+      g_clear_error(&error);
+      return FALSE;
     }
 
-  self = g_new0(FilterInList, 1);
-  filter_expr_node_init_instance(&self->super);
-  self->value_handle = log_msg_get_value_handle(property);
-  self->tree = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, NULL);
+  length = g_mapped_file_get_length(self->list);
+  if (length > G_MAXUINT32)
+    {
+      msg_error("In-list filter list file is too large",
+                evt_tag_str("file", list_file));
+      return FALSE;
+    }
 
-  while (fgets(line, sizeof(line), stream) != NULL)
+  self->contents = g_mapped_file_get_contents(self->list);
+  end = self->contents + length;
+  for (line = self->contents; line < end; line = eol + 1)
     {
-      line[strlen(line) - 1] = '\0';
-      if (line[0])
-        g_tree_insert(self->tree, g_strdup(line), GINT_TO_POINTER(1));
+      eol = memchr(line, '\n', end - line);
+      if (!eol)
+        eol = end;
+      if (eol == line)
+        continue;
+
+      FilterInListEntry entry = { .offset = line - self->contents, .length = eol - line };
+      g_array_append_val(self->entries, entry);
     }
-  fclose(stream);
+
+  g_array_sort_with_data(self->entries, _compare_entries, (gpointer) self->contents);
+  if (self->match_type == FIL_MATCH_PREFIX)
+    _remove_redundant_prefixes(self);
+  return TRUE;
+}
+
+static void
+filter_in_list_free(FilterExprNode *s)
+{
+  FilterInList *self = (FilterInList *)s;
+
+  if (self->networks)
+    cidr_set_free(self->networks);
+  g_array_free(self->entries, TRUE);
+  if (self->list)
+    g_mapped_file_unref(self->list);
+}
+
+FilterExprNode *
+filter_in_list_new_with_match_type(const gchar *list_file, const gchar *property, gint match_type)
+{
+  FilterInList *self;
+
+  self = g_new0(FilterInList, 1);
+  filter_expr_node_init_instance(&self->super);
+  self->value_handle = log_msg_get_value_handle(property);
+  self->match_type = match_type;
+  self->entries = g_array_new(FALSE, FALSE, sizeof(FilterInListEntry));
+  if (match_type == FIL_MATCH_CIDR)
+    self->networks = cidr_set_new();
 
   self->super.eval = filter_in_list_eval;
   self->super.free_fn = filter_in_list_free;
+
+  if (!_load_list(self, list_file))
+    {
+      filter_expr_unref(&self->super);
+      return NULL;
+    }
   return &self->super;
 }
+
+FilterExprNode *
+filter_in_list_new(const gchar *list_file, const gchar *property)
+{
+  return filter_in_list_new_with_match_type(list_file, property, FIL_MATCH_EXACT);
+}
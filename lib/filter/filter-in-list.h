@@ -27,7 +27,19 @@
 
 #include "filter-expr.h"
 
+enum
+{
+  FIL_MATCH_EXACT,
+  FIL_MATCH_PREFIX,
+  FIL_MATCH_CIDR,
+};
+
+gint filter_in_list_lookup_match_type(const gchar *match_type);
+
 FilterExprNode *filter_in_list_new(const gchar *list_file,
                                    const gchar *property);
+FilterExprNode *filter_in_list_new_with_match_type(const gchar *list_file,
+                                                   const gchar *property,
+                                                   gint match_type);
 
 #endif
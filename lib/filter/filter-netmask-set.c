@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "filter-netmask-set.h"
+#include "logmsg/logmsg.h"
+#include "str-utils.h"
+#include "cidr-set.h"
+
+/*
+ * netmask-set() matches the sender address (or the IP address in a
+ * name-value pair) against any number of IPv4 and IPv6 networks, with a
+ * single lookup instead of an OR chain of netmask()/netmask6() filters.
+ */
+typedef struct _FilterNetmaskSet
+{
+  FilterExprNode super;
+  CIDRSet *networks;
+  NVHandle value_handle;
+  gboolean loopback_matches;
+} FilterNetmaskSet;
+
+static gboolean
+filter_netmask_set_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+  LogMessage *msg = msgs[0];
+  gboolean result;
+
+  if (self->value_handle)
+    {
+      const gchar *value;
+      gssize len = 0;
+
+      value = log_msg_get_value(msg, self->value_handle, &len);
+      APPEND_ZERO(value, value, len);
+      result = cidr_set_contains(self->networks, value);
+    }
+  else if (!msg->saddr || msg->saddr->sa.sa_family == AF_UNIX)
+    {
+      /* local messages are considered to come from the loopback address,
+       * just like with netmask() and netmask6() */
+      result = self->loopback_matches;
+    }
+  else
+    {
+      result = cidr_set_contains_sockaddr(self->networks, msg->saddr);
+    }
+  return result ^ s->comp;
+}
+
+gboolean
+filter_netmask_set_add(FilterExprNode *s, const gchar *cidr)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+
+  return cidr_set_add(self->networks, cidr);
+}
+
+gboolean
+filter_netmask_set_load_file(FilterExprNode *s, const gchar *filename)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+
+  return cidr_set_load_file(self->networks, filename);
+}
+
+void
+filter_netmask_set_set_value(FilterExprNode *s, const gchar *value_name)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+
+  self->value_handle = log_msg_get_value_handle(value_name);
+}
+
+static void
+filter_netmask_set_init(FilterExprNode *s, GlobalConfig *cfg)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+
+  cidr_set_compile(self->networks);
+  self->loopback_matches = cidr_set_contains(self->networks, "127.0.0.1") ||
+                           cidr_set_contains(self->networks, "::1");
+}
+
+static void
+filter_netmask_set_free(FilterExprNode *s)
+{
+  FilterNetmaskSet *self = (FilterNetmaskSet *) s;
+
+  cidr_set_free(self->networks);
+}
+
+FilterExprNode *
+filter_netmask_set_new(void)
+{
+  FilterNetmaskSet *self = g_new0(FilterNetmaskSet, 1);
+
+  filter_expr_node_init_instance(&self->super);
+  self->networks = cidr_set_new();
+  self->super.init = filter_netmask_set_init;
+  self->super.eval = filter_netmask_set_eval;
+  self->super.free_fn = filter_netmask_set_free;
+  self->super.type = "netmask-set";
+  return &self->super;
+}
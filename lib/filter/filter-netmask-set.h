@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef FILTER_NETMASK_SET_H_INCLUDED
+#define FILTER_NETMASK_SET_H_INCLUDED
+
+#include "filter-expr.h"
+
+FilterExprNode *filter_netmask_set_new(void);
+gboolean filter_netmask_set_add(FilterExprNode *s, const gchar *cidr);
+gboolean filter_netmask_set_load_file(FilterExprNode *s, const gchar *filename);
+void filter_netmask_set_set_value(FilterExprNode *s, const gchar *value_name);
+
+#endif
@@ -37,7 +37,13 @@ log_filter_pipe_init(LogPipe *s)
 
   filter_expr_init(self->expr, log_pipe_get_config(s));
   if (!self->name)
-    self->name = cfg_tree_get_rule_name(&cfg->tree, ENC_FILTER, s->expr_node);
+    {
+      /* named filters are shared between log paths, it is worth to
+       * remember their results on the message */
+      if (s->expr_node && log_expr_node_get_container_rule(s->expr_node, ENC_FILTER)->name)
+        filter_expr_enable_memoization(self->expr, cfg);
+      self->name = cfg_tree_get_rule_name(&cfg->tree, ENC_FILTER, s->expr_node);
+    }
 
   stats_lock();
   StatsClusterKey sc_key;
@@ -26,6 +26,7 @@
 #include "filter/filter-expr-grammar.h"
 #include "filter/filter-netmask.h"
 #include "filter/filter-netmask6.h"
+#include "filter/filter-netmask-set.h"
 #include "filter/filter-op.h"
 #include "filter/filter-cmp.h"
 #include "filter/filter-tags.h"
@@ -40,6 +41,7 @@
 
 
 #include <time.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -112,6 +114,23 @@ create_pcre_regexp_match(gchar *regexp, gint flags)
   return compile_pattern(filter_match_new(), regexp, "pcre", flags);
 }
 
+FilterExprNode *
+create_netmask_set_filter(const gchar *value, ...)
+{
+  FilterExprNode *f = filter_netmask_set_new();
+  const gchar *cidr;
+  va_list va;
+
+  va_start(va, value);
+  while ((cidr = va_arg(va, const gchar *)))
+    filter_netmask_set_add(f, cidr);
+  va_end(va);
+
+  if (value)
+    filter_netmask_set_set_value(f, value);
+  return f;
+}
+
 LogTemplate *
 create_template(const gchar *template)
 {
@@ -384,11 +403,23 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized", filter_netmask_new("10.10.0.0/24"), 1);
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized", filter_netmask_new("10.10.10.0/24"), 0);
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized", filter_netmask_new("0.0.10.10/24"), 0);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter(NULL, "192.168.0.0/16", "10.10.0.0/16", NULL), 1);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter(NULL, "192.168.0.0/16", "10.10.10.0/24", "2001:db8::/32", NULL), 0);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter("HOST", "192.168.0.0/16", NULL), 0);
+  testcase("<15>Oct 15 16:17:01 192.168.1.1 openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter("HOST", "192.168.0.0/16", NULL), 1);
   g_sockaddr_unref(sender_saddr);
 
   sender_saddr = NULL;
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized", filter_netmask_new("127.0.0.1/32"), 1);
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized", filter_netmask_new("127.0.0.2/32"), 0);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter(NULL, "10.0.0.0/8", "127.0.0.0/8", NULL), 1);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           create_netmask_set_filter(NULL, "10.0.0.0/8", NULL), 0);
 
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
            fop_or_new(create_posix_regexp_match(" PTHREAD ", 0), create_posix_regexp_match("PTHREAD", 0)), 1);
@@ -38,6 +38,8 @@
 #define MSG_1 "<15>Sep  4 15:03:55 localhost test-program[3086]: some random message"
 #define MSG_2 "<15>Sep  4 15:03:55 localhost foo[3086]: some random message"
 #define MSG_3 "<15>Sep  4 15:03:55 192.168.1.1 foo[3086]: some random message"
+#define MSG_4 "<15>Sep  4 15:03:55 10.20.30.40 foo[3086]: some random message"
+#define MSG_5 "<15>Sep  4 15:03:55 192.168.2.1 foo[3086]: some random message"
 #define MSG_LONG "<15>Sep  4 15:03:55 test-hostAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA foo[3086]: some random message"
 
 #define LIST_FILE_DIR "%s/lib/filter/tests/filters-in-list/"
@@ -141,6 +143,46 @@ test_filter_with_long_line(const char *top_srcdir)
   g_free(list_file_with_long_line);
 }
 
+void
+test_filter_with_prefix_match(const char *top_srcdir)
+{
+  gchar *prefix_list = g_strdup_printf(LIST_FILE_DIR "prefix.list", top_srcdir);
+
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_new_with_match_type(prefix_list, "PROGRAM", FIL_MATCH_PREFIX)),
+                  TRUE,
+                  "in-list filter with prefix match type should match on a prefix");
+  assert_gboolean(evaluate_testcase(MSG_2, filter_in_list_new_with_match_type(prefix_list, "PROGRAM", FIL_MATCH_PREFIX)),
+                  TRUE,
+                  "in-list filter with prefix match type should match on an exact value");
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_new_with_match_type(prefix_list, "HOST", FIL_MATCH_PREFIX)),
+                  FALSE,
+                  "in-list filter with prefix match type matches");
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_new(prefix_list, "PROGRAM")),
+                  FALSE,
+                  "in-list filter with exact match type should not match on a prefix");
+  g_free(prefix_list);
+}
+
+void
+test_filter_with_cidr_match(const char *top_srcdir)
+{
+  gchar *cidr_list = g_strdup_printf(LIST_FILE_DIR "cidr.list", top_srcdir);
+
+  assert_gboolean(evaluate_testcase(MSG_3, filter_in_list_new_with_match_type(cidr_list, "HOST", FIL_MATCH_CIDR)),
+                  TRUE,
+                  "in-list filter with cidr match type should match on an IPv4 network");
+  assert_gboolean(evaluate_testcase(MSG_4, filter_in_list_new_with_match_type(cidr_list, "HOST", FIL_MATCH_CIDR)),
+                  TRUE,
+                  "in-list filter with cidr match type should match on an IPv4 network");
+  assert_gboolean(evaluate_testcase(MSG_5, filter_in_list_new_with_match_type(cidr_list, "HOST", FIL_MATCH_CIDR)),
+                  FALSE,
+                  "in-list filter with cidr match type matches");
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_new_with_match_type(cidr_list, "HOST", FIL_MATCH_CIDR)),
+                  FALSE,
+                  "in-list filter with cidr match type should not match on a hostname");
+  g_free(cidr_list);
+}
+
 void
 run_testcases(const char *top_srcdir)
 {
@@ -152,6 +194,8 @@ run_testcases(const char *top_srcdir)
   test_list_file_contains_lot_of_lines(top_srcdir);
   test_filter_with_ip_address(top_srcdir);
   test_filter_with_long_line(top_srcdir);
+  test_filter_with_prefix_match(top_srcdir);
+  test_filter_with_cidr_match(top_srcdir);
 }
 
 int
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+#include "apphook.h"
+#include "cfg.h"
+#include "logmsg/logmsg.h"
+#include "filter/filter-expr.h"
+
+typedef struct _CountingFilter
+{
+  FilterExprNode super;
+  gint num_evals;
+  gboolean result;
+} CountingFilter;
+
+static gboolean
+counting_filter_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  CountingFilter *self = (CountingFilter *) s;
+
+  self->num_evals++;
+  return self->result;
+}
+
+static CountingFilter *
+counting_filter_new(gboolean result)
+{
+  CountingFilter *self = g_new0(CountingFilter, 1);
+
+  filter_expr_node_init_instance(&self->super);
+  self->super.eval = counting_filter_eval;
+  self->super.type = "counting";
+  self->result = result;
+  return self;
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new(VERSION_VALUE);
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(filter_memoization, .init = setup, .fini = teardown);
+
+Test(filter_memoization, protected_message_evaluates_filter_only_once)
+{
+  CountingFilter *f = counting_filter_new(TRUE);
+  LogMessage *msg = log_msg_new_empty();
+
+  filter_expr_enable_memoization(&f->super, configuration);
+  log_msg_write_protect(msg);
+
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert_eq(f->num_evals, 1);
+
+  log_msg_write_unprotect(msg);
+  log_msg_unref(msg);
+  filter_expr_unref(&f->super);
+}
+
+Test(filter_memoization, negative_results_are_memoized_too)
+{
+  CountingFilter *f = counting_filter_new(FALSE);
+  LogMessage *msg = log_msg_new_empty();
+
+  filter_expr_enable_memoization(&f->super, configuration);
+  log_msg_write_protect(msg);
+
+  cr_assert_not(filter_expr_eval(&f->super, msg));
+  cr_assert_not(filter_expr_eval(&f->super, msg));
+  cr_assert_eq(f->num_evals, 1);
+
+  log_msg_write_unprotect(msg);
+  log_msg_unref(msg);
+  filter_expr_unref(&f->super);
+}
+
+Test(filter_memoization, writable_message_is_always_evaluated)
+{
+  CountingFilter *f = counting_filter_new(TRUE);
+  LogMessage *msg = log_msg_new_empty();
+
+  filter_expr_enable_memoization(&f->super, configuration);
+
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert_eq(f->num_evals, 2);
+
+  log_msg_unref(msg);
+  filter_expr_unref(&f->super);
+}
+
+Test(filter_memoization, results_are_forgotten_when_protection_ends)
+{
+  CountingFilter *f = counting_filter_new(TRUE);
+  LogMessage *msg = log_msg_new_empty();
+
+  filter_expr_enable_memoization(&f->super, configuration);
+
+  log_msg_write_protect(msg);
+  cr_assert(filter_expr_eval(&f->super, msg));
+  log_msg_write_unprotect(msg);
+
+  log_msg_write_protect(msg);
+  cr_assert(filter_expr_eval(&f->super, msg));
+  log_msg_write_unprotect(msg);
+
+  cr_assert_eq(f->num_evals, 2);
+
+  log_msg_unref(msg);
+  filter_expr_unref(&f->super);
+}
+
+Test(filter_memoization, modifying_filters_are_not_memoized)
+{
+  CountingFilter *f = counting_filter_new(TRUE);
+  LogMessage *msg = log_msg_new_empty();
+
+  f->super.modify = TRUE;
+  filter_expr_enable_memoization(&f->super, configuration);
+  cr_assert_eq(f->super.memo_slot, -1);
+
+  log_msg_write_protect(msg);
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert(filter_expr_eval(&f->super, msg));
+  cr_assert_eq(f->num_evals, 2);
+  log_msg_write_unprotect(msg);
+
+  log_msg_unref(msg);
+  filter_expr_unref(&f->super);
+}
@@ -24,32 +24,52 @@
 #include "find-crlf.h"
 
 #include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define FIND_CRLF_HAVE_SSE2 1
+#include <emmintrin.h>
+
+#if defined(__clang__) || __GNUC__ >= 5
+#define FIND_CRLF_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+typedef const guchar *(*FindFirstOf3Func)(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3);
+
+static inline gboolean
+_byte_matches(guchar ch, guchar c1, guchar c2, guchar c3)
+{
+  return ch == c1 || ch == c2 || ch == c3;
+}
+
+static inline gboolean
+_longword_has_byte(gulong longword, gulong charmask, gulong magic_bits)
+{
+  longword ^= charmask;
+  return (((longword + magic_bits) ^ ~longword) & ~magic_bits) != 0;
+}
+
 /**
- * This is an optimized version of finding either a CR or LF or NUL
- * character in a buffer.  It is used to find these line terminators in
- * syslog traffic.
- *
- * It uses an algorithm very similar to what there's in libc memchr/strchr.
+ * Word-at-a-time version of find_first_of3(), using an algorithm very
+ * similar to what there's in libc memchr/strchr.  This is used on
+ * platforms without SSE2.
  **/
-gchar *
-find_cr_or_lf(gchar *s, gsize n)
+static const guchar *
+_find_first_of3_scalar(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3)
 {
-  gchar *char_ptr;
-  gulong *longword_ptr;
-  gulong longword, magic_bits, cr_charmask, lf_charmask;
-  const char CR = '\r';
-  const char LF = '\n';
+  const guchar *char_ptr;
+  const gulong *longword_ptr;
+  gulong longword, magic_bits, charmask1, charmask2, charmask3;
 
   /* align input to long boundary */
   for (char_ptr = s; n > 0 && ((gulong) char_ptr & (sizeof(longword) - 1)) != 0; ++char_ptr, n--)
     {
-      if (*char_ptr == CR || *char_ptr == LF)
+      if (_byte_matches(*char_ptr, c1, c2, c3))
         return char_ptr;
-      else if (*char_ptr == 0)
-        return NULL;
     }
 
-  longword_ptr = (gulong *) char_ptr;
+  longword_ptr = (const gulong *) char_ptr;
 
 #if GLIB_SIZEOF_LONG == 8
   magic_bits = 0x7efefefefefefeffL;
@@ -58,42 +78,167 @@ find_cr_or_lf(gchar *s, gsize n)
 #else
 #error "unknown architecture"
 #endif
-  memset(&cr_charmask, CR, sizeof(cr_charmask));
-  memset(&lf_charmask, LF, sizeof(lf_charmask));
+  memset(&charmask1, c1, sizeof(charmask1));
+  memset(&charmask2, c2, sizeof(charmask2));
+  memset(&charmask3, c3, sizeof(charmask3));
 
   while (n > sizeof(longword))
     {
       longword = *longword_ptr++;
-      if ((((longword + magic_bits) ^ ~longword) & ~magic_bits) != 0 ||
-          ((((longword ^ cr_charmask) + magic_bits) ^ ~(longword ^ cr_charmask)) & ~magic_bits) != 0 ||
-          ((((longword ^ lf_charmask) + magic_bits) ^ ~(longword ^ lf_charmask)) & ~magic_bits) != 0)
+      if (_longword_has_byte(longword, charmask1, magic_bits) ||
+          _longword_has_byte(longword, charmask2, magic_bits) ||
+          _longword_has_byte(longword, charmask3, magic_bits))
         {
           gint i;
 
-          char_ptr = (gchar *) (longword_ptr - 1);
+          char_ptr = (const guchar *) (longword_ptr - 1);
 
           for (i = 0; i < sizeof(longword); i++)
             {
-              if (*char_ptr == CR || *char_ptr == LF)
+              if (_byte_matches(*char_ptr, c1, c2, c3))
                 return char_ptr;
-              else if (*char_ptr == 0)
-                return NULL;
               char_ptr++;
             }
         }
       n -= sizeof(longword);
     }
 
-  char_ptr = (gchar *) longword_ptr;
+  char_ptr = (const guchar *) longword_ptr;
 
   while (n-- > 0)
     {
-      if (*char_ptr == CR || *char_ptr == LF)
+      if (_byte_matches(*char_ptr, c1, c2, c3))
         return char_ptr;
-      else if (*char_ptr == 0)
-        return NULL;
       ++char_ptr;
     }
 
   return NULL;
 }
+
+#if FIND_CRLF_HAVE_SSE2
+
+/**
+ * SSE2 is part of the x86_64 baseline, so this variant needs no runtime
+ * check: it compares 16 bytes against all three terminators at once and
+ * uses the resulting bitmask to locate the first hit.
+ **/
+static const guchar *
+_find_first_of3_sse2(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3)
+{
+  const __m128i v1 = _mm_set1_epi8((gchar) c1);
+  const __m128i v2 = _mm_set1_epi8((gchar) c2);
+  const __m128i v3 = _mm_set1_epi8((gchar) c3);
+
+  while (n >= sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) s);
+      __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1),
+                                               _mm_cmpeq_epi8(chunk, v2)),
+                                  _mm_cmpeq_epi8(chunk, v3));
+      guint32 mask = (guint32) _mm_movemask_epi8(hits);
+
+      if (mask)
+        return s + __builtin_ctz(mask);
+      s += sizeof(__m128i);
+      n -= sizeof(__m128i);
+    }
+
+  while (n-- > 0)
+    {
+      if (_byte_matches(*s, c1, c2, c3))
+        return s;
+      ++s;
+    }
+  return NULL;
+}
+
+#endif
+
+#if FIND_CRLF_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static const guchar *
+_find_first_of3_avx2(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3)
+{
+  const __m256i v1 = _mm256_set1_epi8((gchar) c1);
+  const __m256i v2 = _mm256_set1_epi8((gchar) c2);
+  const __m256i v3 = _mm256_set1_epi8((gchar) c3);
+
+  while (n >= sizeof(__m256i))
+    {
+      __m256i chunk = _mm256_loadu_si256((const __m256i *) s);
+      __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, v1),
+                                                     _mm256_cmpeq_epi8(chunk, v2)),
+                                     _mm256_cmpeq_epi8(chunk, v3));
+      guint32 mask = (guint32) _mm256_movemask_epi8(hits);
+
+      if (mask)
+        return s + __builtin_ctz(mask);
+      s += sizeof(__m256i);
+      n -= sizeof(__m256i);
+    }
+
+  /* the remaining (at most 31) bytes are handled by the SSE2 version */
+  return _find_first_of3_sse2(s, n, c1, c2, c3);
+}
+
+#endif
+
+static const guchar *_find_first_of3_resolve(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3);
+
+static FindFirstOf3Func find_first_of3_impl = _find_first_of3_resolve;
+
+/*
+ * Selects the best implementation for the running CPU on the first call.
+ * Concurrent first calls may race on setting find_first_of3_impl, but they
+ * would store the same value, so this is harmless.
+ */
+static const guchar *
+_find_first_of3_resolve(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3)
+{
+  FindFirstOf3Func impl = _find_first_of3_scalar;
+
+#if FIND_CRLF_HAVE_SSE2
+  impl = _find_first_of3_sse2;
+#endif
+#if FIND_CRLF_HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    impl = _find_first_of3_avx2;
+#endif
+
+  find_first_of3_impl = impl;
+  return impl(s, n, c1, c2, c3);
+}
+
+/**
+ * Find the first occurence of any of @c1, @c2 or @c3 in the buffer @s of
+ * @n bytes.  Returns NULL if none of them is present.
+ *
+ * This is the common primitive behind line splitting (see find_eom() and
+ * find_cr_or_lf()), it uses SSE2/AVX2 instructions where available
+ * (selected at runtime) and a word-at-a-time algorithm otherwise.
+ **/
+const guchar *
+find_first_of3(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3)
+{
+  return find_first_of3_impl(s, n, c1, c2, c3);
+}
+
+/**
+ * This is an optimized version of finding either a CR or LF or NUL
+ * character in a buffer.  It is used to find these line terminators in
+ * syslog traffic.
+ *
+ * Returns a pointer to the first CR or LF character, or NULL if a NUL
+ * character comes first or there's no line terminator at all.
+ **/
+gchar *
+find_cr_or_lf(gchar *s, gsize n)
+{
+  gchar *eol = (gchar *) find_first_of3((const guchar *) s, n, '\r', '\n', '\0');
+
+  if (eol && *eol == '\0')
+    return NULL;
+  return eol;
+}
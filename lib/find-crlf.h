@@ -26,6 +26,7 @@
 
 #include "syslog-ng.h"
 
+const guchar *find_first_of3(const guchar *s, gsize n, guchar c1, guchar c2, guchar c3);
 gchar *find_cr_or_lf(gchar *s, gsize n);
 
 #endif
@@ -23,6 +23,7 @@
 #include "host-resolve.h"
 #include "hostname.h"
 #include "dnscache.h"
+#include "dnsresolver.h"
 #include "messages.h"
 #include "cfg.h"
 #include "tls-support.h"
@@ -285,6 +286,17 @@ resolve_address_using_gethostbyaddr(GSockAddr *saddr, gchar *buf, gsize buf_len)
 
 #endif
 
+/* looks up the name of @saddr in DNS, returns NULL if it has none */
+const gchar *
+resolve_sockaddr_to_dns_name(GSockAddr *saddr, gchar *buf, gsize buf_len)
+{
+#ifdef SYSLOG_NG_HAVE_GETNAMEINFO
+  return resolve_address_using_getnameinfo(saddr, buf, buf_len);
+#else
+  return resolve_address_using_gethostbyaddr(saddr, buf, buf_len);
+#endif
+}
+
 static void *
 sockaddr_to_dnscache_key(GSockAddr *saddr)
 {
@@ -296,6 +308,12 @@ sockaddr_to_dnscache_key(GSockAddr *saddr)
 #endif
 }
 
+static void
+store_resolved_name(gint family, void *addr, const gchar *hostname, gboolean positive, gpointer user_data)
+{
+  dns_caching_store(family, addr, hostname, positive);
+}
+
 static const gchar *
 resolve_sockaddr_to_inet_or_inet6_hostname(gsize *result_len, GSockAddr *saddr,
                                            const HostResolveOptions *host_resolve_options)
@@ -303,26 +321,36 @@ resolve_sockaddr_to_inet_or_inet6_hostname(gsize *result_len, GSockAddr *saddr,
   const gchar *hname;
   gsize hname_len;
   gboolean positive;
+  gboolean store_result;
   void *dnscache_key;
 
   dnscache_key = sockaddr_to_dnscache_key(saddr);
 
   hname = NULL;
   positive = FALSE;
+  store_result = host_resolve_options->use_dns_cache;
 
   if (host_resolve_options->use_dns_cache)
     {
+      dns_resolver_fetch_results(store_resolved_name, NULL);
       if (dns_caching_lookup(saddr->sa.sa_family, dnscache_key, (const gchar **) &hname, &hname_len, &positive))
         return hostname_apply_options_fqdn(hname_len, result_len, hname, positive, host_resolve_options);
     }
 
   if (!hname && host_resolve_options->use_dns && host_resolve_options->use_dns != 2)
     {
-#ifdef SYSLOG_NG_HAVE_GETNAMEINFO
-      hname = resolve_address_using_getnameinfo(saddr, hostname_buffer, sizeof(hostname_buffer));
-#else
-      hname = resolve_address_using_gethostbyaddr(saddr, hostname_buffer, sizeof(hostname_buffer));
-#endif
+      if (dns_resolver_is_running())
+        {
+          /* if the answer doesn't arrive in time, we continue with the IP
+           * address.  Either way, the resolver thread puts the answer into
+           * the cache, so it is not stored here. */
+          dns_resolver_resolve(saddr, hostname_buffer, sizeof(hostname_buffer), &hname);
+          store_result = FALSE;
+        }
+      else
+        {
+          hname = resolve_sockaddr_to_dns_name(saddr, hostname_buffer, sizeof(hostname_buffer));
+        }
       positive = (hname != NULL);
     }
 
@@ -331,7 +359,7 @@ resolve_sockaddr_to_inet_or_inet6_hostname(gsize *result_len, GSockAddr *saddr,
       hname = g_sockaddr_format(saddr, hostname_buffer, sizeof(hostname_buffer), GSA_ADDRESS_ONLY);
       positive = FALSE;
     }
-  if (host_resolve_options->use_dns_cache)
+  if (store_result)
     dns_caching_store(saddr->sa.sa_family, dnscache_key, hname, positive);
 
   return hostname_apply_options_fqdn(-1, result_len, hname, positive, host_resolve_options);
@@ -38,6 +38,7 @@ typedef struct _HostResolveOptions
 const gchar *resolve_sockaddr_to_hostname(gsize *result_len, GSockAddr *saddr, const HostResolveOptions *host_resolve_options);
 gboolean resolve_hostname_to_sockaddr(GSockAddr **addr, gint family, const gchar *name);
 const gchar *resolve_hostname_to_hostname(gsize *result_len, const gchar *hostname, HostResolveOptions *options);
+const gchar *resolve_sockaddr_to_dns_name(GSockAddr *saddr, gchar *buf, gsize buf_len);
 
 void host_resolve_options_defaults(HostResolveOptions *options);
 void host_resolve_options_global_defaults(HostResolveOptions *options);
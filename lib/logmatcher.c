@@ -26,8 +26,10 @@
 #include "messages.h"
 #include "cfg.h"
 #include "str-utils.h"
+#include "utf8utils.h"
 #include "compat/string.h"
 #include "compat/pcre.h"
+#include "pcre-utils.h"
 
 static gboolean
 _shall_set_values_indirectly(NVHandle value_handle)
@@ -428,7 +430,7 @@ log_matcher_glob_match(LogMatcher *s, LogMessage *msg, gint value_handle, const
 {
   LogMatcherGlob *self =  (LogMatcherGlob *) s;
 
-  if (G_LIKELY((msg->flags & LF_UTF8) || g_utf8_validate(value, value_len, NULL)))
+  if (G_LIKELY((msg->flags & LF_UTF8) || utf8_validate(value, value_len)))
     {
       static gboolean warned = FALSE;
       gchar *buf;
@@ -479,6 +481,11 @@ typedef struct _LogMatcherPcreRe
   pcre *pattern;
   pcre_extra *extra;
   gint match_options;
+  /* pattern properties, queried once at compile time instead of on every match */
+  gint num_captures;
+  gint num_named_captures;
+  gchar *name_table;
+  gint name_entry_size;
 } LogMatcherPcreRe;
 
 static gboolean
@@ -534,13 +541,26 @@ log_matcher_pcre_re_compile(LogMatcher *s, const gchar *re, GError **error)
     }
 
   /* optimize regexp */
-  self->extra = pcre_study(self->pattern, PCRE_STUDY_JIT_COMPILE, &errptr);
+  self->extra = pcre_utils_study(self->pattern, &errptr);
   if (errptr != NULL)
     {
       g_set_error(error, LOG_TEMPLATE_ERROR, 0, "Error while optimizing regular expression, error=%s", errptr);
       return FALSE;
     }
 
+  if (pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_CAPTURECOUNT, &self->num_captures) < 0)
+    g_assert_not_reached();
+  if (self->num_captures > RE_MAX_MATCHES)
+    self->num_captures = RE_MAX_MATCHES;
+
+  pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMECOUNT, &self->num_named_captures);
+  if (self->num_named_captures > 0)
+    {
+      /* the table for translating names to numbers, and the size of each entry in the table. */
+      pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMETABLE, &self->name_table);
+      pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMEENTRYSIZE, &self->name_entry_size);
+    }
+
   return TRUE;
 }
 
@@ -567,31 +587,16 @@ log_matcher_pcre_re_feed_backrefs(LogMatcher *s, LogMessage *msg, gint value_han
 static void
 log_matcher_pcre_re_feed_named_substrings(LogMatcher *s, LogMessage *msg, int *matches, const gchar *value)
 {
-  gchar *name_table = NULL;
-  gint i = 0;
-  gint namecount = 0;
-  gint name_entry_size = 0;
   LogMatcherPcreRe *self = (LogMatcherPcreRe *) s;
+  gchar *tabptr = self->name_table;
+  gint i;
 
-  pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMECOUNT, &namecount);
-  if (namecount > 0)
+  /* scan the table and, for each entry, set the name to the substring */
+  for (i = 0; i < self->num_named_captures; i++)
     {
-      gchar *tabptr;
-      /* Before we can access the substrings, we must extract the table for
-         translating names to numbers, and the size of each entry in the table.
-       */
-      pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMETABLE, &name_table);
-      pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_NAMEENTRYSIZE, &name_entry_size);
-      /* Now we can scan the table and, for each entry, print the number, the name,
-         and the substring itself.
-       */
-      tabptr = name_table;
-      for (i = 0; i < namecount; i++)
-        {
-          int n = (tabptr[0] << 8) | tabptr[1];
-          log_msg_set_value_by_name(msg, tabptr + 2, value + matches[2*n], matches[2*n+1] - matches[2*n]);
-          tabptr += name_entry_size;
-        }
+      int n = (tabptr[0] << 8) | tabptr[1];
+      log_msg_set_value_by_name(msg, tabptr + 2, value + matches[2*n], matches[2*n+1] - matches[2*n]);
+      tabptr += self->name_entry_size;
     }
 }
 
@@ -601,18 +606,12 @@ log_matcher_pcre_re_match(LogMatcher *s, LogMessage *msg, gint value_handle, con
   LogMatcherPcreRe *self = (LogMatcherPcreRe *) s;
   gint *matches;
   gsize matches_size;
-  gint num_matches;
   gint rc;
 
   if (value_len == -1)
     value_len = strlen(value);
 
-  if (pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_CAPTURECOUNT, &num_matches) < 0)
-    g_assert_not_reached();
-  if (num_matches > RE_MAX_MATCHES)
-    num_matches = RE_MAX_MATCHES;
-
-  matches_size = 3 * (num_matches + 1);
+  matches_size = 3 * (self->num_captures + 1);
   matches = g_alloca(matches_size * sizeof(gint));
 
   rc = pcre_exec(self->pattern, self->extra,
@@ -655,18 +654,12 @@ log_matcher_pcre_re_replace(LogMatcher *s, LogMessage *msg, gint value_handle, c
   GString *new_value = NULL;
   gint *matches;
   gsize matches_size;
-  gint num_matches;
   gint rc;
   gint start_offset, last_offset;
   gint options;
   gboolean last_match_was_empty;
 
-  if (pcre_fullinfo(self->pattern, self->extra, PCRE_INFO_CAPTURECOUNT, &num_matches) < 0)
-    g_assert_not_reached();
-  if (num_matches > RE_MAX_MATCHES)
-    num_matches = RE_MAX_MATCHES;
-
-  matches_size = 3 * (num_matches + 1);
+  matches_size = 3 * (self->num_captures + 1);
   matches = g_alloca(matches_size * sizeof(gint));
 
   /* we need zero initialized offsets for the last match as the
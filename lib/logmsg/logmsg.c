@@ -114,6 +114,21 @@
  * stuff, but that shouldn't have that much of an overhead.
  */
 
+#define LOGMSG_HANDLE_CACHE_SIZE 256
+#define LOGMSG_HANDLE_CACHE_NAME_MAX 72
+
+/*
+ * Value names looked up by parsers in this thread, mapped to their handles,
+ * see log_msg_get_value_handle_cached().  The handle of a name never
+ * changes, so entries only get replaced, never invalidated.
+ */
+typedef struct _LogMessageHandleCacheEntry
+{
+  NVHandle handle;
+  guint8 name_len;
+  gchar name[LOGMSG_HANDLE_CACHE_NAME_MAX];
+} LogMessageHandleCacheEntry;
+
 TLS_BLOCK_START
 {
   /* message that is being processed by the current thread. Its ack/ref changes are cached */
@@ -130,6 +145,8 @@ TLS_BLOCK_START
   gboolean logmsg_cached_abort;
   /* suspend flag in the current thread for acks */
   gboolean logmsg_cached_suspend;
+
+  LogMessageHandleCacheEntry logmsg_handle_cache[LOGMSG_HANDLE_CACHE_SIZE];
 }
 TLS_BLOCK_END;
 
@@ -139,6 +156,7 @@ TLS_BLOCK_END;
 #define logmsg_cached_ack_needed    __tls_deref(logmsg_cached_ack_needed)
 #define logmsg_cached_abort         __tls_deref(logmsg_cached_abort)
 #define logmsg_cached_suspend       __tls_deref(logmsg_cached_suspend)
+#define logmsg_handle_cache         __tls_deref(logmsg_handle_cache)
 
 #define LOGMSG_REFCACHE_SUSPEND_SHIFT                 31 /* number of bits to shift to get the SUSPEND flag */
 #define LOGMSG_REFCACHE_SUSPEND_MASK          0x80000000 /* bit mask to extract the SUSPEND flag */
@@ -230,6 +248,10 @@ void
 log_msg_write_unprotect(LogMessage *self)
 {
   self->protect_cnt--;
+
+  /* the message may change from now on, forget what we know about it */
+  if (self->protect_cnt == 0)
+    memset(self->filter_results, 0, sizeof(self->filter_results));
 }
 
 LogMessage *
@@ -247,32 +269,11 @@ log_msg_make_writable(LogMessage **pself, const LogPathOptions *path_options)
 }
 
 
+/* makes sure that the message has its own sdata array with room for
+ * alloc_sdata elements */
 static void
-log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name, gssize name_len)
+log_msg_alloc_sdata(LogMessage *self, guint16 alloc_sdata)
 {
-  guint16 alloc_sdata;
-  guint16 prefix_and_block_len;
-  gint i;
-  const gchar *dot;
-
-  /* this was a structured data element, insert a ref to the sdata array */
-
-  stats_counter_inc(count_sdata_updates);
-  if (self->num_sdata == 255)
-    {
-      msg_error("syslog-ng only supports 255 SD elements right now, just drop an email to the mailing list that it was not enough with your use-case so we can increase it");
-      return;
-    }
-
-  if (self->alloc_sdata <= self->num_sdata)
-    {
-      alloc_sdata = MAX(self->num_sdata + 1, STRICT_ROUND_TO_NEXT_EIGHT(self->num_sdata));
-      if (alloc_sdata > 255)
-        alloc_sdata = 255;
-    }
-  else
-    alloc_sdata = self->alloc_sdata;
-
   if (log_msg_chk_flag(self, LF_STATE_OWN_SDATA) && self->sdata)
     {
       if (self->alloc_sdata < alloc_sdata)
@@ -288,7 +289,7 @@ log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name,
       sdata = g_malloc(alloc_sdata * sizeof(self->sdata[0]));
       if (self->num_sdata)
         memcpy(sdata, self->sdata, self->num_sdata * sizeof(self->sdata[0]));
-      memset(&sdata[self->num_sdata], 0, sizeof(self->sdata[0]) * (self->alloc_sdata - self->num_sdata));
+      memset(&sdata[self->num_sdata], 0, sizeof(self->sdata[0]) * (alloc_sdata - self->num_sdata));
       self->sdata = sdata;
       log_msg_set_flag(self, LF_STATE_OWN_SDATA);
     }
@@ -299,6 +300,52 @@ log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name,
       self->allocated_bytes += ((self->alloc_sdata - old_alloc_sdata) * sizeof(self->sdata[0]));
       stats_counter_add(count_allocated_bytes, (self->alloc_sdata - old_alloc_sdata) * sizeof(self->sdata[0]));
     }
+}
+
+/*
+ * Preallocates the sdata array for @num_sdata elements, so that a parser
+ * which expects that many SD parameters doesn't have to grow it
+ * repeatedly.  It is only a hint, the array grows beyond it if needed.
+ */
+void
+log_msg_reserve_sdata(LogMessage *self, gint num_sdata)
+{
+  if (num_sdata > 255)
+    num_sdata = 255;
+  if (num_sdata <= self->alloc_sdata)
+    return;
+
+  log_msg_alloc_sdata(self, num_sdata);
+}
+
+static void
+log_msg_update_sdata_slow(LogMessage *self, NVHandle handle, const gchar *name, gssize name_len)
+{
+  guint16 alloc_sdata;
+  guint16 prefix_and_block_len;
+  gint i;
+  const gchar *dot;
+
+  /* this was a structured data element, insert a ref to the sdata array */
+
+  stats_counter_inc(count_sdata_updates);
+  if (self->num_sdata == 255)
+    {
+      msg_error("syslog-ng only supports 255 SD elements right now, just drop an email to the mailing list that it was not enough with your use-case so we can increase it");
+      return;
+    }
+
+  if (self->alloc_sdata <= self->num_sdata)
+    {
+      alloc_sdata = MAX(self->num_sdata + 1, STRICT_ROUND_TO_NEXT_EIGHT(self->num_sdata));
+      if (alloc_sdata > 255)
+        alloc_sdata = 255;
+    }
+  else
+    alloc_sdata = self->alloc_sdata;
+
+  log_msg_alloc_sdata(self, alloc_sdata);
+
   /* ok, we have our own SDATA array now which has at least one free slot */
 
   if (!self->initial_parse)
@@ -363,6 +410,42 @@ log_msg_get_value_handle(const gchar *value_name)
   return handle;
 }
 
+/*
+ * Same as log_msg_get_value_handle(), but parsers that look up names
+ * coming from the message (instead of the configuration) for every message
+ * can use this to avoid taking the registry lock in most cases.  @name has
+ * to be NUL terminated, @name_len is its length.
+ */
+NVHandle
+log_msg_get_value_handle_cached(const gchar *name, gsize name_len)
+{
+  LogMessageHandleCacheEntry *entry;
+  NVHandle handle;
+  guint hash = 2166136261U;
+  gsize i;
+
+  if (name_len >= LOGMSG_HANDLE_CACHE_NAME_MAX)
+    return log_msg_get_value_handle(name);
+
+  for (i = 0; i < name_len; i++)
+    hash = (hash ^ (guchar) name[i]) * 16777619U;
+
+  entry = &logmsg_handle_cache[hash % LOGMSG_HANDLE_CACHE_SIZE];
+  if (entry->handle &&
+      entry->name_len == name_len &&
+      memcmp(entry->name, name, name_len) == 0)
+    return entry->handle;
+
+  handle = log_msg_get_value_handle(name);
+  if (handle)
+    {
+      entry->handle = handle;
+      entry->name_len = name_len;
+      memcpy(entry->name, name, name_len);
+    }
+  return handle;
+}
+
 gboolean
 log_msg_is_value_name_valid(const gchar *value)
 {
@@ -676,6 +759,57 @@ log_msg_clear_matches(LogMessage *self)
   self->num_matches = 0;
 }
 
+#define LOGMSG_FILTER_RESULT_VALID 0x1
+#define LOGMSG_FILTER_RESULT_MATCH 0x2
+#define LOGMSG_FILTER_RESULT_MASK  0x3
+
+#define LOGMSG_FILTER_RESULT_SHIFT(slot) (((slot) % LOGMSG_FILTER_RESULTS_PER_WORD) * 2)
+
+/*
+ * Filter results can only be reused as long as the message cannot change
+ * underneath, e.g.  while it is write protected.  Modifications happen on
+ * a clone in that case, which starts with an empty cache.
+ *
+ * The valid and match bits of a filter are in the same word, so a result
+ * is published with a single compare-and-exchange and a reader either
+ * sees both of them or none.
+ */
+gboolean
+log_msg_lookup_filter_result(const LogMessage *self, gint slot, gboolean *result)
+{
+  guint bits;
+
+  if (!log_msg_is_write_protected(self))
+    return FALSE;
+
+  bits = (guint) g_atomic_int_get((gint *) &self->filter_results[slot / LOGMSG_FILTER_RESULTS_PER_WORD]);
+  bits = (bits >> LOGMSG_FILTER_RESULT_SHIFT(slot)) & LOGMSG_FILTER_RESULT_MASK;
+  if ((bits & LOGMSG_FILTER_RESULT_VALID) == 0)
+    return FALSE;
+
+  *result = (bits & LOGMSG_FILTER_RESULT_MATCH) != 0;
+  return TRUE;
+}
+
+void
+log_msg_store_filter_result(LogMessage *self, gint slot, gboolean result)
+{
+  gint *word = &self->filter_results[slot / LOGMSG_FILTER_RESULTS_PER_WORD];
+  guint shift = LOGMSG_FILTER_RESULT_SHIFT(slot);
+  guint bits = LOGMSG_FILTER_RESULT_VALID | (result ? LOGMSG_FILTER_RESULT_MATCH : 0);
+  gint old_value, new_value;
+
+  if (!log_msg_is_write_protected(self))
+    return;
+
+  do
+    {
+      old_value = g_atomic_int_get(word);
+      new_value = (gint) (((guint) old_value & ~(LOGMSG_FILTER_RESULT_MASK << shift)) | (bits << shift));
+    }
+  while (!g_atomic_int_compare_and_exchange(word, old_value, new_value));
+}
+
 #if GLIB_SIZEOF_LONG != GLIB_SIZEOF_VOID_P
 #error "The tags bit array assumes that long is the same size as the pointer"
 #endif
@@ -1201,6 +1335,7 @@ log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options)
                                                 0) + LOGMSG_REFCACHE_ABORT_TO_VALUE(0);
   self->cur_node = 0;
   self->protect_cnt = 0;
+  memset(self->filter_results, 0, sizeof(self->filter_results));
 
   log_msg_add_ack(self, path_options);
   if (!path_options->ack_needed)
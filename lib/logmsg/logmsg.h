@@ -63,6 +63,9 @@ typedef struct _LogPathOptions LogPathOptions;
 typedef void (*LMAckFunc)(LogMessage *lm, AckType ack_type);
 
 #define RE_MAX_MATCHES 256
+#define LOGMSG_MAX_MEMOIZED_FILTERS 64
+/* two bits (valid, match) per filter */
+#define LOGMSG_FILTER_RESULTS_PER_WORD 16
 
 typedef enum
 {
@@ -198,6 +201,11 @@ struct _LogMessage
 
   guint64 rcptid;
 
+  /* memoized results of named filters, only valid while write protected,
+   * updated atomically as multiple threads may evaluate filters on the
+   * same message */
+  gint filter_results[LOGMSG_MAX_MEMOIZED_FILTERS / LOGMSG_FILTER_RESULTS_PER_WORD];
+
   /* preallocated LogQueueNodes used to insert this message into a LogQueue */
   LogMessageQueueNode nodes[0];
 
@@ -221,12 +229,15 @@ gboolean log_msg_read(LogMessage *self, SerializeArchive *sa);
 
 /* generic values that encapsulate log message fields, dynamic values and structured data */
 NVHandle log_msg_get_value_handle(const gchar *value_name);
+NVHandle log_msg_get_value_handle_cached(const gchar *name, gsize name_len);
 gboolean log_msg_is_value_name_valid(const gchar *value);
 
 gboolean log_msg_is_handle_macro(NVHandle handle);
 gboolean log_msg_is_handle_sdata(NVHandle handle);
 gboolean log_msg_is_handle_match(NVHandle handle);
 
+void log_msg_reserve_sdata(LogMessage *self, gint num_sdata);
+
 static inline gboolean
 log_msg_is_handle_settable_with_an_indirect_value(NVHandle handle)
 {
@@ -283,6 +294,9 @@ void log_msg_set_match(LogMessage *self, gint index, const gchar *value, gssize
 void log_msg_set_match_indirect(LogMessage *self, gint index, NVHandle ref_handle, guint8 type, guint16 ofs, guint16 len);
 void log_msg_clear_matches(LogMessage *self);
 
+gboolean log_msg_lookup_filter_result(const LogMessage *self, gint slot, gboolean *result);
+void log_msg_store_filter_result(LogMessage *self, gint slot, gboolean result);
+
 static inline void
 log_msg_set_value_by_name(LogMessage *self, const gchar *name, const gchar *value, gssize length)
 {
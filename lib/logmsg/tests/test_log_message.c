@@ -384,6 +384,28 @@ Test(log_message, test_sdata_value_omits_unset_values)
   log_msg_unref(msg);
 }
 
+Test(log_message, test_cached_value_handles_match_the_registry)
+{
+  const gchar *names[] = { "foo", "bar", ".SDATA.foo.bar", "foo", ".SDATA.foo.bar" };
+  gchar long_name[128];
+  NVHandle handle;
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(names); i++)
+    cr_assert_eq(log_msg_get_value_handle_cached(names[i], strlen(names[i])), log_msg_get_value_handle(names[i]),
+                 "Cached handle differs from the registry; name=%s", names[i]);
+
+  cr_assert(log_msg_is_handle_sdata(log_msg_get_value_handle_cached(".SDATA.foo.bar", 14)));
+
+  memset(long_name, 'x', sizeof(long_name) - 1);
+  long_name[sizeof(long_name) - 1] = 0;
+  handle = log_msg_get_value_handle_cached(long_name, strlen(long_name));
+  cr_assert_eq(handle, log_msg_get_value_handle(long_name));
+  cr_assert_eq(log_msg_get_value_handle_cached(long_name, strlen(long_name)), handle);
+
+  cr_assert_eq(log_msg_get_value_handle_cached("", 0), 0);
+}
+
 #define DEFUN_KEY_VALUE(name, key, value, size) \
   gchar name ## _key[size]; \
   gchar name ## _value[size]; \
@@ -61,97 +61,272 @@ log_proto_buffered_server_put_state(LogProtoBufferedServer *self)
     persist_state_unmap_entry(self->persist_state, self->persist_handle);
 }
 
+/*
+ * The input encoding is ASCII compatible if ASCII characters are
+ * represented by the very same single byte and bytes of multi-byte
+ * characters never fall into the ASCII range, so ASCII runs can be copied
+ * to the UTF-8 buffer as is.
+ *
+ * Encoding names can't be trusted for this (e.g. LATIN-GREEK is a 7 bit
+ * encoding, the trail bytes of Shift-JIS or GBK characters overlap with
+ * ASCII, ISO-2022 switches character sets with ASCII escape sequences), so
+ * the converter itself is probed with every byte followed by an ASCII
+ * byte: the ASCII byte has to come out unchanged, after an ASCII byte that
+ * must come out unchanged as well, and after a non-ASCII byte that must
+ * either be converted on its own or rejected as invalid.
+ */
+static gboolean
+_converts_byte_pair_compatibly(GIConv convert, guchar first, guchar ascii)
+{
+  gchar raw[2] = { first, ascii };
+  gchar converted[16];
+  gchar *in = raw, *out = converted;
+  gsize avail_in = sizeof(raw), avail_out = sizeof(converted);
+
+  g_iconv(convert, NULL, NULL, NULL, NULL);
+  if (g_iconv(convert, &in, &avail_in, &out, &avail_out) == (gsize) -1)
+    {
+      /* an invalid lead byte is fine, but an incomplete character means
+       * that it continues with the ASCII byte */
+      return first >= 0x80 && errno == EILSEQ && in == raw;
+    }
+
+  if (first < 0x80)
+    return out - converted == sizeof(raw) && memcmp(converted, raw, sizeof(raw)) == 0;
+  return out - converted > 1 && out[-1] == ascii;
+}
+
+static gboolean
+_probe_ascii_compatibility(GIConv convert)
+{
+  gint first, ascii;
+
+  for (first = 1; first < 0x100; first++)
+    {
+      for (ascii = 1; ascii < 0x80; ascii++)
+        {
+          if (!_converts_byte_pair_compatibly(convert, first, ascii))
+            return FALSE;
+        }
+    }
+  return TRUE;
+}
+
+/* the verdict is cached per encoding, as probing takes some 32k
+ * conversions and a converter is opened for every connection */
+static gboolean
+log_proto_buffered_server_is_ascii_compatible_encoding(const gchar *encoding, GIConv convert)
+{
+  static GStaticMutex lock = G_STATIC_MUTEX_INIT;
+  static GHashTable *verdicts;
+  gpointer verdict;
+  gboolean result;
+
+  g_static_mutex_lock(&lock);
+  if (!verdicts)
+    verdicts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  if (g_hash_table_lookup_extended(verdicts, encoding, NULL, &verdict))
+    {
+      result = GPOINTER_TO_INT(verdict);
+    }
+  else
+    {
+      result = _probe_ascii_compatibility(convert);
+      g_hash_table_insert(verdicts, g_strdup(encoding), GINT_TO_POINTER(result));
+    }
+  g_static_mutex_unlock(&lock);
+
+  /* leave the converter in its initial state */
+  g_iconv(convert, NULL, NULL, NULL, NULL);
+  return result;
+}
+
+/* the high bit of each byte in a machine word */
+#define ASCII_WORD_HIGH_BITS (((gsize) -1 / 0xFF) * 0x80)
+
+static gsize
+_find_ascii_prefix_len(const guchar *buffer, gsize buffer_len)
+{
+  gsize i = 0;
+
+  for (; i + sizeof(gsize) <= buffer_len; i += sizeof(gsize))
+    {
+      gsize word;
+
+      memcpy(&word, buffer + i, sizeof(word));
+      if (word & ASCII_WORD_HIGH_BITS)
+        break;
+    }
+  while (i < buffer_len && buffer[i] < 0x80)
+    i++;
+  return i;
+}
+
+static gsize
+_find_non_ascii_prefix_len(const guchar *buffer, gsize buffer_len)
+{
+  gsize i = 0;
+
+  while (i < buffer_len && buffer[i] >= 0x80)
+    i++;
+  return i;
+}
+
+static gboolean
+log_proto_buffered_server_grow_buffer(LogProtoBufferedServer *self, LogProtoBufferedServerState *state)
+{
+  if (state->buffer_size >= self->super.options->max_buffer_size)
+    {
+      msg_error("Incoming byte stream requires a too large conversion buffer, probably invalid character sequence",
+                evt_tag_str("encoding", self->super.options->encoding),
+                evt_tag_printf("buffer", "%.*s", (gint) state->pending_buffer_end, self->buffer));
+      return FALSE;
+    }
+
+  state->buffer_size *= 2;
+  if (state->buffer_size > self->super.options->max_buffer_size)
+    state->buffer_size = self->super.options->max_buffer_size;
+
+  self->buffer = g_realloc(self->buffer, state->buffer_size);
+  return TRUE;
+}
+
+static gboolean
+log_proto_buffered_server_append_ascii(LogProtoBufferedServer *self, LogProtoBufferedServerState *state,
+                                       const guchar *raw_buffer, gsize raw_buffer_len)
+{
+  while (TRUE)
+    {
+      gsize len = MIN(raw_buffer_len, state->buffer_size - state->pending_buffer_end);
+
+      memcpy(self->buffer + state->pending_buffer_end, raw_buffer, len);
+      state->pending_buffer_end += len;
+      self->ascii_tail_len += len;
+      raw_buffer += len;
+      raw_buffer_len -= len;
+
+      if (raw_buffer_len == 0)
+        return TRUE;
+      if (!log_proto_buffered_server_grow_buffer(self, state))
+        return FALSE;
+    }
+}
+
+/*
+ * With an ASCII compatible encoding, ASCII runs of the input are copied
+ * verbatim and only the rest goes through iconv, one run of non-ASCII
+ * bytes at a time.  As multi-byte characters of these encodings consist of
+ * non-ASCII bytes only, the runs end on character boundaries, except for
+ * an incomplete character at the end of the input.
+ */
 static gboolean
 log_proto_buffered_server_convert_from_raw(LogProtoBufferedServer *self, const guchar *raw_buffer, gsize raw_buffer_len)
 {
   /* some data was read */
-  gsize avail_in = raw_buffer_len;
+  const guchar *raw_buffer_end = raw_buffer + raw_buffer_len;
+  gsize avail_in;
   gsize avail_out;
   gchar *out;
   gint  ret = -1;
+  gint error;
   gboolean success = FALSE;
   LogProtoBufferedServerState *state = log_proto_buffered_server_get_state(self);
 
-  do
+  while (raw_buffer < raw_buffer_end)
     {
-      avail_out = state->buffer_size - state->pending_buffer_end;
-      out = (gchar *) self->buffer + state->pending_buffer_end;
+      avail_in = raw_buffer_end - raw_buffer;
+      if (self->convert_ascii_compatible)
+        {
+          gsize ascii_len = _find_ascii_prefix_len(raw_buffer, avail_in);
+
+          if (ascii_len > 0)
+            {
+              if (!log_proto_buffered_server_append_ascii(self, state, raw_buffer, ascii_len))
+                goto error;
+              raw_buffer += ascii_len;
+              continue;
+            }
+          avail_in = _find_non_ascii_prefix_len(raw_buffer, avail_in);
+        }
 
-      ret = g_iconv(self->convert, (gchar **) &raw_buffer, &avail_in, (gchar **) &out, &avail_out);
-      if (ret == (gsize) -1)
+      self->ascii_tail_len = 0;
+      do
         {
-          switch (errno)
+          avail_out = state->buffer_size - state->pending_buffer_end;
+          out = (gchar *) self->buffer + state->pending_buffer_end;
+
+          ret = g_iconv(self->convert, (gchar **) &raw_buffer, &avail_in, (gchar **) &out, &avail_out);
+          if (ret == (gsize) -1)
             {
-            case EINVAL:
-              if (self->stream_based)
-                {
-                  /* Incomplete text, do not report an error, rather try to read again */
-                  state->pending_buffer_end = state->buffer_size - avail_out;
+              error = errno;
 
-                  if (avail_in > 0)
+              /* only the end of the input may hold an incomplete
+               * character, anywhere else it is followed by ASCII and is
+               * invalid */
+              if (error == EINVAL && raw_buffer + avail_in != raw_buffer_end)
+                error = EILSEQ;
+
+              switch (error)
+                {
+                case EINVAL:
+                  if (self->stream_based)
                     {
-                      if (avail_in > sizeof(state->raw_buffer_leftover))
+                      /* Incomplete text, do not report an error, rather try to read again */
+                      state->pending_buffer_end = state->buffer_size - avail_out;
+
+                      if (avail_in > 0)
                         {
-                          msg_error("Invalid byte sequence, the remaining raw buffer is larger than the supported leftover size",
+                          if (avail_in > sizeof(state->raw_buffer_leftover))
+                            {
+                              msg_error("Invalid byte sequence, the remaining raw buffer is larger than the supported leftover size",
+                                        evt_tag_str("encoding", self->super.options->encoding),
+                                        evt_tag_int("avail_in", avail_in),
+                                        evt_tag_int("leftover_size", sizeof(state->raw_buffer_leftover)));
+                              goto error;
+                            }
+                          memcpy(state->raw_buffer_leftover, raw_buffer, avail_in);
+                          state->raw_buffer_leftover_size = avail_in;
+                          state->raw_buffer_size -= avail_in;
+                          msg_trace("Leftover characters remained after conversion, delaying message until another chunk arrives",
                                     evt_tag_str("encoding", self->super.options->encoding),
-                                    evt_tag_int("avail_in", avail_in),
-                                    evt_tag_int("leftover_size", sizeof(state->raw_buffer_leftover)));
-                          goto error;
+                                    evt_tag_int("avail_in", avail_in));
+                          goto success;
                         }
-                      memcpy(state->raw_buffer_leftover, raw_buffer, avail_in);
-                      state->raw_buffer_leftover_size = avail_in;
-                      state->raw_buffer_size -= avail_in;
-                      msg_trace("Leftover characters remained after conversion, delaying message until another chunk arrives",
+                    }
+                  else
+                    {
+                      msg_error("Byte sequence too short, cannot convert an individual frame in its entirety",
                                 evt_tag_str("encoding", self->super.options->encoding),
                                 evt_tag_int("avail_in", avail_in));
-                      goto success;
+                      goto error;
                     }
-                }
-              else
-                {
-                  msg_error("Byte sequence too short, cannot convert an individual frame in its entirety",
-                            evt_tag_str("encoding", self->super.options->encoding),
-                            evt_tag_int("avail_in", avail_in));
-                  goto error;
-                }
-              break;
-            case E2BIG:
-              state->pending_buffer_end = state->buffer_size - avail_out;
-              /* extend the buffer */
-
-              if (state->buffer_size < self->super.options->max_buffer_size)
-                {
-                  state->buffer_size *= 2;
-                  if (state->buffer_size > self->super.options->max_buffer_size)
-                    state->buffer_size = self->super.options->max_buffer_size;
+                  break;
+                case E2BIG:
+                  state->pending_buffer_end = state->buffer_size - avail_out;
+                  /* extend the buffer */
 
-                  self->buffer = g_realloc(self->buffer, state->buffer_size);
+                  if (!log_proto_buffered_server_grow_buffer(self, state))
+                    goto error;
 
                   /* recalculate the out pointer, and add what we have now */
                   ret = -1;
-                }
-              else
-                {
-                  msg_error("Incoming byte stream requires a too large conversion buffer, probably invalid character sequence",
-                            evt_tag_str("encoding", self->super.options->encoding),
-                            evt_tag_printf("buffer", "%.*s", (gint) state->pending_buffer_end, self->buffer));
+                  break;
+                case EILSEQ:
+                default:
+                  msg_notice("Invalid byte sequence or other error while converting input, skipping character",
+                             evt_tag_str("encoding", self->super.options->encoding),
+                             evt_tag_printf("char", "0x%02x", *(guchar *) raw_buffer));
                   goto error;
                 }
-              break;
-            case EILSEQ:
-            default:
-              msg_notice("Invalid byte sequence or other error while converting input, skipping character",
-                         evt_tag_str("encoding", self->super.options->encoding),
-                         evt_tag_printf("char", "0x%02x", *(guchar *) raw_buffer));
-              goto error;
+            }
+          else
+            {
+              state->pending_buffer_end = state->buffer_size - avail_out;
             }
         }
-      else
-        {
-          state->pending_buffer_end = state->buffer_size - avail_out;
-        }
+      while (avail_in > 0);
     }
-  while (avail_in > 0);
 
 success:
   success = TRUE;
@@ -885,7 +1060,12 @@ log_proto_buffered_server_init(LogProtoBufferedServer *self, LogTransport *trans
   self->read_data = log_proto_buffered_server_read_data_method;
   self->io_status = G_IO_STATUS_NORMAL;
   if (options->encoding)
-    self->convert = g_iconv_open("utf-8", options->encoding);
+    {
+      self->convert = g_iconv_open("utf-8", options->encoding);
+      if (self->convert != (GIConv) -1)
+        self->convert_ascii_compatible = log_proto_buffered_server_is_ascii_compatible_encoding(options->encoding,
+                                         self->convert);
+    }
   else
     self->convert = (GIConv) -1;
   self->stream_based = TRUE;
@@ -80,7 +80,11 @@ struct _LogProtoBufferedServer
      * or fixed-size records read from a file.  */
     stream_based:1,
 
-    no_multi_read:1;
+    no_multi_read:1,
+
+    /* ASCII characters of the input encoding are the same bytes as in
+     * UTF-8, so ASCII input doesn't need to go through iconv */
+    convert_ascii_compatible:1;
   gint fetch_state;
   GIOStatus io_status;
   LogProtoBufferedServerState *state1;
@@ -89,6 +93,12 @@ struct _LogProtoBufferedServer
   GIConv convert;
   guchar *buffer;
 
+  /* the number of bytes at the end of the buffer (before
+   * pending_buffer_end) that were copied verbatim from ASCII input, thus
+   * their raw size is the same.  It may exceed the buffer contents after
+   * the buffer is emptied, the excess is to be ignored. */
+  gsize ascii_tail_len;
+
   /* auxiliary data (e.g. GSockAddr, other transport related meta
    * data) associated with the already buffered data */
   LogTransportAuxData buffer_aux;
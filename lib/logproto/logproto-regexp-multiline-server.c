@@ -24,6 +24,7 @@
 #include "logproto-regexp-multiline-server.h"
 #include "messages.h"
 #include "compat/pcre.h"
+#include "pcre-utils.h"
 
 #include <string.h>
 
@@ -37,7 +38,6 @@ MultiLineRegexp *
 multi_line_regexp_compile(const gchar *regexp, GError **error)
 {
   MultiLineRegexp *self = g_new0(MultiLineRegexp, 1);
-  gint optflags = 0;
   gint rc;
   const gchar *errptr;
   gint erroffset;
@@ -53,12 +53,8 @@ multi_line_regexp_compile(const gchar *regexp, GError **error)
       goto error;
     }
 
-#ifdef PCRE_STUDY_JIT_COMPILE
-  optflags = PCRE_STUDY_JIT_COMPILE;
-#endif
-
   /* optimize regexp */
-  self->extra = pcre_study(self->pattern, optflags, &errptr);
+  self->extra = pcre_utils_study(self->pattern, &errptr);
   if (errptr != NULL)
     {
       g_set_error(error, 0, 0, "Error while studying multi-line regexp, error=%s", errptr);
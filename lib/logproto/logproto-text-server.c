@@ -138,7 +138,7 @@ log_proto_text_server_maybe_realloc_reverse_buffer(LogProtoTextServer *self, gsi
  * data). Also, this is only invoked if the file uses an encoding.
  */
 static gsize
-log_proto_text_server_get_raw_size_of_buffer(LogProtoTextServer *self, const guchar *buffer, gsize buffer_len)
+log_proto_text_server_reverse_convert_size(LogProtoTextServer *self, const guchar *buffer, gsize buffer_len)
 {
   gchar *out;
   const guchar *in;
@@ -189,6 +189,22 @@ log_proto_text_server_get_raw_size_of_buffer(LogProtoTextServer *self, const guc
     }
 }
 
+/*
+ * Same as above for the data at the end of our buffer, where the part that
+ * was copied verbatim from ASCII input is counted as is, and only the rest
+ * (if any) needs to be reverse-converted.
+ */
+static gsize
+log_proto_text_server_get_raw_size_of_buffer(LogProtoTextServer *self, const guchar *buffer, gsize buffer_len)
+{
+  gsize ascii_tail_len = MIN(self->super.ascii_tail_len, buffer_len);
+
+  if (ascii_tail_len == buffer_len)
+    return buffer_len;
+
+  return log_proto_text_server_reverse_convert_size(self, buffer, buffer_len - ascii_tail_len) + ascii_tail_len;
+}
+
 static gint
 log_proto_text_server_accumulate_line_method(LogProtoTextServer *self, const guchar *msg, gsize msg_len,
                                              gssize consumed_len)
@@ -219,7 +235,7 @@ log_proto_text_server_split_buffer(LogProtoTextServer *self, LogProtoBufferedSer
 
 
       if (self->super.super.options->encoding)
-        raw_split_size = log_proto_text_server_get_raw_size_of_buffer(self, buffer_start, buffer_bytes);
+        raw_split_size = log_proto_text_server_get_raw_size_of_buffer(self, self->super.buffer, buffer_bytes);
       else
         raw_split_size = buffer_bytes;
 
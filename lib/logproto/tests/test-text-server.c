@@ -26,8 +26,13 @@
 #include "proto_lib.h"
 #include "msg_parse_lib.h"
 #include "logproto/logproto-text-server.h"
+#include "persist_lib.h"
+#include "transport/transport-file.h"
+#include "bookmark.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 /****************************************************************************************
  * LogProtoTextServer
@@ -234,6 +239,131 @@ test_log_proto_text_server_iso8859_2(void)
   log_proto_server_free(proto);
 }
 
+static void
+test_log_proto_text_server_iso8859_2_mixed_with_ascii(void)
+{
+  LogProtoServer *proto;
+
+  log_proto_server_options_set_encoding(&proto_server_options, "iso-8859-2");
+  proto = construct_test_proto(
+            log_transport_mock_stream_new(
+              /* iso-8859-2 */
+              "ascii prefix \xe1\x72\x76\xed", -1,                                  /*  |ascii prefix árví| */
+              "\x7a\x74\xfb\x72\xf5 ascii suffix\nnext ", -1,                     /*  |ztűrő ascii suffix| */
+              "line\n", -1,
+              LTM_EOF));
+
+  assert_true(log_proto_server_validate_options(proto),
+              "validate_options() returned failure but it should have succeeded");
+  assert_proto_server_fetch(proto, "ascii prefix árvíztűrő ascii suffix", -1);
+  assert_proto_server_fetch(proto, "next line", -1);
+  assert_proto_server_fetch_failure(proto, LPS_EOF, NULL);
+  log_proto_server_free(proto);
+}
+
+static void
+test_log_proto_text_server_partial_char_after_ascii(void)
+{
+  LogProtoServer *proto;
+
+  log_proto_server_options_set_encoding(&proto_server_options, "utf-8");
+  proto = construct_test_proto(
+            log_transport_mock_stream_new(
+              /* utf8, "á" split between two reads */
+              "abc\xc3", -1,
+              "\xa1" "def\n", -1,
+              LTM_EOF));
+
+  assert_true(log_proto_server_validate_options(proto),
+              "validate_options() returned failure but it should have succeeded");
+  assert_proto_server_fetch(proto, "abcádef", -1);
+  assert_proto_server_fetch_failure(proto, LPS_EOF, NULL);
+  log_proto_server_free(proto);
+}
+
+static void
+assert_proto_server_fetch_and_save_bookmark(LogProtoServer *proto, PersistState *persist_state,
+                                            const gchar *expected_msg)
+{
+  const guchar *msg = NULL;
+  gsize msg_len = 0;
+  LogProtoStatus status;
+  LogTransportAuxData aux;
+  Bookmark bookmark;
+  gboolean may_read = TRUE;
+
+  bookmark_init(&bookmark);
+  bookmark.persist_state = persist_state;
+  do
+    {
+      log_transport_aux_data_init(&aux);
+      status = log_proto_server_fetch(proto, &msg, &msg_len, &may_read, &aux, &bookmark);
+      log_transport_aux_data_destroy(&aux);
+    }
+  while (status == LPS_SUCCESS && msg == NULL && may_read);
+
+  assert_proto_server_status(proto, status, LPS_SUCCESS);
+  assert_nstring((const gchar *) msg, msg_len, expected_msg, -1, "LogProtoServer expected message mismatch");
+  assert_not_null(bookmark.save, "fetch() didn't fill the bookmark");
+  bookmark.save(&bookmark);
+}
+
+static LogProtoServer *
+construct_test_proto_on_file(const gchar *filename, PersistState *persist_state)
+{
+  LogProtoServer *proto;
+  gint fd;
+
+  fd = open(filename, O_RDONLY);
+  assert_true(fd >= 0, "error opening test input file");
+  proto = construct_test_proto(log_transport_file_new(fd));
+  log_proto_server_restart_with_state(proto, persist_state, "test_text_server_pos_tracking");
+  return proto;
+}
+
+static void
+test_log_proto_text_server_pos_tracking_with_encoding(void)
+{
+  const gchar *input_file = "test_text_server_pos_tracking.log";
+  /* EUC-JP is ASCII compatible, but its characters are shorter than in
+   * UTF-8 and it is not one of the fixed width encodings, so the raw size
+   * of a partial line is calculated by converting it back */
+  const gchar input[] =
+    "1\n"
+    /* 日本語 followed by ASCII, split after "mor" by the first 16 byte read */
+    "\xc6\xfc\xcb\xdc\xb8\xec and more ascii\n"
+    "3 \xb8\xec\n"
+    "end\n";
+  PersistState *persist_state;
+  LogProtoServer *proto;
+
+  assert_true(g_file_set_contents(input_file, input, -1, NULL), "error writing test input file");
+  persist_state = clean_and_create_persist_state_for_test("test_text_server_pos_tracking.persist");
+
+  log_proto_server_options_set_encoding(&proto_server_options, "euc-jp");
+  proto_server_options.position_tracking_enabled = TRUE;
+  proto_server_options.init_buffer_size = 16;
+
+  proto = construct_test_proto_on_file(input_file, persist_state);
+  assert_proto_server_fetch(proto, "1", -1);
+  /* the partial line is moved to the start of the buffer, overlapping its
+   * original location, its raw size has to be calculated after the move */
+  assert_proto_server_fetch_and_save_bookmark(proto, persist_state, "日本語 and more ascii");
+  assert_proto_server_fetch(proto, "3 語", -1);
+  log_proto_server_free(proto);
+
+  /* continue from the saved position after a restart */
+  persist_state = restart_persist_state(persist_state);
+  proto = construct_test_proto_on_file(input_file, persist_state);
+  assert_proto_server_fetch(proto, "3 語", -1);
+  assert_proto_server_fetch(proto, "end", -1);
+  assert_proto_server_fetch_failure(proto, LPS_EOF, NULL);
+  log_proto_server_free(proto);
+
+  cancel_and_destroy_persist_state(persist_state);
+  unlink(input_file);
+}
+
 static void
 test_log_proto_text_server_invalid_encoding(void)
 {
@@ -547,6 +677,9 @@ test_log_proto_text_server(void)
   PROTO_TESTCASE(test_log_proto_text_server_not_fixed_encoding);
   PROTO_TESTCASE(test_log_proto_text_server_ucs4);
   PROTO_TESTCASE(test_log_proto_text_server_iso8859_2);
+  PROTO_TESTCASE(test_log_proto_text_server_iso8859_2_mixed_with_ascii);
+  PROTO_TESTCASE(test_log_proto_text_server_partial_char_after_ascii);
+  PROTO_TESTCASE(test_log_proto_text_server_pos_tracking_with_encoding);
   PROTO_TESTCASE(test_log_proto_text_server_invalid_encoding);
   PROTO_TESTCASE(test_log_proto_text_server_multi_read);
   PROTO_TESTCASE(test_log_proto_text_server_multi_read_not_allowed);
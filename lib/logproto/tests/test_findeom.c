@@ -77,6 +77,10 @@ main()
   testcase("abcdefghijklmnopqrstuvwx\nb\nc\n", 29, 24);
   testcase("abcdefghijklmnopqrstuvwxy\nb\nc\n", 30, 25);
   testcase("abcdefghijklmnopqrstuvwxyz\nb\nc\n", 31, 26);
+  testcase("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\nb\nc\n", 57, 52);
+  testcase("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklm\n", 66, 65);
+  testcase("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\0\n", 54, 52);
+  testcase("abcdefghijklmnopqrstuvwxyzabcdef\rb\n", 35, 34);
 
   testcase("a",  1, -1);
   testcase("ab",  2, -1);
@@ -104,5 +108,6 @@ main()
   testcase("abcdefghijklmnopqrstuvwx", 24, -1);
   testcase("abcdefghijklmnopqrstuvwxy", 25, -1);
   testcase("abcdefghijklmnopqrstuvwxyz", 26, -1);
+  testcase("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklm", 65, -1);
   return 0;
 }
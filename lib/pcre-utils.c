@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "pcre-utils.h"
+#include "tls-support.h"
+
+/*
+ * JIT compiled patterns run on a JIT stack, which is by default a 32kB
+ * area on the machine stack.  Complex patterns (e.g. the ones in a
+ * patterndb) may run out of it, in which case pcre_exec() fails with
+ * PCRE_ERROR_JIT_STACKLIMIT.  We give every thread its own, growable JIT
+ * stack instead, allocated when the thread first runs a JIT compiled
+ * pattern.  A JIT stack may only be used by one thread at a time, hence
+ * the thread local storage.
+ */
+#define PCRE_JIT_STACK_START_SIZE (32 * 1024)
+#define PCRE_JIT_STACK_MAX_SIZE   (1024 * 1024)
+
+static gboolean jit_enabled = TRUE;
+
+#ifdef PCRE_CONFIG_JIT
+
+TLS_BLOCK_START
+{
+  pcre_jit_stack *jit_stack;
+}
+TLS_BLOCK_END;
+
+#define jit_stack __tls_deref(jit_stack)
+
+static pcre_jit_stack *
+_get_thread_jit_stack(void *user_data)
+{
+  /* if the allocation fails, we return NULL and PCRE falls back to the
+   * machine stack */
+  if (!jit_stack)
+    jit_stack = pcre_jit_stack_alloc(PCRE_JIT_STACK_START_SIZE, PCRE_JIT_STACK_MAX_SIZE);
+  return jit_stack;
+}
+
+#endif
+
+/*
+ * Study @pattern with JIT compilation enabled (if PCRE supports it), and
+ * set it up to use the per-thread JIT stack.  The result has to be freed
+ * using pcre_free_study(), it may be NULL if JIT is disabled and studying
+ * found nothing to optimize.
+ */
+pcre_extra *
+pcre_utils_study(pcre *pattern, const gchar **errptr)
+{
+  pcre_extra *extra;
+
+  extra = pcre_study(pattern, jit_enabled ? PCRE_STUDY_JIT_COMPILE : 0, errptr);
+#ifdef PCRE_CONFIG_JIT
+  if (extra)
+    pcre_assign_jit_stack(extra, _get_thread_jit_stack, NULL);
+#endif
+  return extra;
+}
+
+/*
+ * Patterns studied after disabling JIT are matched by the PCRE interpreter,
+ * the same way as if PCRE was built without JIT support.  Patterns that
+ * were already studied are not affected.
+ */
+void
+pcre_utils_set_jit_enabled(gboolean enabled)
+{
+  jit_enabled = enabled;
+}
+
+void
+pcre_utils_thread_deinit(void)
+{
+#ifdef PCRE_CONFIG_JIT
+  if (jit_stack)
+    {
+      pcre_jit_stack_free(jit_stack);
+      jit_stack = NULL;
+    }
+#endif
+}
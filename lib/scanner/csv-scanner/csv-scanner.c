@@ -25,6 +25,7 @@
 #include "str-utils.h"
 #include "string-list.h"
 #include "scratch-buffers.h"
+#include "find-crlf.h"
 
 #include <string.h>
 
@@ -51,11 +52,27 @@ csv_scanner_options_set_columns(CSVScannerOptions *options, GList *columns)
   options->columns = columns;
 }
 
+static void
+_update_span_scanning(CSVScannerOptions *options)
+{
+  gsize num_delimiters = options->delimiters ? strlen(options->delimiters) : 0;
+  gsize i;
+
+  options->scan_spans = !options->string_delimiters &&
+                        num_delimiters > 0 && num_delimiters <= G_N_ELEMENTS(options->span_delimiters);
+  if (!options->scan_spans)
+    return;
+
+  for (i = 0; i < G_N_ELEMENTS(options->span_delimiters); i++)
+    options->span_delimiters[i] = options->delimiters[MIN(i, num_delimiters - 1)];
+}
+
 void
 csv_scanner_options_set_delimiters(CSVScannerOptions *options, const gchar *delimiters)
 {
   g_free(options->delimiters);
   options->delimiters = g_strdup(delimiters);
+  _update_span_scanning(options);
 }
 
 void
@@ -63,6 +80,7 @@ csv_scanner_options_set_string_delimiters(CSVScannerOptions *options, GList *str
 {
   string_list_free(options->string_delimiters);
   options->string_delimiters = string_delimiters;
+  _update_span_scanning(options);
 }
 
 void
@@ -291,9 +309,68 @@ _parse_unquoted_literal_character(CSVScanner *self)
   self->src++;
 }
 
+/* appends everything up to the closing quote or the next escape character */
+static void
+_parse_span_with_quotation(CSVScanner *self)
+{
+  guchar escape = self->options->dialect == CSV_SCANNER_ESCAPE_BACKSLASH ? '\\' : self->current_quote;
+  const gchar *end = (const gchar *) find_first_of3((const guchar *) self->src, self->src_end - self->src,
+                                                     self->current_quote, escape, self->current_quote);
+
+  if (!end)
+    end = self->src_end;
+  g_string_append_len(self->current_value, self->src, end - self->src);
+  self->src = end;
+}
+
+/* appends everything up to the next delimiter and consumes the delimiter,
+ * returns FALSE if the input ended without one */
+static gboolean
+_parse_unquoted_span(CSVScanner *self)
+{
+  const gchar *end = (const gchar *) find_first_of3((const guchar *) self->src, self->src_end - self->src,
+                                                     self->options->span_delimiters[0],
+                                                     self->options->span_delimiters[1],
+                                                     self->options->span_delimiters[2]);
+
+  if (!end)
+    {
+      g_string_append_len(self->current_value, self->src, self->src_end - self->src);
+      self->src = self->src_end;
+      return FALSE;
+    }
+  g_string_append_len(self->current_value, self->src, end - self->src);
+  self->src = end + 1;
+  return TRUE;
+}
+
+static void
+_parse_value_in_spans(CSVScanner *self)
+{
+  while (*self->src)
+    {
+      if (self->current_quote)
+        {
+          _parse_span_with_quotation(self);
+          if (*self->src)
+            _parse_character_with_quotation(self);
+        }
+      else if (_parse_unquoted_span(self))
+        {
+          break;
+        }
+    }
+}
+
 static void
 _parse_value_with_whitespace_and_delimiter(CSVScanner *self)
 {
+  if (self->options->scan_spans)
+    {
+      _parse_value_in_spans(self);
+      return;
+    }
+
   while (*self->src)
     {
       if (self->current_quote)
@@ -393,13 +470,15 @@ csv_scanner_is_scan_finished(CSVScanner *self)
 }
 
 void
-csv_scanner_init(CSVScanner *scanner, CSVScannerOptions *options, const gchar *input)
+csv_scanner_init(CSVScanner *scanner, CSVScannerOptions *options, const gchar *input, gssize input_len)
 {
   memset(scanner, 0, sizeof(*scanner));
   scanner->src = input;
   scanner->current_value = scratch_buffers_alloc();
   scanner->current_column = NULL;
   scanner->options = options;
+  if (input && options->scan_spans)
+    scanner->src_end = input + (input_len < 0 ? strlen(input) : input_len);
 }
 
 void
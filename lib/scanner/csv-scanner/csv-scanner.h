@@ -49,6 +49,10 @@ typedef struct _CSVScannerOptions
   GList *string_delimiters;
   CSVScannerDialect dialect;
   guint32 flags;
+  /* up to 3 single character delimiters and no string delimiters: values
+   * are scanned a span at a time instead of character by character */
+  gboolean scan_spans;
+  guchar span_delimiters[3];
 } CSVScannerOptions;
 
 void csv_scanner_options_clean(CSVScannerOptions *options);
@@ -68,6 +72,7 @@ typedef struct {
   CSVScannerOptions *options;
   GList *current_column;
   const gchar *src;
+  const gchar *src_end;
   GString *current_value;
   gchar current_quote;
 } CSVScanner;
@@ -79,7 +84,7 @@ gboolean csv_scanner_scan_next(CSVScanner *pstate);
 gboolean csv_scanner_is_scan_finished(CSVScanner *pstate);
 gchar *csv_scanner_dup_current_value(CSVScanner *self);
 
-void csv_scanner_init(CSVScanner *pstate, CSVScannerOptions *options, const gchar *input);
+void csv_scanner_init(CSVScanner *pstate, CSVScannerOptions *options, const gchar *input, gssize input_len);
 void csv_scanner_deinit(CSVScanner *pstate);
 
 #endif
@@ -23,6 +23,7 @@
 #include "kv-scanner.h"
 #include "str-repr/decode.h"
 #include "str-repr/encode.h"
+#include "scratch-buffers.h"
 #include <string.h>
 
 static inline gboolean
@@ -39,7 +40,7 @@ _is_valid_key_character(gchar c)
 static inline const gchar *
 _locate_separator(KVScanner *self, const gchar *start)
 {
-  return strchr(start, self->value_separator);
+  return memchr(start, self->value_separator, self->input + self->input_len - start);
 }
 
 static inline void
@@ -263,6 +264,7 @@ _decode_value(KVScanner *self)
     .match_delimiter = _match_delimiter,
     .match_delimiter_data = self,
     .delimiter_chars = { ' ', self->pair_separator[0], self->stop_char },
+    .input_end = self->input + self->input_len,
   };
 
   self->value_was_quoted = _is_quoted(input);
@@ -345,6 +347,25 @@ void kv_scanner_free_method(KVScanner *self)
   g_free(self->pair_separator);
 }
 
+/*
+ * Initializes @self to scan a single input in the current thread with the
+ * configuration of @src, without the allocations of kv_scanner_clone():
+ * the buffers are taken from the scratch buffers, so @self must not be
+ * freed and is only valid until those are reclaimed.
+ */
+void
+kv_scanner_init_transient(KVScanner *self, KVScanner *src)
+{
+  *self = *src;
+  self->key = scratch_buffers_alloc();
+  self->value = scratch_buffers_alloc();
+  self->decoded_value = scratch_buffers_alloc();
+  if (src->stray_words)
+    self->stray_words = scratch_buffers_alloc();
+  self->clone = NULL;
+  self->free_fn = NULL;
+}
+
 void
 kv_scanner_init_instance(KVScanner *self, gchar value_separator, const gchar *pair_separator,
                          gboolean extract_stray_words)
@@ -37,6 +37,7 @@ struct _KVScanner
 {
   const gchar *input;
   gsize input_pos;
+  gsize input_len;
   GString *key;
   GString *value;
   GString *decoded_value;
@@ -55,13 +56,16 @@ struct _KVScanner
 };
 
 void kv_scanner_init_instance(KVScanner *self, gchar value_separator, const gchar *pair_separator, gboolean extract_stray_words);
+void kv_scanner_init_transient(KVScanner *self, KVScanner *src);
 void kv_scanner_free_method(KVScanner *self);
 
+/* @input has to be NUL terminated, @input_len may be -1 to use its length */
 static inline void
-kv_scanner_input(KVScanner *self, const gchar *input)
+kv_scanner_input(KVScanner *self, const gchar *input, gssize input_len)
 {
   self->input = input;
   self->input_pos = 0;
+  self->input_len = input_len < 0 ? strlen(input) : input_len;
   if (self->stray_words)
     g_string_truncate(self->stray_words, 0);
 }
@@ -194,7 +194,7 @@ _expect_kvq_triplets(KVScanner *scanner, KVQContainer args, gchar **error)
     KVScanner *scanner = create_kv_scanner(SCANNER_config); \
     gchar *error = NULL; \
     \
-    kv_scanner_input(scanner, TEST_KV_SCAN_input);            \
+    kv_scanner_input(scanner, TEST_KV_SCAN_input, -1);        \
     if (!_expect_kvq_triplets(scanner, INIT_KVQCONTAINER(__VA_ARGS__), &error)) \
       { \
         cr_expect(FALSE, "%s", error); \
@@ -215,7 +215,7 @@ _expect_kvq_triplets(KVScanner *scanner, KVQContainer args, gchar **error)
     KVScanner *scanner = create_kv_scanner(TEST_KV_SCAN_config); \
     gchar *error = NULL; \
     \
-    kv_scanner_input(scanner, TEST_KV_SCAN_input);            \
+    kv_scanner_input(scanner, TEST_KV_SCAN_input, -1);        \
     if (!_expect_kv_pairs(scanner, INIT_KVCONTAINER(__VA_ARGS__), &error))  \
       { \
         cr_expect(FALSE, "%s", error); \
@@ -243,7 +243,7 @@ _expect_kvq_triplets(KVScanner *scanner, KVQContainer args, gchar **error)
       .extract_stray_words=TRUE})); \
     gchar *error = NULL; \
     \
-    kv_scanner_input(scanner, INPUT);            \
+    kv_scanner_input(scanner, INPUT, -1);        \
     if (!_expect_kv_pairs(scanner, INIT_KVCONTAINER(__VA_ARGS__), &error))  \
       { \
         cr_expect(FALSE, "%s", error); \
@@ -984,7 +984,7 @@ _test_performance(Testcase *tcs, gchar *title)
         {
           gchar *error = NULL;
 
-          kv_scanner_input(scanner, tc->input);
+          kv_scanner_input(scanner, tc->input, -1);
           if (!_expect_kv_pairs(scanner, tc->expected, &error))
             {
               cr_expect(FALSE, "%s", error);
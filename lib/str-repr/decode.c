@@ -22,6 +22,7 @@
  *
  */
 #include "str-repr/decode.h"
+#include "find-crlf.h"
 
 #include <string.h>
 
@@ -120,6 +121,41 @@ _match_and_skip_delimiter(StrReprDecodeState *state)
 }
 
 
+/* appends the current character and everything up to the next occurrence
+ * of @c1, @c2 or @c3, leaving state->cur at the last character appended */
+static void
+_append_span_until(StrReprDecodeState *state, gchar c1, gchar c2, gchar c3)
+{
+  const gchar *input_end = state->options->input_end;
+  const gchar *span_end;
+
+  if (!input_end)
+    {
+      g_string_append_c(state->value, *state->cur);
+      return;
+    }
+
+  span_end = (const gchar *) find_first_of3((const guchar *) state->cur + 1, input_end - (state->cur + 1), c1, c2, c3);
+  if (!span_end)
+    span_end = input_end;
+  g_string_append_len(state->value, state->cur, span_end - state->cur);
+  state->cur = span_end - 1;
+}
+
+static void
+_append_unquoted_characters(StrReprDecodeState *state)
+{
+  const StrReprDecodeOptions *options = state->options;
+
+  /* without delimiter_chars any character may be a delimiter */
+  if (!options->delimiter_chars[0])
+    {
+      g_string_append_c(state->value, *state->cur);
+      return;
+    }
+  _append_span_until(state, options->delimiter_chars[0], options->delimiter_chars[1], options->delimiter_chars[2]);
+}
+
 static gint
 _process_initial_character(StrReprDecodeState *state)
 {
@@ -134,7 +170,7 @@ _process_initial_character(StrReprDecodeState *state)
     }
   else
     {
-      g_string_append_c(state->value, *state->cur);
+      _append_unquoted_characters(state);
       return KV_UNQUOTED_CHARACTERS;
     }
 }
@@ -147,7 +183,7 @@ _process_quoted_string_characters(StrReprDecodeState *state)
   else if (*state->cur == '\\')
     return KV_QUOTE_BACKSLASH;
 
-  g_string_append_c(state->value, *state->cur);
+  _append_span_until(state, state->quote_char, '\\', state->quote_char);
   return KV_QUOTE_STRING;
 }
 
@@ -179,7 +215,7 @@ _process_unquoted_characters(StrReprDecodeState *state)
 {
   if (_match_and_skip_delimiter(state))
     return KV_FINISH_SUCCESS;
-  g_string_append_c(state->value, *state->cur);
+  _append_unquoted_characters(state);
   return KV_UNQUOTED_CHARACTERS;
 }
 
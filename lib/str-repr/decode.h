@@ -33,6 +33,9 @@ typedef struct _StrReprDecodeOptions
   MatchDelimiterFunc match_delimiter;
   gpointer match_delimiter_data;
   gchar delimiter_chars[3];
+  /* optional: the end of the input, if known, characters other than
+   * delimiter_chars, quotes and escapes are then skipped in bulk */
+  const gchar *input_end;
 } StrReprDecodeOptions;
 
 gboolean str_repr_decode(GString *value, const gchar *input, const gchar **end);
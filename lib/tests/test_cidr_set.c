@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "testutils.h"
+#include "cidr-set.h"
+
+#include <arpa/inet.h>
+
+static CIDRSet *
+_create_set(const gchar *networks[])
+{
+  CIDRSet *set = cidr_set_new();
+  gint i;
+
+  for (i = 0; networks[i]; i++)
+    assert_true(cidr_set_add(set, networks[i]), "Adding network failed: %s", networks[i]);
+  cidr_set_compile(set);
+  return set;
+}
+
+static void
+test_ipv4_networks(void)
+{
+  const gchar *networks[] = { "10.0.0.0/8", "192.168.1.0/24", "172.16.5.5", "1.2.3.4/255.255.255.252", NULL };
+  CIDRSet *set = _create_set(networks);
+
+  assert_true(cidr_set_contains(set, "10.0.0.0"), "network address should match");
+  assert_true(cidr_set_contains(set, "10.255.255.255"), "broadcast address should match");
+  assert_true(cidr_set_contains(set, "192.168.1.77"), "address in network should match");
+  assert_true(cidr_set_contains(set, "172.16.5.5"), "host address should match");
+  assert_true(cidr_set_contains(set, "1.2.3.7"), "address in dotted netmask network should match");
+
+  assert_false(cidr_set_contains(set, "11.0.0.0"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "192.168.2.1"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "172.16.5.6"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "1.2.3.8"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "localhost"), "hostname should not match");
+  assert_false(cidr_set_contains(set, ""), "empty string should not match");
+
+  cidr_set_free(set);
+}
+
+static void
+test_overlapping_networks_are_merged(void)
+{
+  const gchar *networks[] = { "10.1.0.0/16", "10.0.0.0/8", "10.2.3.4", "11.0.0.0/8", "12.0.0.1", NULL };
+  CIDRSet *set = _create_set(networks);
+
+  assert_gint(cidr_set_get_size(set), 2, "overlapping and adjacent networks should be merged");
+  assert_true(cidr_set_contains(set, "10.1.2.3"), "address in merged network should match");
+  assert_true(cidr_set_contains(set, "11.200.0.1"), "address in merged network should match");
+  assert_true(cidr_set_contains(set, "12.0.0.1"), "host address should match");
+  assert_false(cidr_set_contains(set, "12.0.0.0"), "address outside of networks should not match");
+
+  cidr_set_free(set);
+}
+
+static void
+test_large_ipv4_set(void)
+{
+  CIDRSet *set = cidr_set_new();
+  gchar network[32];
+  gint i;
+
+  for (i = 0; i < 200; i++)
+    {
+      g_snprintf(network, sizeof(network), "10.%d.0.0/24", i);
+      assert_true(cidr_set_add(set, network), "Adding network failed: %s", network);
+    }
+  assert_true(cidr_set_add(set, "0.0.0.0/32"), "Adding network failed");
+  assert_true(cidr_set_add(set, "255.255.255.255"), "Adding network failed");
+  cidr_set_compile(set);
+
+  assert_true(cidr_set_contains(set, "10.0.0.1"), "address in first network should match");
+  assert_true(cidr_set_contains(set, "10.5.0.7"), "address in network should match");
+  assert_true(cidr_set_contains(set, "10.199.0.255"), "address in last network should match");
+  assert_true(cidr_set_contains(set, "0.0.0.0"), "lowest address should match");
+  assert_true(cidr_set_contains(set, "255.255.255.255"), "highest address should match");
+  assert_false(cidr_set_contains(set, "10.5.1.0"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "10.200.0.1"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "9.255.255.255"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "0.0.0.1"), "address outside of networks should not match");
+
+  cidr_set_free(set);
+}
+
+static void
+test_invalid_networks_are_rejected(void)
+{
+  CIDRSet *set = cidr_set_new();
+
+  assert_false(cidr_set_add(set, "foobar"), "invalid address should be rejected");
+  assert_false(cidr_set_add(set, "10.0.0.0/33"), "invalid prefix should be rejected");
+  assert_false(cidr_set_add(set, "10.0.0.0/"), "empty prefix should be rejected");
+  assert_false(cidr_set_add(set, "10.0.0.0/255.0.255.0"), "non-contiguous netmask should be rejected");
+  cidr_set_compile(set);
+  assert_gint(cidr_set_get_size(set), 0, "nothing should have been added");
+
+  cidr_set_free(set);
+}
+
+#if SYSLOG_NG_ENABLE_IPV6
+static void
+test_ipv6_networks(void)
+{
+  const gchar *networks[] = { "2001:db8::/32", "::1", "fe80::/10", "10.0.0.0/8", "::ffff:192.168.0.0/120", NULL };
+  CIDRSet *set = _create_set(networks);
+  GSockAddr *saddr;
+
+  assert_true(cidr_set_contains(set, "2001:db8:1:2::3"), "address in IPv6 network should match");
+  assert_true(cidr_set_contains(set, "::1"), "IPv6 host address should match");
+  assert_true(cidr_set_contains(set, "febf:ffff::1"), "address in IPv6 network should match");
+  assert_true(cidr_set_contains(set, "::ffff:10.1.2.3"), "IPv4-mapped address should match IPv4 network");
+  assert_true(cidr_set_contains(set, "192.168.0.5"), "IPv4 address should match IPv4-mapped network");
+  assert_false(cidr_set_contains(set, "192.168.1.5"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "2001:db9::1"), "address outside of networks should not match");
+  assert_false(cidr_set_contains(set, "::2"), "address outside of networks should not match");
+
+  saddr = g_sockaddr_inet6_new("2001:db8::42", 514);
+  assert_true(cidr_set_contains_sockaddr(set, saddr), "IPv6 socket address should match");
+  g_sockaddr_unref(saddr);
+
+  cidr_set_free(set);
+}
+#endif
+
+static void
+test_sockaddr_lookup(void)
+{
+  const gchar *networks[] = { "192.168.0.0/16", NULL };
+  CIDRSet *set = _create_set(networks);
+  GSockAddr *saddr;
+
+  saddr = g_sockaddr_inet_new("192.168.10.1", 514);
+  assert_true(cidr_set_contains_sockaddr(set, saddr), "IPv4 socket address should match");
+  g_sockaddr_unref(saddr);
+
+  saddr = g_sockaddr_inet_new("192.169.10.1", 514);
+  assert_false(cidr_set_contains_sockaddr(set, saddr), "IPv4 socket address should not match");
+  g_sockaddr_unref(saddr);
+
+  cidr_set_free(set);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  test_ipv4_networks();
+  test_overlapping_networks_are_merged();
+  test_large_ipv4_set();
+  test_invalid_networks_are_rejected();
+#if SYSLOG_NG_ENABLE_IPV6
+  test_ipv6_networks();
+#endif
+  test_sockaddr_lookup();
+  return 0;
+}
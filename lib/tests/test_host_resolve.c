@@ -30,10 +30,12 @@
 #include "testutils.h"
 #include "apphook.h"
 #include "dnscache.h"
+#include "dnsresolver.h"
 #include "gsocket.h"
 #include "hostname.h"
 #include "cfg.h"
 #include <libgen.h>
+#include <arpa/inet.h>
 
 #define HOST_RESOLVE_TESTCASE(x, ...) do { host_resolve_testcase_begin(domain_override, #x, #__VA_ARGS__); x(__VA_ARGS__); host_resolve_testcase_end(); } while(0)
 
@@ -222,6 +224,71 @@ test_sockaddr_without_dns_resolution_results_in_ip(void)
   }
 }
 
+static void
+set_dns_resolver_threads(gint num_threads, gint timeout)
+{
+  DNSCacheOptions dns_cache_options;
+
+  dns_cache_options_defaults(&dns_cache_options);
+  dns_cache_options.resolver_threads = num_threads;
+  dns_cache_options.resolver_timeout = timeout;
+  dns_resolver_update_options(&dns_cache_options);
+  dns_cache_options_destroy(&dns_cache_options);
+}
+
+static void
+test_resolvable_ip_results_in_hostname_with_resolver_threads(void)
+{
+  set_dns_resolver_threads(2, 10000);
+  test_resolvable_ip_results_in_hostname();
+  set_dns_resolver_threads(0, 0);
+}
+
+static void
+test_sockaddr_without_dns_resolution_results_in_ip_with_resolver_threads(void)
+{
+  set_dns_resolver_threads(2, 10000);
+  test_sockaddr_without_dns_resolution_results_in_ip();
+  set_dns_resolver_threads(0, 0);
+}
+
+static void
+set_dns_cache_shared(gboolean shared)
+{
+  DNSCacheOptions dns_cache_options;
+
+  dns_cache_options_defaults(&dns_cache_options);
+  dns_cache_options.shared = shared;
+  dns_caching_update_options(&dns_cache_options);
+  dns_cache_options_destroy(&dns_cache_options);
+}
+
+/* the shared cache is filled by the resolver thread, not by the caller */
+static void
+test_resolver_threads_store_into_the_shared_dns_cache(void)
+{
+  struct in_addr addr;
+  const gchar *hostname;
+  gsize hostname_len;
+  gboolean positive = FALSE;
+
+  set_dns_cache_shared(TRUE);
+  set_dns_resolver_threads(2, 10000);
+
+  host_resolve_options.use_dns = TRUE;
+  host_resolve_options.use_dns_cache = TRUE;
+  assert_ip_to_fqdn_hostname("198.41.0.4", "a.root-servers.net");
+
+  inet_aton("198.41.0.4", &addr);
+  assert_true(dns_caching_lookup(AF_INET, &addr, &hostname, &hostname_len, &positive),
+              "resolved name was not stored into the shared DNS cache");
+  assert_true(positive, "resolved name was stored as a failed lookup");
+  assert_nstring(hostname, hostname_len, "a.root-servers.net", -1, "shared DNS cache entry mismatch");
+
+  set_dns_resolver_threads(0, 0);
+  set_dns_cache_shared(FALSE);
+}
+
 static void
 test_unix_domain_sockaddr_results_in_the_local_hostname(void)
 {
@@ -239,6 +306,9 @@ test_resolve_sockaddr_to_hostname(void)
   HOST_RESOLVE_TESTCASE(test_resolvable_ip_results_in_hostname);
   HOST_RESOLVE_TESTCASE(test_unresolvable_ip_results_in_ip);
   HOST_RESOLVE_TESTCASE(test_sockaddr_without_dns_resolution_results_in_ip);
+  HOST_RESOLVE_TESTCASE(test_resolvable_ip_results_in_hostname_with_resolver_threads);
+  HOST_RESOLVE_TESTCASE(test_sockaddr_without_dns_resolution_results_in_ip_with_resolver_threads);
+  HOST_RESOLVE_TESTCASE(test_resolver_threads_store_into_the_shared_dns_cache);
   HOST_RESOLVE_TESTCASE(test_unix_domain_sockaddr_results_in_the_local_hostname);
 }
 
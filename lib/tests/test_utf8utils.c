@@ -72,6 +72,12 @@ assert_escaped_text(const gchar *str, const gchar *expected_escaped_str)
   assert_escaped_text_with_unsafe_chars(str, expected_escaped_str, NULL);
 }
 
+void
+assert_utf8_validate(const gchar *str, gssize str_len, gboolean expected)
+{
+  assert_gboolean(utf8_validate(str, str_len), expected, "utf8_validate() result mismatch, str=%s", str);
+}
+
 int
 main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 {
@@ -106,5 +112,26 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"text\\\"", "\"");
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"te\\xt\\\"", "\"x");
 
+  /* long enough to be processed in blocks */
+  assert_escaped_text("0123456789abcdef0123456789abcdef0123456789",
+                      "0123456789abcdef0123456789abcdef0123456789");
+  assert_escaped_text("0123456789abcde\n0123456789abcdef\x7fáé\xad""0123456789abcdef",
+                      "0123456789abcde\\n0123456789abcdef\x7fáé\\\\xad0123456789abcdef");
+  assert_escaped_text("0123456789abcdef\t0123456789abcdef\x01", "0123456789abcdef\\t0123456789abcdef\\u0001");
+  assert_escaped_text_with_unsafe_chars("key=\"0123456789abcdef0123456789\" other='value'",
+                                        "key=\\\"0123456789abcdef0123456789\\\" other=\\'value\\'", "\"'");
+  assert_escaped_text_with_unsafe_chars("key=\"0123456789abcdef0123456789\" other='value'",
+                                        "key\\=\\\"0123456789abcdef0123456789\\\" other\\=\\'value\\'", "\"'=");
+  assert_escaped_binary_with_len("0123456789abcdef0123456789\xc3""\xa1", 27, "0123456789abcdef0123456789\\xc3");
+
+  assert_utf8_validate("", -1, TRUE);
+  assert_utf8_validate("árvíztűrőtükörfúrógép", -1, TRUE);
+  assert_utf8_validate("0123456789abcdef0123456789abcdef árvíztűrőtükörfúrógép 0123456789abcdef", -1, TRUE);
+  assert_utf8_validate("0123456789abcdef0123456789abcdef\xad""0123456789abcdef", -1, FALSE);
+  assert_utf8_validate("0123456789abcdef0123456789abcdef\xc3", -1, FALSE);
+  assert_utf8_validate("0123456789abcdef\xc3\xa1", 17, FALSE);
+  assert_utf8_validate("0123456789abcdef\xc3\xa1", 18, TRUE);
+  assert_utf8_validate("0123456789abcdef0123\0", 21, FALSE);
+
   return 0;
 }
@@ -29,6 +29,7 @@
 #include "pathutils.h"
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <iv.h>
 
@@ -77,6 +78,29 @@ typedef struct _TimeCache
   struct tm tm;
 } TimeCache;
 
+/*
+ * A period of time during which the local zone offset doesn't change, so
+ * local time can be calculated with plain arithmetic instead of calling
+ * localtime() and mktime().  The periods come from the transitions of the
+ * local time zone file, or if it is not available (e.g. TZ is a POSIX
+ * rule), from probing libc a few days around the time converted.  @tm
+ * holds a libc conversion from the period, used to fill the fields that
+ * are not computed (tm_isdst, tm_gmtoff, tm_zone).
+ */
+typedef struct _LocalTimePeriod
+{
+  gint64 start;
+  gint64 end;
+  glong gmtoff;
+  struct tm tm;
+} LocalTimePeriod;
+
+#define LOCAL_TIME_PROBE_RANGE (2 * 86400)
+
+/* local times closer than this to the edges of a period may be ambiguous
+ * or nonexistent, those are left to mktime() */
+#define LOCAL_TIME_MKTIME_MARGIN 86400
+
 static const gchar *
 get_time_zone_basedir(void)
 {
@@ -96,7 +120,9 @@ TLS_BLOCK_START
 {
   GTimeVal current_time_value;
   struct iv_task invalidate_time_task;
-  TimeCache local_time_cache[64];
+  LocalTimePeriod local_time_period;
+  TimeZoneInfo *local_time_zone_info;
+  gboolean local_time_zone_info_loaded;
   TimeCache gm_time_cache[64];
   struct tm mktime_prev_tm;
   time_t mktime_prev_time;
@@ -105,7 +131,9 @@ TLS_BLOCK_END;
 
 #define current_time_value   __tls_deref(current_time_value)
 #define invalidate_time_task __tls_deref(invalidate_time_task)
-#define local_time_cache     __tls_deref(local_time_cache)
+#define local_time_period    __tls_deref(local_time_period)
+#define local_time_zone_info __tls_deref(local_time_zone_info)
+#define local_time_zone_info_loaded __tls_deref(local_time_zone_info_loaded)
 #define gm_time_cache        __tls_deref(gm_time_cache)
 #define mktime_prev_tm       __tls_deref(mktime_prev_tm)
 #define mktime_prev_time     __tls_deref(mktime_prev_time)
@@ -114,6 +142,10 @@ TLS_BLOCK_END;
 static GStaticMutex localtime_lock = G_STATIC_MUTEX_INIT;
 #endif
 
+static TimeZoneInfo *time_zone_info_load_local(void);
+static gboolean time_zone_info_get_period(const TimeZoneInfo *self, gint64 timestamp,
+                                          gint64 *start, gint64 *end, glong *gmtoff);
+
 void
 invalidate_cached_time(void)
 {
@@ -158,6 +190,164 @@ cached_g_current_time_sec()
   return now.tv_sec;
 }
 
+static inline gint64
+_floor_div(gint64 a, gint64 b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+/* days since the epoch of a proleptic Gregorian date, month is 1-12 */
+static gint64
+_days_from_civil(gint64 year, gint month, gint mday)
+{
+  gint64 era, yoe, doy, doe;
+
+  year -= month <= 2;
+  era = _floor_div(year, 400);
+  yoe = year - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/* seconds since the epoch of the broken down time, as if it was UTC,
+ * out of range fields are normalized the same way as mktime() does */
+static gint64
+_seconds_from_tm(const struct tm *tm)
+{
+  gint64 year = (gint64) tm->tm_year + 1900 + _floor_div(tm->tm_mon, 12);
+  gint month = tm->tm_mon - _floor_div(tm->tm_mon, 12) * 12;
+  gint64 days = _days_from_civil(year, month + 1, 1) + tm->tm_mday - 1;
+
+  return days * 86400 + tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+}
+
+/* the inverse of _seconds_from_tm(), only touches the calendar fields */
+static void
+_seconds_to_tm(gint64 seconds, struct tm *tm)
+{
+  gint64 days = _floor_div(seconds, 86400);
+  gint64 secs = seconds - days * 86400;
+  gint64 z, era, doe, yoe, doy, mp, year;
+  gint month;
+
+  tm->tm_hour = secs / 3600;
+  tm->tm_min = (secs % 3600) / 60;
+  tm->tm_sec = secs % 60;
+  tm->tm_wday = (gint) (days - _floor_div(days + 4, 7) * 7 + 4);
+
+  z = days + 719468;
+  era = _floor_div(z, 146097);
+  doe = z - era * 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yoe + era * 400 + (month <= 2);
+
+  tm->tm_mday = doy - (153 * mp + 2) / 5 + 1;
+  tm->tm_mon = month - 1;
+  tm->tm_year = year - 1900;
+  tm->tm_yday = days - _days_from_civil(year, 1, 1);
+}
+
+static void
+_libc_localtime(time_t when, struct tm *tm)
+{
+#ifdef SYSLOG_NG_HAVE_LOCALTIME_R
+  localtime_r(&when, tm);
+#else
+  struct tm *ltm;
+
+  g_static_mutex_lock(&localtime_lock);
+  ltm = localtime(&when);
+  *tm = *ltm;
+  g_static_mutex_unlock(&localtime_lock);
+#endif
+}
+
+static glong
+_libc_local_gmtoff(time_t when)
+{
+  struct tm tm;
+
+  _libc_localtime(when, &tm);
+  return _seconds_from_tm(&tm) - when;
+}
+
+static inline gboolean
+_local_time_period_contains(const LocalTimePeriod *period, gint64 when)
+{
+  return when >= period->start && when < period->end;
+}
+
+static void
+_local_time_period_convert(const LocalTimePeriod *period, gint64 when, struct tm *tm)
+{
+  *tm = period->tm;
+  _seconds_to_tm(when + period->gmtoff, tm);
+}
+
+/* @tm is the libc conversion of @when, start a new period around it */
+static void
+_local_time_period_update(time_t when, const struct tm *tm)
+{
+  LocalTimePeriod *period = &local_time_period;
+  glong gmtoff = _seconds_from_tm(tm) - when;
+  glong zone_gmtoff;
+  gint64 start, end;
+
+  period->start = period->end = 0;
+
+  if (!local_time_zone_info_loaded)
+    {
+      local_time_zone_info = time_zone_info_load_local();
+      local_time_zone_info_loaded = TRUE;
+    }
+
+  if (local_time_zone_info &&
+      time_zone_info_get_period(local_time_zone_info, when, &start, &end, &zone_gmtoff))
+    {
+      if (zone_gmtoff == gmtoff)
+        goto found;
+
+      /* the zone file doesn't describe what libc uses, don't use it anymore */
+      time_zone_info_free(local_time_zone_info);
+      local_time_zone_info = NULL;
+    }
+
+  start = (gint64) when - LOCAL_TIME_PROBE_RANGE;
+  end = (gint64) when + LOCAL_TIME_PROBE_RANGE;
+  if (_libc_local_gmtoff(start) != gmtoff || _libc_local_gmtoff(end) != gmtoff)
+    return;
+
+found:
+  period->start = start;
+  period->end = end;
+  period->gmtoff = gmtoff;
+  period->tm = *tm;
+}
+
+static gboolean
+_local_time_period_mktime(struct tm *tm, time_t *result)
+{
+  LocalTimePeriod *period = &local_time_period;
+  gint64 when;
+
+  if (period->start == period->end)
+    return FALSE;
+  if (tm->tm_isdst >= 0 && tm->tm_isdst != period->tm.tm_isdst)
+    return FALSE;
+
+  when = _seconds_from_tm(tm) - period->gmtoff;
+  if (when < period->start + LOCAL_TIME_MKTIME_MARGIN || when >= period->end - LOCAL_TIME_MKTIME_MARGIN)
+    return FALSE;
+
+  _local_time_period_convert(period, when, tm);
+  *result = (time_t) when;
+  return TRUE;
+}
+
 time_t
 cached_mktime(struct tm *tm)
 {
@@ -173,7 +363,13 @@ cached_mktime(struct tm *tm)
       result = mktime_prev_time;
       return result;
     }
-  result = mktime(tm);
+  if (!_local_time_period_mktime(tm, &result))
+    {
+      result = mktime(tm);
+      /* mktime() normalized @tm to the local time of result */
+      if (result != (time_t) -1)
+        _local_time_period_update(result, tm);
+    }
   mktime_prev_tm = *tm;
   mktime_prev_time = result;
   return result;
@@ -182,29 +378,14 @@ cached_mktime(struct tm *tm)
 void
 cached_localtime(time_t *when, struct tm *tm)
 {
-  guchar i = 0;
-
-  i = *when & 0x3F;
-  if (G_LIKELY(*when == local_time_cache[i].when))
+  if (G_LIKELY(_local_time_period_contains(&local_time_period, *when)))
     {
-      *tm = local_time_cache[i].tm;
+      _local_time_period_convert(&local_time_period, *when, tm);
       return;
     }
-  else
-    {
-#ifdef SYSLOG_NG_HAVE_LOCALTIME_R
-      localtime_r(when, tm);
-#else
-      struct tm *ltm;
 
-      g_static_mutex_lock(&localtime_lock);
-      ltm = localtime(when);
-      *tm = *ltm;
-      g_static_mutex_unlock(&localtime_lock);
-#endif
-      local_time_cache[i].tm = *tm;
-      local_time_cache[i].when = *when;
-    }
+  _libc_localtime(*when, tm);
+  _local_time_period_update(*when, tm);
 }
 
 void
@@ -245,6 +426,9 @@ cached_gmtime(time_t *when, struct tm *tm)
 long
 get_local_timezone_ofs(time_t when)
 {
+  if (G_LIKELY(_local_time_period_contains(&local_time_period, when)))
+    return local_time_period.gmtoff;
+
 #ifdef SYSLOG_NG_HAVE_STRUCT_TM_TM_GMTOFF
   struct tm ltm;
 
@@ -278,7 +462,20 @@ void
 clean_time_cache(void)
 {
   memset(&gm_time_cache, 0, sizeof(gm_time_cache));
-  memset(&local_time_cache, 0, sizeof(local_time_cache));
+  memset(&local_time_period, 0, sizeof(local_time_period));
+  memset(&mktime_prev_tm, 0, sizeof(mktime_prev_tm));
+
+  /* reloaded on the next conversion, as TZ may have changed */
+  if (local_time_zone_info)
+    time_zone_info_free(local_time_zone_info);
+  local_time_zone_info = NULL;
+  local_time_zone_info_loaded = FALSE;
+}
+
+void
+timeutils_thread_deinit(void)
+{
+  clean_time_cache();
 }
 
 int
@@ -783,12 +980,12 @@ zone_info_parser(unsigned char **input, gboolean is64bitData, gint *version)
   /* http://osdir.com/ml/time.tz/2006-02/msg00041.html */
   /* We dont nead this flags to compute the wall time of the timezone*/
 
-  /* Ignore isstd flags */
-  for (i=0; i<typecnt; i++)
+  /* Ignore isstd flags, there may be none of them */
+  for (i=0; i<isdstcnt; i++)
     readbool(input);
 
-  /* Ignore isgmt flags */
-  for (i=0; i<typecnt; i++)
+  /* Ignore isgmt flags, there may be none of them */
+  for (i=0; i<isgmtcnt; i++)
     readbool(input);
 
 error:
@@ -827,11 +1024,39 @@ zone_info_get_offset(ZoneInfo *self, gint64 timestamp)
   return self->transitions[self->last_transitions_index].gmtoffset;
 }
 
+/* finds the period between two transitions containing @timestamp, the
+ * period after the last transition is open ended and is not reported */
 static gboolean
-zone_info_read(const gchar *zonename, ZoneInfo **zone, ZoneInfo **zone64)
+zone_info_get_period(ZoneInfo *self, gint64 timestamp, gint64 *start, gint64 *end, glong *gmtoff)
+{
+  gint64 lo, hi, mid;
+
+  if (!self->transitions || self->timecnt < 2 ||
+      timestamp < self->transitions[0].time ||
+      timestamp >= self->transitions[self->timecnt - 1].time)
+    return FALSE;
+
+  lo = 0;
+  hi = self->timecnt - 1;
+  while (hi - lo > 1)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (self->transitions[mid].time <= timestamp)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  *start = self->transitions[lo].time;
+  *end = self->transitions[hi].time;
+  *gmtoff = self->transitions[lo].gmtoffset;
+  return TRUE;
+}
+
+static gboolean
+zone_info_read_file(const gchar *filename, ZoneInfo **zone, ZoneInfo **zone64)
 {
   unsigned char *buff = NULL;
-  gchar *filename = NULL;
   int byte_read = 0;
   int version;
   GError *error = NULL;
@@ -840,15 +1065,12 @@ zone_info_read(const gchar *zonename, ZoneInfo **zone, ZoneInfo **zone64)
   *zone = NULL;
   *zone64 = NULL;
 
-  filename = g_build_path(G_DIR_SEPARATOR_S, get_time_zone_basedir(), zonename, NULL);
-
   file_map = g_mapped_file_new(filename, FALSE, &error);
   if (!file_map)
     {
       msg_error("Failed to open the time zone file", evt_tag_str("filename", filename), evt_tag_str("message",
                 error->message));
       g_error_free(error);
-      g_free(filename);
       return FALSE;
     }
 
@@ -859,7 +1081,6 @@ zone_info_read(const gchar *zonename, ZoneInfo **zone, ZoneInfo **zone64)
     {
       msg_error("Failed to read the time zone file", evt_tag_str("filename", filename));
       g_mapped_file_unref(file_map);
-      g_free(filename);
       return FALSE;
     }
 
@@ -872,10 +1093,21 @@ zone_info_read(const gchar *zonename, ZoneInfo **zone, ZoneInfo **zone64)
     }
 
   g_mapped_file_unref(file_map);
-  g_free(filename);
   return *zone != NULL || *zone64 != NULL;
 }
 
+static gboolean
+zone_info_read(const gchar *zonename, ZoneInfo **zone, ZoneInfo **zone64)
+{
+  gchar *filename;
+  gboolean result;
+
+  filename = g_build_path(G_DIR_SEPARATOR_S, get_time_zone_basedir(), zonename, NULL);
+  result = zone_info_read_file(filename, zone, zone64);
+  g_free(filename);
+  return result;
+}
+
 gint32
 time_zone_info_get_offset(const TimeZoneInfo *self, time_t stamp)
 {
@@ -894,6 +1126,58 @@ time_zone_info_get_offset(const TimeZoneInfo *self, time_t stamp)
   return -1;
 }
 
+static gboolean
+time_zone_info_get_period(const TimeZoneInfo *self, gint64 timestamp, gint64 *start, gint64 *end, glong *gmtoff)
+{
+  if (self->zone64)
+    return zone_info_get_period(self->zone64, timestamp, start, end, gmtoff);
+  if (self->zone)
+    return zone_info_get_period(self->zone, timestamp, start, end, gmtoff);
+  return FALSE;
+}
+
+/*
+ * Loads the zone file libc uses for local time, that is the one named by
+ * TZ, or /etc/localtime if TZ is not set.  Returns NULL if TZ doesn't name
+ * a file (e.g. it is a POSIX rule).
+ */
+static TimeZoneInfo *
+time_zone_info_load_local(void)
+{
+  const gchar *tz = getenv("TZ");
+  TimeZoneInfo *self = NULL;
+  gchar *filename;
+
+  if (!tz)
+    {
+      filename = g_strdup("/etc/localtime");
+    }
+  else
+    {
+      if (*tz == ':')
+        tz++;
+      if (!*tz)
+        return NULL;
+      if (g_path_is_absolute(tz))
+        filename = g_strdup(tz);
+      else
+        filename = g_build_path(G_DIR_SEPARATOR_S, get_time_zone_basedir(), tz, NULL);
+    }
+
+  if (g_file_test(filename, G_FILE_TEST_IS_REGULAR))
+    {
+      self = g_new0(TimeZoneInfo, 1);
+      self->zone_offset = -1;
+      if (!zone_info_read_file(filename, &self->zone, &self->zone64))
+        {
+          time_zone_info_free(self);
+          self = NULL;
+        }
+    }
+  g_free(filename);
+  return self;
+}
+
 TimeZoneInfo *
 time_zone_info_new(const gchar *tz)
 {
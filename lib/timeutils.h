@@ -34,6 +34,7 @@ void cached_gmtime(time_t *when, struct tm *tm);
 
 long get_local_timezone_ofs(time_t when);
 void clean_time_cache(void);
+void timeutils_thread_deinit(void);
 
 
 void invalidate_cached_time(void);
@@ -24,6 +24,111 @@
 #include "utf8utils.h"
 #include "str-utils.h"
 
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8UTILS_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* characters that _find_first_special_byte() checks for in addition to
+ * control characters, non-ASCII bytes and backslash */
+typedef struct _SpecialBytes
+{
+  gboolean vectorized;
+  guchar c1, c2;
+  const gchar *unsafe_chars;
+} SpecialBytes;
+
+static inline void
+_special_bytes_init(SpecialBytes *self, const gchar *unsafe_chars)
+{
+  self->unsafe_chars = unsafe_chars;
+  self->c1 = self->c2 = '\\';
+  self->vectorized = TRUE;
+
+  if (!unsafe_chars || !unsafe_chars[0])
+    return;
+
+  self->c1 = unsafe_chars[0];
+  if (!unsafe_chars[1])
+    return;
+
+  self->c2 = unsafe_chars[1];
+  if (unsafe_chars[2])
+    self->vectorized = FALSE;
+}
+
+static inline gboolean
+_is_special_byte(guchar c, const SpecialBytes *special)
+{
+  if (c < 0x20 || c >= 0x80 || c == '\\')
+    return TRUE;
+  return special->unsafe_chars && strchr(special->unsafe_chars, c) != NULL;
+}
+
+/*
+ * Returns the first byte in [s, end) that can't be copied to the output
+ * verbatim without looking at it more closely: control characters, bytes
+ * of multibyte (or invalid) sequences, backslash and unsafe characters.
+ * Returns end if there's no such byte.
+ */
+static const gchar *
+_find_first_special_byte(const gchar *s, const gchar *end, const SpecialBytes *special)
+{
+#if UTF8UTILS_HAVE_SSE2
+  if (special->vectorized)
+    {
+      const __m128i space = _mm_set1_epi8(0x20);
+      const __m128i backslash = _mm_set1_epi8('\\');
+      const __m128i v1 = _mm_set1_epi8((gchar) special->c1);
+      const __m128i v2 = _mm_set1_epi8((gchar) special->c2);
+
+      while (end - s >= (gssize) sizeof(__m128i))
+        {
+          __m128i chunk = _mm_loadu_si128((const __m128i *) s);
+
+          /* the comparison is signed, so bytes >= 0x80 are below 0x20 too */
+          __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi8(chunk, space),
+                                                   _mm_cmpeq_epi8(chunk, backslash)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(chunk, v1),
+                                                   _mm_cmpeq_epi8(chunk, v2)));
+          guint32 mask = (guint32) _mm_movemask_epi8(hits);
+
+          if (mask)
+            return s + __builtin_ctz(mask);
+          s += sizeof(__m128i);
+        }
+    }
+#endif
+
+  while (s < end && !_is_special_byte(*(const guchar *) s, special))
+    s++;
+  return s;
+}
+
+/*
+ * Returns the end of the longest prefix of [s, end) that is reproduced as
+ * is by the escaping functions: printable ASCII characters which are not
+ * unsafe and valid multibyte UTF-8 characters.
+ */
+static const gchar *
+_find_end_of_verbatim_run(const gchar *s, const gchar *end, const SpecialBytes *special)
+{
+  while (s < end)
+    {
+      s = _find_first_special_byte(s, end, special);
+      if (s == end || *(const guchar *) s < 0x80)
+        break;
+
+      gunichar uchar = g_utf8_get_char_validated(s, end - s);
+      if (uchar == (gunichar) -1 || uchar == (gunichar) -2)
+        break;
+      s = g_utf8_next_char(s);
+    }
+  return s;
+}
+
 static inline gboolean
 _is_character_unsafe(gunichar uchar, const gchar *unsafe_chars)
 {
@@ -117,10 +222,23 @@ _append_unsafe_utf8_as_escaped_with_specific_length(GString *escaped_output, con
                                                     const gchar *invalid_format)
 {
   const gchar *raw_end = raw + raw_len;
+  SpecialBytes special;
 
+  _special_bytes_init(&special, unsafe_chars);
   while (raw < raw_end)
-    _append_escaped_utf8_character(escaped_output, &raw, raw_end - raw, unsafe_chars,
-                                   control_format, invalid_format);
+    {
+      const gchar *run_end = _find_end_of_verbatim_run(raw, raw_end, &special);
+
+      if (run_end != raw)
+        {
+          g_string_append_len(escaped_output, raw, run_end - raw);
+          raw = run_end;
+          if (raw == raw_end)
+            break;
+        }
+      _append_escaped_utf8_character(escaped_output, &raw, raw_end - raw, unsafe_chars,
+                                     control_format, invalid_format);
+    }
 }
 
 static void
@@ -230,3 +348,55 @@ convert_unsafe_utf8_to_escaped_text(const gchar *str, gssize str_len,
   append_unsafe_utf8_as_escaped_text(escaped_string, str, str_len, unsafe_chars);
   return g_string_free(escaped_string, FALSE);
 }
+
+/**
+ * Equivalent to g_utf8_validate() with an explicit length: returns TRUE if
+ * @str is valid UTF-8 without embedded NUL characters.  Runs of ASCII
+ * characters are checked 16 bytes at a time, only the multibyte sequences
+ * in between are validated by g_utf8_validate().  As none of the bytes of
+ * a multibyte sequence is ASCII, validating each run of non-ASCII bytes on
+ * its own gives the same result as validating the whole string.
+ */
+gboolean
+utf8_validate(const gchar *str, gssize str_len)
+{
+  if (str_len < 0)
+    str_len = strlen(str);
+
+  const gchar *end = str + str_len;
+
+  while (str < end)
+    {
+#if UTF8UTILS_HAVE_SSE2
+      const __m128i zero = _mm_setzero_si128();
+
+      while (end - str >= (gssize) sizeof(__m128i))
+        {
+          __m128i chunk = _mm_loadu_si128((const __m128i *) str);
+          guint32 mask = (guint32) _mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, zero)));
+
+          if (mask)
+            {
+              str += __builtin_ctz(mask);
+              break;
+            }
+          str += sizeof(__m128i);
+        }
+#endif
+      while (str < end && *(const guchar *) str < 0x80 && *str)
+        str++;
+
+      if (str == end)
+        break;
+      if (*str == 0)
+        return FALSE;
+
+      const gchar *run = str;
+
+      while (str < end && *(const guchar *) str >= 0x80)
+        str++;
+      if (!g_utf8_validate(run, str - run, NULL))
+        return FALSE;
+    }
+  return TRUE;
+}
@@ -36,4 +36,6 @@ void append_unsafe_utf8_as_escaped_text(GString *escaped_string, const gchar *st
 gchar *convert_unsafe_utf8_to_escaped_text(const gchar *str, gssize str_len,
                                            const gchar *unsafe_chars);
 
+gboolean utf8_validate(const gchar *str, gssize str_len);
+
 #endif
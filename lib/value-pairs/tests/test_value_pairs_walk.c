@@ -128,6 +128,215 @@ test_value_pairs_walk_prefix_data(GlobalConfig *cfg)
   log_msg_unref(msg);
 };
 
+static gboolean
+_trace_obj_start(const gchar *name,
+                 const gchar *prefix, gpointer *prefix_data,
+                 const gchar *prev, gpointer *prev_data,
+                 gpointer user_data)
+{
+  GString *trace = (GString *) user_data;
+
+  if (name)
+    g_string_append_printf(trace, "%s[%s]", name, prefix);
+  g_string_append_c(trace, '{');
+  return FALSE;
+}
+
+static gboolean
+_trace_obj_end(const gchar *name,
+               const gchar *prefix, gpointer *prefix_data,
+               const gchar *prev, gpointer *prev_data,
+               gpointer user_data)
+{
+  GString *trace = (GString *) user_data;
+
+  g_string_append_c(trace, '}');
+  return FALSE;
+}
+
+static gboolean
+_trace_value(const gchar *name, const gchar *prefix,
+             TypeHint type, const gchar *value, gsize value_len,
+             gpointer *prefix_data, gpointer user_data)
+{
+  GString *trace = (GString *) user_data;
+
+  g_string_append_printf(trace, "%s=%.*s,", name, (gint) value_len, value);
+  return FALSE;
+}
+
+/* containers are traced as key[prefix]{...}, values as key=value, */
+static void
+assert_walk_trace(ValuePairs *vp, LogMessage *msg, const gchar *expected)
+{
+  GString *trace = g_string_new("");
+
+  value_pairs_walk(vp, _trace_obj_start, _trace_value, _trace_obj_end, msg, 0, LTZ_LOCAL, &template_options, trace);
+  assert_string(trace->str, expected, "Unexpected value_pairs_walk() trace");
+  g_string_free(trace, TRUE);
+}
+
+static void
+_set_value(LogMessage *msg, const gchar *name, const gchar *value)
+{
+  log_msg_set_value_by_name(msg, name, value, -1);
+}
+
+void
+test_value_pairs_walk_special_names(void)
+{
+  ValuePairs *vp;
+  LogMessage *msg;
+
+  vp = value_pairs_new();
+  value_pairs_add_glob_pattern(vp, "w*", TRUE);
+  value_pairs_add_glob_pattern(vp, ".SDATA.*", TRUE);
+  msg = log_msg_new_empty();
+
+  _set_value(msg, "w.trailing.", "1");
+  _set_value(msg, "w.empty..key", "2");
+  _set_value(msg, "w..lead", "3");
+  _set_value(msg, "w.win@18372.4.fruit", "4");
+  _set_value(msg, "w.n@me.x", "5");
+  _set_value(msg, "w.id@1.2", "6");
+  _set_value(msg, "w.id@3.", "7");
+  _set_value(msg, ".SDATA.origin@18372.4.ip", "8");
+
+  assert_walk_trace(vp, msg,
+                    "{w[w]{"
+                    "win@18372.4[w.win@18372.4]{fruit=4,}"
+                    "trailing=1,"
+                    "n@me[w.n@me]{x=5,}"
+                    "id@3=7,"
+                    "id@1.2=6,"
+                    "empty[w.empty]{[w.empty.]{key=2,}}"
+                    "[w.]{lead=3,}"
+                    "}"
+                    "[]{SDATA[.SDATA]{origin@18372.4[.SDATA.origin@18372.4]{ip=8,}}}"
+                    "}");
+
+  value_pairs_unref(vp);
+  log_msg_unref(msg);
+}
+
+void
+test_value_pairs_walk_deep_nesting(void)
+{
+  ValuePairs *vp;
+  LogMessage *msg;
+  GString *name, *expected;
+  gint i;
+
+  vp = value_pairs_new();
+  value_pairs_add_glob_pattern(vp, "deep.*", TRUE);
+  value_pairs_add_glob_pattern(vp, "nest.*", TRUE);
+  msg = log_msg_new_empty();
+
+  _set_value(msg, "deep.a.b.c.d.e", "1");
+  _set_value(msg, "deep.a.b.x", "2");
+  _set_value(msg, "deep.a.y", "3");
+  _set_value(msg, "deep.z", "4");
+
+  assert_walk_trace(vp, msg,
+                    "{deep[deep]{z=4,a[deep.a]{y=3,b[deep.a.b]{x=2,c[deep.a.b.c]{d[deep.a.b.c.d]{e=1,}}}}}}");
+
+  /* the stack of containers grows as needed */
+  name = g_string_new("nest");
+  expected = g_string_new("{nest[nest]{");
+  for (i = 0; i < 64; i++)
+    {
+      g_string_append_printf(name, ".l%d", i);
+      g_string_append_printf(expected, "l%d[%s]{", i, name->str);
+    }
+  g_string_append(name, ".leaf");
+  g_string_append(expected, "leaf=1,");
+  for (i = 0; i < 64 + 2; i++)
+    g_string_append_c(expected, '}');
+
+  log_msg_unref(msg);
+  msg = log_msg_new_empty();
+  _set_value(msg, name->str, "1");
+  assert_walk_trace(vp, msg, expected->str);
+
+  g_string_free(name, TRUE);
+  g_string_free(expected, TRUE);
+  value_pairs_unref(vp);
+  log_msg_unref(msg);
+}
+
+void
+test_value_pairs_walk_name_cache_is_reset_on_change(void)
+{
+  ValuePairs *vp;
+  LogMessage *msg;
+  ValuePairsTransformSet *vpts;
+
+  vp = value_pairs_new();
+  value_pairs_add_glob_pattern(vp, "cache.*", TRUE);
+  msg = log_msg_new_empty();
+
+  _set_value(msg, "cache.a", "1");
+  _set_value(msg, "cache.b.c", "2");
+  _set_value(msg, ".cache.d", "3");
+
+  assert_walk_trace(vp, msg, "{cache[cache]{b[cache.b]{c=2,}a=1,}}");
+
+  value_pairs_add_scope(vp, "dot-nv-pairs");
+  assert_walk_trace(vp, msg, "{cache[cache]{b[cache.b]{c=2,}a=1,}[]{cache[.cache]{d=3,}}}");
+
+  value_pairs_add_glob_pattern(vp, "cache.b.*", FALSE);
+  assert_walk_trace(vp, msg, "{cache[cache]{a=1,}[]{cache[.cache]{d=3,}}}");
+
+  vpts = value_pairs_transform_set_new("*");
+  value_pairs_transform_set_add_func(vpts, value_pairs_new_transform_add_prefix("new."));
+  value_pairs_add_transforms(vp, vpts);
+  assert_walk_trace(vp, msg, "{new[new]{cache[new.cache]{a=1,}[new.]{cache[new..cache]{d=3,}}}}");
+
+  value_pairs_unref(vp);
+  log_msg_unref(msg);
+}
+
+void
+test_value_pairs_walk_repeated_exclude_and_rekey(void)
+{
+  ValuePairs *vp;
+  LogMessage *msg;
+  ValuePairsTransformSet *vpts;
+  gint i;
+
+  vp = value_pairs_new();
+  value_pairs_add_glob_pattern(vp, "fmt.*", TRUE);
+  value_pairs_add_glob_pattern(vp, "fmt.secret.*", FALSE);
+  vpts = value_pairs_transform_set_new("fmt.*");
+  value_pairs_transform_set_add_func(vpts, value_pairs_new_transform_replace_prefix("fmt.", "out."));
+  value_pairs_add_transforms(vp, vpts);
+
+  msg = log_msg_new_empty();
+  _set_value(msg, "fmt.host", "h");
+  _set_value(msg, "fmt.user.name", "u");
+  _set_value(msg, "fmt.user.id", "1");
+  _set_value(msg, "fmt.secret.key", "k");
+
+  for (i = 0; i < 3; i++)
+    assert_walk_trace(vp, msg, "{out[out]{user[out.user]{name=u,id=1,}host=h,}}");
+  log_msg_unref(msg);
+
+  /* same handles with different values, plus ones not seen yet */
+  msg = log_msg_new_empty();
+  _set_value(msg, "fmt.host", "h2");
+  _set_value(msg, "fmt.user.name", "u2");
+  _set_value(msg, "fmt.user.id", "2");
+  _set_value(msg, "fmt.user.group", "g");
+  _set_value(msg, "fmt.secret.key", "k2");
+  _set_value(msg, "fmt.secret.token", "t");
+
+  for (i = 0; i < 3; i++)
+    assert_walk_trace(vp, msg, "{out[out]{user[out.user]{name=u2,id=2,group=g,}host=h2,}}");
+
+  value_pairs_unref(vp);
+  log_msg_unref(msg);
+}
+
 int main()
 {
   app_startup();
@@ -138,5 +347,9 @@ int main()
   msg_format_options_init(&parse_options, configuration);
 
   test_value_pairs_walk_prefix_data(configuration);
+  test_value_pairs_walk_special_names();
+  test_value_pairs_walk_deep_nesting();
+  test_value_pairs_walk_name_cache_is_reset_on_change();
+  test_value_pairs_walk_repeated_exclude_and_rekey();
   app_shutdown();
 };
@@ -30,6 +30,7 @@
 #include "cfg-parser.h"
 #include "string-list.h"
 #include "scratch-buffers.h"
+#include "str-utils.h"
 #include "cfg.h"
 
 #include <ctype.h>
@@ -43,6 +44,8 @@ typedef struct
 typedef struct
 {
   gchar *name;
+  /* name with the transformations applied */
+  gchar *transformed_name;
   LogTemplate *template;
 } VPPairConf;
 
@@ -51,31 +54,46 @@ typedef struct
   /* we don't own any of the fields here, it is assumed that allocations are
    * managed by the caller */
 
-  GString *name;
+  const gchar *name;
   GString *value;
   TypeHint type_hint;
+
+  /* insertion order, the last one wins among values with the same name */
+  gint ndx;
 } VPResultValue;
 
 typedef struct
 {
-  GTree *result_tree;
-
-  /* array of VPResultValue instances */
-  GArray *values;
+  /* array of VPResultValue instances, stored in a scratch buffer */
+  GString *values;
 } VPResults;
 
+/* the transformed names of nv-pairs are cached in pages indexed by the
+ * NVHandle, handles above the cache size are transformed each time */
+#define VP_NVPAIR_NAME_PAGE_SIZE 256
+#define VP_NVPAIR_NAME_PAGES     256
+
 struct _ValuePairs
 {
   GAtomicCounter ref_cnt;
   GPtrArray *builtins;
+  /* transformed names of builtins, in the same order */
+  GPtrArray *builtin_names;
   GPtrArray *patterns;
   GPtrArray *vpairs;
   GPtrArray *transforms;
 
   /* guint32 as CfgFlagHandler only supports 32 bit integers */
   guint32 scopes;
+
+  /* pages of transformed nv-pair names, allocated and filled in lazily by
+   * whichever thread needs them first, vp_excluded_nvpair marks nv-pairs
+   * that are not included */
+  gchar **nvpair_names[VP_NVPAIR_NAME_PAGES];
 };
 
+static gchar vp_excluded_nvpair[] = "";
+
 typedef enum
 {
   VPS_NV_PAIRS        = 0x01,
@@ -178,6 +196,7 @@ vp_pair_conf_new(const gchar *key, LogTemplate *value)
   VPPairConf *p = g_new(VPPairConf, 1);
 
   p->name = g_strdup(key);
+  p->transformed_name = NULL;
   p->template = log_template_ref(value);
   return p;
 }
@@ -187,71 +206,87 @@ vp_pair_conf_free(VPPairConf *vpc)
 {
   log_template_unref(vpc->template);
   g_free(vpc->name);
+  g_free(vpc->transformed_name);
   g_free(vpc);
 }
 
 static void
-vp_result_value_init(VPResultValue *rv, GString *name, TypeHint type_hint, GString *value)
+vp_results_init(VPResults *results)
 {
-  rv->type_hint = type_hint;
-  rv->name = name;
-  rv->value = value;
+  results->values = scratch_buffers_alloc();
 }
 
-static void
-vp_results_init(VPResults *results, GCompareFunc compare_func)
+static guint
+vp_results_len(VPResults *results)
 {
-  results->values = g_array_sized_new(FALSE, FALSE, sizeof(VPResultValue), 16);
-  results->result_tree = g_tree_new_full((GCompareDataFunc) compare_func, NULL,
-                                         NULL, NULL);
+  return results->values->len / sizeof(VPResultValue);
 }
 
-static void
-vp_results_deinit(VPResults *results)
+static VPResultValue *
+vp_results_index(VPResults *results, guint ndx)
 {
-  g_tree_destroy(results->result_tree);
-  g_array_free(results->values, TRUE);
+  return &((VPResultValue *) results->values->str)[ndx];
 }
 
 static void
-vp_results_insert(VPResults *results, GString *name, TypeHint type_hint, GString *value)
+vp_results_insert(VPResults *results, const gchar *name, TypeHint type_hint, GString *value)
 {
-  VPResultValue *rv;
-  gint ndx = results->values->len;
+  VPResultValue rv;
 
-  g_array_set_size(results->values, ndx + 1);
-  rv = &g_array_index(results->values, VPResultValue, ndx);
-  vp_result_value_init(rv, name, type_hint, value);
-  /* GTree takes over ownership of name */
-  g_tree_insert(results->result_tree, name->str, GINT_TO_POINTER(ndx));
+  rv.name = name;
+  rv.value = value;
+  rv.type_hint = type_hint;
+  rv.ndx = vp_results_len(results);
+  g_string_append_len(results->values, (const gchar *) &rv, sizeof(rv));
 }
 
-static GString *
-vp_transform_apply (ValuePairs *vp, gchar *key)
+static gint
+vp_results_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
 {
-  gint i;
-  GString *result = scratch_buffers_alloc();
+  const VPResultValue *rv1 = (const VPResultValue *) a;
+  const VPResultValue *rv2 = (const VPResultValue *) b;
+  GCompareFunc compare_func = (GCompareFunc) user_data;
+  gint r;
 
-  g_string_assign(result, key);
+  r = compare_func(rv1->name, rv2->name);
+  if (r != 0)
+    return r;
+  return rv1->ndx - rv2->ndx;
+}
+
+static void
+vp_results_sort(VPResults *results, GCompareFunc compare_func)
+{
+  g_qsort_with_data(results->values->str, vp_results_len(results), sizeof(VPResultValue),
+                    vp_results_cmp, (gpointer) compare_func);
+}
 
-  if (vp->transforms->len == 0)
-    return result;
+static void
+vp_transform_apply(ValuePairs *vp, GString *key)
+{
+  gint i;
 
   for (i = 0; i < vp->transforms->len; i++)
     {
       ValuePairsTransformSet *t = (ValuePairsTransformSet *) g_ptr_array_index(vp->transforms, i);
 
-      value_pairs_transform_set_apply(t, result);
+      value_pairs_transform_set_apply(t, key);
     }
+}
 
-  return result;
+static gchar *
+vp_transform_name(ValuePairs *vp, const gchar *name)
+{
+  GString *result = g_string_new(name);
+
+  vp_transform_apply(vp, result);
+  return g_string_free(result, FALSE);
 }
 
 /* runs over the name-value pairs requested by the user (e.g. with value_pairs_add_pair) */
 static void
 vp_pairs_foreach(gpointer data, gpointer user_data)
 {
-  ValuePairs *vp = ((gpointer *)user_data)[0];
   LogMessage *msg = ((gpointer *)user_data)[2];
   gint32 seq_num = GPOINTER_TO_INT (((gpointer *)user_data)[3]);
   VPResults *results = ((gpointer *)user_data)[5];
@@ -264,20 +299,14 @@ vp_pairs_foreach(gpointer data, gpointer user_data)
                              template_options,
                              time_zone_mode, seq_num, NULL, sb);
 
-  vp_results_insert(results, vp_transform_apply(vp, vpc->name), vpc->template->type_hint, sb);
+  vp_results_insert(results, vpc->transformed_name, vpc->template->type_hint, sb);
 }
 
-/* runs over the LogMessage nv-pairs, and inserts them unless excluded */
 static gboolean
-vp_msg_nvpairs_foreach(NVHandle handle, gchar *name,
-                       const gchar *value, gssize value_len,
-                       gpointer user_data)
+vp_is_nvpair_included(ValuePairs *vp, NVHandle handle, const gchar *name)
 {
-  ValuePairs *vp = ((gpointer *)user_data)[0];
-  VPResults *results = ((gpointer *)user_data)[5];
   guint j;
   gboolean inc;
-  GString *sb;
 
   inc = (name[0] == '.' && (vp->scopes & VPS_DOT_NV_PAIRS)) ||
   (name[0] != '.' && (vp->scopes & VPS_NV_PAIRS)) ||
@@ -290,13 +319,101 @@ vp_msg_nvpairs_foreach(NVHandle handle, gchar *name,
         inc = vps->include;
     }
 
-  if (!inc)
+  return inc;
+}
+
+/* returns the transformed name of an nv-pair or NULL if it's excluded */
+static const gchar *
+vp_lookup_nvpair_name(ValuePairs *vp, NVHandle handle, const gchar *name)
+{
+  gchar **page;
+  gchar *cached;
+
+  if (handle >= VP_NVPAIR_NAME_PAGES * VP_NVPAIR_NAME_PAGE_SIZE)
+    {
+      GString *sb;
+
+      if (!vp_is_nvpair_included(vp, handle, name))
+        return NULL;
+
+      sb = scratch_buffers_alloc();
+      g_string_assign(sb, name);
+      vp_transform_apply(vp, sb);
+      return sb->str;
+    }
+
+  page = g_atomic_pointer_get(&vp->nvpair_names[handle / VP_NVPAIR_NAME_PAGE_SIZE]);
+  if (G_UNLIKELY(!page))
+    {
+      page = g_new0(gchar *, VP_NVPAIR_NAME_PAGE_SIZE);
+      if (!g_atomic_pointer_compare_and_exchange((gpointer *) &vp->nvpair_names[handle / VP_NVPAIR_NAME_PAGE_SIZE],
+                                                 NULL, page))
+        {
+          g_free(page);
+          page = g_atomic_pointer_get(&vp->nvpair_names[handle / VP_NVPAIR_NAME_PAGE_SIZE]);
+        }
+    }
+
+  cached = g_atomic_pointer_get(&page[handle % VP_NVPAIR_NAME_PAGE_SIZE]);
+  if (G_UNLIKELY(!cached))
+    {
+      if (vp_is_nvpair_included(vp, handle, name))
+        cached = vp_transform_name(vp, name);
+      else
+        cached = vp_excluded_nvpair;
+
+      if (!g_atomic_pointer_compare_and_exchange((gpointer *) &page[handle % VP_NVPAIR_NAME_PAGE_SIZE], NULL, cached))
+        {
+          if (cached != vp_excluded_nvpair)
+            g_free(cached);
+          cached = g_atomic_pointer_get(&page[handle % VP_NVPAIR_NAME_PAGE_SIZE]);
+        }
+    }
+
+  if (cached == vp_excluded_nvpair)
+    return NULL;
+  return cached;
+}
+
+static void
+vp_clear_nvpair_names(ValuePairs *vp)
+{
+  gint i, j;
+
+  for (i = 0; i < VP_NVPAIR_NAME_PAGES; i++)
+    {
+      if (!vp->nvpair_names[i])
+        continue;
+
+      for (j = 0; j < VP_NVPAIR_NAME_PAGE_SIZE; j++)
+        {
+          if (vp->nvpair_names[i][j] != vp_excluded_nvpair)
+            g_free(vp->nvpair_names[i][j]);
+        }
+      g_free(vp->nvpair_names[i]);
+      vp->nvpair_names[i] = NULL;
+    }
+}
+
+/* runs over the LogMessage nv-pairs, and inserts them unless excluded */
+static gboolean
+vp_msg_nvpairs_foreach(NVHandle handle, gchar *name,
+                       const gchar *value, gssize value_len,
+                       gpointer user_data)
+{
+  ValuePairs *vp = ((gpointer *)user_data)[0];
+  VPResults *results = ((gpointer *)user_data)[5];
+  const gchar *transformed_name;
+  GString *sb;
+
+  transformed_name = vp_lookup_nvpair_name(vp, handle, name);
+  if (!transformed_name)
     return FALSE;
 
   sb = scratch_buffers_alloc();
 
   g_string_append_len(sb, value, value_len);
-  vp_results_insert(results, vp_transform_apply(vp, name), TYPE_HINT_STRING, sb);
+  vp_results_insert(results, transformed_name, TYPE_HINT_STRING, sb);
 
   return FALSE;
 }
@@ -347,6 +464,36 @@ vp_merge_set(ValuePairs *vp, ValuePairSpec *set)
 }
 
 
+/*
+ * The names of the builtins and the explicit pairs are fixed, so they are
+ * transformed here once instead of for each message.  The per-handle cache
+ * of nv-pair names depends on the same settings, so it is dropped here.
+ */
+static void
+vp_update_transformed_names(ValuePairs *vp)
+{
+  gint i;
+
+  g_ptr_array_foreach(vp->builtin_names, (GFunc) g_free, NULL);
+  g_ptr_array_set_size(vp->builtin_names, 0);
+  for (i = 0; i < vp->builtins->len; i++)
+    {
+      ValuePairSpec *spec = (ValuePairSpec *) g_ptr_array_index(vp->builtins, i);
+
+      g_ptr_array_add(vp->builtin_names, vp_transform_name(vp, spec->name));
+    }
+
+  for (i = 0; i < vp->vpairs->len; i++)
+    {
+      VPPairConf *vpc = (VPPairConf *) g_ptr_array_index(vp->vpairs, i);
+
+      g_free(vpc->transformed_name);
+      vpc->transformed_name = vp_transform_name(vp, vpc->name);
+    }
+
+  vp_clear_nvpair_names(vp);
+}
+
 static void
 vp_update_builtin_list_of_values(ValuePairs *vp)
 {
@@ -366,6 +513,8 @@ vp_update_builtin_list_of_values(ValuePairs *vp)
 
   if (vp->scopes & VPS_ALL_MACROS)
     vp_merge_set(vp, all_macros);
+
+  vp_update_transformed_names(vp);
 }
 
 static void
@@ -405,24 +554,33 @@ vp_merge_builtins(ValuePairs *vp, VPResults *results, LogMessage *msg, gint32 se
           continue;
         }
 
-      vp_results_insert(results, vp_transform_apply(vp, spec->name), TYPE_HINT_STRING, sb);
+      vp_results_insert(results, g_ptr_array_index(vp->builtin_names, i), TYPE_HINT_STRING, sb);
     }
 }
 
+/*
+ * Runs the callback over the sorted results.  When the same name was
+ * inserted more than once, the value inserted last is used.
+ */
 static gboolean
-vp_foreach_helper(const gchar *name, gpointer ndx_as_pointer, gpointer data)
+vp_results_foreach(VPResults *results, GCompareFunc compare_func, VPForeachFunc func, gpointer user_data)
 {
-  VPResults *results = ((gpointer *)data)[0];
-  gint ndx = GPOINTER_TO_INT(ndx_as_pointer);
-  VPResultValue *rv = &g_array_index(results->values, VPResultValue, ndx);
-  VPForeachFunc func = ((gpointer *)data)[1];
-  gpointer user_data = ((gpointer *)data)[2];
-  gboolean *r = ((gpointer *)data)[3];
+  guint len = vp_results_len(results);
+  guint i, j;
+
+  for (i = 0; i < len; i = j)
+    {
+      VPResultValue *first = vp_results_index(results, i);
+      VPResultValue *last;
+
+      for (j = i + 1; j < len && compare_func(vp_results_index(results, j)->name, first->name) == 0; j++)
+        ;
+      last = vp_results_index(results, j - 1);
 
-  *r &= !func(name, rv->type_hint,
-              rv->value->str,
-              rv->value->len, user_data);
-  return !*r;
+      if (func(first->name, last->type_hint, last->value->str, last->value->len, user_data))
+        return FALSE;
+    }
+  return TRUE;
 }
 
 
@@ -437,13 +595,12 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
                       /* remove constness, we are not using that pointer non-const anyway */
                       (LogTemplateOptions *) template_options, GINT_TO_POINTER(time_zone_mode)
                     };
-  gboolean result = TRUE;
+  gboolean result;
   VPResults results;
-  gpointer helper_args[] = { &results, func, user_data, &result };
   ScratchBuffersMarker mark;
 
   scratch_buffers_mark(&mark);
-  vp_results_init(&results, compare_func);
+  vp_results_init(&results);
   args[5] = &results;
 
   /*
@@ -460,8 +617,8 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
   g_ptr_array_foreach(vp->vpairs, (GFunc)vp_pairs_foreach, args);
 
   /* Aaand we run it through the callback! */
-  g_tree_foreach(results.result_tree, (GTraverseFunc)vp_foreach_helper, helper_args);
-  vp_results_deinit(&results);
+  vp_results_sort(&results, compare_func);
+  result = vp_results_foreach(&results, compare_func, func, user_data);
   scratch_buffers_reclaim_marked(mark);
 
   return result;
@@ -477,75 +634,23 @@ value_pairs_foreach(ValuePairs *vp, VPForeachFunc func,
                                     msg, seq_num, time_zone_mode, template_options, user_data);
 }
 
-/*******************************************************************************
- * vp_stack (represented by vp_stack_t)
- *
- * A not very generic stack implementation used by vp_walker.
- *******************************************************************************/
-
-#define VP_STACK_INITIAL_SIZE 16
-
-typedef struct
-{
-  GPtrArray *elems;
-} vp_stack_t;
-
-static void
-vp_stack_init(vp_stack_t *stack)
-{
-  stack->elems = g_ptr_array_sized_new(VP_STACK_INITIAL_SIZE);
-}
-
-static void
-vp_stack_destroy(vp_stack_t *stack)
-{
-  g_ptr_array_free(stack->elems, TRUE);
-}
-
-static void
-vp_stack_push(vp_stack_t *stack, gpointer data)
-{
-  g_ptr_array_add(stack->elems, data);
-}
-
-static gpointer
-vp_stack_peek(vp_stack_t *stack)
-{
-  if (stack->elems->len == 0)
-    return NULL;
-
-  return g_ptr_array_index(stack->elems, stack->elems->len - 1);
-}
-
-static gpointer
-vp_stack_pop(vp_stack_t *stack)
-{
-  gpointer data = NULL;
-
-  data = vp_stack_peek(stack);
-  if (data)
-    g_ptr_array_remove_index(stack->elems, stack->elems->len - 1);
-  return data;
-}
-
-static guint
-vp_stack_height(vp_stack_t *stack)
-{
-  return stack->elems->len;
-}
-
 /*******************************************************************************
  * vp_walker (represented by vp_walk_state_t),
  *
  * The stuff that translates name-value pairs to a tree with SAX like
  * callbacks. (start/value/end)
+ *
+ * The stack of open containers and the strings they refer to are kept in
+ * scratch buffers, the names are split to tokens in place, so walking a
+ * message doesn't allocate memory.
  *******************************************************************************/
 
 typedef struct
 {
-  gchar *key;
-  gchar *prefix;
-  gint prefix_len;
+  /* offsets into vp_walk_state_t->strings */
+  gsize key_ofs;
+  gsize prefix_ofs;
+  gsize prefix_len;
 
   gpointer data;
 } vp_walk_stack_data_t;
@@ -557,42 +662,78 @@ typedef struct
   VPWalkValueCallbackFunc process_value;
 
   gpointer user_data;
-  vp_stack_t stack;
+
+  /* array of vp_walk_stack_data_t */
+  GString *stack;
+  /* NUL terminated keys and prefixes of the stack elements */
+  GString *strings;
+  /* the key of the current value, if it needs to be copied */
+  GString *key;
 } vp_walk_state_t;
 
-static vp_walk_stack_data_t *
-vp_walker_stack_push (vp_stack_t *stack,
-                      gchar *key, gchar *prefix)
+static gint
+vp_walker_stack_height(vp_walk_state_t *state)
 {
-  vp_walk_stack_data_t *nt = g_new(vp_walk_stack_data_t, 1);
+  return state->stack->len / sizeof(vp_walk_stack_data_t);
+}
 
-  nt->key = key;
-  nt->prefix = prefix;
-  nt->prefix_len = strlen(nt->prefix);
-  nt->data = NULL;
+static vp_walk_stack_data_t *
+vp_walker_stack_index(vp_walk_state_t *state, gint ndx)
+{
+  if (ndx < 0 || ndx >= vp_walker_stack_height(state))
+    return NULL;
 
-  vp_stack_push(stack, nt);
-  return nt;
+  return &((vp_walk_stack_data_t *) state->stack->str)[ndx];
 }
 
 static vp_walk_stack_data_t *
-vp_walker_stack_peek(vp_stack_t *stack)
+vp_walker_stack_peek(vp_walk_state_t *state)
 {
-  return (vp_walk_stack_data_t *) vp_stack_peek(stack);
+  return vp_walker_stack_index(state, vp_walker_stack_height(state) - 1);
 }
 
-static vp_walk_stack_data_t *
-vp_walker_stack_pop(vp_stack_t *stack)
+static const gchar *
+vp_walker_stack_data_key(vp_walk_state_t *state, vp_walk_stack_data_t *t)
 {
-  return (vp_walk_stack_data_t *) vp_stack_pop(stack);
+  return state->strings->str + t->key_ofs;
+}
+
+static const gchar *
+vp_walker_stack_data_prefix(vp_walk_state_t *state, vp_walk_stack_data_t *t)
+{
+  if (!t)
+    return NULL;
+
+  return state->strings->str + t->prefix_ofs;
+}
+
+static vp_walk_stack_data_t *
+vp_walker_stack_push(vp_walk_state_t *state,
+                     const gchar *key, gsize key_len,
+                     const gchar *prefix, gsize prefix_len)
+{
+  vp_walk_stack_data_t nt;
+
+  nt.key_ofs = state->strings->len;
+  g_string_append_len(state->strings, key, key_len);
+  g_string_append_c(state->strings, 0);
+  nt.prefix_ofs = state->strings->len;
+  nt.prefix_len = prefix_len;
+  g_string_append_len(state->strings, prefix, prefix_len);
+  g_string_append_c(state->strings, 0);
+  nt.data = NULL;
+
+  g_string_append_len(state->stack, (const gchar *) &nt, sizeof(nt));
+  return vp_walker_stack_peek(state);
 }
 
 static void
-vp_walker_free_stack_data(vp_walk_stack_data_t *t)
+vp_walker_stack_pop(vp_walk_state_t *state)
 {
-  g_free(t->key);
-  g_free(t->prefix);
-  g_free(t);
+  vp_walk_stack_data_t *t = vp_walker_stack_peek(state);
+
+  g_string_truncate(state->strings, t->key_ofs);
+  g_string_truncate(state->stack, state->stack->len - sizeof(vp_walk_stack_data_t));
 }
 
 static void
@@ -601,28 +742,22 @@ vp_walker_stack_unwind_containers_until(vp_walk_state_t *state,
 {
   vp_walk_stack_data_t *t;
 
-  while ((t = vp_walker_stack_pop(&state->stack)) != NULL)
+  while ((t = vp_walker_stack_peek(state)) != NULL)
     {
       vp_walk_stack_data_t *p;
 
-      if (name && strncmp(name, t->prefix, t->prefix_len) == 0)
+      if (name && strncmp(name, vp_walker_stack_data_prefix(state, t), t->prefix_len) == 0)
         {
-          /* This one matched, put it back, PUT IT BACK! */
-          vp_stack_push(&state->stack, t);
+          /* This one matched, keep it */
           break;
         }
 
-      p = vp_walker_stack_peek(&state->stack);
+      p = vp_walker_stack_index(state, vp_walker_stack_height(state) - 2);
 
-      if (p)
-        state->obj_end(t->key, t->prefix, &t->data,
-                       p->prefix, &p->data,
-                       state->user_data);
-      else
-        state->obj_end(t->key, t->prefix, &t->data,
-                       NULL, NULL,
-                       state->user_data);
-      vp_walker_free_stack_data(t);
+      state->obj_end(vp_walker_stack_data_key(state, t), vp_walker_stack_data_prefix(state, t), &t->data,
+                     vp_walker_stack_data_prefix(state, p), p ? &p->data : NULL,
+                     state->user_data);
+      vp_walker_stack_pop(state);
     }
 }
 
@@ -648,100 +783,66 @@ vp_walker_skip_sdata_enterprise_id(const gchar *name)
   return name;
 }
 
-static GPtrArray *
-vp_walker_split_name_to_tokens(vp_walk_state_t *state, const gchar *name)
+/* returns the end of the dot separated token starting at token_start */
+static const gchar *
+vp_walker_find_token_end(const gchar *token_start)
 {
-  const gchar *token_start = name;
-  const gchar *token_end = name;
-
-  GPtrArray *array = g_ptr_array_sized_new(VP_STACK_INITIAL_SIZE);
+  const gchar *token_end = token_start;
 
-  while (*token_end)
+  while (*token_end && *token_end != '.')
     {
-      switch (*token_end)
+      if (*token_end == '@')
         {
-        case '@':
           token_end = vp_walker_skip_sdata_enterprise_id(token_end);
-          break;
-        case '.':
-          g_ptr_array_add(array, g_strndup(token_start, token_end - token_start));
-          ++token_end;
-          token_start = token_end;
-          break;
-        default:
+        }
+      else
+        {
           ++token_end;
           token_end += strcspn(token_end, "@.");
         }
     }
-
-  if (token_start != token_end)
-    g_ptr_array_add(array, g_strndup(token_start, token_end - token_start));
-
-  if (array->len == 0)
-    {
-      g_ptr_array_free(array, TRUE);
-      return NULL;
-    }
-
-  return array;
-}
-
-static gchar *
-vp_walker_name_combine_prefix(GPtrArray *tokens, gint until)
-{
-  GString *s = scratch_buffers_alloc();
-  gchar *str;
-  gint i;
-
-  for (i = 0; i < until; i++)
-    {
-      g_string_append(s, g_ptr_array_index(tokens, i));
-      g_string_append_c(s, '.');
-    }
-  g_string_append(s, g_ptr_array_index(tokens, until));
-
-  str = g_strdup(s->str);
-  return str;
+  return token_end;
 }
 
-static gchar *
+/*
+ * Opens the containers for the tokens of name that are not on the stack
+ * yet and returns the last token, which is the key of the value.  A
+ * trailing dot doesn't start an empty token.
+ */
+static const gchar *
 vp_walker_start_containers_for_name(vp_walk_state_t *state,
                                     const gchar *name)
 {
-  GPtrArray *tokens;
-  gchar *key = NULL;
-  guint i, start;
-
-  tokens = vp_walker_split_name_to_tokens(state, name);
+  const gchar *token_start = name;
+  const gchar *token_end;
+  gint start = vp_walker_stack_height(state);
+  gint i;
 
-  start = vp_stack_height(&state->stack);
-  for (i = start; i < tokens->len - 1; i++)
+  for (i = 0; ; i++)
     {
       vp_walk_stack_data_t *p, *nt;
 
-      p = vp_walker_stack_peek(&state->stack);
-      nt = vp_walker_stack_push(&state->stack,
-                                g_strdup(g_ptr_array_index(tokens, i)),
-                                vp_walker_name_combine_prefix(tokens, i));
+      token_end = vp_walker_find_token_end(token_start);
+      if (*token_end == '\0' || *(token_end + 1) == '\0')
+        break;
 
-      if (p)
-        state->obj_start(nt->key, nt->prefix, &nt->data,
-                         p->prefix, &p->data,
-                         state->user_data);
-      else
-        state->obj_start(nt->key, nt->prefix, &nt->data,
-                         NULL, NULL, state->user_data);
-    }
+      if (i >= start)
+        {
+          nt = vp_walker_stack_push(state, token_start, token_end - token_start, name, token_end - name);
+          p = vp_walker_stack_index(state, vp_walker_stack_height(state) - 2);
 
-  /* The last token is the key (well, second to last, last being
-     NULL), so treat that normally. */
-  key = g_ptr_array_index(tokens, tokens->len - 1);
-  g_ptr_array_index(tokens, tokens->len - 1) = NULL;
+          state->obj_start(vp_walker_stack_data_key(state, nt), vp_walker_stack_data_prefix(state, nt), &nt->data,
+                           vp_walker_stack_data_prefix(state, p), p ? &p->data : NULL,
+                           state->user_data);
+        }
+      token_start = token_end + 1;
+    }
 
-  g_ptr_array_foreach(tokens, (GFunc)g_free, NULL);
-  g_ptr_array_free(tokens, TRUE);
+  if (*token_end == '\0')
+    return token_start;
 
-  return key;
+  g_string_assign_len(state->key, token_start, token_end - token_start);
+  return state->key->str;
 }
 
 static gboolean
@@ -750,27 +851,16 @@ value_pairs_walker(const gchar *name, TypeHint type, const gchar *value, gsize v
 {
   vp_walk_state_t *state = (vp_walk_state_t *)user_data;
   vp_walk_stack_data_t *data;
-  gchar *key;
-  gboolean result;
+  const gchar *key;
 
   vp_walker_stack_unwind_containers_until(state, name);
   key = vp_walker_start_containers_for_name(state, name);
-  data = vp_walker_stack_peek(&state->stack);
+  data = vp_walker_stack_peek(state);
 
-  if (data != NULL)
-    result = state->process_value(key, data->prefix,
-                                  type, value, value_len,
-                                  &data->data,
-                                  state->user_data);
-  else
-    result = state->process_value(key, NULL,
-                                  type, value, value_len,
-                                  NULL,
-                                  state->user_data);
-
-  g_free(key);
-
-  return result;
+  return state->process_value(key, vp_walker_stack_data_prefix(state, data),
+                              type, value, value_len,
+                              data ? &data->data : NULL,
+                              state->user_data);
 }
 
 static gint
@@ -794,12 +884,16 @@ value_pairs_walk(ValuePairs *vp,
 {
   vp_walk_state_t state;
   gboolean result;
+  ScratchBuffersMarker mark;
 
+  scratch_buffers_mark(&mark);
   state.user_data = user_data;
   state.obj_start = obj_start_func;
   state.obj_end = obj_end_func;
   state.process_value = process_value_func;
-  vp_stack_init(&state.stack);
+  state.stack = scratch_buffers_alloc();
+  state.strings = scratch_buffers_alloc();
+  state.key = scratch_buffers_alloc();
 
   state.obj_start(NULL, NULL, NULL, NULL, NULL, user_data);
   result = value_pairs_foreach_sorted(vp, value_pairs_walker,
@@ -807,7 +901,7 @@ value_pairs_walk(ValuePairs *vp,
                                       seq_num, time_zone_mode, template_options, &state);
   vp_walker_stack_unwind_all_containers(&state);
   state.obj_end(NULL, NULL, NULL, NULL, NULL, user_data);
-  vp_stack_destroy(&state.stack);
+  scratch_buffers_reclaim_marked(mark);
 
   return result;
 }
@@ -866,6 +960,7 @@ value_pairs_new(void)
   vp = g_new0(ValuePairs, 1);
   g_atomic_counter_set(&vp->ref_cnt, 1);
   vp->builtins = g_ptr_array_new();
+  vp->builtin_names = g_ptr_array_new();
   vp->vpairs = g_ptr_array_new();
   vp->patterns = g_ptr_array_new();
   vp->transforms = g_ptr_array_new();
@@ -908,6 +1003,9 @@ value_pairs_free (ValuePairs *vp)
     }
   g_ptr_array_free(vp->transforms, TRUE);
   g_ptr_array_free(vp->builtins, TRUE);
+  g_ptr_array_foreach(vp->builtin_names, (GFunc) g_free, NULL);
+  g_ptr_array_free(vp->builtin_names, TRUE);
+  vp_clear_nvpair_names(vp);
   g_free(vp);
 }
 
@@ -41,6 +41,9 @@ static CfgLexerKeyword add_contextual_data_keywords[] =
   {"selector", KW_ADD_CONTEXTUAL_DATA_SELECTOR},
   {"default_selector", KW_ADD_CONTEXTUAL_DATA_DEFAULT_SELECTOR},
   {"prefix", KW_ADD_CONTEXTUAL_DATA_PREFIX},
+  {"cache_dir", KW_ADD_CONTEXTUAL_DATA_CACHE_DIR},
+  {"cidr", KW_ADD_CONTEXTUAL_DATA_CIDR},
+  {"domain", KW_ADD_CONTEXTUAL_DATA_DOMAIN},
   {NULL}
 };
 
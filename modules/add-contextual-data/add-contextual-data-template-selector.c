@@ -30,6 +30,9 @@ typedef struct _AddContextualDataTemplateSelector
   AddContextualDataSelector super;
   gchar *selector_template_string;
   LogTemplate *selector_template;
+  gboolean prefix_match;
+  ContextPrefixIndexType prefix_index_type;
+  ContextPrefixIndex *prefix_index;
 } AddContextualDataTemplateSelector;
 
 static gboolean
@@ -60,10 +63,32 @@ _replace_template(LogTemplate **old_template, LogTemplate *new_template)
   *old_template = log_template_ref(new_template);
 }
 
+static void
+_build_prefix_index(AddContextualDataTemplateSelector *self, GList *ordered_selectors)
+{
+  GList *l;
+
+  if (self->prefix_index)
+    context_prefix_index_free(self->prefix_index);
+  self->prefix_index = context_prefix_index_new(self->prefix_index_type);
+
+  for (l = ordered_selectors; l; l = l->next)
+    {
+      const gchar *selector = (const gchar *) l->data;
+
+      if (!context_prefix_index_add(self->prefix_index, selector))
+        msg_debug("add-contextual-data(): selector is not a prefix, it is only matched exactly",
+                  evt_tag_str("selector", selector));
+    }
+}
+
 static gboolean
 _init(AddContextualDataSelector *s, GList *ordered_selectors)
 {
   AddContextualDataTemplateSelector *self = (AddContextualDataTemplateSelector *)s;
+
+  if (self->prefix_match)
+    _build_prefix_index(self, ordered_selectors);
   return _compile_selector_template(self);
 }
 
@@ -76,6 +101,16 @@ _resolve(AddContextualDataSelector *s, LogMessage *msg)
   log_template_format(self->selector_template, msg, NULL, LTZ_LOCAL, 0, NULL,
                       selector_str);
 
+  if (self->prefix_index)
+    {
+      const gchar *matching_selector = context_prefix_index_lookup(self->prefix_index, selector_str->str);
+
+      if (matching_selector)
+        {
+          g_string_assign(selector_str, matching_selector);
+        }
+    }
+
   return g_string_free(selector_str, FALSE);
 }
 
@@ -85,6 +120,8 @@ _free(AddContextualDataSelector *s)
   AddContextualDataTemplateSelector *self = (AddContextualDataTemplateSelector *)s;
   log_template_unref(self->selector_template);
   g_free(self->selector_template_string);
+  if (self->prefix_index)
+    context_prefix_index_free(self->prefix_index);
 }
 
 static AddContextualDataSelector *
@@ -94,6 +131,8 @@ _clone(AddContextualDataSelector *s, GlobalConfig *cfg)
   AddContextualDataTemplateSelector *cloned = (AddContextualDataTemplateSelector *)
                                               add_contextual_data_template_selector_new(cfg, self->selector_template_string);
   _replace_template(&cloned->selector_template, self->selector_template);
+  cloned->prefix_match = self->prefix_match;
+  cloned->prefix_index_type = self->prefix_index_type;
 
   return &cloned->super;
 }
@@ -111,3 +150,22 @@ add_contextual_data_template_selector_new(GlobalConfig *cfg, const gchar *select
 
   return &new_instance->super;
 }
+
+/*
+ * Prefix selectors format the template the same way, but instead of using
+ * the result as is, they look up the most specific network or domain
+ * among the selectors of the database, so one record can cover all hosts
+ * of a /24 or all names under a domain.  Values without a covering
+ * selector are returned unchanged.
+ */
+AddContextualDataSelector *
+add_contextual_data_prefix_selector_new(GlobalConfig *cfg, const gchar *selector_template_string,
+                                        ContextPrefixIndexType prefix_index_type)
+{
+  AddContextualDataTemplateSelector *self = (AddContextualDataTemplateSelector *)
+                                            add_contextual_data_template_selector_new(cfg, selector_template_string);
+
+  self->prefix_match = TRUE;
+  self->prefix_index_type = prefix_index_type;
+  return &self->super;
+}
@@ -24,8 +24,12 @@
 #define ADD_CONTEXTUAL_DATA_TEMPLATE_SELECTOR_H_INCLUDED
 
 #include "add-contextual-data-selector.h"
+#include "context-prefix-index.h"
 
 AddContextualDataSelector*
 add_contextual_data_template_selector_new(GlobalConfig *cfg, const gchar *selector_template_string);
+AddContextualDataSelector*
+add_contextual_data_prefix_selector_new(GlobalConfig *cfg, const gchar *selector_template_string,
+                                        ContextPrefixIndexType prefix_index_type);
 
 #endif
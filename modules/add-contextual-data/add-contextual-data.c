@@ -32,9 +32,13 @@
 #include "template/templates.h"
 #include "context-info-db.h"
 #include "pathutils.h"
+#include "apphook.h"
+#include "messages.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 typedef struct AddContextualData
 {
@@ -44,6 +48,8 @@ typedef struct AddContextualData
   gchar *default_selector;
   gchar *filename;
   gchar *prefix;
+  gchar *cache_dir;
+  gchar *image_filename;
 } AddContextualData;
 
 void
@@ -72,6 +78,15 @@ add_contextual_data_set_prefix(LogParser *p, const gchar *prefix)
   self->prefix = g_strdup(prefix);
 }
 
+void
+add_contextual_data_set_cache_dir(LogParser *p, const gchar *cache_dir)
+{
+  AddContextualData *self = (AddContextualData *) p;
+
+  g_free(self->cache_dir);
+  self->cache_dir = g_strdup(cache_dir);
+}
+
 void
 add_contextual_data_set_database_default_selector(LogParser *p, const gchar *default_selector)
 {
@@ -86,6 +101,7 @@ add_contextual_data_set_selector(LogParser *p, AddContextualDataSelector *select
 {
   AddContextualData *self = (AddContextualData *) p;
 
+  add_contextual_data_selector_free(self->selector);
   self->selector = selector;
 }
 
@@ -144,6 +160,7 @@ _clone(LogPipe *s)
   _replace_context_info_db(&cloned->context_info_db, self->context_info_db);
   add_contextual_data_set_prefix(&cloned->super, self->prefix);
   add_contextual_data_set_filename(&cloned->super, self->filename);
+  add_contextual_data_set_cache_dir(&cloned->super, self->cache_dir);
   add_contextual_data_set_database_default_selector(&cloned->super,
                                                     self->default_selector);
   cloned->selector = add_contextual_data_selector_clone(self->selector, s->cfg);
@@ -159,6 +176,8 @@ _free(LogPipe *s)
   context_info_db_unref(self->context_info_db);
   g_free(self->filename);
   g_free(self->prefix);
+  g_free(self->cache_dir);
+  g_free(self->image_filename);
   g_free(self->default_selector);
   add_contextual_data_selector_free(self->selector);
   log_parser_free_method(s);
@@ -178,24 +197,167 @@ _complete_relative_path_with_config_path(const gchar *filename)
                      filename, NULL);
 }
 
-static FILE *
-_open_data_file(const gchar *filename)
+static gchar *
+_get_data_file_path(const gchar *filename)
 {
-  FILE *f = NULL;
-
   if (_is_relative_path(filename))
+    return _complete_relative_path_with_config_path(filename);
+
+  return g_strdup(filename);
+}
+
+/* With cache-dir() set, the database is cached as an image in that
+ * directory, which is mapped into memory instead of parsing the file again
+ * as long as the file and the prefix remain the same.  */
+#define IMAGE_FILENAME_PREFIX "add-contextual-data-"
+#define IMAGE_FILENAME_SUFFIX ".ctxdb"
+
+static gchar *
+_get_image_cache_dir(const gchar *cache_dir)
+{
+  if (_is_relative_path(cache_dir))
+    return g_build_filename(get_installation_path_for(SYSLOG_NG_PATH_LOCALSTATEDIR), cache_dir, NULL);
+
+  return g_strdup(cache_dir);
+}
+
+static gchar *
+_get_image_filename(const gchar *cache_dir, const gchar *path, const gchar *prefix)
+{
+  gchar *key = g_strdup_printf("%s\n%s", path, prefix ? prefix : "");
+  gchar *basename = g_strdup_printf(IMAGE_FILENAME_PREFIX "%08x" IMAGE_FILENAME_SUFFIX, g_str_hash(key));
+  gchar *image_filename = g_build_filename(cache_dir, basename, NULL);
+
+  g_free(basename);
+  g_free(key);
+  return image_filename;
+}
+
+/* Images referenced by the parsers of the running configuration, with the
+ * number of references, and every cache directory used so far.  Once a
+ * configuration is loaded, the images in these directories that are not
+ * referenced anymore are removed.  Parsers are initialized and deinitialized
+ * in the main thread, so no locking is needed.  */
+static GHashTable *referenced_images;
+static GHashTable *image_cache_dirs;
+static gboolean image_cleanup_scheduled;
+
+static gboolean
+_is_image_filename(const gchar *name)
+{
+  /* temporary files left behind are named after the image, with a suffix */
+  return g_str_has_prefix(name, IMAGE_FILENAME_PREFIX) && strstr(name, IMAGE_FILENAME_SUFFIX) != NULL;
+}
+
+static void
+_remove_unreferenced_images_in_dir(const gchar *cache_dir)
+{
+  GDir *dir = g_dir_open(cache_dir, 0, NULL);
+  const gchar *name;
+
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name(dir)))
     {
-      gchar *absolute_path =
-        _complete_relative_path_with_config_path(filename);
-      f = fopen(absolute_path, "r");
-      g_free(absolute_path);
+      gchar *filename;
+
+      if (!_is_image_filename(name))
+        continue;
+
+      filename = g_build_filename(cache_dir, name, NULL);
+      if (!g_hash_table_lookup(referenced_images, filename))
+        {
+          msg_debug("Removing unused add-contextual-data database image",
+                    evt_tag_str("filename", filename));
+          unlink(filename);
+        }
+      g_free(filename);
     }
-  else
+  g_dir_close(dir);
+}
+
+static void
+_remove_unreferenced_images(gint type, gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer cache_dir;
+
+  image_cleanup_scheduled = FALSE;
+  g_hash_table_iter_init(&iter, image_cache_dirs);
+  while (g_hash_table_iter_next(&iter, &cache_dir, NULL))
+    _remove_unreferenced_images_in_dir((const gchar *) cache_dir);
+}
+
+static void
+_reference_image(AddContextualData *self, const gchar *cache_dir, gchar *image_filename)
+{
+  if (!referenced_images)
+    {
+      referenced_images = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      image_cache_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+  gint ref_cnt = GPOINTER_TO_INT(g_hash_table_lookup(referenced_images, image_filename));
+  g_hash_table_insert(referenced_images, g_strdup(image_filename), GINT_TO_POINTER(ref_cnt + 1));
+  if (!g_hash_table_lookup(image_cache_dirs, cache_dir))
+    g_hash_table_insert(image_cache_dirs, g_strdup(cache_dir), GINT_TO_POINTER(TRUE));
+
+  g_free(self->image_filename);
+  self->image_filename = image_filename;
+
+  /* the rest of the configuration is not initialized yet, it may still
+   * reference images in the same directory */
+  if (!image_cleanup_scheduled)
     {
-      f = fopen(filename, "r");
+      image_cleanup_scheduled = TRUE;
+      register_application_hook(AH_POST_CONFIG_LOADED, _remove_unreferenced_images, NULL);
     }
+}
+
+static void
+_unreference_image(AddContextualData *self)
+{
+  gint ref_cnt;
+
+  if (!self->image_filename)
+    return;
+
+  ref_cnt = GPOINTER_TO_INT(g_hash_table_lookup(referenced_images, self->image_filename));
+  if (ref_cnt > 1)
+    g_hash_table_insert(referenced_images, g_strdup(self->image_filename), GINT_TO_POINTER(ref_cnt - 1));
+  else
+    g_hash_table_remove(referenced_images, self->image_filename);
 
-  return f;
+  g_free(self->image_filename);
+  self->image_filename = NULL;
+}
+
+/* The tag identifies the version of the file the image was created from.
+ * Whole second timestamps miss changes made within the same second that
+ * keep the size, so sub-second timestamps are used where available, and
+ * the inode and ctime catch files replaced by a rename or changed with
+ * their mtime reset.  */
+static gchar *
+_get_image_tag(const gchar *path, const gchar *prefix, const struct stat *st)
+{
+  glong mtime_nsec = 0, ctime_nsec = 0;
+
+#ifdef SYSLOG_NG_HAVE_STRUCT_STAT_ST_MTIM
+  mtime_nsec = st->st_mtim.tv_nsec;
+  ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+
+  return g_strdup_printf("%s\n%s\n"
+                         "dev=%" G_GUINT64_FORMAT "\n"
+                         "ino=%" G_GUINT64_FORMAT "\n"
+                         "size=%" G_GINT64_FORMAT "\n"
+                         "mtime=%" G_GINT64_FORMAT ".%09ld\n"
+                         "ctime=%" G_GINT64_FORMAT ".%09ld",
+                         path, prefix ? prefix : "",
+                         (guint64) st->st_dev, (guint64) st->st_ino, (gint64) st->st_size,
+                         (gint64) st->st_mtime, mtime_nsec,
+                         (gint64) st->st_ctime, ctime_nsec);
 }
 
 static ContextualDataRecordScanner *
@@ -218,14 +380,14 @@ _get_scanner(AddContextualData *self)
 }
 
 static gboolean
-_load_context_info_db(AddContextualData *self)
+_import_context_info_db(AddContextualData *self, const gchar *path)
 {
   ContextualDataRecordScanner *scanner = _get_scanner(self);
 
   if (!scanner)
     return FALSE;
 
-  FILE *f = _open_data_file(self->filename);
+  FILE *f = fopen(path, "r");
   if (!f)
     {
       msg_error("Error loading add_contextual_data database",
@@ -248,6 +410,56 @@ _load_context_info_db(AddContextualData *self)
   return TRUE;
 }
 
+static gboolean
+_load_context_info_db(AddContextualData *self)
+{
+  gchar *path = _get_data_file_path(self->filename);
+  gchar *image_tag = NULL;
+  gboolean result = FALSE;
+  struct stat st;
+
+  if (self->image_filename && stat(path, &st) == 0)
+    {
+      image_tag = _get_image_tag(path, self->prefix, &st);
+      if (context_info_db_load_image(self->context_info_db, self->image_filename, image_tag))
+        {
+          result = TRUE;
+          goto exit;
+        }
+    }
+
+  if (!_import_context_info_db(self, path))
+    goto exit;
+
+  /* the database is shared with our clones, so it is switched over to the
+   * image in place, the parsed records are dropped if this succeeds */
+  if (image_tag && context_info_db_write_image(self->context_info_db, self->image_filename, image_tag))
+    context_info_db_load_image(self->context_info_db, self->image_filename, image_tag);
+  result = TRUE;
+
+exit:
+  g_free(image_tag);
+  g_free(path);
+  return result;
+}
+
+static void
+_init_image(AddContextualData *self)
+{
+  gchar *cache_dir;
+  gchar *path;
+
+  _unreference_image(self);
+  if (!self->cache_dir)
+    return;
+
+  cache_dir = _get_image_cache_dir(self->cache_dir);
+  path = _get_data_file_path(self->filename);
+  _reference_image(self, cache_dir, _get_image_filename(cache_dir, path, self->prefix));
+  g_free(path);
+  g_free(cache_dir);
+}
+
 static gboolean
 _init_context_info_db(AddContextualData *self)
 {
@@ -257,6 +469,8 @@ _init_context_info_db(AddContextualData *self)
       return FALSE;
     }
 
+  _init_image(self);
+
   if (!context_info_db_is_loaded(self->context_info_db) && !_load_context_info_db(self))
     {
       msg_error("Failed to load the database file.");
@@ -278,12 +492,25 @@ _init(LogPipe *s)
   AddContextualData *self = (AddContextualData *)s;
 
   if (!_init_context_info_db(self))
-    return FALSE;
+    goto error;
   if (!_init_selector(self))
-    return FALSE;
+    goto error;
   if (!log_parser_init_method(s))
-    return FALSE;
+    goto error;
+
+  return TRUE;
+
+error:
+  _unreference_image(self);
+  return FALSE;
+}
+
+static gboolean
+_deinit(LogPipe *s)
+{
+  AddContextualData *self = (AddContextualData *)s;
 
+  _unreference_image(self);
   return TRUE;
 }
 
@@ -301,6 +528,7 @@ add_contextual_data_parser_new(GlobalConfig *cfg)
   self->super.super.clone = _clone;
   self->super.super.free_fn = _free;
   self->super.super.init = _init;
+  self->super.super.deinit = _deinit;
   self->default_selector = NULL;
   self->prefix = NULL;
 
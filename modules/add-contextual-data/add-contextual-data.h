@@ -46,6 +46,7 @@ void add_contextual_data_set_database_default_selector(LogParser *p,
                                                        default_selector);
 
 void add_contextual_data_set_prefix(LogParser *p, const gchar *perfix);
+void add_contextual_data_set_cache_dir(LogParser *p, const gchar *cache_dir);
 void add_contextual_data_set_filters_path(LogParser *p, const gchar *filename);
 
 void add_contextual_data_set_selector(LogParser *p, AddContextualDataSelector *selector);
@@ -25,7 +25,67 @@
 #include "messages.h"
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * Database images
+ *
+ * Loading a large CSV file means several heap allocations per record, so
+ * the records can also be written into an image file, that is mapped into
+ * memory later instead of being parsed again.  The image consists of:
+ *
+ *   - a header
+ *   - the selectors, in the order of their first appearance in the CSV
+ *     file, each referring to its range of records
+ *   - the records, grouped by selector
+ *   - an open addressing hash table, mapping selectors to their index
+ *   - a table of interned, NUL terminated strings referred to by offset
+ *
+ * Images use the native byte order and are not meant to be portable, they
+ * are rebuilt if they don't match the running system.
+ */
+
+#define CONTEXT_INFO_DB_IMAGE_MAGIC "CTXINFO"
+#define CONTEXT_INFO_DB_IMAGE_BYTE_ORDER 0x01020304
+#define CONTEXT_INFO_DB_IMAGE_VERSION 1
+
+typedef struct _ContextInfoDBImageHeader
+{
+  gchar magic[8];
+  guint32 byte_order;
+  guint32 version;
+  guint32 num_selectors;
+  guint32 num_records;
+  guint32 hash_size;
+  /* describes the source of the image, see context_info_db_load_image() */
+  guint32 tag;
+  guint64 selectors_offset;
+  guint64 records_offset;
+  guint64 hash_offset;
+  guint64 strings_offset;
+  guint64 strings_len;
+} ContextInfoDBImageHeader;
+
+typedef struct _ContextInfoDBImageSelector
+{
+  guint32 selector;
+  guint32 selector_len;
+  guint32 first_record;
+  guint32 num_records;
+} ContextInfoDBImageSelector;
+
+typedef struct _ContextInfoDBImageRecord
+{
+  guint32 name;
+  guint32 name_len;
+  guint32 value;
+  guint32 value_len;
+} ContextInfoDBImageRecord;
 
 struct _ContextInfoDB
 {
@@ -34,6 +94,17 @@ struct _ContextInfoDB
   GHashTable *index;
   gboolean is_data_indexed;
   GList *ordered_selectors;
+  GList *ordered_selectors_tail;
+  GHashTable *known_selectors;
+
+  /* the mapped image, used instead of data and index if set */
+  gchar *image;
+  gsize image_len;
+  const ContextInfoDBImageHeader *image_header;
+  const ContextInfoDBImageSelector *image_selectors;
+  const ContextInfoDBImageRecord *image_records;
+  const guint32 *image_hash;
+  const gchar *image_strings;
 };
 
 typedef struct _element_range
@@ -51,15 +122,22 @@ _contextual_data_record_cmp(gconstpointer k1, gconstpointer k2)
   return strcmp(r1->selector->str, r2->selector->str);
 }
 
+static void _image_fill_ordered_selectors(ContextInfoDB *self);
+
 GList *
 context_info_db_ordered_selectors(ContextInfoDB *self)
 {
+  if (self->image && !self->ordered_selectors)
+    _image_fill_ordered_selectors(self);
   return self->ordered_selectors;
 }
 
 void
 context_info_db_index(ContextInfoDB *self)
 {
+  if (self->image)
+    return;
+
   if (self->data->len > 0)
     {
       g_array_sort(self->data, _contextual_data_record_cmp);
@@ -117,13 +195,15 @@ _new(ContextInfoDB *self)
 {
   self->data = g_array_new(FALSE, FALSE, sizeof(ContextualDataRecord));
   self->index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  self->known_selectors = g_hash_table_new(g_str_hash, g_str_equal);
   self->is_data_indexed = FALSE;
   self->ordered_selectors = NULL;
+  self->ordered_selectors_tail = NULL;
   g_atomic_counter_set(&self->ref_cnt, 1);
 }
 
 static void
-_free_array(GArray *array)
+_free_records(GArray *array)
 {
   for (gsize i = 0; i < array->len; ++i)
     {
@@ -131,9 +211,31 @@ _free_array(GArray *array)
         g_array_index(array, ContextualDataRecord, i);
       _record_free(&current_record);
     }
+}
+
+static void
+_free_array(GArray *array)
+{
+  _free_records(array);
   g_array_free(array, TRUE);
 }
 
+static void
+_unmap_image(ContextInfoDB *self)
+{
+  if (!self->image)
+    return;
+
+  munmap(self->image, self->image_len);
+  self->image = NULL;
+  self->image_len = 0;
+  self->image_header = NULL;
+  self->image_selectors = NULL;
+  self->image_records = NULL;
+  self->image_hash = NULL;
+  self->image_strings = NULL;
+}
+
 static void
 _free(ContextInfoDB *self)
 {
@@ -149,6 +251,11 @@ _free(ContextInfoDB *self)
     {
       g_list_free(self->ordered_selectors);
     }
+  if (self->known_selectors)
+    {
+      g_hash_table_unref(self->known_selectors);
+    }
+  _unmap_image(self);
 }
 
 ContextInfoDB *
@@ -187,12 +294,23 @@ _get_range_of_records(ContextInfoDB *self, const gchar *selector)
   return (element_range *) g_hash_table_lookup(self->index, selector);
 }
 
+static const ContextInfoDBImageSelector *_image_lookup_selector(ContextInfoDB *self, const gchar *selector);
+
 void
 context_info_db_purge(ContextInfoDB *self)
 {
   g_hash_table_remove_all(self->index);
+  g_hash_table_remove_all(self->known_selectors);
+  g_list_free(self->ordered_selectors);
+  self->ordered_selectors = NULL;
+  self->ordered_selectors_tail = NULL;
   if (self->data->len > 0)
-    self->data = g_array_remove_range(self->data, 0, self->data->len);
+    {
+      _free_records(self->data);
+      self->data = g_array_remove_range(self->data, 0, self->data->len);
+    }
+  self->is_data_indexed = FALSE;
+  _unmap_image(self);
 }
 
 void
@@ -205,20 +323,25 @@ context_info_db_free(ContextInfoDB *self)
     }
 }
 
-static gint
-_g_strcmp(const gconstpointer a, gconstpointer b)
-{
-  return g_strcmp0((const gchar *) a, (const gchar *) b);
-}
-
 void
 context_info_db_insert(ContextInfoDB *self,
                        const ContextualDataRecord *record)
 {
+  g_assert(self->image == NULL);
+
   g_array_append_val(self->data, *record);
   self->is_data_indexed = FALSE;
-  if (!g_list_find_custom(self->ordered_selectors, record->selector->str, _g_strcmp))
-    self->ordered_selectors = g_list_append(self->ordered_selectors, record->selector->str);
+  if (!g_hash_table_lookup(self->known_selectors, record->selector->str))
+    {
+      g_hash_table_insert(self->known_selectors, record->selector->str, record->selector->str);
+
+      /* appending to the tail keeps this O(1) */
+      self->ordered_selectors_tail = g_list_append(self->ordered_selectors_tail, record->selector->str);
+      if (!self->ordered_selectors)
+        self->ordered_selectors = self->ordered_selectors_tail;
+      else
+        self->ordered_selectors_tail = self->ordered_selectors_tail->next;
+    }
 }
 
 gboolean
@@ -227,6 +350,9 @@ context_info_db_contains(ContextInfoDB *self, const gchar *selector)
   if (!selector)
     return FALSE;
 
+  if (self->image)
+    return _image_lookup_selector(self, selector) != NULL;
+
   _ensure_indexed_db(self);
   return (_get_range_of_records(self, selector) != NULL);
 }
@@ -235,6 +361,13 @@ gsize
 context_info_db_number_of_records(ContextInfoDB *self,
                                   const gchar *selector)
 {
+  if (self->image)
+    {
+      const ContextInfoDBImageSelector *image_selector = _image_lookup_selector(self, selector);
+
+      return image_selector ? image_selector->num_records : 0;
+    }
+
   _ensure_indexed_db(self);
 
   gsize n = 0;
@@ -246,10 +379,19 @@ context_info_db_number_of_records(ContextInfoDB *self,
   return n;
 }
 
+static void _image_foreach_record(ContextInfoDB *self, const gchar *selector,
+                                  ADD_CONTEXT_INFO_CB callback, gpointer arg);
+
 void
 context_info_db_foreach_record(ContextInfoDB *self, const gchar *selector,
                                ADD_CONTEXT_INFO_CB callback, gpointer arg)
 {
+  if (self->image)
+    {
+      _image_foreach_record(self, selector, callback, arg);
+      return;
+    }
+
   _ensure_indexed_db(self);
 
   element_range *record_range = _get_range_of_records(self, selector);
@@ -269,18 +411,23 @@ context_info_db_foreach_record(ContextInfoDB *self, const gchar *selector,
 gboolean
 context_info_db_is_indexed(const ContextInfoDB *self)
 {
-  return self->is_data_indexed;
+  return self->image != NULL || self->is_data_indexed;
 }
 
 gboolean
 context_info_db_is_loaded(const ContextInfoDB *self)
 {
+  if (self->image)
+    return self->image_header->num_records > 0;
   return (self->data != NULL && self->data->len > 0);
 }
 
 GList *
 context_info_db_get_selectors(ContextInfoDB *self)
 {
+  if (self->image)
+    return g_list_copy(context_info_db_ordered_selectors(self));
+
   _ensure_indexed_db(self);
   return g_hash_table_get_keys(self->index);
 }
@@ -331,3 +478,374 @@ context_info_db_import(ContextInfoDB *self, FILE *fp,
 
   return TRUE;
 }
+
+/* database images */
+
+static guint32
+_image_hash(const gchar *str)
+{
+  guint32 hash = 2166136261U;
+
+  for (; *str; str++)
+    hash = (hash ^ (guchar) *str) * 16777619U;
+  return hash;
+}
+
+/* the image is only validated as a whole at load time (header, table
+ * bounds, tag), offsets stored in the tables are checked where they are
+ * dereferenced */
+static const gchar *
+_image_get_string(ContextInfoDB *self, guint32 offset, guint32 len)
+{
+  if ((guint64) offset + len >= self->image_header->strings_len || self->image_strings[offset + len] != '\0')
+    return NULL;
+  return self->image_strings + offset;
+}
+
+static const ContextInfoDBImageSelector *
+_image_lookup_selector(ContextInfoDB *self, const gchar *selector)
+{
+  guint32 hash_size = self->image_header->hash_size;
+  guint32 mask = hash_size - 1;
+  guint32 pos, i;
+
+  if (!selector || hash_size == 0)
+    return NULL;
+
+  pos = _image_hash(selector) & mask;
+  for (i = 0; i < hash_size; i++, pos = (pos + 1) & mask)
+    {
+      guint32 index = self->image_hash[pos];
+      const ContextInfoDBImageSelector *image_selector;
+      const gchar *image_selector_str;
+
+      if (index == 0 || index > self->image_header->num_selectors)
+        break;
+
+      image_selector = &self->image_selectors[index - 1];
+      image_selector_str = _image_get_string(self, image_selector->selector, image_selector->selector_len);
+      if (!image_selector_str || strcmp(image_selector_str, selector) != 0)
+        continue;
+
+      if ((guint64) image_selector->first_record + image_selector->num_records > self->image_header->num_records)
+        return NULL;
+      return image_selector;
+    }
+  return NULL;
+}
+
+static void
+_image_foreach_record(ContextInfoDB *self, const gchar *selector,
+                      ADD_CONTEXT_INFO_CB callback, gpointer arg)
+{
+  const ContextInfoDBImageSelector *image_selector = _image_lookup_selector(self, selector);
+
+  if (!image_selector)
+    return;
+
+  /* the strings are handed out as GString instances pointing into the
+   * read-only mapping, callbacks must not change them */
+  GString selector_str = { .str = (gchar *) self->image_strings + image_selector->selector, .len = image_selector->selector_len };
+
+  for (guint32 i = 0; i < image_selector->num_records; i++)
+    {
+      const ContextInfoDBImageRecord *image_record = &self->image_records[image_selector->first_record + i];
+      const gchar *name_str = _image_get_string(self, image_record->name, image_record->name_len);
+      const gchar *value_str = _image_get_string(self, image_record->value, image_record->value_len);
+
+      if (!name_str || !value_str)
+        continue;
+
+      GString name = { .str = (gchar *) name_str, .len = image_record->name_len };
+      GString value = { .str = (gchar *) value_str, .len = image_record->value_len };
+      ContextualDataRecord record = { .selector = &selector_str, .name = &name, .value = &value };
+
+      callback(arg, &record);
+    }
+}
+
+static void
+_image_fill_ordered_selectors(ContextInfoDB *self)
+{
+  for (guint32 i = self->image_header->num_selectors; i > 0; i--)
+    {
+      const ContextInfoDBImageSelector *image_selector = &self->image_selectors[i - 1];
+      const gchar *selector = _image_get_string(self, image_selector->selector, image_selector->selector_len);
+
+      if (selector)
+        self->ordered_selectors = g_list_prepend(self->ordered_selectors, (gpointer) selector);
+    }
+}
+
+static gboolean
+_image_table_is_valid(gsize image_len, guint64 offset, guint64 count, gsize item_size)
+{
+  return offset % sizeof(guint32) == 0 &&
+         offset <= image_len &&
+         count <= (image_len - offset) / item_size;
+}
+
+static gboolean
+_image_is_valid(const gchar *image, gsize image_len, const gchar *tag)
+{
+  const ContextInfoDBImageHeader *header = (const ContextInfoDBImageHeader *) image;
+  const gchar *strings;
+
+  if (image_len < sizeof(*header) ||
+      memcmp(header->magic, CONTEXT_INFO_DB_IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->byte_order != CONTEXT_INFO_DB_IMAGE_BYTE_ORDER ||
+      header->version != CONTEXT_INFO_DB_IMAGE_VERSION)
+    return FALSE;
+
+  if (!_image_table_is_valid(image_len, header->selectors_offset, header->num_selectors,
+                             sizeof(ContextInfoDBImageSelector)) ||
+      !_image_table_is_valid(image_len, header->records_offset, header->num_records, sizeof(ContextInfoDBImageRecord)) ||
+      !_image_table_is_valid(image_len, header->hash_offset, header->hash_size, sizeof(guint32)) ||
+      !_image_table_is_valid(image_len, header->strings_offset, header->strings_len, 1) ||
+      header->strings_len == 0)
+    return FALSE;
+
+  if ((header->hash_size & (header->hash_size - 1)) != 0 || header->hash_size < header->num_selectors)
+    return FALSE;
+
+  strings = image + header->strings_offset;
+  return strings[header->strings_len - 1] == '\0' &&
+         header->tag < header->strings_len &&
+         strcmp(strings + header->tag, tag) == 0;
+}
+
+/*
+ * Maps the image stored in @filename, replacing the current contents of
+ * the database.  @tag identifies the source the image was created from, the
+ * image is only used if it was written with the same tag.
+ */
+gboolean
+context_info_db_load_image(ContextInfoDB *self, const gchar *filename, const gchar *tag)
+{
+  struct stat st;
+  gchar *image;
+  gint fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+
+  if (fstat(fd, &st) < 0 || (gsize) st.st_size < sizeof(ContextInfoDBImageHeader))
+    {
+      close(fd);
+      return FALSE;
+    }
+
+  image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    {
+      msg_error("Error mapping add-contextual-data database image",
+                evt_tag_str("filename", filename),
+                evt_tag_errno("error", errno));
+      return FALSE;
+    }
+
+  if (!_image_is_valid(image, st.st_size, tag))
+    {
+      msg_debug("add-contextual-data database image is outdated or invalid, ignoring",
+                evt_tag_str("filename", filename));
+      munmap(image, st.st_size);
+      return FALSE;
+    }
+
+  context_info_db_purge(self);
+  self->image = image;
+  self->image_len = st.st_size;
+  self->image_header = (const ContextInfoDBImageHeader *) image;
+  self->image_selectors = (const ContextInfoDBImageSelector *) (image + self->image_header->selectors_offset);
+  self->image_records = (const ContextInfoDBImageRecord *) (image + self->image_header->records_offset);
+  self->image_hash = (const guint32 *) (image + self->image_header->hash_offset);
+  self->image_strings = image + self->image_header->strings_offset;
+  return TRUE;
+}
+
+typedef struct _ContextInfoDBImageBuilder
+{
+  GArray *selectors;
+  GArray *records;
+  guint32 *hash;
+  guint32 hash_size;
+  GString *strings;
+  GHashTable *interned_strings;
+} ContextInfoDBImageBuilder;
+
+static gboolean
+_image_builder_intern(ContextInfoDBImageBuilder *self, const gchar *str, gsize len, guint32 *offset)
+{
+  gpointer value;
+
+  if (g_hash_table_lookup_extended(self->interned_strings, str, NULL, &value))
+    {
+      *offset = GPOINTER_TO_UINT(value);
+      return TRUE;
+    }
+
+  if (self->strings->len + len + 1 > G_MAXUINT32)
+    return FALSE;
+
+  *offset = self->strings->len;
+  g_string_append_len(self->strings, str, len);
+  g_string_append_c(self->strings, '\0');
+  g_hash_table_insert(self->interned_strings, g_strndup(str, len), GUINT_TO_POINTER(*offset));
+  return TRUE;
+}
+
+static gboolean
+_image_builder_add_selector(ContextInfoDBImageBuilder *self, ContextInfoDB *db, const gchar *selector)
+{
+  element_range *range = _get_range_of_records(db, selector);
+  ContextInfoDBImageSelector image_selector;
+  guint32 mask = self->hash_size - 1;
+  guint32 pos;
+
+  image_selector.selector_len = strlen(selector);
+  image_selector.first_record = self->records->len;
+  image_selector.num_records = range->length;
+  if (!_image_builder_intern(self, selector, image_selector.selector_len, &image_selector.selector))
+    return FALSE;
+
+  for (gsize i = range->offset; i < range->offset + range->length; i++)
+    {
+      ContextualDataRecord *record = &g_array_index(db->data, ContextualDataRecord, i);
+      ContextInfoDBImageRecord image_record;
+
+      image_record.name_len = record->name->len;
+      image_record.value_len = record->value->len;
+      if (!_image_builder_intern(self, record->name->str, record->name->len, &image_record.name) ||
+          !_image_builder_intern(self, record->value->str, record->value->len, &image_record.value))
+        return FALSE;
+      g_array_append_val(self->records, image_record);
+    }
+
+  g_array_append_val(self->selectors, image_selector);
+
+  pos = _image_hash(selector) & mask;
+  while (self->hash[pos] != 0)
+    pos = (pos + 1) & mask;
+  self->hash[pos] = self->selectors->len;
+  return TRUE;
+}
+
+static gboolean
+_write_all(FILE *f, const void *data, gsize len)
+{
+  return len == 0 || fwrite(data, len, 1, f) == 1;
+}
+
+static gboolean
+_image_builder_write(ContextInfoDBImageBuilder *self, const gchar *filename, guint32 tag)
+{
+  ContextInfoDBImageHeader header;
+  gchar *temp_filename;
+  gboolean success;
+  gint fd;
+  FILE *f;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CONTEXT_INFO_DB_IMAGE_MAGIC, sizeof(header.magic));
+  header.byte_order = CONTEXT_INFO_DB_IMAGE_BYTE_ORDER;
+  header.version = CONTEXT_INFO_DB_IMAGE_VERSION;
+  header.num_selectors = self->selectors->len;
+  header.num_records = self->records->len;
+  header.hash_size = self->hash_size;
+  header.tag = tag;
+  header.selectors_offset = sizeof(header);
+  header.records_offset = header.selectors_offset + (guint64) self->selectors->len * sizeof(ContextInfoDBImageSelector);
+  header.hash_offset = header.records_offset + (guint64) self->records->len * sizeof(ContextInfoDBImageRecord);
+  header.strings_offset = header.hash_offset + (guint64) self->hash_size * sizeof(guint32);
+  header.strings_len = self->strings->len;
+
+  /* write a new file and rename it over the old one, so that it doesn't
+   * change under those still having the previous version mapped */
+  temp_filename = g_strdup_printf("%s.XXXXXX", filename);
+  fd = g_mkstemp(temp_filename);
+  f = fd >= 0 ? fdopen(fd, "w") : NULL;
+  if (!f)
+    {
+      msg_debug("Error creating add-contextual-data database image",
+                evt_tag_str("filename", temp_filename),
+                evt_tag_errno("error", errno));
+      if (fd >= 0)
+        {
+          close(fd);
+          unlink(temp_filename);
+        }
+      g_free(temp_filename);
+      return FALSE;
+    }
+
+  success = _write_all(f, &header, sizeof(header)) &&
+            _write_all(f, self->selectors->data, self->selectors->len * sizeof(ContextInfoDBImageSelector)) &&
+            _write_all(f, self->records->data, self->records->len * sizeof(ContextInfoDBImageRecord)) &&
+            _write_all(f, self->hash, self->hash_size * sizeof(guint32)) &&
+            _write_all(f, self->strings->str, self->strings->len);
+  success = (fclose(f) == 0) && success;
+
+  if (success && rename(temp_filename, filename) < 0)
+    success = FALSE;
+
+  if (!success)
+    {
+      msg_debug("Error writing add-contextual-data database image",
+                evt_tag_str("filename", filename),
+                evt_tag_errno("error", errno));
+      unlink(temp_filename);
+    }
+  g_free(temp_filename);
+  return success;
+}
+
+/*
+ * Writes the records of the database into an image that can be mapped by
+ * context_info_db_load_image().
+ */
+gboolean
+context_info_db_write_image(ContextInfoDB *self, const gchar *filename, const gchar *tag)
+{
+  ContextInfoDBImageBuilder builder;
+  guint32 num_selectors = g_hash_table_size(self->known_selectors);
+  guint32 tag_offset;
+  gboolean success = FALSE;
+
+  if (self->image)
+    return FALSE;
+
+  _ensure_indexed_db(self);
+
+  builder.selectors = g_array_sized_new(FALSE, FALSE, sizeof(ContextInfoDBImageSelector), num_selectors);
+  builder.records = g_array_sized_new(FALSE, FALSE, sizeof(ContextInfoDBImageRecord), self->data->len);
+  builder.hash_size = num_selectors ? 1 : 0;
+  while (builder.hash_size && builder.hash_size < num_selectors * 2)
+    builder.hash_size <<= 1;
+  builder.hash = g_new0(guint32, builder.hash_size);
+  builder.strings = g_string_sized_new(4096);
+  builder.interned_strings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  if (!_image_builder_intern(&builder, tag, strlen(tag), &tag_offset))
+    goto exit;
+
+  for (GList *l = self->ordered_selectors; l; l = l->next)
+    {
+      if (!_image_builder_add_selector(&builder, self, (const gchar *) l->data))
+        {
+          msg_debug("add-contextual-data database is too large for an image");
+          goto exit;
+        }
+    }
+
+  success = _image_builder_write(&builder, filename, tag_offset);
+
+exit:
+  g_hash_table_unref(builder.interned_strings);
+  g_string_free(builder.strings, TRUE);
+  g_free(builder.hash);
+  g_array_free(builder.records, TRUE);
+  g_array_free(builder.selectors, TRUE);
+  return success;
+}
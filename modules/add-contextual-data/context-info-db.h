@@ -63,4 +63,7 @@ GList *context_info_db_get_selectors(ContextInfoDB *self);
 gboolean context_info_db_import(ContextInfoDB *self, FILE *fp,
                                 ContextualDataRecordScanner *scanner);
 
+gboolean context_info_db_write_image(ContextInfoDB *self, const gchar *filename, const gchar *tag);
+gboolean context_info_db_load_image(ContextInfoDB *self, const gchar *filename, const gchar *tag);
+
 #endif
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+
+#include "context-prefix-index.h"
+#include "cidr-set.h"
+
+#include <string.h>
+
+/* nodes of the CIDR trie are kept in a single array and refer to each
+ * other by index.  Addresses are parsed by cidr-set, which returns IPv4
+ * ones as IPv4-mapped IPv6 addresses: networks within ::ffff:0:0/96 go to
+ * their own root so that IPv4 lookups walk 32 bits at most, no matter
+ * which notation was used */
+#define CIDR_ROOT_IPV4 1
+#define CIDR_ROOT_IPV6 2
+
+#define CIDR_IPV4_MAPPED_PREFIX_LEN 96
+
+#define DOMAIN_MAX_LABEL_LEN 64
+
+typedef struct _ContextCIDRNode
+{
+  guint32 child[2];
+  gint32 selector;
+} ContextCIDRNode;
+
+typedef struct _ContextDomainNode
+{
+  GHashTable *children;
+  gint32 selector;
+} ContextDomainNode;
+
+struct _ContextPrefixIndex
+{
+  ContextPrefixIndexType type;
+  GPtrArray *selectors;
+  GArray *cidr_nodes;
+  ContextDomainNode *domain_root;
+};
+
+static gint32
+_add_selector(ContextPrefixIndex *self, const gchar *selector)
+{
+  g_ptr_array_add(self->selectors, g_strdup(selector));
+  return self->selectors->len - 1;
+}
+
+static inline ContextCIDRNode *
+_cidr_node(ContextPrefixIndex *self, guint32 node)
+{
+  return &g_array_index(self->cidr_nodes, ContextCIDRNode, node);
+}
+
+static guint32
+_cidr_node_new(ContextPrefixIndex *self)
+{
+  ContextCIDRNode node = { { 0, 0 }, -1 };
+
+  g_array_append_val(self->cidr_nodes, node);
+  return self->cidr_nodes->len - 1;
+}
+
+static inline gint
+_address_bit(const guint8 *address, gint bit)
+{
+  return (address[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static gboolean
+_is_ipv4_mapped(const guint8 *address)
+{
+  static const guint8 ipv4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+  return memcmp(address, ipv4_mapped_prefix, sizeof(ipv4_mapped_prefix)) == 0;
+}
+
+static gboolean
+_cidr_add(ContextPrefixIndex *self, const gchar *selector)
+{
+  guint8 address[16];
+  const guint8 *bits_start = address;
+  guint32 node = CIDR_ROOT_IPV6;
+  gint bits, i;
+
+  if (!cidr_parse_network(selector, address, &bits))
+    return FALSE;
+
+  if (_is_ipv4_mapped(address) && bits >= CIDR_IPV4_MAPPED_PREFIX_LEN)
+    {
+      node = CIDR_ROOT_IPV4;
+      bits_start = address + CIDR_IPV4_MAPPED_PREFIX_LEN / 8;
+      bits -= CIDR_IPV4_MAPPED_PREFIX_LEN;
+    }
+
+  for (i = 0; i < bits; i++)
+    {
+      gint bit = _address_bit(bits_start, i);
+      guint32 child = _cidr_node(self, node)->child[bit];
+
+      if (!child)
+        {
+          child = _cidr_node_new(self);
+          _cidr_node(self, node)->child[bit] = child;
+        }
+      node = child;
+    }
+
+  /* the same network may be spelled differently, the first one wins */
+  if (_cidr_node(self, node)->selector < 0)
+    _cidr_node(self, node)->selector = _add_selector(self, selector);
+  return TRUE;
+}
+
+/* returns the most specific selector on the path of @address, or @best */
+static gint32
+_cidr_walk(ContextPrefixIndex *self, guint32 node, const guint8 *address, gint bits, gint32 best)
+{
+  gint i;
+
+  for (i = 0; ; i++)
+    {
+      const ContextCIDRNode *n = _cidr_node(self, node);
+
+      if (n->selector >= 0)
+        best = n->selector;
+      if (i == bits)
+        break;
+      node = n->child[_address_bit(address, i)];
+      if (!node)
+        break;
+    }
+  return best;
+}
+
+static const gchar *
+_cidr_lookup(ContextPrefixIndex *self, const gchar *value)
+{
+  guint8 address[16];
+  gint32 best;
+
+  if (!cidr_parse_address(value, address))
+    return NULL;
+
+  if (_is_ipv4_mapped(address))
+    {
+      /* IPv6 networks shorter than /96 may cover IPv4 addresses too */
+      best = _cidr_walk(self, CIDR_ROOT_IPV6, address, CIDR_IPV4_MAPPED_PREFIX_LEN - 1, -1);
+      best = _cidr_walk(self, CIDR_ROOT_IPV4, address + CIDR_IPV4_MAPPED_PREFIX_LEN / 8,
+                        128 - CIDR_IPV4_MAPPED_PREFIX_LEN, best);
+    }
+  else
+    {
+      best = _cidr_walk(self, CIDR_ROOT_IPV6, address, 128, -1);
+    }
+  return best >= 0 ? g_ptr_array_index(self->selectors, best) : NULL;
+}
+
+static ContextDomainNode *
+_domain_node_new(void)
+{
+  ContextDomainNode *self = g_new0(ContextDomainNode, 1);
+
+  self->selector = -1;
+  return self;
+}
+
+static void
+_domain_node_free(ContextDomainNode *self)
+{
+  if (self->children)
+    g_hash_table_destroy(self->children);
+  g_free(self);
+}
+
+/* finds the label preceding @end in @value, returns its start */
+static const gchar *
+_domain_prev_label(const gchar *value, const gchar *end)
+{
+  const gchar *p = end;
+
+  while (p > value && *(p - 1) != '.')
+    p--;
+  return p;
+}
+
+static gboolean
+_domain_add(ContextPrefixIndex *self, const gchar *selector)
+{
+  ContextDomainNode *node = self->domain_root;
+  const gchar *start = selector;
+  const gchar *end, *label;
+  gchar *label_str;
+
+  if (strncmp(start, "*.", 2) == 0)
+    start += 2;
+  else if (*start == '.')
+    start++;
+  end = start + strlen(start);
+  if (end > start && *(end - 1) == '.')
+    end--;
+  if (end == start)
+    return FALSE;
+
+  while (end > start)
+    {
+      ContextDomainNode *child;
+
+      label = _domain_prev_label(start, end);
+      if (label == end || end - label >= DOMAIN_MAX_LABEL_LEN)
+        return FALSE;
+
+      label_str = g_ascii_strdown(label, end - label);
+      if (!node->children)
+        node->children = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) _domain_node_free);
+      child = g_hash_table_lookup(node->children, label_str);
+      if (!child)
+        {
+          child = _domain_node_new();
+          g_hash_table_insert(node->children, label_str, child);
+        }
+      else
+        {
+          g_free(label_str);
+        }
+      node = child;
+      end = label > start ? label - 1 : label;
+    }
+
+  if (node->selector < 0)
+    node->selector = _add_selector(self, selector);
+  return TRUE;
+}
+
+static const gchar *
+_domain_lookup(ContextPrefixIndex *self, const gchar *value)
+{
+  ContextDomainNode *node = self->domain_root;
+  gchar label_str[DOMAIN_MAX_LABEL_LEN];
+  const gchar *end, *label;
+  gint32 best = -1;
+  gint i;
+
+  end = value + strlen(value);
+  if (end > value && *(end - 1) == '.')
+    end--;
+
+  while (end > value && node->children)
+    {
+      label = _domain_prev_label(value, end);
+      if (end - label >= DOMAIN_MAX_LABEL_LEN)
+        break;
+
+      for (i = 0; label + i < end; i++)
+        label_str[i] = g_ascii_tolower(label[i]);
+      label_str[i] = 0;
+
+      node = g_hash_table_lookup(node->children, label_str);
+      if (!node)
+        break;
+      if (node->selector >= 0)
+        best = node->selector;
+      end = label > value ? label - 1 : label;
+    }
+  return best >= 0 ? g_ptr_array_index(self->selectors, best) : NULL;
+}
+
+/*
+ * Adds a selector of the context database to the index.  Returns FALSE if
+ * the selector is not a network (or domain name), in which case it can
+ * still be matched exactly, but not as a prefix.
+ */
+gboolean
+context_prefix_index_add(ContextPrefixIndex *self, const gchar *selector)
+{
+  if (self->type == CONTEXT_PREFIX_INDEX_CIDR)
+    return _cidr_add(self, selector);
+  return _domain_add(self, selector);
+}
+
+gsize
+context_prefix_index_get_size(ContextPrefixIndex *self)
+{
+  return self->selectors->len;
+}
+
+/*
+ * Returns the most specific selector covering @value, or NULL if there's
+ * none.  The returned string is owned by the index.
+ */
+const gchar *
+context_prefix_index_lookup(ContextPrefixIndex *self, const gchar *value)
+{
+  if (self->type == CONTEXT_PREFIX_INDEX_CIDR)
+    return _cidr_lookup(self, value);
+  return _domain_lookup(self, value);
+}
+
+ContextPrefixIndex *
+context_prefix_index_new(ContextPrefixIndexType type)
+{
+  ContextPrefixIndex *self = g_new0(ContextPrefixIndex, 1);
+
+  self->type = type;
+  self->selectors = g_ptr_array_new();
+  if (type == CONTEXT_PREFIX_INDEX_CIDR)
+    {
+      self->cidr_nodes = g_array_new(FALSE, FALSE, sizeof(ContextCIDRNode));
+      /* node 0 stands for "no child" */
+      _cidr_node_new(self);
+      _cidr_node_new(self);
+      _cidr_node_new(self);
+    }
+  else
+    {
+      self->domain_root = _domain_node_new();
+    }
+  return self;
+}
+
+void
+context_prefix_index_free(ContextPrefixIndex *self)
+{
+  g_ptr_array_foreach(self->selectors, (GFunc) g_free, NULL);
+  g_ptr_array_free(self->selectors, TRUE);
+  if (self->cidr_nodes)
+    g_array_free(self->cidr_nodes, TRUE);
+  if (self->domain_root)
+    _domain_node_free(self->domain_root);
+  g_free(self);
+}
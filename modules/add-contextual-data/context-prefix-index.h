@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+
+#ifndef CONTEXT_PREFIX_INDEX_H_INCLUDED
+#define CONTEXT_PREFIX_INDEX_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * Maps a value to the most specific selector of the context database that
+ * covers it, so that a single record can describe a whole network or
+ * domain.  CIDR indexes hold selectors like "10.0.0.0/24" or "2001:db8::/32"
+ * in a binary trie and return the longest matching prefix of an address.
+ * Domain indexes hold selectors like "example.com" in a trie of reversed
+ * labels and return the longest matching suffix of a hostname.
+ */
+
+typedef enum
+{
+  CONTEXT_PREFIX_INDEX_CIDR,
+  CONTEXT_PREFIX_INDEX_DOMAIN,
+} ContextPrefixIndexType;
+
+typedef struct _ContextPrefixIndex ContextPrefixIndex;
+
+ContextPrefixIndex *context_prefix_index_new(ContextPrefixIndexType type);
+void context_prefix_index_free(ContextPrefixIndex *self);
+
+gboolean context_prefix_index_add(ContextPrefixIndex *self, const gchar *selector);
+gsize context_prefix_index_get_size(ContextPrefixIndex *self);
+const gchar *context_prefix_index_lookup(ContextPrefixIndex *self, const gchar *value);
+
+#endif
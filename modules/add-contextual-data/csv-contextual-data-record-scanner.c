@@ -66,7 +66,7 @@ const gboolean
 get_next_record(ContextualDataRecordScanner *s, const gchar *input, ContextualDataRecord *record)
 {
   CSVContextualDataRecordScanner *csv_record_scanner = (CSVContextualDataRecordScanner *) s;
-  csv_scanner_init(&csv_record_scanner->scanner, &csv_record_scanner->options, input);
+  csv_scanner_init(&csv_record_scanner->scanner, &csv_record_scanner->options, input, -1);
 
   if (!_fetch_next_without_prefix(csv_record_scanner, &record->selector))
     return FALSE;
@@ -25,7 +25,9 @@
 #include <criterion/criterion.h>
 #include <criterion/parameterized.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
@@ -426,3 +428,78 @@ ParameterizedTest(struct TestNVPairPrefix *param, add_contextual_data, test_impo
       &param->expected,
       1);
 }
+
+Test(add_contextual_data, test_image_roundtrip)
+{
+  gchar image_filename[] = "test_context_info_db_image_XXXXXX";
+  ContextInfoDB *db = context_info_db_new();
+  ContextInfoDB *image_db = context_info_db_new();
+  gint fd = mkstemp(image_filename);
+
+  cr_assert(fd >= 0);
+  close(fd);
+
+  _fill_context_info_db(db, "selector", "name", "value", 3, 2);
+  cr_assert(context_info_db_write_image(db, image_filename, "tag"),
+            "Failed to write database image");
+
+  cr_assert_not(context_info_db_load_image(image_db, image_filename, "other-tag"),
+                "Database image loaded with a mismatching tag");
+  cr_assert(context_info_db_load_image(image_db, image_filename, "tag"),
+            "Failed to load database image");
+  unlink(image_filename);
+
+  cr_assert(context_info_db_is_loaded(image_db));
+  cr_assert(context_info_db_contains(image_db, "selector-2"));
+  cr_assert_not(context_info_db_contains(image_db, "selector-3"));
+  cr_assert_eq(context_info_db_number_of_records(image_db, "selector-1"), 2);
+  cr_assert_eq(context_info_db_number_of_records(image_db, "selector-3"), 0);
+
+  TestNVPair expected_nvpairs[] =
+  {
+    {.name = "name-1.0",.value = "value-1.0"},
+    {.name = "name-1.1",.value = "value-1.1"},
+  };
+  _assert_context_info_db_contains_name_value_pairs_by_selector(image_db, "selector-1",
+      expected_nvpairs, ARRAY_SIZE(expected_nvpairs));
+
+  GList *ordered_selectors = context_info_db_ordered_selectors(image_db);
+  cr_assert_eq(g_list_length(ordered_selectors), 3);
+  cr_assert_str_eq((const gchar *) g_list_nth_data(ordered_selectors, 0), "selector-0");
+  cr_assert_str_eq((const gchar *) g_list_nth_data(ordered_selectors, 2), "selector-2");
+
+  context_info_db_unref(image_db);
+  context_info_db_unref(db);
+}
+
+Test(add_contextual_data, test_image_write_leaves_no_temporary_files)
+{
+  gchar image_dir[] = "test_context_info_db_image_dir_XXXXXX";
+  ContextInfoDB *db = context_info_db_new();
+  const gchar *name;
+  gchar *image_filename;
+  GDir *dir;
+  gint num_files = 0;
+
+  cr_assert_not_null(mkdtemp(image_dir));
+  image_filename = g_build_filename(image_dir, "image.ctxdb", NULL);
+
+  _fill_context_info_db(db, "selector", "name", "value", 3, 2);
+  cr_assert(context_info_db_write_image(db, image_filename, "tag"),
+            "Failed to write database image");
+
+  dir = g_dir_open(image_dir, 0, NULL);
+  cr_assert_not_null(dir);
+  while ((name = g_dir_read_name(dir)))
+    {
+      cr_assert_str_eq(name, "image.ctxdb", "Unexpected file in the image directory: %s", name);
+      num_files++;
+    }
+  g_dir_close(dir);
+  cr_assert_eq(num_files, 1);
+
+  unlink(image_filename);
+  rmdir(image_dir);
+  g_free(image_filename);
+  context_info_db_unref(db);
+}
@@ -83,3 +83,85 @@ Test(add_contextual_data_template_selector, test_template_selector_cannot_be_res
   log_msg_unref(msg);
   add_contextual_data_selector_free(selector);
 }
+
+static AddContextualDataSelector *
+_create_prefix_selector(const gchar *template_string, ContextPrefixIndexType type, const gchar **selectors)
+{
+  GlobalConfig *cfg = cfg_new(VERSION_VALUE);
+  AddContextualDataSelector *selector = add_contextual_data_prefix_selector_new(cfg, template_string, type);
+  GList *ordered_selectors = NULL;
+
+  for (; *selectors; selectors++)
+    ordered_selectors = g_list_append(ordered_selectors, (gpointer) *selectors);
+  cr_assert(add_contextual_data_selector_init(selector, ordered_selectors));
+  g_list_free(ordered_selectors);
+
+  return selector;
+}
+
+static void
+_assert_resolves_to(AddContextualDataSelector *selector, const gchar *host, const gchar *expected)
+{
+  LogMessage *msg = _create_log_msg("testmsg", host);
+  gchar *resolved_selector = add_contextual_data_selector_resolve(selector, msg);
+
+  cr_assert_str_eq(resolved_selector, expected, "Value %s resolved to %s instead of %s", host, resolved_selector,
+                   expected);
+  g_free(resolved_selector);
+  log_msg_unref(msg);
+}
+
+Test(add_contextual_data_template_selector, test_cidr_selector_resolves_to_the_longest_matching_network)
+{
+  const gchar *selectors[] = { "10.0.0.0/8", "10.1.2.0/24", "10.1.2.3", "2001:db8::/32", "localhost", NULL };
+  AddContextualDataSelector *selector = _create_prefix_selector("$HOST", CONTEXT_PREFIX_INDEX_CIDR, selectors);
+
+  _assert_resolves_to(selector, "10.1.2.3", "10.1.2.3");
+  _assert_resolves_to(selector, "10.1.2.4", "10.1.2.0/24");
+  _assert_resolves_to(selector, "10.200.0.1", "10.0.0.0/8");
+  _assert_resolves_to(selector, "2001:db8::1", "2001:db8::/32");
+  _assert_resolves_to(selector, "192.168.1.1", "192.168.1.1");
+  _assert_resolves_to(selector, "localhost", "localhost");
+  add_contextual_data_selector_free(selector);
+}
+
+Test(add_contextual_data_template_selector, test_cidr_selector_normalizes_ipv4_mapped_addresses)
+{
+  const gchar *selectors[] = { "::/64", "::ffff:192.168.0.0/112", "10.0.0.0/8", "172.16.0.0/255.255.0.0", NULL };
+  AddContextualDataSelector *selector = _create_prefix_selector("$HOST", CONTEXT_PREFIX_INDEX_CIDR, selectors);
+
+  _assert_resolves_to(selector, "192.168.3.4", "::ffff:192.168.0.0/112");
+  _assert_resolves_to(selector, "::ffff:10.1.1.1", "10.0.0.0/8");
+  _assert_resolves_to(selector, "172.16.200.1", "172.16.0.0/255.255.0.0");
+  _assert_resolves_to(selector, "8.8.8.8", "::/64");
+  _assert_resolves_to(selector, "::1", "::/64");
+  add_contextual_data_selector_free(selector);
+}
+
+Test(add_contextual_data_template_selector, test_domain_selector_resolves_to_the_longest_matching_suffix)
+{
+  const gchar *selectors[] = { "example.com", "mail.example.com", "org", NULL };
+  AddContextualDataSelector *selector = _create_prefix_selector("$HOST", CONTEXT_PREFIX_INDEX_DOMAIN, selectors);
+
+  _assert_resolves_to(selector, "example.com", "example.com");
+  _assert_resolves_to(selector, "www.example.com", "example.com");
+  _assert_resolves_to(selector, "smtp.MAIL.example.com.", "mail.example.com");
+  _assert_resolves_to(selector, "www.syslog-ng.org", "org");
+  _assert_resolves_to(selector, "badexample.com", "badexample.com");
+  add_contextual_data_selector_free(selector);
+}
+
+Test(add_contextual_data_template_selector, test_cloned_prefix_selector_builds_its_own_index)
+{
+  const gchar *selectors[] = { "10.0.0.0/8", NULL };
+  AddContextualDataSelector *selector = _create_prefix_selector("$HOST", CONTEXT_PREFIX_INDEX_CIDR, selectors);
+  AddContextualDataSelector *cloned = add_contextual_data_selector_clone(selector, cfg_new(VERSION_VALUE));
+  GList *ordered_selectors = g_list_append(NULL, "10.0.0.0/8");
+
+  add_contextual_data_selector_free(selector);
+  cr_assert(add_contextual_data_selector_init(cloned, ordered_selectors));
+  g_list_free(ordered_selectors);
+
+  _assert_resolves_to(cloned, "10.1.1.1", "10.0.0.0/8");
+  add_contextual_data_selector_free(cloned);
+}
@@ -24,7 +24,6 @@
 #include "csvparser.h"
 #include "scanner/csv-scanner/csv-scanner.h"
 #include "parser/parser-expr.h"
-#include "scratch-buffers.h"
 
 #include <string.h>
 
@@ -34,6 +33,9 @@ typedef struct _CSVParser
   CSVScannerOptions options;
   gchar *prefix;
   gint prefix_len;
+  /* value handles of the (prefixed) column names, resolved at init time */
+  NVHandle *column_handles;
+  gint num_column_handles;
 } CSVParser;
 
 #define _ESCAPE_MODE_SHIFT 16
@@ -96,26 +98,33 @@ csv_parser_set_prefix(LogParser *s, const gchar *prefix)
     }
 }
 
-static const gchar *
-_format_key_for_prefix(GString *scratch, const gchar *key, const gint prefix_len)
+static void
+_resolve_column_handles(CSVParser *self)
 {
-  g_string_truncate(scratch, prefix_len);
-  g_string_append(scratch, key);
-  return scratch->str;
-}
+  GString *key = g_string_new(self->prefix);
+  GList *l;
+  gint i;
 
-static const gchar *
-_return_key(GString *scratch, const gchar *key, const gint prefix_len)
-{
-  return key;
-}
+  g_free(self->column_handles);
+  self->num_column_handles = g_list_length(self->options.columns);
+  self->column_handles = g_new(NVHandle, self->num_column_handles);
 
-typedef const gchar *(*key_formatter_t)(GString *scratch, const gchar *key, const gint prefix_len);
+  for (l = self->options.columns, i = 0; l; l = l->next, i++)
+    {
+      g_string_truncate(key, self->prefix_len);
+      g_string_append(key, (const gchar *) l->data);
+      self->column_handles[i] = log_msg_get_value_handle(key->str);
+    }
+  g_string_free(key, TRUE);
+}
 
-static key_formatter_t
-dispatch_key_formatter(gchar *prefix)
+static gboolean
+csv_parser_init(LogPipe *s)
 {
-  return prefix ? _format_key_for_prefix : _return_key;
+  CSVParser *self = (CSVParser *) s;
+
+  _resolve_column_handles(self);
+  return log_parser_init_method(s);
 }
 
 static gboolean
@@ -126,20 +135,15 @@ csv_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_o
   LogMessage *msg = log_msg_make_writable(pmsg, path_options);
 
   CSVScanner scanner;
-  csv_scanner_init(&scanner, &self->options, input);
-
-  GString *key_scratch = scratch_buffers_alloc();
-  if (self->prefix)
-    g_string_assign(key_scratch, self->prefix);
+  gint column = 0;
 
-  key_formatter_t _key_formatter = dispatch_key_formatter(self->prefix);
+  csv_scanner_init(&scanner, &self->options, input, input_len);
   while (csv_scanner_scan_next(&scanner))
     {
-
-      log_msg_set_value_by_name(msg,
-                                _key_formatter(key_scratch, csv_scanner_get_current_name(&scanner), self->prefix_len),
-                                csv_scanner_get_current_value(&scanner),
-                                csv_scanner_get_current_value_len(&scanner));
+      g_assert(column < self->num_column_handles);
+      log_msg_set_value(msg, self->column_handles[column++],
+                        csv_scanner_get_current_value(&scanner),
+                        csv_scanner_get_current_value_len(&scanner));
     }
 
   csv_scanner_deinit(&scanner);
@@ -166,6 +170,7 @@ csv_parser_free(LogPipe *s)
 
   csv_scanner_options_clean(&self->options);
   g_free(self->prefix);
+  g_free(self->column_handles);
   log_parser_free_method(s);
 }
 
@@ -178,6 +183,7 @@ csv_parser_new(GlobalConfig *cfg)
   CSVParser *self = g_new0(CSVParser, 1);
 
   log_parser_init_instance(&self->super, cfg);
+  self->super.super.init = csv_parser_init;
   self->super.super.free_fn = csv_parser_free;
   self->super.super.clone = csv_parser_clone;
   self->super.process = csv_parser_process;
@@ -122,6 +122,7 @@ testcase(gchar *msg, guint parse_flags, gint max_columns, gint dialect, guint32
 
   pclone = (LogParser *) log_pipe_clone(&p->super);
   log_pipe_unref(&p->super);
+  log_pipe_init(&pclone->super);
 
   nvtable = nv_table_ref(logmsg->payload);
   success = log_parser_process(pclone, &logmsg, NULL, log_msg_get_value(logmsg, LM_V_MESSAGE, NULL), -1);
@@ -396,6 +397,17 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
            CSV_SCANNER_GREEDY | CSV_SCANNER_DROP_INVALID, " ", "\"\"", "-", NULL,
            "random.vhost", "10.0.0.1", "", "GET /index.html HTTP/1.1", "200", "", NULL);
 
+  /* values longer than a vector register, delimiters and quotes across chunk boundaries */
+  testcase("2017-05-30 12:01:02.123456789,ACCEPT_TCP_OUTBOUND_CONNECTION_RULE_0001,\"src=192.168.100.254, dst=10.0.0.1, proto=TCP\",\"a \\\"very\\\" long, quoted value that spans more than thirty-two bytes\",,-,last",
+           LP_NOPARSE, 7, CSV_SCANNER_ESCAPE_BACKSLASH, 0, ",", "\"\"", "-", NULL,
+           "2017-05-30 12:01:02.123456789", "ACCEPT_TCP_OUTBOUND_CONNECTION_RULE_0001", "src=192.168.100.254, dst=10.0.0.1, proto=TCP",
+           "a \"very\" long, quoted value that spans more than thirty-two bytes", "", "", "last", NULL);
+
+  testcase("2017-05-30 12:01:02.123456789;ACCEPT_TCP_OUTBOUND_CONNECTION_RULE_0001|'it''s a quoted value that spans more than thirty-two bytes',tail",
+           LP_NOPARSE, 4, CSV_SCANNER_ESCAPE_DOUBLE_CHAR, 0, ";,|", "''", NULL, NULL,
+           "2017-05-30 12:01:02.123456789", "ACCEPT_TCP_OUTBOUND_CONNECTION_RULE_0001",
+           "it's a quoted value that spans more than thirty-two bytes", "tail", NULL);
+
   testcase("random.vhost\t10.0.0.1\t-\t\"GET /index.html HTTP/1.1\"\t200", LP_NOPARSE, 6, CSV_SCANNER_ESCAPE_BACKSLASH, 0,
            "\t", "\"\"", "-", NULL,
            "random.vhost", "10.0.0.1", "", "GET /index.html HTTP/1.1", "200", "", NULL);
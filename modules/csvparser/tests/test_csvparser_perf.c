@@ -87,6 +87,7 @@ _construct_parser(gint max_columns, gint dialect, gchar *delimiters, gchar *quot
   if (string_delims)
     csv_scanner_options_set_string_delimiters(csv_parser_get_scanner_options(p), string_array_to_list(string_delims));
 
+  log_pipe_init(&p->super);
   return p;
 }
 
@@ -48,6 +48,7 @@ _create_parser(GlobalConfig *cfg)
   csv_scanner_options_set_delimiters(csv_parser_get_scanner_options(p), ",");
   csv_scanner_options_set_flags(csv_parser_get_scanner_options(p), CSV_SCANNER_DROP_INVALID);
   csv_scanner_options_set_columns(csv_parser_get_scanner_options(p), string_array_to_list(column_array));
+  log_pipe_init(&p->super);
 
   return p;
 }
@@ -23,7 +23,14 @@
 
 #include "date-parser.h"
 #include "strptime-tz.h"
+#include "strptime-compiled.h"
 #include "str-utils.h"
+#include "tls-support.h"
+
+#include <string.h>
+
+/* longer timestamps are not memoized */
+#define DATE_PARSER_MEMO_INPUT_MAX 64
 
 typedef struct _DateParser
 {
@@ -32,8 +39,35 @@ typedef struct _DateParser
   gchar *date_tz;
   LogMessageTimeStamp time_stamp;
   TimeZoneInfo *date_tz_info;
+  StrptimeCompiled *compiled_format;
+  gint memo_id;
 } DateParser;
 
+/*
+ * The last timestamp parsed by this thread.  Missing fields (the year for
+ * instance) are taken from the time of reception, so the result is only
+ * reused for the same input received in the same second.  Parsers get a
+ * new memo_id whenever they are initialized, so a stale entry of a freed
+ * or reconfigured parser is never matched.
+ */
+typedef struct _DateParserMemo
+{
+  gint memo_id;
+  time_t now;
+  LogStamp result;
+  gchar input[DATE_PARSER_MEMO_INPUT_MAX];
+} DateParserMemo;
+
+TLS_BLOCK_START
+{
+  DateParserMemo date_parser_memo;
+}
+TLS_BLOCK_END;
+
+#define date_parser_memo __tls_deref(date_parser_memo)
+
+static gint date_parser_memo_id_counter;
+
 void
 date_parser_set_format(LogParser *s, gchar *format)
 {
@@ -68,6 +102,11 @@ date_parser_init(LogPipe *s)
   if (self->date_tz_info)
     time_zone_info_free(self->date_tz_info);
   self->date_tz_info = self->date_tz ? time_zone_info_new(self->date_tz) : NULL;
+
+  if (self->compiled_format)
+    strptime_compiled_free(self->compiled_format);
+  self->compiled_format = strptime_compiled_new(self->date_format);
+  self->memo_id = g_atomic_int_exchange_and_add(&date_parser_memo_id_counter, 1) + 1;
   return log_parser_init_method(s);
 }
 
@@ -84,7 +123,10 @@ _parse_timestamp_and_deduce_missing_parts(DateParser *self, struct tm *tm, glong
   current_year = tm->tm_year;
   tm->tm_year = 0;
   tm_gmtoff = -1;
-  remainder = strptime_with_tz(input, self->date_format, tm, &tm_gmtoff, &tm_zone);
+  if (self->compiled_format)
+    remainder = strptime_compiled_parse(self->compiled_format, input, tm, &tm_gmtoff, &tm_zone);
+  else
+    remainder = strptime_with_tz(input, self->date_format, tm, &tm_gmtoff, &tm_zone);
   if (!remainder || remainder[0])
     return FALSE;
 
@@ -174,6 +216,44 @@ _convert_timestamp_to_logstamp(DateParser *self, time_t now, LogStamp *target, c
   return TRUE;
 }
 
+static gboolean
+_lookup_memo(DateParser *self, time_t now, LogStamp *target, const gchar *input)
+{
+  if (date_parser_memo.memo_id != self->memo_id || date_parser_memo.now != now
+      || strcmp(date_parser_memo.input, input) != 0)
+    return FALSE;
+
+  *target = date_parser_memo.result;
+  return TRUE;
+}
+
+static void
+_store_memo(DateParser *self, time_t now, const LogStamp *result, const gchar *input)
+{
+  gsize input_len = strlen(input);
+
+  if (input_len >= sizeof(date_parser_memo.input))
+    return;
+
+  date_parser_memo.memo_id = self->memo_id;
+  date_parser_memo.now = now;
+  date_parser_memo.result = *result;
+  memcpy(date_parser_memo.input, input, input_len + 1);
+}
+
+static gboolean
+_convert_timestamp_to_logstamp_memoized(DateParser *self, time_t now, LogStamp *target, const gchar *input)
+{
+  if (_lookup_memo(self, now, target, input))
+    return TRUE;
+
+  if (!_convert_timestamp_to_logstamp(self, now, target, input))
+    return FALSE;
+
+  _store_memo(self, now, target, input);
+  return TRUE;
+}
+
 static gboolean
 date_parser_process(LogParser *s,
                     LogMessage **pmsg,
@@ -189,10 +269,10 @@ date_parser_process(LogParser *s,
    */
 
   APPEND_ZERO(input, input, input_len);
-  return _convert_timestamp_to_logstamp(self,
-                                        msg->timestamps[LM_TS_RECVD].tv_sec,
-                                        &msg->timestamps[self->time_stamp],
-                                        input);
+  return _convert_timestamp_to_logstamp_memoized(self,
+                                                 msg->timestamps[LM_TS_RECVD].tv_sec,
+                                                 &msg->timestamps[self->time_stamp],
+                                                 input);
 }
 
 static LogPipe *
@@ -219,6 +299,8 @@ date_parser_free(LogPipe *s)
   g_free(self->date_tz);
   if (self->date_tz_info)
     time_zone_info_free(self->date_tz_info);
+  if (self->compiled_format)
+    strptime_compiled_free(self->compiled_format);
 
   log_parser_free_method(s);
 }
@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "strptime-compiled.h"
+#include "strptime-tz.h"
+
+#include <string.h>
+
+#define TM_YEAR_BASE 1900
+
+#define isleap(y) ((((y) % 4) == 0 && ((y) % 100) != 0) || ((y) % 400) == 0)
+#define isleap_sum(a, b)  isleap((a) % 400 + (b) % 400)
+
+/* the same bits strptime_with_tz() uses to track the parsed fields */
+#define S_YEAR      (1 << 0)
+#define S_MON       (1 << 1)
+#define S_YDAY      (1 << 2)
+#define S_MDAY      (1 << 3)
+#define S_WDAY      (1 << 4)
+#define S_HOUR      (1 << 5)
+
+typedef enum
+{
+  SPO_SPACE,
+  SPO_LITERAL,
+  SPO_YEAR,
+  SPO_YEAR_OF_CENTURY,
+  SPO_MONTH,
+  SPO_MDAY,
+  SPO_HOUR,
+  SPO_HOUR12,
+  SPO_MINUTE,
+  SPO_SECOND,
+  SPO_YDAY,
+  SPO_MONTH_NAME,
+  SPO_WDAY_NAME,
+  SPO_AMPM,
+  SPO_ZONE_OFFSET,
+  SPO_ZONE_NAME,
+} StrptimeOpcode;
+
+typedef struct _StrptimeInstruction
+{
+  guint8 opcode;
+  /* S_* bits set once the instruction succeeded */
+  guint8 state;
+  gchar literal;
+} StrptimeInstruction;
+
+struct _StrptimeCompiled
+{
+  gint num_instructions;
+  /* S_* bits of the complex conversions (%F, %D, ...), set upfront */
+  guint8 state;
+  StrptimeInstruction instructions[0];
+};
+
+typedef struct _StrptimeName
+{
+  const gchar *name;
+  gsize len;
+} StrptimeName;
+
+#define NAME(n) { n, sizeof(n) - 1 }
+
+/* full names, the first three characters of which are the abbreviations */
+static const StrptimeName month_names[12] =
+{
+  NAME("january"), NAME("february"), NAME("march"), NAME("april"), NAME("may"), NAME("june"),
+  NAME("july"), NAME("august"), NAME("september"), NAME("october"), NAME("november"), NAME("december")
+};
+
+static const StrptimeName wday_names[7] =
+{
+  NAME("sunday"), NAME("monday"), NAME("tuesday"), NAME("wednesday"), NAME("thursday"), NAME("friday"), NAME("saturday")
+};
+
+#undef NAME
+
+static const gint start_of_month[2][13] =
+{
+  { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+  { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 }
+};
+
+/*
+ * Compiler
+ */
+
+static void
+_emit(GArray *instructions, StrptimeOpcode opcode, gboolean nested, guint8 state, gchar literal)
+{
+  StrptimeInstruction insn;
+
+  insn.opcode = opcode;
+  /* nested formats track their own fields in strptime_with_tz(), the
+   * enclosing conversion only sees the bits of the complex conversion */
+  insn.state = nested ? 0 : state;
+  insn.literal = literal;
+  g_array_append_val(instructions, insn);
+}
+
+static gboolean
+_compile_format(GArray *instructions, const gchar *fmt, gboolean nested, guint8 *state, gint *years_of_century)
+{
+  const gchar *new_fmt;
+  guint8 new_state;
+  gchar c;
+
+  while ((c = *fmt++) != '\0')
+    {
+      if (g_ascii_isspace(c))
+        {
+          StrptimeInstruction *last = instructions->len
+                                      ? &g_array_index(instructions, StrptimeInstruction, instructions->len - 1)
+                                      : NULL;
+
+          if (!last || last->opcode != SPO_SPACE)
+            _emit(instructions, SPO_SPACE, nested, 0, 0);
+          continue;
+        }
+      if (c != '%')
+        {
+          _emit(instructions, SPO_LITERAL, nested, 0, c);
+          continue;
+        }
+
+      new_fmt = NULL;
+      new_state = 0;
+      switch (c = *fmt++)
+        {
+        case '%':
+          _emit(instructions, SPO_LITERAL, nested, 0, '%');
+          break;
+        case 'c':
+          new_fmt = "%a %b %e %H:%M:%S %Y";
+          new_state = S_WDAY | S_MON | S_MDAY | S_YEAR;
+          break;
+        case 'D':
+          new_fmt = "%m/%d/%y";
+          new_state = S_MON | S_MDAY | S_YEAR;
+          break;
+        case 'F':
+          new_fmt = "%Y-%m-%d";
+          new_state = S_MON | S_MDAY | S_YEAR;
+          break;
+        case 'x':
+          new_fmt = "%m/%d/%y";
+          new_state = S_MON | S_MDAY | S_YEAR;
+          break;
+        case 'R':
+          new_fmt = "%H:%M";
+          break;
+        case 'r':
+          new_fmt = "%I:%M:%S %p";
+          break;
+        case 'T':
+        case 'X':
+          new_fmt = "%H:%M:%S";
+          break;
+        case 'A':
+        case 'a':
+          _emit(instructions, SPO_WDAY_NAME, nested, S_WDAY, 0);
+          break;
+        case 'B':
+        case 'b':
+        case 'h':
+          _emit(instructions, SPO_MONTH_NAME, nested, S_MON, 0);
+          break;
+        case 'd':
+        case 'e':
+          _emit(instructions, SPO_MDAY, nested, S_MDAY, 0);
+          break;
+        case 'H':
+        case 'k':
+          _emit(instructions, SPO_HOUR, nested, S_HOUR, 0);
+          break;
+        case 'I':
+        case 'l':
+          _emit(instructions, SPO_HOUR12, nested, S_HOUR, 0);
+          break;
+        case 'j':
+          _emit(instructions, SPO_YDAY, nested, S_YDAY, 0);
+          break;
+        case 'M':
+          _emit(instructions, SPO_MINUTE, nested, 0, 0);
+          break;
+        case 'm':
+          _emit(instructions, SPO_MONTH, nested, S_MON, 0);
+          break;
+        case 'p':
+          _emit(instructions, SPO_AMPM, nested, 0, 0);
+          break;
+        case 'S':
+          _emit(instructions, SPO_SECOND, nested, 0, 0);
+          break;
+        case 'Y':
+          _emit(instructions, SPO_YEAR, nested, S_YEAR, 0);
+          break;
+        case 'y':
+          /* a second %y would complete the century of the first one */
+          if (++(*years_of_century) > 1)
+            return FALSE;
+          _emit(instructions, SPO_YEAR_OF_CENTURY, nested, S_YEAR, 0);
+          break;
+        case 'n':
+        case 't':
+          _emit(instructions, SPO_SPACE, nested, 0, 0);
+          break;
+        case 'z':
+          _emit(instructions, SPO_ZONE_OFFSET, nested, 0, 0);
+          break;
+        case 'Z':
+          _emit(instructions, SPO_ZONE_NAME, nested, 0, 0);
+          break;
+        default:
+          /* alternative representations, week numbers, %s and the like */
+          return FALSE;
+        }
+
+      if (new_fmt)
+        {
+          if (!nested)
+            *state |= new_state;
+          if (!_compile_format(instructions, new_fmt, TRUE, state, years_of_century))
+            return FALSE;
+        }
+    }
+  return TRUE;
+}
+
+StrptimeCompiled *
+strptime_compiled_new(const gchar *fmt)
+{
+  StrptimeCompiled *self = NULL;
+  GArray *instructions = g_array_new(FALSE, FALSE, sizeof(StrptimeInstruction));
+  gint years_of_century = 0;
+  guint8 state = 0;
+
+  if (_compile_format(instructions, fmt, FALSE, &state, &years_of_century))
+    {
+      self = g_malloc(sizeof(StrptimeCompiled) + instructions->len * sizeof(StrptimeInstruction));
+      self->num_instructions = instructions->len;
+      self->state = state;
+      memcpy(self->instructions, instructions->data, instructions->len * sizeof(StrptimeInstruction));
+    }
+  g_array_free(instructions, TRUE);
+  return self;
+}
+
+void
+strptime_compiled_free(StrptimeCompiled *self)
+{
+  g_free(self);
+}
+
+/*
+ * Execution
+ */
+
+/* same as conv_num() in strptime-tz.c: the upper limit determines the
+ * number of digits consumed */
+static inline const guchar *
+_parse_number(const guchar *bp, gint *dest, guint llim, guint ulim)
+{
+  guint result = 0;
+  guint rulim = ulim;
+  guchar ch = *bp;
+
+  if (ch < '0' || ch > '9')
+    return NULL;
+
+  do
+    {
+      result = result * 10 + (ch - '0');
+      rulim /= 10;
+      ch = *++bp;
+    }
+  while ((result * 10 <= ulim) && rulim && ch >= '0' && ch <= '9');
+
+  if (result < llim || result > ulim)
+    return NULL;
+
+  *dest = result;
+  return bp;
+}
+
+static inline guint32
+_lower_abbreviation(const guchar *bp)
+{
+  /* a NUL stops the comparison at the first mismatch, so bp is never read
+   * beyond the end of the string */
+  if (!bp[0] || !bp[1])
+    return 0;
+  return ((bp[0] | 0x20) << 16) | ((bp[1] | 0x20) << 8) | (bp[2] | 0x20);
+}
+
+/* full names take precedence over abbreviations, just like in
+ * strptime_with_tz() */
+static const guchar *
+_parse_name(const guchar *bp, gint *dest, const StrptimeName *names, gint num_names)
+{
+  guint32 abbrev = _lower_abbreviation(bp);
+  gint i;
+
+  if (!abbrev)
+    return NULL;
+
+  for (i = 0; i < num_names; i++)
+    {
+      const gchar *name = names[i].name;
+
+      if (abbrev != (((guchar) name[0] << 16) | ((guchar) name[1] << 8) | (guchar) name[2]))
+        continue;
+
+      *dest = i;
+      if (g_ascii_strncasecmp((const gchar *) bp + 3, name + 3, names[i].len - 3) == 0)
+        return bp + names[i].len;
+      return bp + 3;
+    }
+  return NULL;
+}
+
+/* the numeric forms of %z, anything else is left to strptime_with_tz() */
+static const guchar *
+_parse_zone_offset(const guchar *bp, struct tm *tm, long *tm_gmtoff, const gchar **tm_zone)
+{
+  const guchar *start = bp;
+  gboolean neg;
+  gint offs, i;
+
+  while (g_ascii_isspace(*bp))
+    bp++;
+
+  switch (*bp)
+    {
+    case 'Z':
+      tm->tm_isdst = 0;
+      *tm_gmtoff = 0;
+      *tm_zone = "UTC";
+      return bp + 1;
+    case '+':
+      neg = FALSE;
+      break;
+    case '-':
+      neg = TRUE;
+      break;
+    default:
+      return (const guchar *) strptime_with_tz((const gchar *) start, "%z", tm, tm_gmtoff, tm_zone);
+    }
+  bp++;
+
+  offs = 0;
+  for (i = 0; i < 4; )
+    {
+      if (*bp >= '0' && *bp <= '9')
+        {
+          offs = offs * 10 + (*bp++ - '0');
+          i++;
+          continue;
+        }
+      if (i == 2 && *bp == ':')
+        {
+          bp++;
+          continue;
+        }
+      break;
+    }
+
+  switch (i)
+    {
+    case 2:
+      offs *= 100;
+      break;
+    case 4:
+      i = offs % 100;
+      if (i >= 60)
+        return NULL;
+      /* minutes in decimal, rounded the same way as strptime_with_tz() */
+      offs = (offs / 100) * 100 + (i * 50) / 30;
+      break;
+    default:
+      return NULL;
+    }
+  if (neg)
+    offs = -offs;
+  tm->tm_isdst = 0;
+  *tm_gmtoff = (offs * 3600) / 100;
+  *tm_zone = "UTC";
+  return bp;
+}
+
+static gint
+_first_wday_of(gint yr)
+{
+  return ((2 * (3 - (yr / 100) % 4)) + (yr % 100) + ((yr % 100) /  4) +
+          (isleap(yr) ? 6 : 0) + 1) % 7;
+}
+
+/* fill the fields that can be deduced from the parsed ones, see the end
+ * of strptime_with_tz() */
+static void
+_complete_tm(struct tm *tm, guint state)
+{
+  gint leap, i;
+
+  if (!(state & S_YEAR))
+    return;
+
+  if (!(state & S_YDAY) && (state & S_MON) && (state & S_MDAY))
+    {
+      tm->tm_yday = start_of_month[isleap_sum(tm->tm_year, TM_YEAR_BASE)][tm->tm_mon] + (tm->tm_mday - 1);
+      state |= S_YDAY;
+    }
+
+  if (!(state & S_YDAY))
+    return;
+
+  leap = isleap_sum(tm->tm_year, TM_YEAR_BASE);
+  if (!(state & S_MON))
+    {
+      for (i = 0; i < 13 && tm->tm_yday >= start_of_month[leap][i]; i++)
+        ;
+      if (i > 12)
+        {
+          i = 1;
+          tm->tm_yday -= start_of_month[leap][12];
+          tm->tm_year++;
+        }
+      tm->tm_mon = i - 1;
+    }
+
+  if (!(state & S_MDAY))
+    tm->tm_mday = tm->tm_yday - start_of_month[isleap_sum(tm->tm_year, TM_YEAR_BASE)][tm->tm_mon] + 1;
+
+  if (!(state & S_WDAY))
+    tm->tm_wday = (_first_wday_of(tm->tm_year) + tm->tm_yday + 1) % 7;
+}
+
+const gchar *
+strptime_compiled_parse(const StrptimeCompiled *self, const gchar *buf, struct tm *tm,
+                        long *tm_gmtoff, const gchar **tm_zone)
+{
+  const guchar *bp = (const guchar *) buf;
+  guint state = self->state;
+  gint i, value;
+
+  for (i = 0; i < self->num_instructions; i++)
+    {
+      const StrptimeInstruction *insn = &self->instructions[i];
+
+      switch (insn->opcode)
+        {
+        case SPO_SPACE:
+          while (g_ascii_isspace(*bp))
+            bp++;
+          break;
+        case SPO_LITERAL:
+          if (*bp++ != (guchar) insn->literal)
+            return NULL;
+          break;
+        case SPO_YEAR:
+          bp = _parse_number(bp, &value, 0, 9999);
+          if (bp)
+            tm->tm_year = value - TM_YEAR_BASE;
+          break;
+        case SPO_YEAR_OF_CENTURY:
+          bp = _parse_number(bp, &value, 0, 99);
+          if (bp)
+            tm->tm_year = value <= 68 ? value + 2000 - TM_YEAR_BASE : value;
+          break;
+        case SPO_MONTH:
+          bp = _parse_number(bp, &value, 1, 12);
+          if (bp)
+            tm->tm_mon = value - 1;
+          break;
+        case SPO_MDAY:
+          bp = _parse_number(bp, &tm->tm_mday, 1, 31);
+          break;
+        case SPO_HOUR:
+          bp = _parse_number(bp, &tm->tm_hour, 0, 23);
+          break;
+        case SPO_HOUR12:
+          bp = _parse_number(bp, &tm->tm_hour, 1, 12);
+          if (bp && tm->tm_hour == 12)
+            tm->tm_hour = 0;
+          break;
+        case SPO_MINUTE:
+          bp = _parse_number(bp, &tm->tm_min, 0, 59);
+          break;
+        case SPO_SECOND:
+          bp = _parse_number(bp, &tm->tm_sec, 0, 61);
+          break;
+        case SPO_YDAY:
+          bp = _parse_number(bp, &value, 1, 366);
+          if (bp)
+            tm->tm_yday = value - 1;
+          break;
+        case SPO_MONTH_NAME:
+          bp = _parse_name(bp, &tm->tm_mon, month_names, G_N_ELEMENTS(month_names));
+          break;
+        case SPO_WDAY_NAME:
+          bp = _parse_name(bp, &tm->tm_wday, wday_names, G_N_ELEMENTS(wday_names));
+          break;
+        case SPO_AMPM:
+          if (g_ascii_strncasecmp((const gchar *) bp, "AM", 2) == 0)
+            value = 0;
+          else if (g_ascii_strncasecmp((const gchar *) bp, "PM", 2) == 0)
+            value = 1;
+          else
+            return NULL;
+          if ((state & S_HOUR) && tm->tm_hour > 11)
+            return NULL;
+          tm->tm_hour += value * 12;
+          bp += 2;
+          break;
+        case SPO_ZONE_OFFSET:
+          bp = _parse_zone_offset(bp, tm, tm_gmtoff, tm_zone);
+          break;
+        case SPO_ZONE_NAME:
+          bp = (const guchar *) strptime_with_tz((const gchar *) bp, "%Z", tm, tm_gmtoff, tm_zone);
+          break;
+        default:
+          g_assert_not_reached();
+        }
+      if (!bp)
+        return NULL;
+      state |= insn->state;
+    }
+
+  _complete_tm(tm, state);
+  return (const gchar *) bp;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#ifndef DATE_STRPTIME_COMPILED_H_INCLUDED
+#define DATE_STRPTIME_COMPILED_H_INCLUDED 1
+
+#include "syslog-ng.h"
+#include <time.h>
+
+/*
+ * A strptime() format translated to a sequence of instructions once, so
+ * that parsing a timestamp doesn't have to interpret the format string
+ * again.  The results are the same as those of strptime_with_tz() with the
+ * same format.  Formats using conversions not covered here can't be
+ * compiled, strptime_compiled_new() returns NULL for those and the caller
+ * is expected to use strptime_with_tz() instead.
+ */
+typedef struct _StrptimeCompiled StrptimeCompiled;
+
+StrptimeCompiled *strptime_compiled_new(const gchar *fmt);
+const gchar *strptime_compiled_parse(const StrptimeCompiled *self, const gchar *buf, struct tm *tm,
+                                     long *tm_gmtoff, const gchar **tm_zone);
+void strptime_compiled_free(StrptimeCompiled *self);
+
+#endif
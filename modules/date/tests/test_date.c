@@ -57,16 +57,37 @@ _construct_parser(gchar *timezone_, gchar *format, gint time_stamp)
 }
 
 static LogMessage *
-_construct_logmsg(const gchar *msg)
+_construct_logmsg_received_at(const gchar *msg, time_t recvd)
 {
   LogMessage *logmsg;
 
   logmsg = log_msg_new_empty();
-  logmsg->timestamps[LM_TS_RECVD].tv_sec = 1451473200; /* Dec  30 2015 */
+  logmsg->timestamps[LM_TS_RECVD].tv_sec = recvd;
   log_msg_set_value(logmsg, LM_V_MESSAGE, msg, -1);
   return logmsg;
 }
 
+static LogMessage *
+_construct_logmsg(const gchar *msg)
+{
+  return _construct_logmsg_received_at(msg, 1451473200); /* Dec  30 2015 */
+}
+
+static void
+_assert_parsed_stamp(LogParser *parser, const gchar *msg, time_t recvd, const gchar *expected)
+{
+  LogMessage *logmsg = _construct_logmsg_received_at(msg, recvd);
+  GString *res = g_string_sized_new(128);
+
+  cr_assert(log_parser_process(parser, &logmsg, NULL, log_msg_get_value(logmsg, LM_V_MESSAGE, NULL), -1),
+            "unable to parse msg=%s", msg);
+  log_stamp_append_format(&logmsg->timestamps[LM_TS_STAMP], res, TS_FMT_ISO, -1, 0);
+  cr_assert_str_eq(res->str, expected, "incorrect date parsed msg=%s", msg);
+
+  g_string_free(res, TRUE);
+  log_msg_unref(logmsg);
+}
+
 void
 setup(void)
 {
@@ -125,6 +146,12 @@ ParameterizedTestParameters(date, test_date_parser)
     { "01/Sep:00:40:07 +0500", NULL, "%d/%b:%T %z", LM_TS_STAMP, "2015-09-01T00:40:07+05:00" },
     { "01/Oct:00:40:07 +0500", NULL, "%d/%b:%T %z", LM_TS_STAMP, "2015-10-01T00:40:07+05:00" },
     { "01/Nov:00:40:07 +0500", NULL, "%d/%b:%T %z", LM_TS_STAMP, "2015-11-01T00:40:07+05:00" },
+    { "Jan 27 11:48:46", NULL, "%b %e %H:%M:%S", LM_TS_STAMP, "2016-01-27T11:48:46+01:00" },
+
+    /* Names, day of year and 12-hour clock */
+    { "January 27 2015 11:48", NULL, "%B %d %Y %R", LM_TS_STAMP, "2015-01-27T11:48:00+01:00" },
+    { "2015 027 11:48:46", NULL, "%Y %j %T", LM_TS_STAMP, "2015-01-27T11:48:46+01:00" },
+    { "01/27/15 11:48:46 PM", NULL, "%D %r", LM_TS_STAMP, "2015-01-27T23:48:46+01:00" },
 
 
     { "1446128356 +01:00", NULL, "%s %z", LM_TS_STAMP, "2015-10-29T15:19:16+01:00" },
@@ -168,3 +195,30 @@ Test(date, test_date_with_additional_text_at_the_end)
   log_pipe_unref(&parser->super);
   log_msg_unref(logmsg);
 }
+
+Test(date, test_repeated_timestamps_are_parsed_the_same_way)
+{
+  LogParser *parser = _construct_parser(NULL, "%d/%b:%T %z", LM_TS_STAMP);
+
+  _assert_parsed_stamp(parser, "01/Jan:00:40:07 +0500", 1451473200, "2016-01-01T00:40:07+05:00");
+  _assert_parsed_stamp(parser, "01/Jan:00:40:07 +0500", 1451473200, "2016-01-01T00:40:07+05:00");
+
+  /* the missing year depends on the time of reception */
+  _assert_parsed_stamp(parser, "01/Jan:00:40:07 +0500", 1435000000, "2015-01-01T00:40:07+05:00");
+  _assert_parsed_stamp(parser, "01/Jan:00:40:08 +0500", 1435000000, "2015-01-01T00:40:08+05:00");
+
+  log_pipe_unref(&parser->super);
+}
+
+Test(date, test_repeated_timestamps_are_parsed_by_each_parser)
+{
+  LogParser *phoenix = _construct_parser("America/Phoenix", "%a, %d %b %Y %T", LM_TS_STAMP);
+  LogParser *local = _construct_parser(NULL, "%a, %d %b %Y %T", LM_TS_STAMP);
+
+  _assert_parsed_stamp(phoenix, "Tue, 27 Jan 2015 11:48:46", 1451473200, "2015-01-27T11:48:46-07:00");
+  _assert_parsed_stamp(local, "Tue, 27 Jan 2015 11:48:46", 1451473200, "2015-01-27T11:48:46+01:00");
+  _assert_parsed_stamp(phoenix, "Tue, 27 Jan 2015 11:48:46", 1451473200, "2015-01-27T11:48:46-07:00");
+
+  log_pipe_unref(&phoenix->super);
+  log_pipe_unref(&local->super);
+}
@@ -36,6 +36,7 @@
 #include "str-utils.h"
 #include "filter/filter-expr-parser.h"
 #include "logpipe.h"
+#include "tls-support.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -45,6 +46,7 @@
 static NVHandle context_id_handle = 0;
 
 #define EXPECTED_NUMBER_OF_MESSAGES_EMITTED 32
+#define PATTERN_DB_CORRELLATION_SHARDS 16
 
 typedef struct _PDBProcessParams
 {
@@ -56,25 +58,211 @@ typedef struct _PDBProcessParams
   gpointer emitted_messages[EXPECTED_NUMBER_OF_MESSAGES_EMITTED];
   GPtrArray *emitted_messages_overflow;
   gint num_emitted_messages;
+
+  /* contexts created by create-context actions, these are registered in
+   * their own shard once the lock of the current one is released */
+  GPtrArray *new_contexts;
+
+  /* contexts expired by the timer wheels, their timeout actions are
+   * executed in the order of their expiration, see _expire_contexts() */
+  GArray *expired_contexts;
 } PDBProcessParams;
 
-struct _PatternDB
+typedef struct _PDBExpiredContext
 {
-  GStaticRWLock lock;
-  PDBRuleSet *ruleset;
+  guint64 expiration;
+  guint seq;
+  PDBContext *context;
+} PDBExpiredContext;
+
+/* Correllation contexts are distributed among shards based on the hash of
+ * their key.  Each shard has its own lock, state hash and timer wheel, so
+ * messages belonging to different contexts can be processed in parallel.
+ * The timer wheels are moved forward together, by one thread at a time,
+ * see _advance_time().  */
+typedef struct _PDBCorrellationShard
+{
+  GStaticMutex lock;
   CorrellationState correllation;
-  GHashTable *rate_limits;
   TimerWheel *timer_wheel;
-  GTimeVal last_tick;
 
   /* process_params used by the timer expiration callback.  Should only be
-   * set with the write lock held and only during the duration of
+   * set with the lock held and only during the duration of
    * timer_wheel_set_time() */
   PDBProcessParams *timer_process_params;
+} PDBCorrellationShard;
+
+/* A retired ruleset is freed once no lookup started before its retirement
+ * is running, see PDBRuleSetReader. */
+typedef struct _PDBRetiredRuleSet
+{
+  PDBRuleSet *ruleset;
+  gint epoch;
+} PDBRetiredRuleSet;
+
+struct _PatternDB
+{
+  /* The ruleset is immutable once loaded and is read without locking, see
+   * PDBRuleSetReader.  The lock serializes reloads and protects the list
+   * of retired rulesets.  */
+  GStaticMutex ruleset_lock;
+  PDBRuleSet *ruleset;
+  GList *retired_rulesets;
+
+  GStaticMutex rate_limits_lock;
+  GHashTable *rate_limits;
+
+  /* protects current_time and last_tick */
+  GStaticMutex time_lock;
+  guint64 current_time;
+  GTimeVal last_tick;
+
+  /* held by the thread moving the timer wheels forward, see _advance_time() */
+  GStaticMutex advance_lock;
+
+  PDBCorrellationShard shards[PATTERN_DB_CORRELLATION_SHARDS];
   PatternDBEmitFunc emit;
   gpointer emit_data;
 };
 
+/*
+ * Ruleset lookups neither lock nor reference the ruleset, they load the
+ * pointer atomically.  A reload publishes the new ruleset by swapping the
+ * pointer and retires the old one, which can only be freed once the
+ * lookups that may still be using it have finished.
+ *
+ * Every thread doing lookups has a PDBRuleSetReader, recording the value of
+ * ruleset_epoch when its current lookup started (0 if it is not in a
+ * lookup).  Only the thread itself writes it, so lookups don't bounce any
+ * shared cache lines.  Retiring a ruleset bumps the epoch: lookups started
+ * with an epoch value at least as high as that of the retired ruleset are
+ * guaranteed to see the new pointer.  Retired rulesets are checked at
+ * reloads and from the timer tick.
+ */
+typedef struct _PDBRuleSetReader
+{
+  volatile gint epoch;
+} PDBRuleSetReader;
+
+static volatile gint ruleset_epoch = 1;
+static GStaticMutex ruleset_readers_lock = G_STATIC_MUTEX_INIT;
+static GList *ruleset_readers;
+/* only used to unregister the reader when its thread exits */
+static GStaticPrivate ruleset_reader_private = G_STATIC_PRIVATE_INIT;
+
+TLS_BLOCK_START
+{
+  PDBRuleSetReader *ruleset_reader;
+}
+TLS_BLOCK_END;
+
+#define ruleset_reader __tls_deref(ruleset_reader)
+
+static void
+_ruleset_reader_free(PDBRuleSetReader *reader)
+{
+  g_static_mutex_lock(&ruleset_readers_lock);
+  ruleset_readers = g_list_remove(ruleset_readers, reader);
+  g_static_mutex_unlock(&ruleset_readers_lock);
+  g_free(reader);
+}
+
+static PDBRuleSetReader *
+_get_ruleset_reader(void)
+{
+  PDBRuleSetReader *reader = ruleset_reader;
+
+  if (G_UNLIKELY(!reader))
+    {
+      reader = g_new0(PDBRuleSetReader, 1);
+
+      g_static_mutex_lock(&ruleset_readers_lock);
+      ruleset_readers = g_list_prepend(ruleset_readers, reader);
+      g_static_mutex_unlock(&ruleset_readers_lock);
+      g_static_private_set(&ruleset_reader_private, reader, (GDestroyNotify) _ruleset_reader_free);
+      ruleset_reader = reader;
+    }
+  return reader;
+}
+
+static PDBRuleSet *
+_start_ruleset_lookup(PatternDB *self, PDBRuleSetReader *reader)
+{
+  g_atomic_int_set(&reader->epoch, g_atomic_int_get(&ruleset_epoch));
+  return (PDBRuleSet *) g_atomic_pointer_get(&self->ruleset);
+}
+
+static void
+_finish_ruleset_lookup(PDBRuleSetReader *reader)
+{
+  g_atomic_int_set(&reader->epoch, 0);
+}
+
+/* the epoch of the oldest lookup in progress, G_MAXINT if there's none */
+static gint
+_get_oldest_ruleset_lookup_epoch(void)
+{
+  gint oldest = G_MAXINT;
+  GList *l;
+
+  g_static_mutex_lock(&ruleset_readers_lock);
+  for (l = ruleset_readers; l; l = l->next)
+    {
+      gint epoch = g_atomic_int_get(&((PDBRuleSetReader *) l->data)->epoch);
+
+      if (epoch && epoch < oldest)
+        oldest = epoch;
+    }
+  g_static_mutex_unlock(&ruleset_readers_lock);
+  return oldest;
+}
+
+/* must be called with ruleset_lock held */
+static void
+_free_unused_rulesets(PatternDB *self)
+{
+  gint oldest_epoch;
+  GList *l, *next;
+
+  if (!self->retired_rulesets)
+    return;
+
+  oldest_epoch = _get_oldest_ruleset_lookup_epoch();
+  for (l = self->retired_rulesets; l; l = next)
+    {
+      PDBRetiredRuleSet *retired = (PDBRetiredRuleSet *) l->data;
+
+      next = l->next;
+      if (retired->epoch > oldest_epoch)
+        continue;
+
+      pdb_rule_set_free(retired->ruleset);
+      g_free(retired);
+      self->retired_rulesets = g_list_delete_link(self->retired_rulesets, l);
+    }
+}
+
+/* must be called with ruleset_lock held */
+static void
+_publish_ruleset(PatternDB *self, PDBRuleSet *new_ruleset)
+{
+  PDBRuleSet *old_ruleset;
+  PDBRetiredRuleSet *retired;
+
+  do
+    old_ruleset = (PDBRuleSet *) g_atomic_pointer_get(&self->ruleset);
+  while (!g_atomic_pointer_compare_and_exchange((gpointer *) &self->ruleset, old_ruleset, new_ruleset));
+
+  if (old_ruleset)
+    {
+      retired = g_new0(PDBRetiredRuleSet, 1);
+      retired->ruleset = old_ruleset;
+      retired->epoch = g_atomic_int_exchange_and_add(&ruleset_epoch, 1) + 1;
+      self->retired_rulesets = g_list_prepend(self->retired_rulesets, retired);
+    }
+  _free_unused_rulesets(self);
+}
+
 static inline gpointer
 _piggy_back_log_message_pointer_with_synthetic_value(LogMessage *msg, gboolean synthetic)
 {
@@ -192,6 +380,25 @@ _flush_emitted_messages(PatternDB *self, PDBProcessParams *process_params)
  */
 
 
+static guint64
+_get_current_time(PatternDB *self)
+{
+  guint64 now;
+
+  g_static_mutex_lock(&self->time_lock);
+  now = self->current_time;
+  g_static_mutex_unlock(&self->time_lock);
+  return now;
+}
+
+static PDBCorrellationShard *
+_lookup_shard(PatternDB *self, CorrellationKey *key)
+{
+  guint hash = correllation_key_hash(key);
+
+  return &self->shards[(hash ^ (hash >> 16)) % PATTERN_DB_CORRELLATION_SHARDS];
+}
+
 /*********************************************
  * Rule evaluation
  *********************************************/
@@ -207,13 +414,16 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
   CorrellationKey key;
   PDBRateLimit *rl;
   guint64 now;
+  gboolean within_limit = FALSE;
 
   if (action->rate == 0)
     return TRUE;
 
   g_string_printf(buffer, "%s:%d", rule->rule_id, action->id);
   correllation_key_setup(&key, rule->context.scope, msg, buffer->str);
+  now = _get_current_time(db);
 
+  g_static_mutex_lock(&db->rate_limits_lock);
   rl = g_hash_table_lookup(db->rate_limits, &key);
   if (!rl)
     {
@@ -221,7 +431,6 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
       g_hash_table_insert(db->rate_limits, &rl->key, rl);
       g_string_steal(buffer);
     }
-  now = timer_wheel_get_time(db->timer_wheel);
   if (rl->last_check == 0)
     {
       rl->last_check = now;
@@ -245,9 +454,10 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
   if (rl->buckets)
     {
       rl->buckets--;
-      return TRUE;
+      within_limit = TRUE;
     }
-  return FALSE;
+  g_static_mutex_unlock(&db->rate_limits_lock);
+  return within_limit;
 }
 
 static gboolean
@@ -300,8 +510,6 @@ _execute_action_message(PatternDB *db, PDBProcessParams *process_params)
   log_msg_unref(genmsg);
 }
 
-static void pattern_db_expire_entry(TimerWheel *wheel, guint64 now, gpointer user_data);
-
 static void
 _execute_action_create_context(PatternDB *db, PDBProcessParams *process_params)
 {
@@ -337,19 +545,20 @@ _execute_action_create_context(PatternDB *db, PDBProcessParams *process_params)
             evt_tag_str("rule", rule->rule_id),
             evt_tag_str("context", buffer->str),
             evt_tag_int("context_timeout", syn_context->timeout),
-            evt_tag_int("context_expiration", timer_wheel_get_time(db->timer_wheel) + syn_context->timeout));
+            evt_tag_int("context_expiration", _get_current_time(db) + syn_context->timeout));
 
   correllation_key_setup(&key, syn_context->scope, context_msg, buffer->str);
   new_context = pdb_context_new(&key);
-  g_hash_table_insert(db->correllation.state, &new_context->super.key, new_context);
   g_string_steal(buffer);
 
   g_ptr_array_add(new_context->super.messages, context_msg);
-
-  new_context->super.timer = timer_wheel_add_timer(db->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
-                                                   correllation_context_ref(&new_context->super),
-                                                   (GDestroyNotify) correllation_context_unref);
   new_context->rule = pdb_rule_ref(rule);
+
+  /* the new context may belong to a different shard than the one we are
+   * holding the lock of, it is registered by _register_new_contexts() */
+  if (!process_params->new_contexts)
+    process_params->new_contexts = g_ptr_array_new();
+  g_ptr_array_add(process_params->new_contexts, new_context);
 }
 
 static void
@@ -401,37 +610,167 @@ _execute_rule_actions(PatternDB *db, PDBProcessParams *process_params, PDBAction
  * PatternDB
  *********************************************************/
 
-/* NOTE: this function requires PatternDB reader/writer lock to be
- * write-locked.
+/* NOTE: this function requires the lock of the shard owning the timer
+ * wheel to be held.
  *
  * Currently, it is, as timer_wheel_set_time() is only called with that
  * precondition, and timer-wheel callbacks are only called from within
  * timer_wheel_set_time().
+ *
+ * The context is only removed from the state here, its timeout actions are
+ * executed by _expire_contexts() once all shards have been advanced.
  */
 
 static void
 pattern_db_expire_entry(TimerWheel *wheel, guint64 now, gpointer user_data)
 {
   PDBContext *context = user_data;
-  PatternDB *pdb = (PatternDB *) timer_wheel_get_associated_data(wheel);
-  GString *buffer = g_string_sized_new(256);
-  LogMessage *msg = correllation_context_get_last_message(&context->super);
-  PDBProcessParams *process_params = pdb->timer_process_params;
-
-  msg_debug("Expiring patterndb correllation context",
-            evt_tag_str("last_rule", context->rule->rule_id),
-            evt_tag_long("utc", timer_wheel_get_time(pdb->timer_wheel)));
-  process_params->context = context;
-  process_params->rule = context->rule;
-  process_params->msg = msg;
-  process_params->buffer = buffer;
-  _execute_rule_actions(pdb, process_params, RAT_TIMEOUT);
-  g_hash_table_remove(pdb->correllation.state, &context->super.key);
+  PDBCorrellationShard *shard = (PDBCorrellationShard *) timer_wheel_get_associated_data(wheel);
+  PDBProcessParams *process_params = shard->timer_process_params;
+  PDBExpiredContext expired;
+
+  if (!process_params->expired_contexts)
+    process_params->expired_contexts = g_array_new(FALSE, FALSE, sizeof(PDBExpiredContext));
+
+  expired.expiration = now;
+  expired.seq = process_params->expired_contexts->len;
+  expired.context = (PDBContext *) correllation_context_ref(&context->super);
+  g_array_append_val(process_params->expired_contexts, expired);
+
+  /* the timer entry is freed when returning from this function */
+  context->super.timer = NULL;
+  g_hash_table_remove(shard->correllation.state, &context->super.key);
+}
+
+static gint
+_compare_expired_contexts(gconstpointer a, gconstpointer b)
+{
+  const PDBExpiredContext *ea = (const PDBExpiredContext *) a;
+  const PDBExpiredContext *eb = (const PDBExpiredContext *) b;
+
+  if (ea->expiration != eb->expiration)
+    return ea->expiration < eb->expiration ? -1 : 1;
+  return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq);
+}
+
+/* Executes the timeout actions of the contexts collected by
+ * pattern_db_expire_entry().  The shards are advanced one after the other,
+ * so the contexts are sorted by their expiration time first, otherwise
+ * timeouts would be emitted grouped by shard.  Contexts expiring in the
+ * same second keep the order they were expired in.  */
+static void
+_expire_contexts(PatternDB *self, PDBProcessParams *process_params)
+{
+  GArray *expired_contexts = process_params->expired_contexts;
+  PDBProcessParams saved_params = *process_params;
+  GString *buffer;
+  gint i;
+
+  if (!expired_contexts)
+    return;
+
+  process_params->expired_contexts = NULL;
+  g_array_sort(expired_contexts, _compare_expired_contexts);
+
+  buffer = g_string_sized_new(256);
+  for (i = 0; i < expired_contexts->len; i++)
+    {
+      PDBExpiredContext *expired = &g_array_index(expired_contexts, PDBExpiredContext, i);
+      PDBContext *context = expired->context;
+
+      msg_debug("Expiring patterndb correllation context",
+                evt_tag_str("last_rule", context->rule->rule_id),
+                evt_tag_long("utc", expired->expiration));
+      process_params->context = context;
+      process_params->rule = context->rule;
+      process_params->msg = correllation_context_get_last_message(&context->super);
+      process_params->buffer = buffer;
+      _execute_rule_actions(self, process_params, RAT_TIMEOUT);
+      correllation_context_unref(&context->super);
+    }
   g_string_free(buffer, TRUE);
+  g_array_free(expired_contexts, TRUE);
+
+  /* time is advanced while processing a matching message too, don't
+   * clobber the parameters of that */
+  process_params->context = saved_params.context;
+  process_params->rule = saved_params.rule;
+  process_params->action = saved_params.action;
+  process_params->msg = saved_params.msg;
+  process_params->buffer = saved_params.buffer;
+}
+
+/* Adds the contexts created by create-context actions to their shards.
+ * Must be called without holding any shard locks. */
+static gboolean
+_register_new_contexts(PatternDB *self, PDBProcessParams *process_params)
+{
+  GPtrArray *new_contexts = process_params->new_contexts;
+  gint i;
+
+  if (!new_contexts)
+    return FALSE;
 
-  /* pdb_context_free is automatically called when returning from
-     this function by the timerwheel code as a destroy notify
-     callback. */
+  process_params->new_contexts = NULL;
+  for (i = 0; i < new_contexts->len; i++)
+    {
+      PDBContext *new_context = (PDBContext *) g_ptr_array_index(new_contexts, i);
+      PDBCorrellationShard *shard = _lookup_shard(self, &new_context->super.key);
+
+      g_static_mutex_lock(&shard->lock);
+      g_hash_table_insert(shard->correllation.state, &new_context->super.key, new_context);
+      new_context->super.timer = timer_wheel_add_timer(shard->timer_wheel, new_context->rule->context.timeout,
+                                                       pattern_db_expire_entry,
+                                                       correllation_context_ref(&new_context->super),
+                                                       (GDestroyNotify) correllation_context_unref);
+      g_static_mutex_unlock(&shard->lock);
+    }
+  g_ptr_array_free(new_contexts, TRUE);
+  return TRUE;
+}
+
+static void
+_set_shard_time(PDBCorrellationShard *shard, PDBProcessParams *process_params, guint64 new_time)
+{
+  g_static_mutex_lock(&shard->lock);
+  /* the expire callback uses this pointer to find the process_params it
+   * needs to emit messages.  ProcessParams itself is a per-thread value,
+   * however the timer callback is executing with the shard lock held.
+   * There's no other mechanism to pass this pointer to the timer callback,
+   * so we add it to the shard, but make sure it is properly protected by
+   * locks.
+   * */
+  shard->timer_process_params = process_params;
+  timer_wheel_set_time(shard->timer_wheel, new_time);
+  shard->timer_process_params = NULL;
+  g_static_mutex_unlock(&shard->lock);
+}
+
+/*
+ * Moves all timer wheels forward to current_time, the caller has already
+ * updated that.  Only one thread advances the wheels at a time, the others
+ * don't wait for it: whoever holds advance_lock rechecks current_time
+ * after releasing it, and goes on if it was changed in the meantime.
+ */
+static void
+_advance_time(PatternDB *self, PDBProcessParams *process_params)
+{
+  guint64 new_time;
+  gint i;
+
+  while (g_static_mutex_trylock(&self->advance_lock))
+    {
+      new_time = _get_current_time(self);
+      for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+        _set_shard_time(&self->shards[i], process_params, new_time);
+
+      _expire_contexts(self, process_params);
+      _register_new_contexts(self, process_params);
+      g_static_mutex_unlock(&self->advance_lock);
+
+      if (_get_current_time(self) == new_time)
+        break;
+    }
 }
 
 /*
@@ -447,11 +786,11 @@ pattern_db_timer_tick(PatternDB *self)
 {
   GTimeVal now;
   glong diff;
+  guint64 new_time = 0;
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
 
-  g_static_rw_lock_writer_lock(&self->lock);
-  self->timer_process_params = process_params;
+  g_static_mutex_lock(&self->time_lock);
   cached_g_current_time(&now);
   diff = g_time_val_diff(&now, &self->last_tick);
 
@@ -459,11 +798,10 @@ pattern_db_timer_tick(PatternDB *self)
     {
       glong diff_sec = diff / 1e6;
 
-      timer_wheel_set_time(self->timer_wheel, timer_wheel_get_time(self->timer_wheel) + diff_sec);
-      msg_debug("Advancing patterndb current time because of timer tick",
-                evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)));
-      /* update last_tick, take the fraction of the seconds not calculated into this update into account */
+      self->current_time += diff_sec;
+      new_time = self->current_time;
 
+      /* update last_tick, take the fraction of the seconds not calculated into this update into account */
       self->last_tick = now;
       g_time_val_add(&self->last_tick, -(diff - diff_sec * 1e6));
     }
@@ -475,16 +813,29 @@ pattern_db_timer_tick(PatternDB *self)
        */
       self->last_tick = now;
     }
-  self->timer_process_params = NULL;
-  g_static_rw_lock_writer_unlock(&self->lock);
+  g_static_mutex_unlock(&self->time_lock);
+
+  if (new_time)
+    {
+      _advance_time(self, process_params);
+      msg_debug("Advancing patterndb current time because of timer tick",
+                evt_tag_long("utc", new_time));
+    }
   _flush_emitted_messages(self, process_params);
+
+  if (self->retired_rulesets)
+    {
+      g_static_mutex_lock(&self->ruleset_lock);
+      _free_unused_rulesets(self);
+      g_static_mutex_unlock(&self->ruleset_lock);
+    }
 }
 
-/* NOTE: lock should be acquired for writing before calling this function. */
 static void
 _advance_time_based_on_message(PatternDB *self, PDBProcessParams *process_params, const LogStamp *ls)
 {
   GTimeVal now;
+  guint64 new_time = 0;
 
   /* clamp the current time between the timestamp of the current message
    * (low limit) and the current system time (high limit).  This ensures
@@ -492,24 +843,28 @@ _advance_time_based_on_message(PatternDB *self, PDBProcessParams *process_params
    * correllation engine too much. */
 
   cached_g_current_time(&now);
+
+  g_static_mutex_lock(&self->time_lock);
   self->last_tick = now;
 
   if (ls->tv_sec < now.tv_sec)
     now.tv_sec = ls->tv_sec;
 
-  /* the expire callback uses this pointer to find the process_params it
-   * needs to emit messages.  ProcessParams itself is a per-thread value,
-   * however the timer callback is executing with the writer lock held.
-   * There's no other mechanism to pass this pointer to the timer callback,
-   * so we add it to PatternDB, but make sure it is properly protected by
-   * locks.
-   * */
-  self->timer_process_params = process_params;
-  timer_wheel_set_time(self->timer_wheel, now.tv_sec);
-  self->timer_process_params = NULL;
+  /* time is not allowed to go backwards, and as long as it stays within
+   * the same second, there's nothing to do */
+  if ((guint64) now.tv_sec > self->current_time)
+    {
+      self->current_time = now.tv_sec;
+      new_time = self->current_time;
+    }
+  g_static_mutex_unlock(&self->time_lock);
 
-  msg_debug("Advancing patterndb current time because of an incoming message",
-            evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)));
+  if (new_time)
+    {
+      _advance_time(self, process_params);
+      msg_debug("Advancing patterndb current time because of an incoming message",
+                evt_tag_long("utc", new_time));
+    }
 }
 
 void
@@ -517,14 +872,12 @@ pattern_db_advance_time(PatternDB *self, gint timeout)
 {
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
-  time_t new_time;
-
-  g_static_rw_lock_writer_lock(&self->lock);
-  new_time = timer_wheel_get_time(self->timer_wheel) + timeout;
-  self->timer_process_params = process_params;
-  timer_wheel_set_time(self->timer_wheel, new_time);
-  self->timer_process_params = NULL;
-  g_static_rw_lock_writer_unlock(&self->lock);
+
+  g_static_mutex_lock(&self->time_lock);
+  self->current_time += timeout;
+  g_static_mutex_unlock(&self->time_lock);
+
+  _advance_time(self, process_params);
   _flush_emitted_messages(self, process_params);
 }
 
@@ -539,15 +892,11 @@ pattern_db_reload_ruleset(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_f
       pdb_rule_set_free(new_ruleset);
       return FALSE;
     }
-  else
-    {
-      g_static_rw_lock_writer_lock(&self->lock);
-      if (self->ruleset)
-        pdb_rule_set_free(self->ruleset);
-      self->ruleset = new_ruleset;
-      g_static_rw_lock_writer_unlock(&self->lock);
-      return TRUE;
-    }
+
+  g_static_mutex_lock(&self->ruleset_lock);
+  _publish_ruleset(self, new_ruleset);
+  g_static_mutex_unlock(&self->ruleset_lock);
+  return TRUE;
 }
 
 
@@ -576,21 +925,15 @@ pattern_db_get_ruleset(PatternDB *self)
   return self->ruleset;
 }
 
-static gboolean
-_pattern_db_is_empty(PatternDB *self)
-{
-  return (G_UNLIKELY(!self->ruleset) || self->ruleset->is_empty);
-}
-
 static void
 _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_params)
 {
+  PDBCorrellationShard *shard = NULL;
   PDBContext *context = NULL;
   PDBRule *rule = process_params->rule;
   LogMessage *msg = process_params->msg;
   GString *buffer = g_string_sized_new(32);
 
-  g_static_rw_lock_writer_lock(&self->lock);
   _advance_time_based_on_message(self, process_params, &msg->timestamps[LM_TS_STAMP]);
   if (rule->context.id_template)
     {
@@ -600,16 +943,19 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
       log_msg_set_value(msg, context_id_handle, buffer->str, -1);
 
       correllation_key_setup(&key, rule->context.scope, msg, buffer->str);
-      context = g_hash_table_lookup(self->correllation.state, &key);
+      shard = _lookup_shard(self, &key);
+
+      g_static_mutex_lock(&shard->lock);
+      context = g_hash_table_lookup(shard->correllation.state, &key);
       if (!context)
         {
           msg_debug("Correllation context lookup failure, starting a new context",
                     evt_tag_str("rule", rule->rule_id),
                     evt_tag_str("context", buffer->str),
                     evt_tag_int("context_timeout", rule->context.timeout),
-                    evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context.timeout));
+                    evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context.timeout));
           context = pdb_context_new(&key);
-          g_hash_table_insert(self->correllation.state, &context->super.key, context);
+          g_hash_table_insert(shard->correllation.state, &context->super.key, context);
           g_string_steal(buffer);
         }
       else
@@ -618,7 +964,7 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
                     evt_tag_str("rule", rule->rule_id),
                     evt_tag_str("context", buffer->str),
                     evt_tag_int("context_timeout", rule->context.timeout),
-                    evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context.timeout),
+                    evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context.timeout),
                     evt_tag_int("num_messages", context->super.messages->len));
         }
 
@@ -626,11 +972,11 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
 
       if (context->super.timer)
         {
-          timer_wheel_mod_timer(self->timer_wheel, context->super.timer, rule->context.timeout);
+          timer_wheel_mod_timer(shard->timer_wheel, context->super.timer, rule->context.timeout);
         }
       else
         {
-          context->super.timer = timer_wheel_add_timer(self->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
+          context->super.timer = timer_wheel_add_timer(shard->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
                                                        correllation_context_ref(&context->super),
                                                        (GDestroyNotify) correllation_context_unref);
         }
@@ -653,8 +999,11 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
   _emit_message(self, process_params, FALSE, msg);
   _execute_rule_actions(self, process_params, RAT_MATCH);
 
+  if (shard)
+    g_static_mutex_unlock(&shard->lock);
   pdb_rule_unref(rule);
-  g_static_rw_lock_writer_unlock(&self->lock);
+
+  _register_new_contexts(self, process_params);
 
   if (context)
     log_msg_write_protect(msg);
@@ -667,10 +1016,8 @@ _pattern_db_process_unmatching_rule(PatternDB *self, PDBProcessParams *process_p
 {
   LogMessage *msg = process_params->msg;
 
-  g_static_rw_lock_writer_lock(&self->lock);
   _advance_time_based_on_message(self, process_params, &msg->timestamps[LM_TS_STAMP]);
   _emit_message(self, process_params, FALSE, msg);
-  g_static_rw_lock_writer_unlock(&self->lock);
 }
 
 static gboolean
@@ -679,16 +1026,21 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
   LogMessage *msg = lookup->msg;
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
+  PDBRuleSetReader *reader = _get_ruleset_reader();
+  PDBRuleSet *ruleset;
 
-  g_static_rw_lock_reader_lock(&self->lock);
-  if (_pattern_db_is_empty(self))
+  /* the matching rule is referenced by the lookup, the ruleset is not
+   * needed after it */
+  ruleset = _start_ruleset_lookup(self, reader);
+  if (G_UNLIKELY(!ruleset) || ruleset->is_empty)
     {
-      g_static_rw_lock_reader_unlock(&self->lock);
+      _finish_ruleset_lookup(reader);
       return FALSE;
     }
-  process_params->rule = pdb_ruleset_lookup(self->ruleset, lookup, dbg_list);
+  process_params->rule = pdb_ruleset_lookup(ruleset, lookup, dbg_list);
   process_params->msg = msg;
-  g_static_rw_lock_reader_unlock(&self->lock);
+  _finish_ruleset_lookup(reader);
+
   if (process_params->rule)
     _pattern_db_process_matching_rule(self, process_params);
   else
@@ -732,64 +1084,146 @@ pattern_db_expire_state(PatternDB *self)
 {
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
+  gboolean new_contexts_created;
+  gint i;
 
-  g_static_rw_lock_writer_lock(&self->lock);
-  self->timer_process_params = process_params;
-  timer_wheel_expire_all(self->timer_wheel);
-  self->timer_process_params = NULL;
-  g_static_rw_lock_writer_unlock(&self->lock);
+  g_static_mutex_lock(&self->advance_lock);
+  /* timeout actions may create new contexts, expire those as well */
+  do
+    {
+      for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+        {
+          PDBCorrellationShard *shard = &self->shards[i];
+
+          g_static_mutex_lock(&shard->lock);
+          shard->timer_process_params = process_params;
+          timer_wheel_expire_all(shard->timer_wheel);
+          shard->timer_process_params = NULL;
+          g_static_mutex_unlock(&shard->lock);
+        }
+      _expire_contexts(self, process_params);
+      new_contexts_created = _register_new_contexts(self, process_params);
+    }
+  while (new_contexts_created);
+  g_static_mutex_unlock(&self->advance_lock);
   _flush_emitted_messages(self, process_params);
 
 }
 
+static void
+_init_shard_state(PDBCorrellationShard *shard)
+{
+  correllation_state_init_instance(&shard->correllation);
+  shard->timer_wheel = timer_wheel_new();
+  timer_wheel_set_associated_data(shard->timer_wheel, shard, NULL);
+}
+
+static void
+_destroy_shard_state(PDBCorrellationShard *shard)
+{
+  if (shard->timer_wheel)
+    timer_wheel_free(shard->timer_wheel);
+  correllation_state_deinit_instance(&shard->correllation);
+}
+
 static void
 _init_state(PatternDB *self)
 {
+  gint i;
+
   self->rate_limits = g_hash_table_new_full(correllation_key_hash, correllation_key_equal, NULL,
                                             (GDestroyNotify) pdb_rate_limit_free);
-  correllation_state_init_instance(&self->correllation);
-  self->timer_wheel = timer_wheel_new();
-  timer_wheel_set_associated_data(self->timer_wheel, self, NULL);
+  for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+    _init_shard_state(&self->shards[i]);
+  self->current_time = 0;
 }
 
 static void
 _destroy_state(PatternDB *self)
 {
-  if (self->timer_wheel)
-    timer_wheel_free(self->timer_wheel);
+  gint i;
 
+  for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+    _destroy_shard_state(&self->shards[i]);
   g_hash_table_destroy(self->rate_limits);
-  correllation_state_deinit_instance(&self->correllation);
+}
+
+static void
+_lock_state(PatternDB *self)
+{
+  gint i;
+
+  g_static_mutex_lock(&self->advance_lock);
+  for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+    g_static_mutex_lock(&self->shards[i].lock);
+  g_static_mutex_lock(&self->rate_limits_lock);
+  g_static_mutex_lock(&self->time_lock);
+}
+
+static void
+_unlock_state(PatternDB *self)
+{
+  gint i;
+
+  g_static_mutex_unlock(&self->time_lock);
+  g_static_mutex_unlock(&self->rate_limits_lock);
+  for (i = PATTERN_DB_CORRELLATION_SHARDS - 1; i >= 0; i--)
+    g_static_mutex_unlock(&self->shards[i].lock);
+  g_static_mutex_unlock(&self->advance_lock);
 }
 
 void
 pattern_db_forget_state(PatternDB *self)
 {
-  g_static_rw_lock_writer_lock(&self->lock);
+  _lock_state(self);
   _destroy_state(self);
   _init_state(self);
-  g_static_rw_lock_writer_unlock(&self->lock);
+  _unlock_state(self);
 }
 
 PatternDB *
 pattern_db_new(void)
 {
   PatternDB *self = g_new0(PatternDB, 1);
+  gint i;
 
   self->ruleset = pdb_rule_set_new();
+  for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+    g_static_mutex_init(&self->shards[i].lock);
   _init_state(self);
   cached_g_current_time(&self->last_tick);
-  g_static_rw_lock_init(&self->lock);
+  g_static_mutex_init(&self->ruleset_lock);
+  g_static_mutex_init(&self->rate_limits_lock);
+  g_static_mutex_init(&self->time_lock);
+  g_static_mutex_init(&self->advance_lock);
   return self;
 }
 
 void
 pattern_db_free(PatternDB *self)
 {
+  GList *l;
+  gint i;
+
+  /* there are no lookups in progress by now, nothing uses the retired
+   * rulesets either */
+  for (l = self->retired_rulesets; l; l = l->next)
+    {
+      PDBRetiredRuleSet *retired = (PDBRetiredRuleSet *) l->data;
+
+      pdb_rule_set_free(retired->ruleset);
+      g_free(retired);
+    }
+  g_list_free(self->retired_rulesets);
   if (self->ruleset)
     pdb_rule_set_free(self->ruleset);
   _destroy_state(self);
-  g_static_rw_lock_free(&self->lock);
+  for (i = 0; i < PATTERN_DB_CORRELLATION_SHARDS; i++)
+    g_static_mutex_free(&self->shards[i].lock);
+  g_static_mutex_free(&self->ruleset_lock);
+  g_static_mutex_free(&self->rate_limits_lock);
+  g_static_mutex_free(&self->time_lock);
+  g_static_mutex_free(&self->advance_lock);
   g_free(self);
 }
 
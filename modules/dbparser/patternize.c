@@ -24,9 +24,15 @@
 #include "logmsg/logmsg.h"
 #include "messages.h"
 #include "uuid.h"
+#include "scratch-buffers.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
  * NOTE: most of the algorithms come from SLCT and LogHound, written by Risto Vaarandi
@@ -95,21 +101,159 @@ ptz_find_frequent_words_remove_key_predicate(gpointer key, gpointer value, gpoin
   return (*((guint *) value) < GPOINTER_TO_UINT(support));
 }
 
-GHashTable *
-ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass)
+/* counts the words of logs[first, last), a separate instance is used by
+ * each thread when counting in parallel */
+typedef struct _PTZWordCounter
 {
-  int i, j, pass;
+  GPtrArray *logs;
+  guint first;
+  guint last;
+  gchar *delimiters;
+  gint pass;
+  gboolean two_pass;
+  guint support;
+
+  /* shared between the threads, it is only written during pass 1 */
+  gint *wordlist_cache;
+  guint cachesize;
+  guint cacheseed;
+  gboolean shared_cache;
+
+  GHashTable *wordlist;
+} PTZWordCounter;
+
+static void
+_ptz_count_words(PTZWordCounter *self)
+{
+  int i, j;
   guint *curr_count;
   LogMessage *msg;
   gchar *msgstr;
   gssize msglen;
   gchar **words;
+  guint cacheindex = 0;
+  gchar *hash_key;
+
+  for (i = self->first; i < self->last; ++i)
+    {
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
+      msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
+
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+
+      for (j = 0; words[j]; ++j)
+        {
+          /* NOTE: to calculate the key for the hash, we prefix a word with
+           * its position in the row and a space -- as we always split at
+           * spaces, this should not create confusion
+           */
+          hash_key = g_strdup_printf("%d %s", j, words[j]);
+
+          if (self->two_pass)
+            cacheindex = ptz_str2hash(hash_key, self->cachesize, self->cacheseed);
+
+          if (self->pass == 1)
+            {
+              if (self->shared_cache)
+                g_atomic_int_inc(&self->wordlist_cache[cacheindex]);
+              else
+                self->wordlist_cache[cacheindex]++;
+            }
+          else if (self->pass == 2)
+            {
+              if (!self->two_pass || self->wordlist_cache[cacheindex] >= self->support)
+                {
+                  curr_count = (guint *) g_hash_table_lookup(self->wordlist, hash_key);
+                  if (!curr_count)
+                    {
+                      guint *currcount_ref = g_new(guint, 1);
+                      (*currcount_ref) = 1;
+                      g_hash_table_insert(self->wordlist, g_strdup(hash_key), currcount_ref);
+                    }
+                  else
+                    {
+                      (*curr_count)++;
+                    }
+                }
+            }
+
+          g_free(hash_key);
+
+        }
+
+      g_strfreev(words);
+    }
+}
+
+static gpointer
+_ptz_count_words_thread(gpointer s)
+{
+  _ptz_count_words((PTZWordCounter *) s);
+  return NULL;
+}
+
+static gboolean
+_ptz_merge_word_count(gpointer key, gpointer value, gpointer user_data)
+{
+  GHashTable *wordlist = (GHashTable *) user_data;
+  guint *curr_count;
+
+  curr_count = (guint *) g_hash_table_lookup(wordlist, key);
+  if (!curr_count)
+    {
+      g_hash_table_insert(wordlist, key, value);
+      return TRUE;
+    }
+
+  (*curr_count) += *((guint *) value);
+  g_free(key);
+  g_free(value);
+  return TRUE;
+}
+
+/* the first counter runs in the calling thread, the others in their own
+ * threads, their wordlists are merged into the first one */
+static void
+_ptz_run_word_counters(PTZWordCounter *counters, guint num_counters)
+{
+  GThread **threads = g_new0(GThread *, num_counters);
+  GError *error = NULL;
+  gint i;
+
+  for (i = 1; i < num_counters; i++)
+    {
+      threads[i] = g_thread_create(_ptz_count_words_thread, &counters[i], TRUE, &error);
+      if (!threads[i])
+        {
+          msg_warning("Error creating word counter thread, counting in the main thread instead",
+                      evt_tag_str("error", error ? error->message : "Unknown error"));
+          g_clear_error(&error);
+          _ptz_count_words(&counters[i]);
+        }
+    }
+  _ptz_count_words(&counters[0]);
+  for (i = 1; i < num_counters; i++)
+    {
+      if (threads[i])
+        g_thread_join(threads[i]);
+      if (counters[i].pass == 2)
+        g_hash_table_foreach_steal(counters[i].wordlist, _ptz_merge_word_count, counters[0].wordlist);
+    }
+  g_free(threads);
+}
+
+static GHashTable *
+_ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass, guint num_threads)
+{
+  int i, pass;
   GHashTable *wordlist;
   int *wordlist_cache = NULL;
-  guint cachesize = 0, cacheseed = 0, cacheindex = 0;
-  gchar *hash_key;
+  guint cachesize = 0, cacheseed = 0;
+  PTZWordCounter *counters;
 
+  num_threads = CLAMP(num_threads, 1, MAX(logs->len, 1));
   wordlist = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  counters = g_new0(PTZWordCounter, num_threads);
 
   for (pass = (two_pass ? 1 : 2); pass <= 2; ++pass)
     {
@@ -128,52 +272,26 @@ ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gbool
                        evt_tag_str("phase", "searching"));
         }
 
-      for (i = 0; i < logs->len; ++i)
+      for (i = 0; i < num_threads; i++)
         {
-          msg = (LogMessage *) g_ptr_array_index(logs, i);
-          msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
-
-          words = g_strsplit_set(msgstr, delimiters, PTZ_MAXWORDS);
-
-          for (j = 0; words[j]; ++j)
-            {
-              /* NOTE: to calculate the key for the hash, we prefix a word with
-               * its position in the row and a space -- as we always split at
-               * spaces, this should not create confusion
-               */
-              hash_key = g_strdup_printf("%d %s", j, words[j]);
-
-              if (two_pass)
-                cacheindex = ptz_str2hash(hash_key, cachesize, cacheseed);
-
-              if (pass == 1)
-                {
-                  wordlist_cache[cacheindex]++;
-                }
-              else if (pass == 2)
-                {
-                  if (!two_pass || wordlist_cache[cacheindex] >= support)
-                    {
-                      curr_count = (guint *) g_hash_table_lookup(wordlist, hash_key);
-                      if (!curr_count)
-                        {
-                          guint *currcount_ref = g_new(guint, 1);
-                          (*currcount_ref) = 1;
-                          g_hash_table_insert(wordlist, g_strdup(hash_key), currcount_ref);
-                        }
-                      else
-                        {
-                          (*curr_count)++;
-                        }
-                    }
-                }
-
-              g_free(hash_key);
-
-            }
-
-          g_strfreev(words);
+          PTZWordCounter *counter = &counters[i];
+
+          counter->logs = logs;
+          counter->first = (guint64) logs->len * i / num_threads;
+          counter->last = (guint64) logs->len * (i + 1) / num_threads;
+          counter->delimiters = delimiters;
+          counter->pass = pass;
+          counter->two_pass = two_pass;
+          counter->support = support;
+          counter->wordlist_cache = wordlist_cache;
+          counter->cachesize = cachesize;
+          counter->cacheseed = cacheseed;
+          counter->shared_cache = num_threads > 1;
+          counter->wordlist = i == 0 ? wordlist : g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
         }
+      _ptz_run_word_counters(counters, num_threads);
+      for (i = 1; i < num_threads; i++)
+        g_hash_table_unref(counters[i].wordlist);
 
       /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
 
@@ -182,10 +300,17 @@ ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gbool
 
   if (wordlist_cache)
     g_free(wordlist_cache);
+  g_free(counters);
 
   return wordlist;
 }
 
+GHashTable *
+ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass)
+{
+  return _ptz_find_frequent_words(logs, support, delimiters, two_pass, 1);
+}
+
 gboolean
 ptz_find_clusters_remove_cluster_predicate(gpointer key, gpointer value, gpointer data)
 {
@@ -229,8 +354,8 @@ cluster_free(Cluster *cluster)
   g_free(cluster);
 }
 
-GHashTable *
-ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples)
+static GHashTable *
+_ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples, guint num_threads)
 {
   GHashTable *wordlist;
   GHashTable *clusters;
@@ -246,7 +371,7 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
   gchar *msgdelimiters;
 
   /* get the frequent word list */
-  wordlist = ptz_find_frequent_words(logs, support, delimiters, TRUE);
+  wordlist = _ptz_find_frequent_words(logs, support, delimiters, TRUE, num_threads);
   /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
 
   /* find the cluster candidates */
@@ -331,6 +456,12 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
   return clusters;
 }
 
+GHashTable *
+ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples)
+{
+  return _ptz_find_clusters_slct(logs, support, delimiters, num_of_samples, 1);
+}
+
 /* callback function for g_hash_table_foreach_steal to migrate elements from one hash to the other */
 static gboolean
 ptz_merge_clusterlists(gpointer _key, gpointer _value, gpointer _target)
@@ -348,7 +479,7 @@ ptz_find_clusters_step(Patternizer *self, GPtrArray *logs, guint support, guint
 {
   msg_progress("Searching clusters", evt_tag_int("input lines", logs->len));
   if (self->algo == PTZ_ALGO_SLCT)
-    return ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples);
+    return _ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples, self->num_threads);
   else
     {
       msg_error("Unknown clustering algorithm", evt_tag_int("algo_id", self->algo));
@@ -572,14 +703,142 @@ ptz_print_patterndb(GHashTable *clusters, gchar *delimiters, gboolean named_pars
 
 }
 
+static void
+_ptz_add_line(GPtrArray *logs, gchar *line, MsgFormatOptions *parse_options)
+{
+  int len;
+  LogMessage *msg;
+
+  len = strlen(line);
+  if (line[len-1] == '\n')
+    line[len-1] = 0;
+
+  msg = log_msg_new(line, len, NULL, parse_options);
+  g_ptr_array_add(logs, msg);
+}
+
+/* a part of a memory mapped input file, split at line boundaries */
+typedef struct _PTZInputChunk
+{
+  const gchar *data;
+  gsize len;
+  MsgFormatOptions *parse_options;
+  GPtrArray *logs;
+} PTZInputChunk;
+
+static void
+_ptz_load_chunk(PTZInputChunk *chunk)
+{
+  gchar line[PTZ_MAXLINELEN];
+  gsize pos = 0;
+
+  while (pos < chunk->len)
+    {
+      const gchar *eol = memchr(chunk->data + pos, '\n', chunk->len - pos);
+      gsize line_len = eol ? eol - (chunk->data + pos) + 1 : chunk->len - pos;
+
+      /* split overly long lines the same way fgets() does */
+      line_len = MIN(line_len, PTZ_MAXLINELEN - 1);
+      memcpy(line, chunk->data + pos, line_len);
+      line[line_len] = 0;
+      pos += line_len;
+
+      _ptz_add_line(chunk->logs, line, chunk->parse_options);
+      scratch_buffers_explicit_gc();
+    }
+}
+
+static gpointer
+_ptz_load_chunk_thread(gpointer s)
+{
+  scratch_buffers_allocator_init();
+  _ptz_load_chunk((PTZInputChunk *) s);
+  scratch_buffers_allocator_deinit();
+  return NULL;
+}
+
+/* parses a regular file in self->num_threads chunks in parallel, the
+ * messages are added to self->logs in their original order */
+static gboolean
+_ptz_load_file_parallel(Patternizer *self, gchar *input_file, MsgFormatOptions *parse_options, GError **error)
+{
+  PTZInputChunk *chunks;
+  GThread **threads;
+  GError *thread_error = NULL;
+  struct stat st;
+  gchar *data;
+  gsize pos;
+  gint fd, i, j, num_chunks;
+
+  fd = open(input_file, O_RDONLY);
+  if (fd < 0)
+    {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Error opening input file %s", input_file);
+      return FALSE;
+    }
+  if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+      close(fd);
+      return TRUE;
+    }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Error mapping input file %s: %s", input_file, g_strerror(errno));
+      return FALSE;
+    }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  chunks = g_new0(PTZInputChunk, self->num_threads);
+  threads = g_new0(GThread *, self->num_threads);
+  pos = 0;
+  for (i = 0; i < self->num_threads && pos < st.st_size; i++)
+    {
+      gsize end = (i == self->num_threads - 1) ? st.st_size : MAX(pos, (gsize) st.st_size * (i + 1) / self->num_threads);
+      const gchar *eol = end < st.st_size ? memchr(data + end, '\n', st.st_size - end) : NULL;
+
+      if (end < st.st_size)
+        end = eol ? eol - data + 1 : st.st_size;
+
+      chunks[i].data = data + pos;
+      chunks[i].len = end - pos;
+      chunks[i].parse_options = parse_options;
+      chunks[i].logs = g_ptr_array_sized_new(PTZ_LOGTABLE_ALLOC_BASE);
+      threads[i] = g_thread_create(_ptz_load_chunk_thread, &chunks[i], TRUE, &thread_error);
+      if (!threads[i])
+        {
+          msg_warning("Error creating input parser thread, parsing in the main thread instead",
+                      evt_tag_str("error", thread_error ? thread_error->message : "Unknown error"));
+          g_clear_error(&thread_error);
+          _ptz_load_chunk(&chunks[i]);
+        }
+      pos = end;
+    }
+  num_chunks = i;
+
+  for (i = 0; i < num_chunks; i++)
+    {
+      if (threads[i])
+        g_thread_join(threads[i]);
+      for (j = 0; j < chunks[i].logs->len; j++)
+        g_ptr_array_add(self->logs, g_ptr_array_index(chunks[i].logs, j));
+      g_ptr_array_free(chunks[i].logs, TRUE);
+    }
+
+  g_free(threads);
+  g_free(chunks);
+  munmap(data, st.st_size);
+  return TRUE;
+}
+
 gboolean
 ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **error)
 {
   FILE *file;
-  int len;
   MsgFormatOptions parse_options;
   gchar line[PTZ_MAXLINELEN];
-  LogMessage *msg;
+  gboolean success = TRUE;
 
   if (!input_file)
     {
@@ -587,12 +846,27 @@ ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **
       return FALSE;
     }
 
+  memset(&parse_options, 0, sizeof(parse_options));
+  msg_format_options_defaults(&parse_options);
+  if (no_parse)
+    parse_options.flags |= LP_NOPARSE;
+  else
+    parse_options.flags |= LP_SYSLOG_PROTOCOL;
+  msg_format_options_init(&parse_options, configuration);
+
+  if (self->num_threads > 1 && strcmp(input_file, "-") != 0)
+    {
+      success = _ptz_load_file_parallel(self, input_file, &parse_options, error);
+      goto exit;
+    }
+
   if (strcmp(input_file, "-") != 0)
     {
       if (!(file = fopen(input_file, "r")))
         {
           g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Error opening input file %s", input_file);
-          return FALSE;
+          success = FALSE;
+          goto exit;
         }
     }
   else
@@ -600,27 +874,16 @@ ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **
       file = stdin;
     }
 
-  memset(&parse_options, 0, sizeof(parse_options));
-  msg_format_options_defaults(&parse_options);
-  if (no_parse)
-    parse_options.flags |= LP_NOPARSE;
-  else
-    parse_options.flags |= LP_SYSLOG_PROTOCOL;
-  msg_format_options_init(&parse_options, configuration);
-
   while (fgets(line, PTZ_MAXLINELEN, file))
-    {
-      len = strlen(line);
-      if (line[len-1] == '\n')
-        line[len-1] = 0;
+    _ptz_add_line(self->logs, line, &parse_options);
 
-      msg = log_msg_new(line, len, NULL, &parse_options);
-      g_ptr_array_add(self->logs, msg);
-    }
+  if (file != stdin)
+    fclose(file);
 
+exit:
   self->support = (self->logs->len * (self->support_treshold / 100.0));
   msg_format_options_destroy(&parse_options);
-  return TRUE;
+  return success;
 }
 
 Patternizer *
@@ -634,6 +897,7 @@ ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_sample
   self->support_treshold = support_treshold;
   self->num_of_samples = num_of_samples;
   self->delimiters = delimiters;
+  self->num_threads = 1;
   self->logs = g_ptr_array_sized_new(PTZ_LOGTABLE_ALLOC_BASE);
 
   cluster_tag_id = log_tags_get_by_name(".in_patternize_cluster");
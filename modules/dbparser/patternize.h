@@ -47,6 +47,7 @@ typedef struct _Patternizer
   guint num_of_samples;
   gdouble support_treshold;
   gchar *delimiters;
+  guint num_threads;
 
   // NOTE: for now, we store all logs read in in the memory.
   // This brings in some obvious constraints and should be solved
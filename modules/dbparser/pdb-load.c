@@ -1128,6 +1128,32 @@ GMarkupParser db_parser =
   .error = NULL
 };
 
+static void
+_compact_program_rules(RNode *node)
+{
+  PDBProgram *program = (PDBProgram *) node->value;
+  gint i;
+
+  /* the same program may be referenced by multiple nodes, compacting an
+   * already compacted tree is a noop */
+  if (program)
+    r_compact_tree(program->rules);
+
+  for (i = 0; i < node->num_children; i++)
+    _compact_program_rules(node->children[i]);
+  for (i = 0; i < node->num_pchildren; i++)
+    _compact_program_rules(node->pchildren[i]);
+}
+
+/* the ruleset is not changed after loading, so lay out its radix trees
+ * for lookups */
+static void
+_compact_ruleset(PDBRuleSet *ruleset)
+{
+  _compact_program_rules(ruleset->programs);
+  r_compact_tree(ruleset->programs);
+}
+
 gboolean
 pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GList **examples)
 {
@@ -1180,6 +1206,7 @@ pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GLis
       goto error;
     }
 
+  _compact_ruleset(self);
   if (state.load_examples)
     *examples = state.examples;
 
@@ -28,7 +28,7 @@
 #include "pdb-lookup-params.h"
 #include "pdb-rule.h"
 
-/* rules loaded from a pdb file */
+/* rules loaded from a pdb file, immutable once loaded */
 typedef struct _PDBRuleSet
 {
   RNode *programs;
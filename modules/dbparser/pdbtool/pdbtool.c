@@ -44,6 +44,7 @@
 #include "crypto.h"
 #include "compat/openssl_support.h"
 #include "scratch-buffers.h"
+#include "tls-support.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -52,6 +53,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BOOL(x) ((x) ? "TRUE" : "FALSE")
 
@@ -79,6 +82,7 @@ static gchar **colors = empty_colors;
 
 static gchar *patterndb_file = PATH_PATTERNDB_FILE;
 static gboolean color_out = FALSE;
+static gint num_threads = 1;
 
 typedef struct _PdbToolMergeState
 {
@@ -331,9 +335,11 @@ static gboolean debug_pattern_parse = FALSE;
 gboolean
 pdbtool_match_values(NVHandle handle, const gchar *name, const gchar *value, gssize length, gpointer user_data)
 {
-  gint *ret = user_data;
+  gpointer *args = (gpointer *) user_data;
+  gint *ret = (gint *) args[0];
+  GString *output = (GString *) args[1];
 
-  printf("%s=%.*s\n", name, (gint) length, value);
+  g_string_append_printf(output, "%s=%.*s\n", name, (gint) length, value);
   if (g_str_equal(name, ".classifier.rule_id") && ret)
     *ret = 0;
   if (ret && (g_str_equal(name, ".classifier.class") && g_str_equal(value, "unknown")))
@@ -341,14 +347,10 @@ pdbtool_match_values(NVHandle handle, const gchar *name, const gchar *value, gss
   return FALSE;
 }
 
+/* appends the output for a matching message to @output */
 static void
-pdbtool_pdb_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
+pdbtool_format_match(LogMessage *msg, FilterExprNode *filter, LogTemplate *template, gint *ret, GString *output)
 {
-  gpointer *args = (gpointer *) user_data;
-  FilterExprNode *filter = (FilterExprNode *) args[0];
-  LogTemplate *template = (LogTemplate *) args[1];
-  gint *ret = (gint *) args[2];
-  GString *output = (GString *) args[3];
   gboolean matched;
 
   matched = !filter || filter_expr_eval(filter, msg);
@@ -356,21 +358,302 @@ pdbtool_pdb_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
     {
       if (G_UNLIKELY(!template))
         {
+          gpointer args[] = { ret, output };
+
           if (debug_pattern && !debug_pattern_parse)
-            printf("\nValues:\n");
+            g_string_append(output, "\nValues:\n");
 
-          nv_table_foreach(msg->payload, logmsg_registry, pdbtool_match_values, ret);
-          g_string_truncate(output, 0);
+          nv_table_foreach(msg->payload, logmsg_registry, pdbtool_match_values, args);
+          g_string_append(output, "TAGS=");
           log_msg_print_tags(msg, output);
-          printf("TAGS=%s\n", output->str);
-          printf("\n");
+          g_string_append(output, "\n\n");
         }
       else
         {
-          log_template_format(template, msg, NULL, LTZ_LOCAL, 0, NULL, output);
-          printf("%s", output->str);
+          log_template_append_format(template, msg, NULL, LTZ_LOCAL, 0, NULL, output);
+        }
+    }
+}
+
+static void
+pdbtool_pdb_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+  gpointer *args = (gpointer *) user_data;
+  FilterExprNode *filter = (FilterExprNode *) args[0];
+  LogTemplate *template = (LogTemplate *) args[1];
+  gint *ret = (gint *) args[2];
+  GString *output = (GString *) args[3];
+
+  g_string_truncate(output, 0);
+  pdbtool_format_match(msg, filter, template, ret, output);
+  fwrite(output->str, 1, output->len, stdout);
+}
+
+static void
+pdbtool_report_throughput(const gchar *what, guint64 count, GTimer *timer)
+{
+  gdouble elapsed = g_timer_elapsed(timer, NULL);
+
+  fprintf(stderr, "%s %" G_GUINT64_FORMAT " messages in %.3f seconds, %.0f messages/sec\n",
+          what, count, elapsed, elapsed > 0 ? count / elapsed : 0.0);
+}
+
+/*
+ * Parallel matching: the input file is mapped into memory and cut into
+ * chunks at line boundaries.  Worker threads pick chunks in order, and
+ * collect the output of each chunk in its own buffer, which the main
+ * thread prints in the original order of the input.
+ *
+ * Correlation state is shared by the threads, so messages of the same
+ * context may be processed out of order if they end up in different
+ * chunks.
+ */
+
+#define PDBTOOL_MATCH_CHUNK_SIZE (1024 * 1024)
+
+typedef struct _PdbToolMatchChunk
+{
+  const gchar *data;
+  gsize len;
+  GString *output;
+  guint64 num_messages;
+  gint ret;
+  gboolean done;
+} PdbToolMatchChunk;
+
+typedef struct _PdbToolParallelMatch
+{
+  PatternDB *patterndb;
+  MsgFormatOptions *parse_options;
+  FilterExprNode *filter;
+  LogTemplate *template;
+  gsize max_msg_size;
+  gint *ret;
+
+  GMutex *lock;
+  GCond *chunk_done;
+  PdbToolMatchChunk *chunks;
+  gint num_chunks;
+  gint next_chunk;
+} PdbToolParallelMatch;
+
+TLS_BLOCK_START
+{
+  PdbToolMatchChunk *current_chunk;
+}
+TLS_BLOCK_END;
+
+#define current_chunk __tls_deref(current_chunk)
+
+static void
+pdbtool_pdb_emit_parallel(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+  PdbToolParallelMatch *self = (PdbToolParallelMatch *) user_data;
+  PdbToolMatchChunk *chunk = current_chunk;
+  GString *output;
+
+  if (chunk)
+    {
+      pdbtool_format_match(msg, self->filter, self->template, &chunk->ret, chunk->output);
+      return;
+    }
+
+  /* messages emitted when expiring the remaining state at the end */
+  output = g_string_sized_new(512);
+  pdbtool_format_match(msg, self->filter, self->template, self->ret, output);
+  fwrite(output->str, 1, output->len, stdout);
+  g_string_free(output, TRUE);
+}
+
+static void
+pdbtool_match_chunk(PdbToolParallelMatch *self, PdbToolMatchChunk *chunk)
+{
+  gsize pos = 0;
+
+  while (pos < chunk->len)
+    {
+      const guchar *line = (const guchar *) chunk->data + pos;
+      gsize avail = MIN(chunk->len - pos, self->max_msg_size);
+      const guchar *eol = find_eom(line, avail);
+      gsize line_len = eol ? eol - line : avail;
+      LogMessage *msg;
+
+      pos += eol ? line_len + 1 : line_len;
+
+      /* split lines the same way as LogProtoTextServer does for the
+       * serial case: lines longer than max_msg_size are cut into
+       * max_msg_size sized pieces and a \r or \0 preceding the newline is
+       * dropped */
+      while (line_len > 0 && (line[line_len - 1] == '\r' || line[line_len - 1] == 0))
+        line_len--;
+
+      invalidate_cached_time();
+      msg = log_msg_new_empty();
+      self->parse_options->format_handler->parse(self->parse_options, line, line_len, msg);
+      pattern_db_process(self->patterndb, msg);
+      log_msg_unref(msg);
+      chunk->num_messages++;
+      scratch_buffers_explicit_gc();
+    }
+}
+
+static void
+pdbtool_match_chunks(PdbToolParallelMatch *self)
+{
+  PdbToolMatchChunk *chunk;
+
+  while (TRUE)
+    {
+      g_mutex_lock(self->lock);
+      chunk = self->next_chunk < self->num_chunks ? &self->chunks[self->next_chunk++] : NULL;
+      g_mutex_unlock(self->lock);
+      if (!chunk)
+        break;
+
+      current_chunk = chunk;
+      pdbtool_match_chunk(self, chunk);
+      current_chunk = NULL;
+
+      g_mutex_lock(self->lock);
+      chunk->done = TRUE;
+      g_cond_broadcast(self->chunk_done);
+      g_mutex_unlock(self->lock);
+    }
+}
+
+static gpointer
+pdbtool_match_worker(gpointer user_data)
+{
+  PdbToolParallelMatch *self = (PdbToolParallelMatch *) user_data;
+
+  scratch_buffers_allocator_init();
+  pdbtool_match_chunks(self);
+  scratch_buffers_allocator_deinit();
+  return NULL;
+}
+
+static void
+pdbtool_split_into_chunks(PdbToolParallelMatch *self, const gchar *data, gsize len)
+{
+  GArray *chunks = g_array_new(FALSE, TRUE, sizeof(PdbToolMatchChunk));
+  gsize pos = 0;
+
+  while (pos < len)
+    {
+      PdbToolMatchChunk chunk = { 0 };
+      gsize end = MIN(pos + PDBTOOL_MATCH_CHUNK_SIZE, len);
+      const gchar *eol = end < len ? memchr(data + end, '\n', len - end) : NULL;
+
+      if (end < len)
+        end = eol ? eol - data + 1 : len;
+
+      chunk.data = data + pos;
+      chunk.len = end - pos;
+      chunk.output = g_string_sized_new(4096);
+      chunk.ret = -1;
+      g_array_append_val(chunks, chunk);
+      pos = end;
+    }
+  self->num_chunks = chunks->len;
+  self->chunks = (PdbToolMatchChunk *) g_array_free(chunks, FALSE);
+}
+
+static gint
+pdbtool_match_file_parallel(PatternDB *patterndb, MsgFormatOptions *parse_options, FilterExprNode *filter,
+                            LogTemplate *template, gsize max_msg_size)
+{
+  PdbToolParallelMatch self = { 0 };
+  GThread **threads;
+  GError *error = NULL;
+  GTimer *timer;
+  struct stat st;
+  gchar *data = NULL;
+  guint64 num_messages = 0;
+  gint ret = 0;
+  gint fd, i, num_started;
+
+  fd = open(match_file, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0)
+    {
+      fprintf(stderr, "Error opening file to be processed: %s\n", g_strerror(errno));
+      if (fd >= 0)
+        close(fd);
+      return 1;
+    }
+  if (st.st_size > 0)
+    {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED)
+        {
+          fprintf(stderr, "Error mapping file to be processed: %s\n", g_strerror(errno));
+          close(fd);
+          return 1;
         }
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
     }
+  close(fd);
+
+  self.patterndb = patterndb;
+  self.parse_options = parse_options;
+  self.filter = filter;
+  self.template = template;
+  self.max_msg_size = max_msg_size;
+  self.ret = &ret;
+  self.lock = g_mutex_new();
+  self.chunk_done = g_cond_new();
+  pdbtool_split_into_chunks(&self, data, st.st_size);
+  pattern_db_set_emit_func(patterndb, pdbtool_pdb_emit_parallel, &self);
+
+  timer = g_timer_new();
+  threads = g_new0(GThread *, num_threads);
+  for (num_started = 0; num_started < num_threads; num_started++)
+    {
+      threads[num_started] = g_thread_create(pdbtool_match_worker, &self, TRUE, &error);
+      if (!threads[num_started])
+        {
+          fprintf(stderr, "Error creating worker thread, continuing with %d threads; error='%s'\n",
+                  num_started, error ? error->message : "Unknown error");
+          g_clear_error(&error);
+          break;
+        }
+    }
+
+  /* without a single worker the chunks are processed right here */
+  if (num_started == 0)
+    pdbtool_match_chunks(&self);
+
+  for (i = 0; i < self.num_chunks; i++)
+    {
+      PdbToolMatchChunk *chunk = &self.chunks[i];
+
+      g_mutex_lock(self.lock);
+      while (!chunk->done)
+        g_cond_wait(self.chunk_done, self.lock);
+      g_mutex_unlock(self.lock);
+
+      fwrite(chunk->output->str, 1, chunk->output->len, stdout);
+      g_string_free(chunk->output, TRUE);
+      chunk->output = NULL;
+      if (chunk->ret >= 0)
+        ret = chunk->ret;
+      num_messages += chunk->num_messages;
+    }
+
+  for (i = 0; i < num_started; i++)
+    g_thread_join(threads[i]);
+  pattern_db_expire_state(patterndb);
+
+  if (verbose_flag)
+    pdbtool_report_throughput("Matched", num_messages, timer);
+
+  g_timer_destroy(timer);
+  g_free(threads);
+  g_free(self.chunks);
+  g_cond_free(self.chunk_done);
+  g_mutex_free(self.lock);
+  if (data)
+    munmap(data, st.st_size);
+  return ret;
 }
 
 static gint
@@ -395,6 +678,8 @@ pdbtool_match(int argc, char *argv[])
   LogProtoServerOptions proto_options;
   gboolean may_read = TRUE;
   gpointer args[4];
+  GTimer *timer = NULL;
+  guint64 num_messages = 0;
 
   memset(&parse_options, 0, sizeof(parse_options));
 
@@ -443,6 +728,21 @@ pdbtool_match(int argc, char *argv[])
       goto error;
     }
 
+  if (match_file && num_threads > 1 && !debug_pattern && strcmp(match_file, "-") != 0)
+    {
+      /* chunks are split on raw bytes, without running the input through
+       * the character set conversion of LogProtoTextServer */
+      if (proto_options.encoding)
+        {
+          fprintf(stderr, "Parallel matching (--threads) cannot be used with an input encoding\n");
+          ret = 1;
+          goto error;
+        }
+      ret = pdbtool_match_file_parallel(patterndb, &parse_options, filter, template, proto_options.max_msg_size);
+      goto error;
+    }
+
+  timer = g_timer_new();
   msg = log_msg_new_empty();
   if (!match_file)
     {
@@ -585,6 +885,7 @@ pdbtool_match(int argc, char *argv[])
           pattern_db_process(patterndb, msg);
         }
 
+      num_messages++;
       if (G_LIKELY(proto))
         {
           buf = NULL;
@@ -596,7 +897,11 @@ pdbtool_match(int argc, char *argv[])
         }
     }
   pattern_db_expire_state(patterndb);
+  if (verbose_flag && match_file)
+    pdbtool_report_throughput("Matched", num_messages, timer);
 error:
+  if (timer)
+    g_timer_destroy(timer);
   if (proto)
     log_proto_server_free(proto);
   if (template)
@@ -649,6 +954,10 @@ static GOptionEntry match_options[] =
     "filter", 'F', 0, G_OPTION_ARG_STRING, &filter_string,
     "Only print messages matching the specified syslog-ng filter", "expr"
   },
+  {
+    "threads", 'j', 0, G_OPTION_ARG_INT, &num_threads,
+    "Number of threads to process the file specified by --file with (default: 1)", "<threads>"
+  },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
 };
 
@@ -1043,6 +1352,7 @@ pdbtool_patternize(int argc, char *argv[])
   guint iterate = PTZ_ITERATE_NONE;
   gint i;
   GError *error = NULL;
+  GTimer *timer;
   GString *delimcheck = g_string_new(" "); /* delims should always include a space */
 
   if (iterate_outliers)
@@ -1061,6 +1371,8 @@ pdbtool_patternize(int argc, char *argv[])
     {
       return 1;
     }
+  ptz->num_threads = MAX(num_threads, 1);
+  timer = g_timer_new();
 
   argv[0] = input_logfile;
   for (i = 0; i < argc; i++)
@@ -1073,11 +1385,19 @@ pdbtool_patternize(int argc, char *argv[])
         }
     }
 
+  if (verbose_flag)
+    pdbtool_report_throughput("Loaded", ptz->logs->len, timer);
+
+  g_timer_start(timer);
   clusters = ptz_find_clusters(ptz);
   ptz_print_patterndb(clusters, delimiters, named_parsers);
   g_hash_table_destroy(clusters);
 
+  if (verbose_flag)
+    pdbtool_report_throughput("Clustered", ptz->logs->len, timer);
+
 exit:
+  g_timer_destroy(timer);
   ptz_free(ptz);
 
   return 0;
@@ -1113,6 +1433,10 @@ static GOptionEntry patternize_options[] =
     "samples",           0, 0, G_OPTION_ARG_INT, &num_of_samples,
     "Number of example lines to add for the patterns (default: 1)", "<samples>"
   },
+  {
+    "threads",         'j', 0, G_OPTION_ARG_INT, &num_threads,
+    "Number of threads to load and count words with (default: 1)", "<threads>"
+  },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
 };
 
@@ -0,0 +1,81 @@
+#!/bin/sh
+#############################################################################
+# Copyright (c) 2017 Balabit
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+
+# "pdbtool match --threads" must produce the same output as the serial
+# matcher, including for CRLF terminated lines, lines longer than the
+# maximum message size and input spanning multiple chunks.
+
+PDBTOOL=${PDBTOOL:-./modules/dbparser/pdbtool/pdbtool}
+WORKDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+
+cat > "$WORKDIR/patterndb.xml" <<'PDB'
+<?xml version='1.0' encoding='UTF-8'?>
+<patterndb version='4' pub_date='2010-02-22'>
+  <ruleset name='testset' id='1'>
+    <patterns>
+      <pattern>sshd</pattern>
+    </patterns>
+    <rules>
+      <rule provider='test' id='10' class='system'>
+        <patterns>
+          <pattern>Accepted password for @ESTRING:user: @from @ANYSTRING:host@</pattern>
+        </patterns>
+      </rule>
+    </rules>
+  </ruleset>
+</patterndb>
+PDB
+
+awk 'BEGIN {
+       for (i = 0; i < 60000; i++)
+         {
+           eol = (i % 3 == 0) ? "\r\n" : "\n";
+           if (i % 5 == 0)
+             printf("<38>Feb 22 10:00:00 host sshd[%d]: Unmatched message number %d%s", i, i, eol);
+           else
+             printf("<38>Feb 22 10:00:00 host sshd[%d]: Accepted password for user%d from 10.0.%d.%d%s", i, i, i % 256, i % 100, eol);
+         }
+       # split into two messages at 64k
+       printf("<38>Feb 22 10:00:00 host sshd[0]: ");
+       for (i = 0; i < 70000; i++)
+         printf("x");
+       printf("\n");
+     }' > "$WORKDIR/messages.log"
+
+TEMPLATE='[${MSG}] ${.classifier.class} ${user} ${host}\n'
+
+"$PDBTOOL" match -p "$WORKDIR/patterndb.xml" -f "$WORKDIR/messages.log" -T "$TEMPLATE" > "$WORKDIR/serial.out" || exit 1
+"$PDBTOOL" match -p "$WORKDIR/patterndb.xml" -f "$WORKDIR/messages.log" -T "$TEMPLATE" -j 4 > "$WORKDIR/parallel.out" || exit 1
+
+if [ "$(wc -l < "$WORKDIR/serial.out")" -ne 60002 ]; then
+  echo "Unexpected number of matches in serial output"
+  exit 1
+fi
+
+if ! cmp -s "$WORKDIR/serial.out" "$WORKDIR/parallel.out"; then
+  echo "Parallel match output differs from serial output:"
+  diff "$WORKDIR/serial.out" "$WORKDIR/parallel.out" | head -20
+  exit 1
+fi
+exit 0
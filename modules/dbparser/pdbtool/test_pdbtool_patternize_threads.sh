@@ -0,0 +1,62 @@
+#!/bin/sh
+#############################################################################
+# Copyright (c) 2017 Balabit
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As an additional exemption you are allowed to compile & link against the
+# OpenSSL libraries as published by the OpenSSL project. See the file
+# COPYING for details.
+#
+#############################################################################
+
+# "pdbtool patternize --threads" must find the same patterns as the serial
+# run, with the input split among the threads at line boundaries.
+
+PDBTOOL=${PDBTOOL:-./modules/dbparser/pdbtool/pdbtool}
+WORKDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+
+awk 'BEGIN {
+       for (i = 0; i < 30000; i++)
+         {
+           if (i % 3 == 0)
+             printf("<38>Feb 22 10:00:00 host sshd[%d]: Accepted password for user%d from 10.0.%d.%d port %d\n", i, i % 50, i % 256, i % 100, i);
+           else if (i % 3 == 1)
+             printf("<38>Feb 22 10:00:00 host sshd[%d]: Connection closed by 10.1.%d.%d\n", i, i % 256, i % 100);
+           else
+             printf("<86>Feb 22 10:00:00 host CRON[%d]: pam_unix(cron:session): session opened for user root by (uid=%d)\n", i, i % 50);
+         }
+     }' > "$WORKDIR/messages.log"
+
+# rule and ruleset ids are random UUIDs and pub_date is the current date
+normalize()
+{
+  sed -e "s/id='[^']*'/id=''/" -e "s/pub_date='[^']*'/pub_date=''/"
+}
+
+"$PDBTOOL" patternize -f "$WORKDIR/messages.log" | normalize > "$WORKDIR/serial.out" || exit 1
+"$PDBTOOL" patternize -f "$WORKDIR/messages.log" -j 4 | normalize > "$WORKDIR/parallel.out" || exit 1
+
+if [ "$(grep -c '<rule ' "$WORKDIR/serial.out")" -ne 3 ]; then
+  echo "Unexpected number of patterns in serial output"
+  exit 1
+fi
+
+if ! cmp -s "$WORKDIR/serial.out" "$WORKDIR/parallel.out"; then
+  echo "Parallel patternize output differs from serial output:"
+  diff "$WORKDIR/serial.out" "$WORKDIR/parallel.out" | head -20
+  exit 1
+fi
+exit 0
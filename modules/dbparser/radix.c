@@ -22,12 +22,11 @@
  */
 
 #include "radix.h"
+#include "pcre-utils.h"
 
 #include <string.h>
 #include <stdlib.h>
 
-#include <pcre.h>
-
 /**************************************************************
  * Parsing nodes.
  **************************************************************/
@@ -166,7 +165,7 @@ r_parser_pcre_compile_state(const gchar *expr)
       g_free(self);
       return NULL;
     }
-  self->extra = pcre_study(self->re, 0, &errptr);
+  self->extra = pcre_utils_study(self->re, &errptr);
   if (errptr)
     {
       msg_error("Error while optimizing regular expression",
@@ -174,7 +173,7 @@ r_parser_pcre_compile_state(const gchar *expr)
                 evt_tag_str("error_message", errptr));
       pcre_free(self->re);
       if (self->extra)
-        pcre_free(self->extra);
+        pcre_free_study(self->extra);
       g_free(self);
       return NULL;
     }
@@ -189,7 +188,7 @@ r_parser_pcre_free_state(gpointer s)
   if (self->re)
     pcre_free(self->re);
   if (self->extra)
-    pcre_free(self->extra);
+    pcre_free_study(self->extra);
   g_free(self);
 }
 
@@ -794,6 +793,8 @@ r_node_cmp(const void *ap, const void *bp)
 void
 r_add_child(RNode *parent, RNode *child)
 {
+  g_assert(!parent->compacted);
+
   parent->children = g_realloc(parent->children, (sizeof(RNode *) * (parent->num_children + 1)));
 
   //FIXME: we could do a simple sorted insert without resorting always
@@ -841,6 +842,8 @@ r_add_child_check(RNode *root, guint8 *key, gpointer value, RNodeGetValueFunc va
 void
 r_add_pchild(RNode *parent, RNode *child)
 {
+  g_assert(!parent->compacted);
+
   parent->pchildren = realloc(parent->pchildren, (sizeof(RNode *) * (parent->num_pchildren + 1)));
 
   parent->pchildren[(parent->num_pchildren)++] = child;
@@ -878,7 +881,13 @@ RNode *
 r_find_child_by_first_character(RNode *root, char key)
 {
   register gint l, u, idx;
-  register char k = key;
+  register guint8 k = key;
+
+  if (root->child_index)
+    {
+      idx = root->child_index[k];
+      return idx ? root->children[idx - 1] : NULL;
+    }
 
   l = 0;
   u = root->num_children;
@@ -906,6 +915,8 @@ r_insert_node(RNode *root, guint8 *key, gpointer value, RNodeGetValueFunc value_
   gint nodelen = root->keylen;
   gint i = 0;
 
+  g_assert(!root->compacted);
+
   if (key[0] == '@')
     {
       guint8 *end;
@@ -1091,6 +1102,153 @@ r_insert_node(RNode *root, guint8 *key, gpointer value, RNodeGetValueFunc value_
     }
 }
 
+/**************************************************************
+ * Compacting the tree once it is built.
+ **************************************************************/
+
+/* nodes with at least this many literal children get a 256 entry index
+ * instead of the binary search in r_find_child_by_first_character() */
+#define R_CHILD_INDEX_MIN_CHILDREN 8
+
+typedef struct _RCompactor
+{
+  RNode *next_node;
+  RNode **next_child;
+  guint16 *next_index;
+  guint8 *next_key;
+} RCompactor;
+
+typedef struct _RCompactSize
+{
+  gsize nodes;
+  gsize children;
+  gsize indexes;
+  gsize key_bytes;
+} RCompactSize;
+
+static void
+_measure_subtree(RNode *node, RCompactSize *size)
+{
+  gint i;
+
+  if (node->key)
+    size->key_bytes += node->keylen + 1;
+  size->nodes += node->num_children + node->num_pchildren;
+  size->children += node->num_children + node->num_pchildren;
+  if (node->num_children >= R_CHILD_INDEX_MIN_CHILDREN)
+    size->indexes++;
+
+  for (i = 0; i < node->num_children; i++)
+    _measure_subtree(node->children[i], size);
+  for (i = 0; i < node->num_pchildren; i++)
+    _measure_subtree(node->pchildren[i], size);
+}
+
+static void
+_compact_key(RCompactor *self, RNode *node)
+{
+  guint8 *key;
+
+  if (!node->key)
+    return;
+
+  key = self->next_key;
+  memcpy(key, node->key, node->keylen + 1);
+  self->next_key += node->keylen + 1;
+  g_free(node->key);
+  node->key = key;
+}
+
+/* moves the children of @node next to each other, so that siblings share
+ * cache lines, then continues with the grandchildren */
+static RNode **
+_compact_node_array(RCompactor *self, RNode **nodes, guint num_nodes)
+{
+  RNode **compacted_nodes;
+  gint i;
+
+  if (!num_nodes)
+    return NULL;
+
+  compacted_nodes = self->next_child;
+  self->next_child += num_nodes;
+  for (i = 0; i < num_nodes; i++)
+    {
+      RNode *compacted_node = self->next_node++;
+
+      *compacted_node = *nodes[i];
+      compacted_node->compacted = TRUE;
+      _compact_key(self, compacted_node);
+      g_free(nodes[i]);
+      compacted_nodes[i] = compacted_node;
+    }
+  g_free(nodes);
+  return compacted_nodes;
+}
+
+static void
+_compact_child_index(RCompactor *self, RNode *node)
+{
+  gint i;
+
+  if (node->num_children < R_CHILD_INDEX_MIN_CHILDREN)
+    return;
+
+  node->child_index = self->next_index;
+  self->next_index += 256;
+  memset(node->child_index, 0, 256 * sizeof(node->child_index[0]));
+  for (i = 0; i < node->num_children; i++)
+    node->child_index[node->children[i]->key[0]] = i + 1;
+}
+
+static void
+_compact_subtree(RCompactor *self, RNode *node)
+{
+  gint i;
+
+  node->children = _compact_node_array(self, node->children, node->num_children);
+  node->pchildren = _compact_node_array(self, node->pchildren, node->num_pchildren);
+  _compact_child_index(self, node);
+
+  for (i = 0; i < node->num_children; i++)
+    _compact_subtree(self, node->children[i]);
+  for (i = 0; i < node->num_pchildren; i++)
+    _compact_subtree(self, node->pchildren[i]);
+}
+
+/*
+ * Relocates the nodes below @root into a single memory block, so that
+ * lookups walk contiguous memory instead of chasing pointers into
+ * separately allocated nodes.  No nodes can be inserted into the tree
+ * afterwards.  @root itself remains at the same address.
+ */
+void
+r_compact_tree(RNode *root)
+{
+  RCompactSize size = {0};
+  RCompactor compactor;
+  gsize nodes_size, children_size, indexes_size;
+
+  if (root->compacted)
+    return;
+
+  _measure_subtree(root, &size);
+
+  nodes_size = size.nodes * sizeof(RNode);
+  children_size = size.children * sizeof(RNode *);
+  indexes_size = size.indexes * 256 * sizeof(guint16);
+  root->arena = g_malloc(nodes_size + children_size + indexes_size + size.key_bytes);
+
+  compactor.next_node = (RNode *) root->arena;
+  compactor.next_child = (RNode **) (((gchar *) root->arena) + nodes_size);
+  compactor.next_index = (guint16 *) (((gchar *) compactor.next_child) + children_size);
+  compactor.next_key = ((guint8 *) compactor.next_index) + indexes_size;
+
+  _compact_key(&compactor, root);
+  _compact_subtree(&compactor, root);
+  root->compacted = TRUE;
+}
+
 typedef struct _RFindNodeState
 {
   gboolean require_complete_match;
@@ -1499,6 +1657,10 @@ r_new_node(guint8 *key, gpointer value)
   node->num_pchildren = 0;
   node->pchildren = NULL;
 
+  node->compacted = FALSE;
+  node->arena = NULL;
+  node->child_index = NULL;
+
   return node;
 }
 
@@ -1510,20 +1672,24 @@ r_free_node(RNode *node, void (*free_fn)(gpointer data))
   for (i = 0; i < node->num_children; i++)
     r_free_node(node->children[i], free_fn);
 
-  if (node->children)
+  if (node->children && !node->compacted)
     g_free(node->children);
 
   for (i = 0; i < node->num_pchildren; i++)
     r_free_pnode(node->pchildren[i], free_fn);
 
-  if (node->pchildren)
+  if (node->pchildren && !node->compacted)
     g_free(node->pchildren);
 
-  if (node->key)
+  if (node->key && !node->compacted)
     g_free(node->key);
 
   if (node->value && free_fn)
     free_fn(node->value);
 
-  g_free(node);
+  /* nodes of a compacted tree live in the arena of its root */
+  if (node->arena)
+    g_free(node->arena);
+  if (!node->compacted || node->arena)
+    g_free(node);
 }
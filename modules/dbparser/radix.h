@@ -97,6 +97,14 @@ struct _RNode
 
   guint num_pchildren;
   RNode **pchildren;
+
+  /* set up by r_compact_tree(): the nodes below this one, their keys and
+   * child arrays are stored in one contiguous block, owned by the node
+   * the tree was compacted from.  High fanout nodes get an index mapping
+   * the first character of the key to the child. */
+  gboolean compacted;
+  gpointer arena;
+  guint16 *child_index;
 };
 
 typedef struct _RDebugInfo
@@ -149,6 +157,7 @@ r_parser_type_name(guint8 type)
 RNode *r_new_node(guint8 *key, gpointer value);
 void r_free_node(RNode *node, void (*free_fn)(gpointer data));
 void r_insert_node(RNode *root, guint8 *key, gpointer value, RNodeGetValueFunc value_func);
+void r_compact_tree(RNode *root);
 RNode *r_find_node(RNode *root, guint8 *key, gint keylen, GArray *matches);
 RNode *r_find_node_dbg(RNode *root, guint8 *key, gint keylen, GArray *matches, GArray *dbg_list);
 gchar **r_find_all_applicable_nodes(RNode *root, guint8 *key, gint keylen, RNodeGetValueFunc value_func);
@@ -1109,6 +1109,100 @@ test_patterndb_tags_outside_of_rule()
   _destroy_pattern_db();
 }
 
+gchar *pdb_timeout_ordering_skeleton = "<patterndb version='4' pub_date='2010-02-22'>\
+ <ruleset name='testset' id='1'>\
+  <patterns>\
+   <pattern>prog1</pattern>\
+  </patterns>\
+  <rules>\
+    <rule provider='test' id='21' class='system' context-scope='global'\
+          context-id='${ctx}' context-timeout='60'>\
+      <patterns>\
+        <pattern>timeout-ordering</pattern>\
+      </patterns>\
+      <actions>\
+        <action trigger='timeout'>\
+          <message inherit-properties='TRUE'>\
+            <values>\
+              <value name='MESSAGE'>timeout</value>\
+            </values>\
+          </message>\
+        </action>\
+      </actions>\
+    </rule>\
+  </rules>\
+ </ruleset>\
+</patterndb>";
+
+/* the contexts are spread among the correllation shards, the timeouts
+ * still have to be emitted in the order the contexts expired */
+void
+test_patterndb_timeouts_are_emitted_in_expiration_order(void)
+{
+  const gint num_contexts = 32;
+  gchar ctx[16];
+  gint i;
+
+  _load_pattern_db_from_string(pdb_timeout_ordering_skeleton);
+
+  for (i = 0; i < num_contexts; i++)
+    {
+      g_snprintf(ctx, sizeof(ctx), "ctx%d", i);
+      _feed_message_to_correllation_state("prog1", "timeout-ordering", "ctx", ctx);
+      pattern_db_advance_time(patterndb, 1);
+    }
+  assert_no_such_output_message(num_contexts);
+
+  /* all of them expire in a single step */
+  _advance_time(60);
+  for (i = 0; i < num_contexts; i++)
+    {
+      g_snprintf(ctx, sizeof(ctx), "ctx%d", i);
+      assert_output_message_nvpair_equals(num_contexts + i, "MESSAGE", "timeout");
+      assert_output_message_nvpair_equals(num_contexts + i, "ctx", ctx);
+    }
+  assert_no_such_output_message(2 * num_contexts);
+
+  _destroy_pattern_db();
+}
+
+gchar *pdb_reloaded_skeleton = "<patterndb version='4' pub_date='2010-02-22'>\
+ <ruleset name='testset' id='1'>\
+  <patterns>\
+   <pattern>prog1</pattern>\
+  </patterns>\
+  <rules>\
+    <rule provider='test' id='22' class='reloaded'>\
+      <patterns>\
+        <pattern>reloaded-pattern</pattern>\
+      </patterns>\
+    </rule>\
+  </rules>\
+ </ruleset>\
+</patterndb>";
+
+void
+test_patterndb_lookups_use_the_reloaded_ruleset(void)
+{
+  gint i;
+
+  _load_pattern_db_from_string(pdb_timeout_ordering_skeleton);
+  assert_msg_matches_and_nvpair_equals("timeout-ordering", ".classifier.rule_id", "21");
+
+  /* the previous rulesets are retired, and freed by the timer tick or at
+   * the latest by pattern_db_free() */
+  for (i = 0; i < 3; i++)
+    {
+      g_file_set_contents(filename, pdb_reloaded_skeleton, strlen(pdb_reloaded_skeleton), NULL);
+      assert_true(pattern_db_reload_ruleset(patterndb, configuration, filename), "Error reloading ruleset");
+      assert_msg_doesnot_match("timeout-ordering");
+      assert_msg_matches_and_nvpair_equals("reloaded-pattern", ".classifier.rule_id", "22");
+      pattern_db_timer_tick(patterndb);
+    }
+
+  _destroy_pattern_db();
+}
+
 #include "test_parsers_e2e.c"
 
 int
@@ -1133,6 +1227,8 @@ main(int argc, char *argv[])
   test_patterndb_message_property_inheritance();
   test_patterndb_context_length();
   test_patterndb_tags_outside_of_rule();
+  test_patterndb_timeouts_are_emitted_in_expiration_order();
+  test_patterndb_lookups_use_the_reloaded_ruleset();
 
   app_shutdown();
   return 0;
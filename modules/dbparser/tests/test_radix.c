@@ -296,6 +296,48 @@ test_literals(void)
   r_free_node(root, NULL);
 }
 
+void
+test_compacted_tree(void)
+{
+  RNode *root = r_new_node("", NULL);
+
+  /* enough children on the root to get a child index */
+  insert_node(root, "alma");
+  insert_node(root, "almafa");
+  insert_node(root, "barack");
+  insert_node(root, "citrom");
+  insert_node(root, "dinnye");
+  insert_node(root, "eper");
+  insert_node(root, "fuge");
+  insert_node(root, "gesztenye");
+  insert_node(root, "korte");
+  insert_node(root, "\xc3\xa1fonya");
+  insert_node(root, "szilva @NUMBER:szam@ kg");
+  insert_node(root, "szilva @ESTRING:nev: @kg");
+
+  r_compact_tree(root);
+  /* compacting twice is harmless */
+  r_compact_tree(root);
+
+  test_search(root, "alma", TRUE);
+  test_search_value(root, "almafa", "almafa");
+  test_search_value(root, "almak", "alma");
+  test_search(root, "barack", TRUE);
+  test_search(root, "citrom", TRUE);
+  test_search(root, "dinnye", TRUE);
+  test_search(root, "eper", TRUE);
+  test_search(root, "fuge", TRUE);
+  test_search(root, "gesztenye", TRUE);
+  test_search(root, "korte", TRUE);
+  test_search(root, "\xc3\xa1fonya", TRUE);
+  test_search(root, "\xc3\xa9fonya", FALSE);
+  test_search(root, "mmm", FALSE);
+  test_search_matches(root, "szilva 12 kg", "szam", "12", NULL);
+  test_search_matches(root, "szilva tizenketto kg", "nev", "tizenketto", NULL);
+
+  r_free_node(root, NULL);
+}
+
 void
 test_parsers(void)
 {
@@ -909,6 +951,7 @@ main(int argc, char *argv[])
   msg_init(TRUE);
 
   test_literals();
+  test_compacted_tree();
   test_parsers();
 
   test_ip_matches();
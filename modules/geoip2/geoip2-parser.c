@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "geoip2-parser.h"
+#include "parser/parser-expr.h"
+#include "maxminddb-helper.h"
+#include "messages.h"
+
+typedef struct _GeoIP2Parser GeoIP2Parser;
+
+struct _GeoIP2Parser
+{
+  LogParser super;
+  GeoIP2Database database;
+
+  gchar *database_path;
+  gchar *prefix;
+
+  /* the template is ${SOURCEIP}, the address is taken from the message */
+  gboolean source_ip;
+  struct
+  {
+    NVHandle country_code;
+    NVHandle longitude;
+    NVHandle latitude;
+  } dest;
+};
+
+void
+geoip2_parser_set_prefix(LogParser *s, const gchar *prefix)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+
+  g_free(self->prefix);
+  self->prefix = g_strdup(prefix);
+}
+
+void
+geoip2_parser_set_database(LogParser *s, const gchar *database)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+
+  g_free(self->database_path);
+  self->database_path = g_strdup(database);
+}
+
+static NVHandle
+_get_field_handle(GeoIP2Parser *self, const gchar *field)
+{
+  gchar *name = g_strdup_printf("%s%s", self->prefix, field);
+  NVHandle handle = log_msg_get_value_handle(name);
+
+  g_free(name);
+  return handle;
+}
+
+static void
+geoip2_parser_resolve_fields(GeoIP2Parser *self)
+{
+  self->dest.country_code = _get_field_handle(self, "country_code");
+  self->dest.longitude = _get_field_handle(self, "longitude");
+  self->dest.latitude = _get_field_handle(self, "latitude");
+}
+
+static gboolean
+geoip2_parser_process(LogParser *s, LogMessage **pmsg,
+                      const LogPathOptions *path_options,
+                      const gchar *input, gsize input_len)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+  const GeoIP2Result *result;
+  LogMessage *msg;
+
+  if (self->source_ip)
+    result = geoip2_database_lookup_source_ip(&self->database, *pmsg);
+  else
+    result = geoip2_database_lookup_string(&self->database, input);
+
+  if (!result)
+    return TRUE;
+
+  msg = log_msg_make_writable(pmsg, path_options);
+  if (result->has_country_code)
+    log_msg_set_value(msg, self->dest.country_code, result->country_code, -1);
+  if (result->has_location)
+    {
+      log_msg_set_value(msg, self->dest.latitude, result->latitude, -1);
+      log_msg_set_value(msg, self->dest.longitude, result->longitude, -1);
+    }
+  return TRUE;
+}
+
+static LogPipe *
+geoip2_parser_clone(LogPipe *s)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+  GeoIP2Parser *cloned;
+
+  cloned = (GeoIP2Parser *) geoip2_parser_new(s->cfg);
+
+  geoip2_parser_set_database(&cloned->super, self->database_path);
+  geoip2_parser_set_prefix(&cloned->super, self->prefix);
+  log_parser_set_template(&cloned->super, log_template_ref(self->super.template));
+
+  return &cloned->super.super;
+}
+
+static void
+geoip2_parser_free(LogPipe *s)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+
+  geoip2_database_close(&self->database);
+  g_free(self->database_path);
+  g_free(self->prefix);
+
+  log_parser_free_method(s);
+}
+
+static gboolean
+geoip2_parser_init(LogPipe *s)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+
+  if (!self->database_path)
+    {
+      msg_error("geoip2: the database() option is mandatory",
+                log_pipe_location_tag(s));
+      return FALSE;
+    }
+
+  if (!geoip2_database_open(&self->database, self->database_path))
+    return FALSE;
+
+  geoip2_parser_resolve_fields(self);
+  self->source_ip = geoip2_template_is_source_ip(self->super.template);
+
+  return log_parser_init_method(s);
+}
+
+static gboolean
+geoip2_parser_deinit(LogPipe *s)
+{
+  GeoIP2Parser *self = (GeoIP2Parser *) s;
+
+  geoip2_database_close(&self->database);
+  return TRUE;
+}
+
+LogParser *
+geoip2_parser_new(GlobalConfig *cfg)
+{
+  GeoIP2Parser *self = g_new0(GeoIP2Parser, 1);
+
+  log_parser_init_instance(&self->super, cfg);
+  self->super.super.init = geoip2_parser_init;
+  self->super.super.deinit = geoip2_parser_deinit;
+  self->super.super.free_fn = geoip2_parser_free;
+  self->super.super.clone = geoip2_parser_clone;
+  self->super.process = geoip2_parser_process;
+
+  geoip2_parser_set_prefix(&self->super, ".geoip2.");
+
+  return &self->super;
+}
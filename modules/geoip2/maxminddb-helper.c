@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "maxminddb-helper.h"
+#include "template/repr.h"
+#include "template/macros.h"
+#include "messages.h"
+#include "tls-support.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+#define GEOIP2_CACHE_SIZE 64
+
+typedef struct _GeoIP2CacheEntry
+{
+  gint cache_id;
+  gint family;
+  union
+  {
+    struct in_addr ip;
+#if SYSLOG_NG_ENABLE_IPV6
+    struct in6_addr ip6;
+#endif
+  } addr;
+  gboolean found;
+  GeoIP2Result result;
+} GeoIP2CacheEntry;
+
+/*
+ * The last lookups of this thread, direct-mapped by address, which keeps
+ * the lookup itself a single probe.  Entries with a cache_id of 0 are
+ * unused, as ids are allocated starting from 1.  Lookups of names that
+ * are not IP addresses are not cached, their result is returned in
+ * uncached_result.
+ */
+TLS_BLOCK_START
+{
+  GeoIP2CacheEntry geoip2_cache[GEOIP2_CACHE_SIZE];
+  GeoIP2Result uncached_result;
+}
+TLS_BLOCK_END;
+
+#define geoip2_cache __tls_deref(geoip2_cache)
+#define uncached_result __tls_deref(uncached_result)
+
+static gint geoip2_cache_id_counter;
+
+gboolean
+geoip2_database_open(GeoIP2Database *self, const gchar *filename)
+{
+  gint status;
+
+  geoip2_database_close(self);
+
+  status = MMDB_open(filename, MMDB_MODE_MMAP, &self->mmdb);
+  if (status != MMDB_SUCCESS)
+    {
+      msg_error("geoip2: error opening database",
+                evt_tag_str("filename", filename),
+                evt_tag_str("error", MMDB_strerror(status)));
+      return FALSE;
+    }
+
+  self->cache_id = g_atomic_int_exchange_and_add(&geoip2_cache_id_counter, 1) + 1;
+  self->opened = TRUE;
+  return TRUE;
+}
+
+void
+geoip2_database_close(GeoIP2Database *self)
+{
+  if (!self->opened)
+    return;
+
+  MMDB_close(&self->mmdb);
+  self->opened = FALSE;
+}
+
+static void
+_format_double(gchar *buf, gsize buf_len, gdouble value)
+{
+  /* same format as the legacy geoip parser uses */
+  g_snprintf(buf, buf_len, "%f", value);
+}
+
+static gboolean
+_extract_result(MMDB_lookup_result_s *lookup, GeoIP2Result *result)
+{
+  MMDB_entry_data_s country_code, latitude, longitude;
+
+  memset(result, 0, sizeof(*result));
+  if (!lookup->found_entry)
+    return FALSE;
+
+  if (MMDB_get_value(&lookup->entry, &country_code, "country", "iso_code", NULL) == MMDB_SUCCESS &&
+      country_code.has_data &&
+      country_code.type == MMDB_DATA_TYPE_UTF8_STRING &&
+      country_code.data_size < sizeof(result->country_code))
+    {
+      memcpy(result->country_code, country_code.utf8_string, country_code.data_size);
+      result->country_code[country_code.data_size] = 0;
+      result->has_country_code = TRUE;
+    }
+
+  if (MMDB_get_value(&lookup->entry, &latitude, "location", "latitude", NULL) == MMDB_SUCCESS &&
+      MMDB_get_value(&lookup->entry, &longitude, "location", "longitude", NULL) == MMDB_SUCCESS &&
+      latitude.has_data && latitude.type == MMDB_DATA_TYPE_DOUBLE &&
+      longitude.has_data && longitude.type == MMDB_DATA_TYPE_DOUBLE)
+    {
+      _format_double(result->latitude, sizeof(result->latitude), latitude.double_value);
+      _format_double(result->longitude, sizeof(result->longitude), longitude.double_value);
+      result->has_location = TRUE;
+    }
+  return TRUE;
+}
+
+static GeoIP2CacheEntry *
+_lookup_cache_entry_ipv4(GeoIP2Database *self, const struct sockaddr_in *sin, gboolean *hit)
+{
+  GeoIP2CacheEntry *entry;
+
+  entry = &geoip2_cache[(ntohl(sin->sin_addr.s_addr) ^ self->cache_id) % GEOIP2_CACHE_SIZE];
+  *hit = entry->cache_id == self->cache_id &&
+         entry->family == AF_INET &&
+         entry->addr.ip.s_addr == sin->sin_addr.s_addr;
+  if (!*hit)
+    {
+      entry->family = AF_INET;
+      entry->addr.ip = sin->sin_addr;
+    }
+  return entry;
+}
+
+#if SYSLOG_NG_ENABLE_IPV6
+static GeoIP2CacheEntry *
+_lookup_cache_entry_ipv6(GeoIP2Database *self, const struct sockaddr_in6 *sin6, gboolean *hit)
+{
+  GeoIP2CacheEntry *entry;
+  const guint32 *a32 = (const guint32 *) sin6->sin6_addr.s6_addr;
+
+  entry = &geoip2_cache[(a32[0] ^ a32[1] ^ a32[2] ^ a32[3] ^ self->cache_id) % GEOIP2_CACHE_SIZE];
+  *hit = entry->cache_id == self->cache_id &&
+         entry->family == AF_INET6 &&
+         memcmp(&entry->addr.ip6, &sin6->sin6_addr, sizeof(entry->addr.ip6)) == 0;
+  if (!*hit)
+    {
+      entry->family = AF_INET6;
+      entry->addr.ip6 = sin6->sin6_addr;
+    }
+  return entry;
+}
+#endif
+
+static GeoIP2CacheEntry *
+_lookup_cache_entry(GeoIP2Database *self, const struct sockaddr *sa, gboolean *hit)
+{
+#if SYSLOG_NG_ENABLE_IPV6
+  if (sa->sa_family == AF_INET6)
+    return _lookup_cache_entry_ipv6(self, (const struct sockaddr_in6 *) sa, hit);
+#endif
+  return _lookup_cache_entry_ipv4(self, (const struct sockaddr_in *) sa, hit);
+}
+
+const GeoIP2Result *
+geoip2_database_lookup_sockaddr(GeoIP2Database *self, const struct sockaddr *sa)
+{
+  GeoIP2CacheEntry *entry;
+  MMDB_lookup_result_s lookup;
+  gboolean hit;
+  gint mmdb_error;
+
+  entry = _lookup_cache_entry(self, sa, &hit);
+  if (!hit)
+    {
+      lookup = MMDB_lookup_sockaddr(&self->mmdb, sa, &mmdb_error);
+      entry->found = mmdb_error == MMDB_SUCCESS && _extract_result(&lookup, &entry->result);
+      entry->cache_id = self->cache_id;
+    }
+  return entry->found ? &entry->result : NULL;
+}
+
+/*
+ * Addresses in their textual form are converted to binary here, so that
+ * they share the cache with the binary lookups, anything else (e.g. a
+ * hostname) is passed on to libmaxminddb as is.
+ */
+const GeoIP2Result *
+geoip2_database_lookup_string(GeoIP2Database *self, const gchar *ip)
+{
+  struct sockaddr_in sin;
+#if SYSLOG_NG_ENABLE_IPV6
+  struct sockaddr_in6 sin6;
+#endif
+  MMDB_lookup_result_s lookup;
+  gint gai_error, mmdb_error;
+
+  memset(&sin, 0, sizeof(sin));
+  if (inet_pton(AF_INET, ip, &sin.sin_addr) == 1)
+    {
+      sin.sin_family = AF_INET;
+      return geoip2_database_lookup_sockaddr(self, (struct sockaddr *) &sin);
+    }
+
+#if SYSLOG_NG_ENABLE_IPV6
+  memset(&sin6, 0, sizeof(sin6));
+  if (inet_pton(AF_INET6, ip, &sin6.sin6_addr) == 1)
+    {
+      sin6.sin6_family = AF_INET6;
+      return geoip2_database_lookup_sockaddr(self, (struct sockaddr *) &sin6);
+    }
+#endif
+
+  lookup = MMDB_lookup_string(&self->mmdb, ip, &gai_error, &mmdb_error);
+  if (gai_error != 0 || mmdb_error != MMDB_SUCCESS)
+    return NULL;
+  return _extract_result(&lookup, &uncached_result) ? &uncached_result : NULL;
+}
+
+/* the same address ${SOURCEIP} would expand to, without formatting it */
+const GeoIP2Result *
+geoip2_database_lookup_source_ip(GeoIP2Database *self, LogMessage *msg)
+{
+  if (msg->saddr)
+    {
+      if (g_sockaddr_inet_check(msg->saddr))
+        return geoip2_database_lookup_sockaddr(self, g_sockaddr_get_sa(msg->saddr));
+#if SYSLOG_NG_ENABLE_IPV6
+      if (g_sockaddr_inet6_check(msg->saddr))
+        return geoip2_database_lookup_sockaddr(self, g_sockaddr_get_sa(msg->saddr));
+#endif
+    }
+  return geoip2_database_lookup_string(self, "127.0.0.1");
+}
+
+/*
+ * Returns TRUE if @template is nothing but ${SOURCEIP} of the current
+ * message, in which case the address can be taken from the message in
+ * binary form instead of formatting and then parsing it again.
+ */
+gboolean
+geoip2_template_is_source_ip(LogTemplate *template)
+{
+  LogTemplateElem *e;
+
+  if (!template || !template->compiled_template || template->compiled_template->next)
+    return FALSE;
+
+  e = (LogTemplateElem *) template->compiled_template->data;
+  return e->type == LTE_MACRO &&
+         e->macro == M_SOURCE_IP &&
+         e->text_len == 0 &&
+         e->msg_ref == 0 &&
+         e->default_value == NULL;
+}
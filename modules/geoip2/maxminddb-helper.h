@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef MAXMINDDB_HELPER_H_INCLUDED
+#define MAXMINDDB_HELPER_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "logmsg/logmsg.h"
+#include "template/templates.h"
+
+#include <maxminddb.h>
+
+/*
+ * A MaxMind DB opened in MMDB_MODE_MMAP, so lookups walk the search tree
+ * in the mapped file directly and can be done by several threads at once.
+ * Results are kept in a small per-thread cache, as log sources tend to
+ * send bursts of messages from the same few addresses.  cache_id is
+ * unique for each opened database, so a reopened or different database
+ * never hits the entries of another one.
+ */
+typedef struct _GeoIP2Database
+{
+  MMDB_s mmdb;
+  gint cache_id;
+  gboolean opened;
+} GeoIP2Database;
+
+typedef struct _GeoIP2Result
+{
+  gboolean has_country_code;
+  gboolean has_location;
+  gchar country_code[8];
+  gchar latitude[32];
+  gchar longitude[32];
+} GeoIP2Result;
+
+gboolean geoip2_database_open(GeoIP2Database *self, const gchar *filename);
+void geoip2_database_close(GeoIP2Database *self);
+
+/* the returned result is owned by the current thread and is valid until
+ * its next lookup, NULL is returned if the address is not in the database */
+const GeoIP2Result *geoip2_database_lookup_sockaddr(GeoIP2Database *self, const struct sockaddr *sa);
+const GeoIP2Result *geoip2_database_lookup_string(GeoIP2Database *self, const gchar *ip);
+const GeoIP2Result *geoip2_database_lookup_source_ip(GeoIP2Database *self, LogMessage *msg);
+
+gboolean geoip2_template_is_source_ip(LogTemplate *template);
+
+#endif
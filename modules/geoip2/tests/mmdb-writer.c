@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "mmdb-writer.h"
+
+#include <maxminddb.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The file consists of the search tree (24 bit records), a 16 byte
+ * separator, the data section and the metadata after its marker.  See
+ * http://maxmind.github.io/MaxMind-DB/ for the format.
+ */
+#define MMDB_RECORD_SIZE 24
+#define MMDB_DATA_SECTION_SEPARATOR_SIZE 16
+#define MMDB_METADATA_MARKER "\xab\xcd\xefMaxMind.com"
+
+/* records of the tree being built are node indexes, data section offsets
+ * flagged with RECORD_DATA, or RECORD_EMPTY */
+#define RECORD_DATA  0x80000000
+#define RECORD_EMPTY 0xffffffff
+
+typedef struct _MMDBNode
+{
+  guint32 records[2];
+} MMDBNode;
+
+static void
+_write_control(GString *data, gint type, gsize size)
+{
+  guint8 control = (type <= MMDB_DATA_TYPE_MAP ? type : MMDB_DATA_TYPE_EXTENDED) << 5;
+
+  g_assert(size < 285);
+  control |= size < 29 ? size : 29;
+  g_string_append_c(data, control);
+  if (type > MMDB_DATA_TYPE_MAP)
+    g_string_append_c(data, type - MMDB_DATA_TYPE_MAP);
+  if (size >= 29)
+    g_string_append_c(data, size - 29);
+}
+
+static void
+_write_string(GString *data, const gchar *value)
+{
+  _write_control(data, MMDB_DATA_TYPE_UTF8_STRING, strlen(value));
+  g_string_append(data, value);
+}
+
+static void
+_write_double(GString *data, gdouble value)
+{
+  guint64 bits;
+  gint i;
+
+  memcpy(&bits, &value, sizeof(bits));
+  _write_control(data, MMDB_DATA_TYPE_DOUBLE, sizeof(bits));
+  for (i = sizeof(bits) - 1; i >= 0; i--)
+    g_string_append_c(data, (bits >> (i * 8)) & 0xff);
+}
+
+static void
+_write_uint(GString *data, gint type, guint64 value)
+{
+  gint len = 0;
+  gint i;
+
+  while (len < (gint) sizeof(value) && (value >> (len * 8)) != 0)
+    len++;
+
+  _write_control(data, type, len);
+  for (i = len - 1; i >= 0; i--)
+    g_string_append_c(data, (value >> (i * 8)) & 0xff);
+}
+
+static void
+_write_record(GString *data, const MMDBTestNetwork *network)
+{
+  _write_control(data, MMDB_DATA_TYPE_MAP, 2);
+
+  _write_string(data, "country");
+  _write_control(data, MMDB_DATA_TYPE_MAP, 1);
+  _write_string(data, "iso_code");
+  _write_string(data, network->country_code);
+
+  _write_string(data, "location");
+  _write_control(data, MMDB_DATA_TYPE_MAP, 2);
+  _write_string(data, "latitude");
+  _write_double(data, network->latitude);
+  _write_string(data, "longitude");
+  _write_double(data, network->longitude);
+}
+
+static void
+_write_metadata(GString *data, guint32 node_count)
+{
+  _write_control(data, MMDB_DATA_TYPE_MAP, 9);
+
+  _write_string(data, "binary_format_major_version");
+  _write_uint(data, MMDB_DATA_TYPE_UINT16, 2);
+  _write_string(data, "binary_format_minor_version");
+  _write_uint(data, MMDB_DATA_TYPE_UINT16, 0);
+  _write_string(data, "build_epoch");
+  _write_uint(data, MMDB_DATA_TYPE_UINT64, time(NULL));
+  _write_string(data, "database_type");
+  _write_string(data, "syslog-ng-Test-City");
+  _write_string(data, "description");
+  _write_control(data, MMDB_DATA_TYPE_MAP, 1);
+  _write_string(data, "en");
+  _write_string(data, "syslog-ng test database");
+  _write_string(data, "ip_version");
+  _write_uint(data, MMDB_DATA_TYPE_UINT16, 6);
+  _write_string(data, "languages");
+  _write_control(data, MMDB_DATA_TYPE_ARRAY, 1);
+  _write_string(data, "en");
+  _write_string(data, "node_count");
+  _write_uint(data, MMDB_DATA_TYPE_UINT32, node_count);
+  _write_string(data, "record_size");
+  _write_uint(data, MMDB_DATA_TYPE_UINT16, MMDB_RECORD_SIZE);
+}
+
+static gboolean
+_parse_network(const MMDBTestNetwork *network, guint8 addr[16], gint *prefix_len)
+{
+  memset(addr, 0, 16);
+  if (inet_pton(AF_INET, network->address, addr + 12) == 1)
+    {
+      *prefix_len = network->prefix_len + 96;
+      return TRUE;
+    }
+  if (inet_pton(AF_INET6, network->address, addr) == 1)
+    {
+      *prefix_len = network->prefix_len;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+static void
+_insert_network(GArray *nodes, const guint8 addr[16], gint prefix_len, guint32 data_record)
+{
+  guint32 node = 0;
+  gint depth;
+
+  for (depth = 0; depth < prefix_len; depth++)
+    {
+      gint bit = (addr[depth / 8] >> (7 - depth % 8)) & 1;
+      guint32 record = g_array_index(nodes, MMDBNode, node).records[bit];
+
+      if (depth == prefix_len - 1)
+        {
+          g_array_index(nodes, MMDBNode, node).records[bit] = data_record;
+          break;
+        }
+
+      if (record & RECORD_DATA)
+        {
+          /* split the empty (or larger network's) record */
+          MMDBNode child = { { record, record } };
+
+          g_array_append_val(nodes, child);
+          record = nodes->len - 1;
+          g_array_index(nodes, MMDBNode, node).records[bit] = record;
+        }
+      node = record;
+    }
+}
+
+static void
+_write_search_tree(GString *file, GArray *nodes)
+{
+  guint32 node_count = nodes->len;
+  guint32 node;
+  gint bit, i;
+
+  for (node = 0; node < node_count; node++)
+    {
+      for (bit = 0; bit < 2; bit++)
+        {
+          guint32 record = g_array_index(nodes, MMDBNode, node).records[bit];
+          guint32 value;
+
+          if (record == RECORD_EMPTY)
+            value = node_count;
+          else if (record & RECORD_DATA)
+            value = node_count + MMDB_DATA_SECTION_SEPARATOR_SIZE + (record & ~RECORD_DATA);
+          else
+            value = record;
+
+          g_assert(value < (1 << MMDB_RECORD_SIZE));
+          for (i = MMDB_RECORD_SIZE / 8 - 1; i >= 0; i--)
+            g_string_append_c(file, (value >> (i * 8)) & 0xff);
+        }
+    }
+}
+
+gboolean
+mmdb_test_write_database(const gchar *filename, const MMDBTestNetwork *networks, gint num_networks)
+{
+  GArray *nodes = g_array_new(FALSE, FALSE, sizeof(MMDBNode));
+  MMDBNode root = { { RECORD_EMPTY, RECORD_EMPTY } };
+  GString *data = g_string_new("");
+  GString *file = g_string_new("");
+  gboolean success = FALSE;
+  gint i;
+
+  g_array_append_val(nodes, root);
+  for (i = 0; i < num_networks; i++)
+    {
+      guint8 addr[16];
+      gint prefix_len;
+
+      if (!_parse_network(&networks[i], addr, &prefix_len))
+        goto exit;
+
+      _insert_network(nodes, addr, prefix_len, RECORD_DATA | data->len);
+      _write_record(data, &networks[i]);
+    }
+
+  _write_search_tree(file, nodes);
+  for (i = 0; i < MMDB_DATA_SECTION_SEPARATOR_SIZE; i++)
+    g_string_append_c(file, 0);
+  g_string_append_len(file, data->str, data->len);
+  g_string_append(file, MMDB_METADATA_MARKER);
+  _write_metadata(file, nodes->len);
+
+  success = g_file_set_contents(filename, file->str, file->len, NULL);
+
+exit:
+  g_string_free(file, TRUE);
+  g_string_free(data, TRUE);
+  g_array_free(nodes, TRUE);
+  return success;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef MMDB_WRITER_H_INCLUDED
+#define MMDB_WRITER_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * Writes small MaxMind DB files for the tests, as the test databases of
+ * MaxMind can't be assumed to be available at build time.  The database
+ * is an IPv6 one (IPv4 networks are stored under ::/96, just like in the
+ * GeoLite2 databases), with GeoIP2-City like records holding the country
+ * code and the location only.  Networks are inserted in the order given,
+ * a network contained by another one has to come after it.
+ */
+typedef struct _MMDBTestNetwork
+{
+  const gchar *address;
+  gint prefix_len;
+  const gchar *country_code;
+  gdouble latitude;
+  gdouble longitude;
+} MMDBTestNetwork;
+
+gboolean mmdb_test_write_database(const gchar *filename, const MMDBTestNetwork *networks, gint num_networks);
+
+#endif
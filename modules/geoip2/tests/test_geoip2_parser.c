@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "geoip2-parser.h"
+#include "maxminddb-helper.h"
+#include "mmdb-writer.h"
+#include "apphook.h"
+#include "plugin.h"
+#include "msg_parse_lib.h"
+#include "template_lib.h"
+
+#include <unistd.h>
+
+#define TEST_DATABASE "test_geoip2_city.mmdb"
+#define TEST_DATABASE_UPDATED "test_geoip2_city_updated.mmdb"
+#define TEST_DATABASE_EMPTY "test_geoip2_empty.mmdb"
+
+static void
+write_test_databases(void)
+{
+  MMDBTestNetwork networks[] =
+  {
+    { "217.20.130.0", 24, "HU", 47.5, 19.05 },
+    /* create_empty_message() receives its messages from 10.11.12.13 */
+    { "10.11.12.0", 24, "AU", -33.875, 151.25 },
+    { "2001:db8::", 32, "DE", 52.5, 13.375 },
+  };
+  MMDBTestNetwork updated_networks[] =
+  {
+    { "217.20.130.0", 24, "AT", 48.25, 16.375 },
+  };
+  MMDBTestNetwork unrelated_networks[] =
+  {
+    { "192.0.2.0", 24, "ZZ", 0, 0 },
+  };
+
+  assert_true(mmdb_test_write_database(TEST_DATABASE, networks, G_N_ELEMENTS(networks)),
+              "error writing test database");
+  assert_true(mmdb_test_write_database(TEST_DATABASE_UPDATED, updated_networks, G_N_ELEMENTS(updated_networks)),
+              "error writing test database");
+  assert_true(mmdb_test_write_database(TEST_DATABASE_EMPTY, unrelated_networks, G_N_ELEMENTS(unrelated_networks)),
+              "error writing test database");
+}
+
+static void
+remove_test_databases(void)
+{
+  unlink(TEST_DATABASE);
+  unlink(TEST_DATABASE_UPDATED);
+  unlink(TEST_DATABASE_EMPTY);
+}
+
+static void
+assert_template_is_source_ip(const gchar *template_code, gboolean expected)
+{
+  LogTemplate *template;
+
+  template = log_template_new(NULL, NULL);
+  assert_true(log_template_compile(template, template_code, NULL),
+              "error compiling template: %s", template_code);
+  assert_gboolean(geoip2_template_is_source_ip(template), expected,
+                  "unexpected source-ip detection result for template: %s", template_code);
+  log_template_unref(template);
+}
+
+static void
+test_geoip2_template_is_source_ip(void)
+{
+  assert_template_is_source_ip("${SOURCEIP}", TRUE);
+  assert_template_is_source_ip("$SOURCEIP", TRUE);
+  assert_template_is_source_ip("${HOST}", FALSE);
+  assert_template_is_source_ip("217.20.130.99", FALSE);
+  assert_template_is_source_ip("x${SOURCEIP}", FALSE);
+  assert_template_is_source_ip("${SOURCEIP}x", FALSE);
+  assert_template_is_source_ip("${SOURCEIP:-127.0.0.1}", FALSE);
+  assert_template_is_source_ip("${SOURCEIP}@1", FALSE);
+}
+
+static void
+assert_geoip2_parser_init_fails(const gchar *database)
+{
+  LogParser *geoip2_parser;
+
+  geoip2_parser = geoip2_parser_new(configuration);
+  if (database)
+    geoip2_parser_set_database(geoip2_parser, database);
+  assert_false(log_pipe_init(&geoip2_parser->super),
+               "geoip2 parser initialization was expected to fail, database=%s", database);
+  log_pipe_unref(&geoip2_parser->super);
+}
+
+static void
+test_geoip2_parser_init_requires_a_database(void)
+{
+  assert_geoip2_parser_init_fails(NULL);
+  assert_geoip2_parser_init_fails("/nonexistent/GeoLite2-City.mmdb");
+}
+
+static LogParser *
+create_geoip2_parser(const gchar *template_code)
+{
+  LogParser *geoip2_parser;
+
+  geoip2_parser = geoip2_parser_new(configuration);
+  geoip2_parser_set_database(geoip2_parser, TEST_DATABASE);
+  if (template_code)
+    {
+      LogTemplate *template = log_template_new(configuration, NULL);
+
+      assert_true(log_template_compile(template, template_code, NULL),
+                  "error compiling template: %s", template_code);
+      log_parser_set_template(geoip2_parser, template);
+    }
+  assert_true(log_pipe_init(&geoip2_parser->super), "error initializing geoip2 parser");
+  return geoip2_parser;
+}
+
+static void
+destroy_geoip2_parser(LogParser *geoip2_parser)
+{
+  log_pipe_deinit(&geoip2_parser->super);
+  log_pipe_unref(&geoip2_parser->super);
+}
+
+static LogMessage *
+parse_geoip2_into_log_message(LogParser *geoip2_parser, LogMessage *msg)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  assert_true(log_parser_process_message(geoip2_parser, &msg, &path_options),
+              "geoip2 parser was expected to succeed");
+  return msg;
+}
+
+static void
+assert_geoip2_parser_result(LogParser *geoip2_parser, const gchar *input,
+                            const gchar *country_code, const gchar *latitude, const gchar *longitude)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_MESSAGE, input, -1);
+  msg = parse_geoip2_into_log_message(geoip2_parser, msg);
+  assert_log_message_value_by_name(msg, ".geoip2.country_code", country_code);
+  assert_log_message_value_by_name(msg, ".geoip2.latitude", latitude);
+  assert_log_message_value_by_name(msg, ".geoip2.longitude", longitude);
+  log_msg_unref(msg);
+}
+
+static void
+test_geoip2_parser_lookup(void)
+{
+  LogParser *geoip2_parser = create_geoip2_parser(NULL);
+
+  assert_geoip2_parser_result(geoip2_parser, "217.20.130.99", "HU", "47.500000", "19.050000");
+  /* the second lookup is served from the cache */
+  assert_geoip2_parser_result(geoip2_parser, "217.20.130.99", "HU", "47.500000", "19.050000");
+  assert_geoip2_parser_result(geoip2_parser, "217.20.130.1", "HU", "47.500000", "19.050000");
+#if SYSLOG_NG_ENABLE_IPV6
+  assert_geoip2_parser_result(geoip2_parser, "2001:db8::1", "DE", "52.500000", "13.375000");
+#endif
+  assert_geoip2_parser_result(geoip2_parser, "217.20.131.1", NULL, NULL, NULL);
+  assert_geoip2_parser_result(geoip2_parser, "not-an-address", NULL, NULL, NULL);
+  destroy_geoip2_parser(geoip2_parser);
+}
+
+static void
+test_geoip2_parser_uses_template_to_parse_input(void)
+{
+  LogParser *geoip2_parser = create_geoip2_parser("217.20.130.99");
+
+  assert_geoip2_parser_result(geoip2_parser, "10.11.12.13", "HU", "47.500000", "19.050000");
+  destroy_geoip2_parser(geoip2_parser);
+}
+
+static void
+test_geoip2_parser_takes_source_ip_from_the_message(void)
+{
+  LogParser *geoip2_parser = create_geoip2_parser("${SOURCEIP}");
+  LogMessage *msg;
+
+  msg = parse_geoip2_into_log_message(geoip2_parser, create_empty_message());
+  assert_log_message_value_by_name(msg, ".geoip2.country_code", "AU");
+  assert_log_message_value_by_name(msg, ".geoip2.latitude", "-33.875000");
+  assert_log_message_value_by_name(msg, ".geoip2.longitude", "151.250000");
+  log_msg_unref(msg);
+
+  /* without a source address, ${SOURCEIP} is 127.0.0.1 */
+  msg = parse_geoip2_into_log_message(geoip2_parser, log_msg_new_empty());
+  assert_log_message_value_by_name(msg, ".geoip2.country_code", NULL);
+  log_msg_unref(msg);
+  destroy_geoip2_parser(geoip2_parser);
+}
+
+static void
+test_geoip2_template_function(void)
+{
+  assert_template_format("$(geoip2 --database " TEST_DATABASE " 217.20.130.99)", "HU");
+  assert_template_format("$(geoip2 -d " TEST_DATABASE " ${SOURCEIP})", "AU");
+  assert_template_format("$(geoip2 --database " TEST_DATABASE " 217.20.131.1)", "");
+#if SYSLOG_NG_ENABLE_IPV6
+  assert_template_format("$(geoip2 --database " TEST_DATABASE " 2001:db8::1)", "DE");
+#endif
+  assert_template_failure("$(geoip2 217.20.130.99)", "geoip2: format must be");
+  assert_template_failure("$(geoip2 --database /nonexistent/GeoLite2-City.mmdb 217.20.130.99)",
+                          "geoip2: error while opening database");
+}
+
+/*
+ * Looks @ip up with the search tree of @database replaced by one that
+ * doesn't contain it, so only a cached result can be returned.
+ */
+static void
+assert_geoip2_lookup_is_cached(GeoIP2Database *database, GeoIP2Database *unrelated_database,
+                               const gchar *ip, const gchar *expected_country_code)
+{
+  MMDB_s mmdb = database->mmdb;
+  const GeoIP2Result *result;
+
+  database->mmdb = unrelated_database->mmdb;
+  result = geoip2_database_lookup_string(database, ip);
+  database->mmdb = mmdb;
+
+  assert_not_null(result, "cached lookup was expected to return a result, ip=%s", ip);
+  assert_string(result->country_code, expected_country_code, "cached lookup returned a wrong result, ip=%s", ip);
+}
+
+static void
+assert_geoip2_lookup(GeoIP2Database *database, const gchar *ip, const gchar *expected_country_code)
+{
+  const GeoIP2Result *result;
+
+  result = geoip2_database_lookup_string(database, ip);
+  if (!expected_country_code)
+    {
+      assert_null(result, "lookup was expected to find nothing, ip=%s", ip);
+      return;
+    }
+  assert_not_null(result, "lookup was expected to return a result, ip=%s", ip);
+  assert_string(result->country_code, expected_country_code, "lookup returned a wrong result, ip=%s", ip);
+}
+
+static void
+test_geoip2_cache_is_bound_to_the_opened_database(void)
+{
+  GeoIP2Database database = { 0 };
+  GeoIP2Database unrelated_database = { 0 };
+
+  assert_true(geoip2_database_open(&unrelated_database, TEST_DATABASE_EMPTY), "error opening test database");
+  assert_true(geoip2_database_open(&database, TEST_DATABASE), "error opening test database");
+
+  assert_geoip2_lookup(&database, "217.20.130.99", "HU");
+  assert_geoip2_lookup_is_cached(&database, &unrelated_database, "217.20.130.99", "HU");
+  assert_geoip2_lookup(&unrelated_database, "217.20.130.99", NULL);
+
+  /* a reopened database never sees the results of the previous one, but
+   * caches its own */
+  assert_true(geoip2_database_open(&database, TEST_DATABASE_UPDATED), "error reopening test database");
+  assert_geoip2_lookup(&database, "217.20.130.99", "AT");
+  assert_geoip2_lookup_is_cached(&database, &unrelated_database, "217.20.130.99", "AT");
+
+  assert_true(geoip2_database_open(&database, TEST_DATABASE), "error reopening test database");
+  assert_geoip2_lookup(&database, "217.20.130.99", "HU");
+  assert_geoip2_lookup_is_cached(&database, &unrelated_database, "217.20.130.99", "HU");
+
+  geoip2_database_close(&database);
+  geoip2_database_close(&unrelated_database);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  init_template_tests();
+  plugin_load_module("geoip2", configuration, NULL);
+  write_test_databases();
+
+  test_geoip2_template_is_source_ip();
+  test_geoip2_parser_init_requires_a_database();
+  test_geoip2_parser_lookup();
+  test_geoip2_parser_uses_template_to_parse_input();
+  test_geoip2_parser_takes_source_ip_from_the_message();
+  test_geoip2_template_function();
+  test_geoip2_cache_is_bound_to_the_opened_database();
+
+  remove_test_databases();
+  deinit_template_tests();
+  app_shutdown();
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "plugin.h"
+#include "plugin-types.h"
+#include "template/simple-function.h"
+#include "messages.h"
+#include "cfg.h"
+
+#include "syslog-ng-config.h"
+#include "maxminddb-helper.h"
+
+typedef struct _TFGeoIP2State TFGeoIP2State;
+
+struct _TFGeoIP2State
+{
+  TFSimpleFuncState super;
+  GeoIP2Database database;
+  gchar *database_path;
+
+  /* the argument is ${SOURCEIP}, the address is taken from the message */
+  gboolean source_ip;
+};
+
+static gboolean
+tf_geoip2_prepare(LogTemplateFunction *self, gpointer s, LogTemplate *parent,
+                  gint argc, gchar *argv[], GError **error)
+{
+  TFGeoIP2State *state = (TFGeoIP2State *) s;
+  state->database_path = NULL;
+
+  GOptionEntry geoip2_options[] =
+  {
+    { "database", 'd', 0, G_OPTION_ARG_FILENAME, &state->database_path, "geoip2 database location", NULL },
+    { NULL }
+  };
+
+  GOptionContext *ctx = g_option_context_new("geoip2");
+  g_option_context_add_main_entries(ctx, geoip2_options, NULL);
+
+  if (!g_option_context_parse(ctx, &argc, &argv, error))
+    {
+      g_option_context_free(ctx);
+      return FALSE;
+    }
+  g_option_context_free(ctx);
+
+  if (argc != 2 || !state->database_path)
+    {
+      g_set_error(error, LOG_TEMPLATE_ERROR, LOG_TEMPLATE_ERROR_COMPILE,
+                  "geoip2: format must be: $(geoip2 --database <file location> ${HOST})\n");
+      return FALSE;
+    }
+
+  if (!tf_simple_func_prepare(self, state, parent, argc, argv, error))
+    return FALSE;
+
+  if (!geoip2_database_open(&state->database, state->database_path))
+    {
+      g_set_error(error, LOG_TEMPLATE_ERROR, LOG_TEMPLATE_ERROR_COMPILE,
+                  "geoip2: error while opening database");
+      return FALSE;
+    }
+
+  state->source_ip = geoip2_template_is_source_ip(state->super.argv[0]);
+  return TRUE;
+}
+
+static void
+tf_geoip2_eval(LogTemplateFunction *self, gpointer s, const LogTemplateInvokeArgs *args)
+{
+  TFGeoIP2State *state = (TFGeoIP2State *) s;
+
+  if (state->source_ip)
+    return;
+
+  tf_simple_func_eval(self, s, args);
+}
+
+static void
+tf_geoip2_call(LogTemplateFunction *self, gpointer s, const LogTemplateInvokeArgs *args, GString *result)
+{
+  TFGeoIP2State *state = (TFGeoIP2State *) s;
+  const GeoIP2Result *geoip2_result;
+
+  if (state->source_ip)
+    {
+      geoip2_result = geoip2_database_lookup_source_ip(&state->database, args->messages[args->num_messages - 1]);
+    }
+  else
+    {
+      GString **argv = (GString **) args->bufs->pdata;
+
+      geoip2_result = geoip2_database_lookup_string(&state->database, argv[0]->str);
+    }
+
+  if (geoip2_result && geoip2_result->has_country_code)
+    g_string_append(result, geoip2_result->country_code);
+}
+
+static void
+tf_geoip2_free_state(gpointer s)
+{
+  TFGeoIP2State *state = (TFGeoIP2State *) s;
+
+  geoip2_database_close(&state->database);
+  g_free(state->database_path);
+  tf_simple_func_free_state(&state->super);
+}
+
+TEMPLATE_FUNCTION(TFGeoIP2State, tf_geoip2, tf_geoip2_prepare,
+                  tf_geoip2_eval, tf_geoip2_call, tf_geoip2_free_state, NULL);
@@ -21,8 +21,10 @@
  */
 
 #include "json-parser.h"
+#include "json-scanner.h"
 #include "dot-notation.h"
 #include "scratch-buffers.h"
+#include "string-list.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -37,6 +39,7 @@ typedef struct _JSONParser
   gchar *marker;
   gint marker_len;
   gchar *extract_prefix;
+  GList *keys;
 } JSONParser;
 
 void
@@ -67,13 +70,67 @@ json_parser_set_extract_prefix(LogParser *s, const gchar *extract_prefix)
   self->extract_prefix = g_strdup(extract_prefix);
 }
 
+/* takes ownership of @keys */
+void
+json_parser_set_keys(LogParser *s, GList *keys)
+{
+  JSONParser *self = (JSONParser *) s;
+
+  string_list_free(self->keys);
+  self->keys = keys;
+}
+
+/* TRUE if @key names @name itself or an object/array containing it */
+static inline gboolean
+_key_covers_name(const gchar *key, gsize key_len, const gchar *name, gsize name_len)
+{
+  return name_len >= key_len &&
+         memcmp(key, name, key_len) == 0 &&
+         (name_len == key_len || name[key_len] == '.' || name[key_len] == '[');
+}
+
+static JSONScannerSelection
+json_parser_select_key(JSONParser *self, const gchar *name, gsize name_len)
+{
+  JSONScannerSelection selection = JSON_SCANNER_SKIP;
+  GList *l;
+
+  if (!self->keys)
+    return JSON_SCANNER_EXTRACT;
+
+  for (l = self->keys; l; l = l->next)
+    {
+      const gchar *key = (const gchar *) l->data;
+      gsize key_len = strlen(key);
+
+      if (_key_covers_name(key, key_len, name, name_len))
+        return JSON_SCANNER_EXTRACT;
+      if (_key_covers_name(name, name_len, key, key_len))
+        selection = JSON_SCANNER_DESCEND;
+    }
+  return selection;
+}
+
+/* @name includes the prefix() */
+static gboolean
+json_parser_is_name_selected(JSONParser *self, const gchar *name, gsize name_len)
+{
+  gsize prefix_len = self->prefix ? strlen(self->prefix) : 0;
+
+  if (!self->keys)
+    return TRUE;
+  return json_parser_select_key(self, name + prefix_len, name_len - prefix_len) == JSON_SCANNER_EXTRACT;
+}
+
 static void
-json_parser_process_object(struct json_object *jso,
+json_parser_process_object(JSONParser *self,
+                           struct json_object *jso,
                            const gchar *prefix,
                            LogMessage *msg);
 
 static void
-json_parser_process_single(struct json_object *jso,
+json_parser_process_single(JSONParser *self,
+                           struct json_object *jso,
                            const gchar *prefix,
                            const gchar *obj_key,
                            LogMessage *msg)
@@ -117,7 +174,7 @@ json_parser_process_single(struct json_object *jso,
         g_string_assign(key, prefix);
       g_string_append(key, obj_key);
       g_string_append_c(key, '.');
-      json_parser_process_object(jso, key->str, msg);
+      json_parser_process_object(self, jso, key->str, msg);
       break;
     case json_type_array:
     {
@@ -131,7 +188,8 @@ json_parser_process_single(struct json_object *jso,
         {
           g_string_truncate(key, plen);
           g_string_append_printf(key, "[%d]", i);
-          json_parser_process_single(json_object_array_get_idx(jso, i),
+          json_parser_process_single(self,
+                                     json_object_array_get_idx(jso, i),
                                      prefix,
                                      key->str, msg);
         }
@@ -148,17 +206,14 @@ json_parser_process_single(struct json_object *jso,
   if (parsed)
     {
       if (prefix)
-        {
-          g_string_assign(key, prefix);
-          g_string_append(key, obj_key);
-          log_msg_set_value_by_name(msg,
-                                    key->str,
-                                    value->str,
-                                    value->len);
-        }
+        g_string_assign(key, prefix);
       else
+        g_string_truncate(key, 0);
+      g_string_append(key, obj_key);
+
+      if (json_parser_is_name_selected(self, key->str, key->len))
         log_msg_set_value_by_name(msg,
-                                  obj_key,
+                                  key->str,
                                   value->str,
                                   value->len);
     }
@@ -167,7 +222,8 @@ json_parser_process_single(struct json_object *jso,
 }
 
 static void
-json_parser_process_object(struct json_object *jso,
+json_parser_process_object(JSONParser *self,
+                           struct json_object *jso,
                            const gchar *prefix,
                            LogMessage *msg)
 {
@@ -175,7 +231,7 @@ json_parser_process_object(struct json_object *jso,
 
   json_object_object_foreachC(jso, itr)
   {
-    json_parser_process_single(itr.val, prefix, itr.key, msg);
+    json_parser_process_single(self, itr.val, prefix, itr.key, msg);
   }
 }
 
@@ -190,7 +246,7 @@ json_parser_extract(JSONParser *self, struct json_object *jso, LogMessage *msg)
       return FALSE;
     }
 
-  json_parser_process_object(jso, self->prefix, msg);
+  json_parser_process_object(self, jso, self->prefix, msg);
   return TRUE;
 }
 
@@ -203,23 +259,12 @@ json_tokener_error_desc(enum json_tokener_error err)
 #endif
 
 static gboolean
-json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input,
-                    gsize input_len)
+json_parser_process_with_json_c(JSONParser *self, LogMessage **pmsg, const LogPathOptions *path_options,
+                                const gchar *input, gsize input_len)
 {
-  JSONParser *self = (JSONParser *) s;
   struct json_object *jso;
   struct json_tokener *tok;
 
-  if (self->marker)
-    {
-      if (strncmp(input, self->marker, self->marker_len) != 0)
-        return FALSE;
-      input += self->marker_len;
-
-      while (isspace(*input))
-        input++;
-    }
-
   tok = json_tokener_new();
   jso = json_tokener_parse_ex(tok, input, input_len);
   if (tok->err != json_tokener_success || !jso)
@@ -245,6 +290,110 @@ json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_
   return TRUE;
 }
 
+/*
+ * The streaming scanner collects the name-value pairs as a series of
+ * NUL terminated "name", "value" strings and only sets them once the
+ * whole input was found to be valid, so that a failure leaves the
+ * message intact for the json-c based fallback.
+ */
+typedef struct _JSONParserScanState
+{
+  JSONParser *self;
+  GString *pending;
+} JSONParserScanState;
+
+static JSONScannerSelection
+_select_key(const gchar *name, gsize name_len, gpointer user_data)
+{
+  JSONParserScanState *state = (JSONParserScanState *) user_data;
+
+  return json_parser_select_key(state->self, name, name_len);
+}
+
+static void
+_append_pending_value(const gchar *name, gsize name_len, const gchar *value, gsize value_len, gpointer user_data)
+{
+  JSONParserScanState *state = (JSONParserScanState *) user_data;
+
+  g_string_append_len(state->pending, name, name_len);
+  g_string_append_c(state->pending, 0);
+  g_string_append_len(state->pending, value, value_len);
+  g_string_append_c(state->pending, 0);
+}
+
+static void
+_set_pending_values(LogMessage *msg, GString *pending)
+{
+  const gchar *p = pending->str;
+  const gchar *end = pending->str + pending->len;
+
+  while (p < end)
+    {
+      const gchar *name = p;
+      gsize name_len = strlen(name);
+      const gchar *value = name + name_len + 1;
+      gsize value_len = strlen(value);
+
+      log_msg_set_value(msg, log_msg_get_value_handle_cached(name, name_len), value, value_len);
+      p = value + value_len + 1;
+    }
+}
+
+static gboolean
+json_parser_process_streaming(JSONParser *self, LogMessage **pmsg, const LogPathOptions *path_options,
+                              const gchar *input, gsize input_len)
+{
+  JSONParserScanState state;
+  JSONScanner scanner;
+  ScratchBuffersMarker marker;
+  gboolean success;
+
+  state.self = self;
+  state.pending = scratch_buffers_alloc_and_mark(&marker);
+
+  json_scanner_init(&scanner, scratch_buffers_alloc(), scratch_buffers_alloc(), scratch_buffers_alloc(),
+                    self->prefix);
+  if (self->keys)
+    json_scanner_set_select_func(&scanner, _select_key);
+
+  success = json_scanner_scan_object(&scanner, input, input_len, _append_pending_value, &state);
+  if (success)
+    {
+      log_msg_make_writable(pmsg, path_options);
+      _set_pending_values(*pmsg, state.pending);
+    }
+
+  scratch_buffers_reclaim_marked(marker);
+  return success;
+}
+
+static gboolean
+json_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input,
+                    gsize input_len)
+{
+  JSONParser *self = (JSONParser *) s;
+  const gchar *input_end = input + input_len;
+
+  if (self->marker)
+    {
+      if (strncmp(input, self->marker, self->marker_len) != 0)
+        return FALSE;
+      input += self->marker_len;
+
+      while (input < input_end && isspace(*input))
+        input++;
+    }
+
+  /* extract-prefix() needs random access to the parsed object, and the
+   * scanner rejects the less common constructs json-c accepts: in both
+   * cases we are using json-c */
+  if (!self->extract_prefix &&
+      json_parser_process_streaming(self, pmsg, path_options, input, input_end - input))
+    return TRUE;
+
+  return json_parser_process_with_json_c(self, pmsg, path_options, input, input_end - input);
+}
+
 static LogPipe *
 json_parser_clone(LogPipe *s)
 {
@@ -255,6 +404,7 @@ json_parser_clone(LogPipe *s)
   json_parser_set_prefix(cloned, self->prefix);
   json_parser_set_marker(cloned, self->marker);
   json_parser_set_extract_prefix(cloned, self->extract_prefix);
+  json_parser_set_keys(cloned, string_list_clone(self->keys));
   log_parser_set_template(cloned, log_template_ref(self->super.template));
 
   return &cloned->super;
@@ -268,6 +418,7 @@ json_parser_free(LogPipe *s)
   g_free(self->prefix);
   g_free(self->marker);
   g_free(self->extract_prefix);
+  string_list_free(self->keys);
   log_parser_free_method(s);
 }
 
@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+
+
+#include "json-scanner.h"
+#include "find-crlf.h"
+
+#include <string.h>
+
+/* json-c refuses to parse objects nested deeper than this by default */
+#define JSON_SCANNER_MAX_DEPTH 32
+
+static gboolean _scan_value(JSONScanner *self, JSONScannerSelection selection, gint depth);
+
+static inline gboolean
+_is_eof(JSONScanner *self)
+{
+  return self->input_pos >= self->input_len;
+}
+
+static inline gchar
+_peek(JSONScanner *self)
+{
+  return _is_eof(self) ? 0 : self->input[self->input_pos];
+}
+
+static inline gboolean
+_is_whitespace(gchar c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline void
+_skip_whitespace(JSONScanner *self)
+{
+  while (!_is_eof(self) && _is_whitespace(self->input[self->input_pos]))
+    self->input_pos++;
+}
+
+/* scalars must be followed by whitespace or a structural character */
+static inline gboolean
+_at_delimiter(JSONScanner *self)
+{
+  gchar c = _peek(self);
+
+  return c == 0 || c == ',' || c == '}' || c == ']' || _is_whitespace(c);
+}
+
+static inline void
+_append_c(GString *out, gchar c)
+{
+  if (out)
+    g_string_append_c(out, c);
+}
+
+static gboolean
+_scan_hex4(JSONScanner *self, gunichar *result)
+{
+  gunichar value = 0;
+  gint i;
+
+  if (self->input_len - self->input_pos < 4)
+    return FALSE;
+
+  for (i = 0; i < 4; i++)
+    {
+      gint digit = g_ascii_xdigit_value(self->input[self->input_pos + i]);
+
+      if (digit < 0)
+        return FALSE;
+      value = (value << 4) | digit;
+    }
+  self->input_pos += 4;
+  *result = value;
+  return TRUE;
+}
+
+static gboolean
+_scan_unicode_escape(JSONScanner *self, GString *out)
+{
+  gunichar ch, low;
+
+  if (!_scan_hex4(self, &ch))
+    return FALSE;
+
+  if (ch >= 0xD800 && ch <= 0xDBFF)
+    {
+      if (self->input_len - self->input_pos < 2 ||
+          self->input[self->input_pos] != '\\' ||
+          self->input[self->input_pos + 1] != 'u')
+        return FALSE;
+      self->input_pos += 2;
+
+      if (!_scan_hex4(self, &low) || low < 0xDC00 || low > 0xDFFF)
+        return FALSE;
+      ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+    }
+  else if (ch == 0 || (ch >= 0xDC00 && ch <= 0xDFFF))
+    {
+      /* json-c treats these inconsistently between versions */
+      return FALSE;
+    }
+
+  if (out)
+    g_string_append_unichar(out, ch);
+  return TRUE;
+}
+
+/* appends the unescaped string to @out, or only validates it if @out is NULL */
+static gboolean
+_scan_string(JSONScanner *self, GString *out)
+{
+  gchar quote = self->input[self->input_pos++];
+
+  while (TRUE)
+    {
+      const gchar *chunk = self->input + self->input_pos;
+      const gchar *special;
+      gchar c;
+
+      special = (const gchar *) find_first_of3((const guchar *) chunk, self->input_len - self->input_pos,
+                                               quote, '\\', '\0');
+      if (!special || *special == '\0')
+        return FALSE;
+
+      if (out)
+        g_string_append_len(out, chunk, special - chunk);
+      self->input_pos += special - chunk + 1;
+
+      if (*special == quote)
+        return TRUE;
+
+      if (_is_eof(self))
+        return FALSE;
+
+      c = self->input[self->input_pos++];
+      switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+          _append_c(out, c);
+          break;
+        case 'b':
+          _append_c(out, '\b');
+          break;
+        case 'f':
+          _append_c(out, '\f');
+          break;
+        case 'n':
+          _append_c(out, '\n');
+          break;
+        case 'r':
+          _append_c(out, '\r');
+          break;
+        case 't':
+          _append_c(out, '\t');
+          break;
+        case 'u':
+          if (!_scan_unicode_escape(self, out))
+            return FALSE;
+          break;
+        default:
+          return FALSE;
+        }
+    }
+}
+
+static gboolean
+_scan_digits(JSONScanner *self)
+{
+  gsize start = self->input_pos;
+
+  while (!_is_eof(self) && g_ascii_isdigit(self->input[self->input_pos]))
+    self->input_pos++;
+  return self->input_pos > start;
+}
+
+/* numbers are formatted the same way as json_object_get_int()/get_double() values were */
+static gboolean
+_scan_number(JSONScanner *self, GString *out)
+{
+  gsize start = self->input_pos;
+  gboolean is_double = FALSE;
+
+  if (_peek(self) == '-')
+    self->input_pos++;
+
+  if (_peek(self) == '0')
+    self->input_pos++;
+  else if (!_scan_digits(self))
+    return FALSE;
+
+  if (_peek(self) == '.')
+    {
+      self->input_pos++;
+      if (!_scan_digits(self))
+        return FALSE;
+      is_double = TRUE;
+    }
+
+  if (_peek(self) == 'e' || _peek(self) == 'E')
+    {
+      self->input_pos++;
+      if (_peek(self) == '+' || _peek(self) == '-')
+        self->input_pos++;
+      if (!_scan_digits(self))
+        return FALSE;
+      is_double = TRUE;
+    }
+
+  if (!_at_delimiter(self))
+    return FALSE;
+
+  if (!out)
+    return TRUE;
+
+  g_string_append_len(out, self->input + start, self->input_pos - start);
+  if (is_double)
+    {
+      g_string_printf(out, "%f", g_ascii_strtod(out->str, NULL));
+    }
+  else
+    {
+      gint64 value = g_ascii_strtoll(out->str, NULL, 10);
+
+      g_string_printf(out, "%i", (gint) CLAMP(value, G_MININT32, G_MAXINT32));
+    }
+  return TRUE;
+}
+
+static gboolean
+_scan_literal(JSONScanner *self, const gchar *literal, gsize literal_len)
+{
+  if (self->input_len - self->input_pos < literal_len ||
+      memcmp(self->input + self->input_pos, literal, literal_len) != 0)
+    return FALSE;
+
+  self->input_pos += literal_len;
+  return _at_delimiter(self);
+}
+
+static inline JSONScannerSelection
+_select_member(JSONScanner *self, JSONScannerSelection parent_selection)
+{
+  if (parent_selection != JSON_SCANNER_DESCEND)
+    return parent_selection;
+
+  return self->select(self->name->str + self->prefix_len, self->name->len - self->prefix_len, self->user_data);
+}
+
+static guint32
+_hash_member_name(const gchar *name, gsize name_len)
+{
+  guint32 h = 2166136261U;
+  gsize i;
+
+  for (i = 0; i < name_len; i++)
+    h = (h ^ (guchar) name[i]) * 16777619U;
+  return h;
+}
+
+/*
+ * json-c keeps only the last one of duplicate members, while we would
+ * report what is below each of them (e.g. {"a": {"x": 1, "y": 2}, "a":
+ * {"x": 3}} would leave a.y behind).  Objects with duplicate member names
+ * are therefore left to json-c.  Only the hashes of the names are kept, a
+ * collision between different names just means a fallback to json-c.
+ */
+static gboolean
+_register_member(JSONScanner *self, gsize first_member, const gchar *name, gsize name_len)
+{
+  const guint32 *hashes = (const guint32 *) (self->member_hashes->str + first_member);
+  gsize num_hashes = (self->member_hashes->len - first_member) / sizeof(guint32);
+  guint32 hash = _hash_member_name(name, name_len);
+  gsize i;
+
+  for (i = 0; i < num_hashes; i++)
+    {
+      if (hashes[i] == hash)
+        return FALSE;
+    }
+  g_string_append_len(self->member_hashes, (const gchar *) &hash, sizeof(hash));
+  return TRUE;
+}
+
+static gboolean
+_scan_object(JSONScanner *self, JSONScannerSelection selection, gint depth)
+{
+  gsize name_len = self->name->len;
+  gsize first_member = self->member_hashes->len;
+  gchar c;
+
+  /* skip '{' */
+  self->input_pos++;
+  _skip_whitespace(self);
+  if (_peek(self) == '}')
+    {
+      self->input_pos++;
+      return TRUE;
+    }
+
+  while (TRUE)
+    {
+      JSONScannerSelection member_selection;
+
+      c = _peek(self);
+      if (c != '"' && c != '\'')
+        return FALSE;
+
+      if (!_scan_string(self, selection != JSON_SCANNER_SKIP ? self->name : NULL))
+        return FALSE;
+      member_selection = _select_member(self, selection);
+
+      /* nothing is reported below skipped members, duplicates don't matter there */
+      if (member_selection != JSON_SCANNER_SKIP &&
+          !_register_member(self, first_member, self->name->str + name_len, self->name->len - name_len))
+        return FALSE;
+
+      _skip_whitespace(self);
+      if (_peek(self) != ':')
+        return FALSE;
+      self->input_pos++;
+      _skip_whitespace(self);
+
+      if (!_scan_value(self, member_selection, depth))
+        return FALSE;
+      g_string_truncate(self->name, name_len);
+
+      _skip_whitespace(self);
+      c = _peek(self);
+      if (c == '}')
+        {
+          self->input_pos++;
+          g_string_truncate(self->member_hashes, first_member);
+          return TRUE;
+        }
+      if (c != ',')
+        return FALSE;
+      self->input_pos++;
+      _skip_whitespace(self);
+    }
+}
+
+static gboolean
+_scan_array(JSONScanner *self, JSONScannerSelection selection, gint depth)
+{
+  gsize name_len = self->name->len;
+  gint index = 0;
+  gchar c;
+
+  /* skip '[' */
+  self->input_pos++;
+  _skip_whitespace(self);
+  if (_peek(self) == ']')
+    {
+      self->input_pos++;
+      return TRUE;
+    }
+
+  while (TRUE)
+    {
+      JSONScannerSelection element_selection = selection;
+
+      if (selection != JSON_SCANNER_SKIP)
+        {
+          g_string_append_printf(self->name, "[%d]", index);
+          element_selection = _select_member(self, selection);
+        }
+
+      if (!_scan_value(self, element_selection, depth))
+        return FALSE;
+      g_string_truncate(self->name, name_len);
+      index++;
+
+      _skip_whitespace(self);
+      c = _peek(self);
+      if (c == ']')
+        {
+          self->input_pos++;
+          return TRUE;
+        }
+      if (c != ',')
+        return FALSE;
+      self->input_pos++;
+      _skip_whitespace(self);
+    }
+}
+
+static gboolean
+_scan_value(JSONScanner *self, JSONScannerSelection selection, gint depth)
+{
+  GString *value = (selection == JSON_SCANNER_EXTRACT) ? self->value : NULL;
+
+  if (value)
+    g_string_truncate(value, 0);
+
+  switch (_peek(self))
+    {
+    case '{':
+      if (depth >= JSON_SCANNER_MAX_DEPTH)
+        return FALSE;
+      if (selection != JSON_SCANNER_SKIP)
+        g_string_append_c(self->name, '.');
+      return _scan_object(self, selection, depth + 1);
+    case '[':
+      if (depth >= JSON_SCANNER_MAX_DEPTH)
+        return FALSE;
+      return _scan_array(self, selection, depth + 1);
+    case '"':
+    case '\'':
+      if (!_scan_string(self, value))
+        return FALSE;
+      break;
+    case 't':
+      if (!_scan_literal(self, "true", 4))
+        return FALSE;
+      if (value)
+        g_string_assign(value, "true");
+      break;
+    case 'f':
+      if (!_scan_literal(self, "false", 5))
+        return FALSE;
+      if (value)
+        g_string_assign(value, "false");
+      break;
+    case 'n':
+      /* nulls are not reported, just like with the json-c based parser */
+      return _scan_literal(self, "null", 4);
+    default:
+      if (!_scan_number(self, value))
+        return FALSE;
+      break;
+    }
+
+  if (value)
+    self->emit(self->name->str, self->name->len, value->str, value->len, self->user_data);
+  return TRUE;
+}
+
+/*
+ * Scans the JSON object at the beginning of @input (leading whitespace is
+ * skipped, anything after the object is ignored, the same way
+ * json_tokener_parse_ex() does) and calls @emit for each scalar member.
+ */
+gboolean
+json_scanner_scan_object(JSONScanner *self, const gchar *input, gsize input_len,
+                         JSONScannerEmitFunc emit, gpointer user_data)
+{
+  self->input = input;
+  self->input_len = input_len;
+  self->input_pos = 0;
+  self->emit = emit;
+  self->user_data = user_data;
+  g_string_truncate(self->name, self->prefix_len);
+  g_string_truncate(self->member_hashes, 0);
+
+  _skip_whitespace(self);
+  if (_peek(self) != '{')
+    return FALSE;
+
+  return _scan_object(self, self->select ? JSON_SCANNER_DESCEND : JSON_SCANNER_EXTRACT, 1);
+}
+
+void
+json_scanner_set_select_func(JSONScanner *self, JSONScannerSelectFunc select)
+{
+  self->select = select;
+}
+
+void
+json_scanner_init(JSONScanner *self, GString *name_buffer, GString *value_buffer, GString *member_hashes_buffer,
+                  const gchar *prefix)
+{
+  memset(self, 0, sizeof(*self));
+  self->name = name_buffer;
+  self->value = value_buffer;
+  self->member_hashes = member_hashes_buffer;
+
+  g_string_assign(self->name, prefix ? prefix : "");
+  self->prefix_len = self->name->len;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+
+
+#ifndef JSON_SCANNER_H_INCLUDED
+#define JSON_SCANNER_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * Streaming JSON scanner
+ *
+ * Walks a JSON object without building an object tree and reports every
+ * scalar member with its flattened (dot-notation) name, using the same
+ * naming scheme as json-parser():
+ *
+ *   {"a": {"b": 1}, "c": [true, "x"]}  ->  a.b=1, c[0]=true, c[1]=x
+ *
+ * The scanner only accepts a strict subset of what json-c does (e.g.  no
+ * comments, NaN or lone surrogates), it returns FALSE on anything else, in
+ * which case the caller is expected to fall back to json-c.  Values
+ * already reported before such a failure are to be discarded.  Objects
+ * with duplicate member names are rejected as well.
+ */
+
+typedef enum
+{
+  /* the member is not needed, only validate it */
+  JSON_SCANNER_SKIP,
+  /* the member is an object/array that contains needed members, ask again for each */
+  JSON_SCANNER_DESCEND,
+  /* the member and everything below it is needed */
+  JSON_SCANNER_EXTRACT,
+} JSONScannerSelection;
+
+/* @name is relative to the prefix */
+typedef JSONScannerSelection (*JSONScannerSelectFunc)(const gchar *name, gsize name_len, gpointer user_data);
+typedef void (*JSONScannerEmitFunc)(const gchar *name, gsize name_len,
+                                    const gchar *value, gsize value_len,
+                                    gpointer user_data);
+
+typedef struct _JSONScanner
+{
+  const gchar *input;
+  gsize input_len;
+  gsize input_pos;
+
+  GString *name;
+  gsize prefix_len;
+  GString *value;
+  /* hashes of the member names of the objects being scanned, as a stack */
+  GString *member_hashes;
+
+  JSONScannerSelectFunc select;
+  JSONScannerEmitFunc emit;
+  gpointer user_data;
+} JSONScanner;
+
+void json_scanner_init(JSONScanner *self, GString *name_buffer, GString *value_buffer, GString *member_hashes_buffer,
+                       const gchar *prefix);
+void json_scanner_set_select_func(JSONScanner *self, JSONScannerSelectFunc select);
+gboolean json_scanner_scan_object(JSONScanner *self, const gchar *input, gsize input_len,
+                                  JSONScannerEmitFunc emit, gpointer user_data);
+
+#endif
@@ -147,6 +147,13 @@ test_format_json_with_utf8(void)
   log_msg_unref(msg);
 }
 
+void
+test_format_json_duplicate_keys(void)
+{
+  assert_template_format("$(format-json msg.id=1 msg.id=2)", "{\"msg\":{\"id\":\"2\"}}");
+  assert_template_format("$(format-json --key HOST HOST=foo)", "{\"HOST\":\"foo\"}");
+}
+
 void
 test_format_json_performance(void)
 {
@@ -158,6 +165,7 @@ test_format_json_performance(void)
                     "--exclude .SDATA.* "
                     "..RSTAMP='${R_UNIXTIME}${R_TZ}' "
                     "..TAGS=${TAGS})\n");
+  perftest_template("$(format-json --scope rfc5424 --scope nv-pairs)\n");
 }
 
 int
@@ -175,6 +183,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   test_format_json_with_type_hints();
   test_format_json_on_error();
   test_format_json_with_utf8();
+  test_format_json_duplicate_keys();
   test_format_json_performance();
 
   deinit_template_tests();
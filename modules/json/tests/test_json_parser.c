@@ -23,6 +23,7 @@
 #include "json-parser.h"
 #include "apphook.h"
 #include "msg_parse_lib.h"
+#include "string-list.h"
 
 #define json_parser_testcase_begin(func, args)             \
   do                                                            \
@@ -186,6 +187,94 @@ test_json_parser_works_with_templates(void)
   log_msg_unref(msg);
 }
 
+static void
+test_json_parser_flattens_nested_arrays_and_unescapes_strings(void)
+{
+  LogMessage *msg;
+
+  msg = parse_json_into_log_message("{\"a\": [1, {\"b\": \"c\"}, [2, 3]], \"u\": \"\\u00e1\\\"q\\\"\"}");
+  assert_log_message_value(msg, log_msg_get_value_handle("a[0]"), "1");
+  assert_log_message_value(msg, log_msg_get_value_handle("a[1].b"), "c");
+  assert_log_message_value(msg, log_msg_get_value_handle("a[2][1]"), "3");
+  assert_log_message_value(msg, log_msg_get_value_handle("u"), "\xc3\xa1\"q\"");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_extracts_only_the_configured_keys(void)
+{
+  const gchar *keys[] = { "foo", "object.member1", "array", NULL };
+  LogMessage *msg;
+
+  json_parser_set_keys(json_parser, string_array_to_list(keys));
+  msg = parse_json_into_log_message("{'foo': 'bar', 'bar': 'foo', 'object': {'member1': 'foo', 'member2': 'bar'}, 'array': [1, {'x': 2}]}");
+  assert_log_message_value(msg, log_msg_get_value_handle("foo"), "bar");
+  assert_log_message_value(msg, log_msg_get_value_handle("bar"), NULL);
+  assert_log_message_value(msg, log_msg_get_value_handle("object.member1"), "foo");
+  assert_log_message_value(msg, log_msg_get_value_handle("object.member2"), NULL);
+  assert_log_message_value(msg, log_msg_get_value_handle("array[0]"), "1");
+  assert_log_message_value(msg, log_msg_get_value_handle("array[1].x"), "2");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_extracts_only_the_configured_keys_with_extract_prefix(void)
+{
+  const gchar *keys[] = { "foo", NULL };
+  LogMessage *msg;
+
+  json_parser_set_extract_prefix(json_parser, "[1]");
+  json_parser_set_keys(json_parser, string_array_to_list(keys));
+  msg = parse_json_into_log_message("[{'foo':'bar'}, {'foo':'baz', 'bar':'foo'}]");
+  assert_log_message_value(msg, log_msg_get_value_handle("foo"), "baz");
+  assert_log_message_value(msg, log_msg_get_value_handle("bar"), NULL);
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_fails_for_truncated_json(void)
+{
+  assert_json_parser_fails("{'foo': 'bar', 'baz': ");
+}
+
+static void
+test_json_parser_keeps_the_last_of_duplicate_members(void)
+{
+  LogMessage *msg;
+
+  msg = parse_json_into_log_message("{\"a\": {\"x\": 1, \"y\": 2}, \"a\": {\"x\": 3}}");
+  assert_log_message_value(msg, log_msg_get_value_handle("a.x"), "3");
+  assert_log_message_value(msg, log_msg_get_value_handle("a.y"), NULL);
+  log_msg_unref(msg);
+
+  msg = parse_json_into_log_message("{\"a\": [1, 2], \"b\": \"c\", \"a\": [3]}");
+  assert_log_message_value(msg, log_msg_get_value_handle("a[0]"), "3");
+  assert_log_message_value(msg, log_msg_get_value_handle("a[1]"), NULL);
+  assert_log_message_value(msg, log_msg_get_value_handle("b"), "c");
+  log_msg_unref(msg);
+}
+
+static void
+test_json_parser_stores_values_under_the_same_names_when_repeated(void)
+{
+  LogMessage *msg;
+  gint i;
+
+  for (i = 0; i < 2; i++)
+    {
+      msg = parse_json_into_log_message("{'foo': 'bar', 'object': {'member': 'baz'}}");
+      assert_log_message_value(msg, log_msg_get_value_handle("foo"), "bar");
+      assert_log_message_value(msg, log_msg_get_value_handle("object.member"), "baz");
+      log_msg_unref(msg);
+    }
+
+  json_parser_set_prefix(json_parser, ".prefix.");
+  msg = parse_json_into_log_message("{'foo': 'bar', 'object': {'member': 'baz'}}");
+  assert_log_message_value(msg, log_msg_get_value_handle(".prefix.foo"), "bar");
+  assert_log_message_value(msg, log_msg_get_value_handle(".prefix.object.member"), "baz");
+  log_msg_unref(msg);
+}
+
 static void
 test_json_parser(void)
 {
@@ -198,6 +287,12 @@ test_json_parser(void)
   JSON_PARSER_TESTCASE(test_json_parser_fails_for_non_object_top_element);
   JSON_PARSER_TESTCASE(test_json_parser_extracts_subobjects_if_extract_prefix_is_specified);
   JSON_PARSER_TESTCASE(test_json_parser_works_with_templates);
+  JSON_PARSER_TESTCASE(test_json_parser_flattens_nested_arrays_and_unescapes_strings);
+  JSON_PARSER_TESTCASE(test_json_parser_extracts_only_the_configured_keys);
+  JSON_PARSER_TESTCASE(test_json_parser_extracts_only_the_configured_keys_with_extract_prefix);
+  JSON_PARSER_TESTCASE(test_json_parser_fails_for_truncated_json);
+  JSON_PARSER_TESTCASE(test_json_parser_keeps_the_last_of_duplicate_members);
+  JSON_PARSER_TESTCASE(test_json_parser_stores_values_under_the_same_names_when_repeated);
 }
 
 int
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2017 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+#include "testutils.h"
+#include "json-scanner.h"
+
+#include <string.h>
+
+#define JSON_SCANNER_TESTCASE(x, ...) \
+  do {                                                          \
+      testcase_begin("%s(%s)", #x, #__VA_ARGS__);               \
+      x(__VA_ARGS__);                                           \
+      testcase_end();                                           \
+  } while(0)
+
+static void
+_collect_value(const gchar *name, gsize name_len, const gchar *value, gsize value_len, gpointer user_data)
+{
+  GString *result = (GString *) user_data;
+
+  g_string_append_printf(result, "%s=%s;", name, value);
+}
+
+static JSONScannerSelection
+_select_foo_and_bar_baz(const gchar *name, gsize name_len, gpointer user_data)
+{
+  if (strcmp(name, "foo") == 0 || strcmp(name, "bar.baz") == 0)
+    return JSON_SCANNER_EXTRACT;
+  if (strcmp(name, "bar") == 0)
+    return JSON_SCANNER_DESCEND;
+  return JSON_SCANNER_SKIP;
+}
+
+static gboolean
+_scan(const gchar *json, const gchar *prefix, JSONScannerSelectFunc select, GString *result)
+{
+  JSONScanner scanner;
+  GString *name = g_string_new("");
+  GString *value = g_string_new("");
+  GString *member_hashes = g_string_new("");
+  gboolean success;
+
+  json_scanner_init(&scanner, name, value, member_hashes, prefix);
+  if (select)
+    json_scanner_set_select_func(&scanner, select);
+  success = json_scanner_scan_object(&scanner, json, strlen(json), _collect_value, result);
+
+  g_string_free(name, TRUE);
+  g_string_free(value, TRUE);
+  g_string_free(member_hashes, TRUE);
+  return success;
+}
+
+static void
+assert_json_scanner_output(const gchar *json, const gchar *prefix, JSONScannerSelectFunc select,
+                           const gchar *expected)
+{
+  GString *result = g_string_new("");
+
+  assert_true(_scan(json, prefix, select, result), "expected json-scanner success and it returned failure, json=%s",
+              json);
+  assert_string(result->str, expected, "json-scanner returned unexpected values, json=%s", json);
+  g_string_free(result, TRUE);
+}
+
+static void
+assert_json_scanner_rejects(const gchar *json)
+{
+  GString *result = g_string_new("");
+
+  assert_false(_scan(json, NULL, NULL, result), "expected json-scanner failure and it returned success, json=%s",
+               json);
+  g_string_free(result, TRUE);
+}
+
+static void
+test_json_scanner_flattens_nested_objects_and_arrays(void)
+{
+  assert_json_scanner_output("{'foo': 'bar'}", NULL, NULL, "foo=bar;");
+  assert_json_scanner_output("{'foo': {'bar': 'baz'}}", ".json.", NULL, ".json.foo.bar=baz;");
+  assert_json_scanner_output("{\"a\": [1, {\"b\": \"c\"}, [2, 3], []], \"e\": {}}", NULL, NULL,
+                             "a[0]=1;a[1].b=c;a[2][0]=2;a[2][1]=3;");
+  assert_json_scanner_output("  {'foo': 'bar'} trailing garbage is ignored", NULL, NULL, "foo=bar;");
+}
+
+static void
+test_json_scanner_formats_scalars_like_json_c(void)
+{
+  assert_json_scanner_output("{'t': true, 'f': false, 'n': null, 'i': -123, 'd': 1.5, 'e': 1e3, 'big': 99999999999}",
+                             NULL, NULL,
+                             "t=true;f=false;i=-123;d=1.500000;e=1000.000000;big=2147483647;");
+}
+
+static void
+test_json_scanner_unescapes_strings(void)
+{
+  assert_json_scanner_output("{\"k\\\"ey\": \"a\\\"b\\\\c\\/d\\te\"}", NULL, NULL, "k\"ey=a\"b\\c/d\te;");
+  assert_json_scanner_output("{\"u\": \"\\u00e1\\ud83d\\ude00\"}", NULL, NULL, "u=\xc3\xa1\xf0\x9f\x98\x80;");
+}
+
+static void
+test_json_scanner_extracts_only_selected_members(void)
+{
+  assert_json_scanner_output("{'foo': [1, 2], 'bar': {'baz': 'x', 'qux': 'y'}, 'baz': 'z'}", NULL,
+                             _select_foo_and_bar_baz, "foo[0]=1;foo[1]=2;bar.baz=x;");
+}
+
+static void
+test_json_scanner_rejects_what_it_does_not_understand(void)
+{
+  assert_json_scanner_rejects("");
+  assert_json_scanner_rejects("[1, 2, 3]");
+  assert_json_scanner_rejects("{'foo': 'bar'");
+  assert_json_scanner_rejects("{'foo': 'bar',}");
+  assert_json_scanner_rejects("{'foo': 01}");
+  assert_json_scanner_rejects("{'foo': tru}");
+  assert_json_scanner_rejects("{'foo': /* comment */ 'bar'}");
+  assert_json_scanner_rejects("{'foo': \"\\ud800\"}");
+  assert_json_scanner_rejects("{'foo': \"\\u0000\"}");
+  assert_json_scanner_rejects("{'skipped': {'invalid': }}");
+}
+
+static void
+test_json_scanner_rejects_duplicate_members(void)
+{
+  assert_json_scanner_rejects("{'a': 1, 'a': 2}");
+  assert_json_scanner_rejects("{\"a\": {\"x\": 1, \"y\": 2}, \"a\": {\"x\": 3}}");
+  assert_json_scanner_rejects("{'a': {'x': 1, 'b': {'c': 2, 'c': 3}}}");
+  assert_json_scanner_rejects("{'a': [{'x': 1, 'x': 2}]}");
+
+  /* the same name in different objects is not a duplicate */
+  assert_json_scanner_output("{'a': {'x': 1}, 'b': {'x': 2}, 'x': 3}", NULL, NULL, "a.x=1;b.x=2;x=3;");
+  assert_json_scanner_output("{'a': [{'x': 1}, {'x': 2}]}", NULL, NULL, "a[0].x=1;a[1].x=2;");
+
+  /* members that are not extracted are not checked */
+  assert_json_scanner_output("{'foo': 1, 'baz': 2, 'baz': 3}", NULL, _select_foo_and_bar_baz, "foo=1;");
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  JSON_SCANNER_TESTCASE(test_json_scanner_flattens_nested_objects_and_arrays);
+  JSON_SCANNER_TESTCASE(test_json_scanner_formats_scalars_like_json_c);
+  JSON_SCANNER_TESTCASE(test_json_scanner_unescapes_strings);
+  JSON_SCANNER_TESTCASE(test_json_scanner_extracts_only_selected_members);
+  JSON_SCANNER_TESTCASE(test_json_scanner_rejects_what_it_does_not_understand);
+  JSON_SCANNER_TESTCASE(test_json_scanner_rejects_duplicate_members);
+  return 0;
+}
@@ -21,6 +21,9 @@
 
 #include "kv-parser.h"
 #include "scanner/kv-scanner/kv-scanner.h"
+#include "scratch-buffers.h"
+
+#include <string.h>
 
 gboolean
 kv_parser_is_valid_separator_character(char c)
@@ -74,40 +77,72 @@ kv_parser_set_stray_words_value_name(LogParser *s, const gchar *value_name)
   self->stray_words_value_name = g_strdup(value_name);
 }
 
-static const gchar *
-_get_formatted_key(KVParser *self, const gchar *key)
+/*
+ * Only the listed keys are stored in the message, the rest of the input is
+ * scanned but otherwise ignored.  The table is never changed after
+ * configuration, so the per-message clones share it.
+ */
+void
+kv_parser_set_keys(LogParser *s, GList *keys)
+{
+  KVParser *self = (KVParser *) s;
+  GList *l;
+
+  if (self->keys)
+    g_hash_table_unref(self->keys);
+  self->keys = NULL;
+
+  if (!keys)
+    return;
+
+  self->keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (l = keys; l; l = l->next)
+    g_hash_table_insert(self->keys, l->data, GINT_TO_POINTER(TRUE));
+  g_list_free(keys);
+}
+
+static inline gboolean
+_is_key_selected(KVParser *self, const gchar *key)
 {
+  return !self->keys || g_hash_table_lookup(self->keys, key) != NULL;
+}
+
+static NVHandle
+_get_key_handle(KVParser *self, const gchar *key, gsize key_len)
+{
+  GString *formatted_key;
+
   if (!self->prefix)
-    return key;
-  else if (self->formatted_key->len > 0)
-    g_string_truncate(self->formatted_key, self->prefix_len);
-  else
-    g_string_assign(self->formatted_key, self->prefix);
-  g_string_append(self->formatted_key, key);
-  return self->formatted_key->str;
+    return log_msg_get_value_handle_cached(key, key_len);
+
+  formatted_key = scratch_buffers_alloc();
+  g_string_assign(formatted_key, self->prefix);
+  g_string_append_len(formatted_key, key, key_len);
+  return log_msg_get_value_handle_cached(formatted_key->str, formatted_key->len);
 }
 
 static gboolean
-_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input,
-         gsize input_len)
+_process(KVParser *self, KVScanner *kv_scanner, LogMessage **pmsg, const LogPathOptions *path_options,
+         const gchar *input, gsize input_len)
 {
-  KVParser *self = (KVParser *) s;
-
   log_msg_make_writable(pmsg, path_options);
-  /* FIXME: input length */
-  kv_scanner_input(self->kv_scanner, input);
-  while (kv_scanner_scan_next(self->kv_scanner))
+  kv_scanner_input(kv_scanner, input, input_len);
+  while (kv_scanner_scan_next(kv_scanner))
     {
+      const gchar *key = kv_scanner_get_current_key(kv_scanner);
+      NVHandle handle;
+
+      if (!_is_key_selected(self, key))
+        continue;
+
+      handle = _get_key_handle(self, key, kv_scanner->key->len);
 
-      /* FIXME: value length */
-      log_msg_set_value_by_name(*pmsg,
-                                _get_formatted_key(self, kv_scanner_get_current_key(self->kv_scanner)),
-                                kv_scanner_get_current_value(self->kv_scanner), -1);
+      log_msg_set_value(*pmsg, handle, kv_scanner_get_current_value(kv_scanner), kv_scanner->value->len);
     }
   if (self->stray_words_value_name)
     log_msg_set_value_by_name(*pmsg,
                               self->stray_words_value_name,
-                              kv_scanner_get_stray_words(self->kv_scanner), -1);
+                              kv_scanner_get_stray_words(kv_scanner), -1);
 
   return TRUE;
 }
@@ -120,6 +155,8 @@ kv_parser_clone_method(KVParser *dst, KVParser *src)
   kv_parser_set_value_separator(&dst->super, src->value_separator);
   kv_parser_set_pair_separator(&dst->super, src->pair_separator);
   kv_parser_set_stray_words_value_name(&dst->super, src->stray_words_value_name);
+  if (src->keys)
+    dst->keys = g_hash_table_ref(src->keys);
 
   if (src->kv_scanner)
     dst->kv_scanner = kv_scanner_clone(src->kv_scanner);
@@ -142,21 +179,29 @@ _free(LogPipe *s)
   KVParser *self = (KVParser *)s;
 
   kv_scanner_free(self->kv_scanner);
-  g_string_free(self->formatted_key, TRUE);
+  if (self->keys)
+    g_hash_table_unref(self->keys);
   g_free(self->prefix);
   g_free(self->pair_separator);
   log_parser_free_method(s);
 }
 
+/* the configured scanner is shared by all threads, each message is scanned
+ * by a transient copy of it using scratch buffers */
 static gboolean
 _process_threaded(LogParser *s, LogMessage **pmsg, const LogPathOptions *path_options, const gchar *input,
                   gsize input_len)
 {
-  LogParser *self = (LogParser *)log_pipe_clone(&s->super);
+  KVParser *self = (KVParser *) s;
+  ScratchBuffersMarker marker;
+  KVScanner kv_scanner;
+
+  scratch_buffers_mark(&marker);
+  kv_scanner_init_transient(&kv_scanner, self->kv_scanner);
 
-  gboolean ok = _process(self, pmsg, path_options, input, input_len);
+  gboolean ok = _process(self, &kv_scanner, pmsg, path_options, input, input_len);
 
-  log_pipe_unref(&self->super);
+  scratch_buffers_reclaim_marked(marker);
   return ok;
 }
 
@@ -192,7 +237,6 @@ kv_parser_init_instance(KVParser *self, GlobalConfig *cfg)
   self->kv_scanner = NULL;
   self->value_separator = '=';
   self->pair_separator = g_strdup(", ");
-  self->formatted_key = g_string_sized_new(32);
 }
 
 LogParser *
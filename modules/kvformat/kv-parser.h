@@ -34,7 +34,7 @@ typedef struct _KVParser
   gchar *prefix;
   gchar *stray_words_value_name;
   gsize prefix_len;
-  GString *formatted_key;
+  GHashTable *keys;
   KVScanner *kv_scanner;
 } KVParser;
 
@@ -42,6 +42,7 @@ void kv_parser_set_prefix(LogParser *p, const gchar *prefix);
 void kv_parser_set_value_separator(LogParser *p, gchar value_separator);
 void kv_parser_set_pair_separator(LogParser *p, const gchar *pair_separator);
 void kv_parser_set_stray_words_value_name(LogParser *s, const gchar *value_name);
+void kv_parser_set_keys(LogParser *s, GList *keys);
 gboolean kv_parser_is_valid_separator_character(gchar c);
 
 gboolean kv_parser_init_method(LogPipe *s);
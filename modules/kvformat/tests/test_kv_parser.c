@@ -20,8 +20,10 @@
  */
 #include "testutils.h"
 #include "kv-parser.h"
+#include "linux-audit-parser.h"
 #include "apphook.h"
 #include "msg_parse_lib.h"
+#include "string-list.h"
 
 #define kv_parser_testcase_begin(func, args)             \
   do                                                            \
@@ -139,6 +141,27 @@ test_kv_parser_audit(void)
   log_msg_unref(msg);
 }
 
+static void
+test_linux_audit_parser_decodes_hex_values(void)
+{
+  LogMessage *msg;
+
+  log_pipe_deinit((LogPipe *) kv_parser);
+  log_pipe_unref((LogPipe *) kv_parser);
+  kv_parser = linux_audit_parser_new(NULL);
+  log_pipe_init((LogPipe *) kv_parser);
+
+  /* "/bin/sh\0-c\0ls" as encoded by the kernel, NUL separates the arguments */
+  msg = parse_kv_into_log_message("type=PROCTITLE msg=audit(1436899154.146:186135): proctitle=2F62696E2F7368002D63006C73 "
+                                  "name=\"/etc/passwd\" a0=2F7573722F62696E2F6C73");
+  assert_log_message_value_by_name(msg, "type", "PROCTITLE");
+  assert_log_message_value_by_name(msg, "proctitle", "/bin/sh\t-c\tls");
+  assert_log_message_value_by_name(msg, "name", "/etc/passwd");
+  /* no characters that would need encoding, so it is kept as is */
+  assert_log_message_value_by_name(msg, "a0", "2F7573722F62696E2F6C73");
+  log_msg_unref(msg);
+}
+
 static void
 test_kv_parser_extract_stray_words(void)
 {
@@ -166,13 +189,56 @@ test_kv_parser_extract_stray_words(void)
 
 }
 
+static void
+test_kv_parser_extracts_only_the_configured_keys(void)
+{
+  const gchar *keys[] = { "foo", "baz", NULL };
+  LogMessage *msg;
+
+  kv_parser_set_keys(kv_parser, string_array_to_list(keys));
+  kv_parser_set_prefix(kv_parser, ".prefix.");
+  msg = parse_kv_into_log_message("foo=bar, bar=\"quoted, value\", baz=qux");
+  assert_log_message_value_by_name(msg, ".prefix.foo", "bar");
+  assert_log_message_value_by_name(msg, ".prefix.bar", NULL);
+  assert_log_message_value_by_name(msg, ".prefix.baz", "qux");
+  log_msg_unref(msg);
+}
+
+static void
+test_kv_parser_repeated_keys(void)
+{
+  const gchar *keys[] = { "foo", "a_key_that_is_longer_than_thirty_two_characters", NULL };
+  LogMessage *msg;
+  gint i;
+
+  kv_parser_set_keys(kv_parser, string_array_to_list(keys));
+  for (i = 0; i < 3; i++)
+    {
+      msg = parse_kv_into_log_message("foo=bar bar=baz a_key_that_is_longer_than_thirty_two_characters=long");
+      assert_log_message_value_by_name(msg, "foo", "bar");
+      assert_log_message_value_by_name(msg, "bar", NULL);
+      assert_log_message_value_by_name(msg, "a_key_that_is_longer_than_thirty_two_characters", "long");
+      log_msg_unref(msg);
+    }
+
+  kv_parser_set_keys(kv_parser, NULL);
+  kv_parser_set_prefix(kv_parser, ".prefix.");
+  msg = parse_kv_into_log_message("foo=bar bar=baz");
+  assert_log_message_value_by_name(msg, ".prefix.foo", "bar");
+  assert_log_message_value_by_name(msg, ".prefix.bar", "baz");
+  log_msg_unref(msg);
+}
+
 static void
 test_kv_parser(void)
 {
   KV_PARSER_TESTCASE(test_kv_parser_basics);
   KV_PARSER_TESTCASE(test_kv_parser_audit);
+  KV_PARSER_TESTCASE(test_linux_audit_parser_decodes_hex_values);
   KV_PARSER_TESTCASE(test_kv_parser_uses_template_to_parse_input);
   KV_PARSER_TESTCASE(test_kv_parser_extract_stray_words);
+  KV_PARSER_TESTCASE(test_kv_parser_extracts_only_the_configured_keys);
+  KV_PARSER_TESTCASE(test_kv_parser_repeated_keys);
 }
 
 int
@@ -36,7 +36,7 @@ struct _VarBindListScanner
 static inline void
 varbindlist_scanner_input(VarBindListScanner *self, const gchar *input)
 {
-  kv_scanner_input(&self->super, input);
+  kv_scanner_input(&self->super, input, -1);
 }
 
 static inline VarBindListScanner *
@@ -30,6 +30,7 @@
 #include "str-format.h"
 #include "utf8utils.h"
 #include "str-utils.h"
+#include "tls-support.h"
 
 #include <regex.h>
 #include <ctype.h>
@@ -40,6 +41,52 @@ static const char repeat_msg_string[] = "last message repeated";
 static NVHandle is_synced;
 static NVHandle cisco_seqid;
 
+/* character classes used by the hostname and program name scanners */
+enum
+{
+  SYSLOG_CHAR_NAME_DELIM = 0x01,
+  SYSLOG_CHAR_PID_DELIM = 0x02,
+  SYSLOG_CHAR_HOSTNAME_INVALID = 0x04,
+};
+
+static guint8 syslog_char_classes[256];
+
+#define SYSLOG_ISO_STAMP_LEN 19
+#define SYSLOG_BSD_STAMP_LEN 15
+
+/* seconds a cached timestamp conversion is reused for, the year of BSD
+ * timestamps depends on the current date */
+#define SYSLOG_STAMP_CACHE_TTL 60
+
+/*
+ * The last timestamp converted by this thread.  Messages arriving in a
+ * burst mostly carry the same timestamp up to the second, in which case
+ * the date is not scanned and converted again, only the fraction and the
+ * timezone following it.
+ */
+typedef struct _SyslogStampCache
+{
+  gchar stamp[SYSLOG_ISO_STAMP_LEN];
+  gint stamp_len;
+  glong assume_timezone;
+  glong parsed_zone_offset;
+  time_t created;
+  time_t tv_sec;
+  glong zone_offset;
+} SyslogStampCache;
+
+TLS_BLOCK_START
+{
+  SyslogStampCache stamp_cache;
+  /* the number of SD parameters in the last message with SDATA, used to
+   * size the sdata array of the next one up front */
+  gint sd_params_hint;
+}
+TLS_BLOCK_END;
+
+#define stamp_cache __tls_deref(stamp_cache)
+#define sd_params_hint __tls_deref(sd_params_hint)
+
 static gboolean
 log_msg_parse_pri(LogMessage *self, const guchar **data, gint *length, guint flags, guint16 default_pri)
 {
@@ -277,26 +324,12 @@ __has_iso_timezone(const guchar *src, gint length)
          !isdigit(*(src+6));
 }
 
-static gboolean
-__parse_iso_stamp(const GTimeVal *now, LogMessage *self, struct tm *tm, const guchar **data, gint *length)
+/* parses the [.frac]<+/->ZZ:ZZ part of an RFC3339 timestamp */
+static void
+__parse_iso_stamp_suffix(LogMessage *self, const guchar **data, gint *length)
 {
-  /* RFC3339 timestamp, expected format: YYYY-MM-DDTHH:MM:SS[.frac]<+/->ZZ:ZZ */
-  time_t now_tv_sec = (time_t) now->tv_sec;
   const guchar *src = *data;
 
-  self->timestamps[LM_TS_STAMP].tv_usec = 0;
-
-  /* NOTE: we initialize various unportable fields in tm using a
-   * localtime call, as the value of tm_gmtoff does matter but it does
-   * not exist on all platforms and 0 initializing it causes trouble on
-   * time-zone barriers */
-
-  cached_localtime(&now_tv_sec, tm);
-  if (!scan_iso_timestamp((const gchar **) &src, length, tm))
-    {
-      return FALSE;
-    }
-
   self->timestamps[LM_TS_STAMP].tv_usec = __parse_usec(&src, length);
 
   if (*length > 0 && *src == 'Z')
@@ -316,6 +349,30 @@ __parse_iso_stamp(const GTimeVal *now, LogMessage *self, struct tm *tm, const gu
     }
 
   *data = src;
+}
+
+static gboolean
+__parse_iso_stamp(const GTimeVal *now, LogMessage *self, struct tm *tm, const guchar **data, gint *length)
+{
+  /* RFC3339 timestamp, expected format: YYYY-MM-DDTHH:MM:SS[.frac]<+/->ZZ:ZZ */
+  time_t now_tv_sec = (time_t) now->tv_sec;
+  const guchar *src = *data;
+
+  self->timestamps[LM_TS_STAMP].tv_usec = 0;
+
+  /* NOTE: we initialize various unportable fields in tm using a
+   * localtime call, as the value of tm_gmtoff does matter but it does
+   * not exist on all platforms and 0 initializing it causes trouble on
+   * time-zone barriers */
+
+  cached_localtime(&now_tv_sec, tm);
+  if (!scan_iso_timestamp((const gchar **) &src, length, tm))
+    {
+      return FALSE;
+    }
+
+  __parse_iso_stamp_suffix(self, &src, length);
+  *data = src;
   return TRUE;
 }
 
@@ -499,9 +556,75 @@ _normalize_time(LogStamp *stamp, struct tm *tm, glong assume_timezone)
   stamp->tv_sec = __get_normalized_time(*stamp, tm->tm_hour, unnormalized_hour);
 }
 
+/* returns the length of the timestamp up to the seconds if it is in one
+ * of the common formats, or 0 if it should be parsed the long way */
+static gint
+_get_cacheable_stamp_length(const guchar *src, gint left, guint parse_flags)
+{
+  if (__is_iso_stamp((const gchar *) src, left))
+    return SYSLOG_ISO_STAMP_LEN;
+  if ((parse_flags & LP_SYSLOG_PROTOCOL) == 0 &&
+      __is_bsd_rfc_3164(src, left) &&
+      !__is_bsd_linksys(src, left))
+    return SYSLOG_BSD_STAMP_LEN;
+  return 0;
+}
+
+static gboolean
+_parse_date_cached(LogMessage *self, const guchar **data, gint *length, gint stamp_len, glong assume_timezone)
+{
+  SyslogStampCache *cache = &stamp_cache;
+  LogStamp *stamp = &self->timestamps[LM_TS_STAMP];
+  const guchar *src = *data + stamp_len;
+  gint left = *length - stamp_len;
+  GTimeVal now;
+
+  if (cache->stamp_len != stamp_len ||
+      cache->assume_timezone != assume_timezone ||
+      memcmp(cache->stamp, *data, stamp_len) != 0)
+    return FALSE;
+
+  cached_g_current_time(&now);
+  if (now.tv_sec < cache->created || now.tv_sec - cache->created >= SYSLOG_STAMP_CACHE_TTL)
+    return FALSE;
+
+  if (stamp_len == SYSLOG_ISO_STAMP_LEN)
+    __parse_iso_stamp_suffix(self, &src, &left);
+  else
+    stamp->tv_usec = __parse_usec(&src, &left);
+
+  if (stamp->zone_offset != cache->parsed_zone_offset)
+    return FALSE;
+
+  stamp->tv_sec = cache->tv_sec;
+  stamp->zone_offset = cache->zone_offset;
+  *data = src;
+  *length = left;
+  return TRUE;
+}
+
+static void
+_store_date_cache(const guchar *data, gint stamp_len, glong assume_timezone, glong parsed_zone_offset,
+                  const LogStamp *stamp)
+{
+  SyslogStampCache *cache = &stamp_cache;
+  GTimeVal now;
+
+  cached_g_current_time(&now);
+  memcpy(cache->stamp, data, stamp_len);
+  cache->stamp_len = stamp_len;
+  cache->assume_timezone = assume_timezone;
+  cache->parsed_zone_offset = parsed_zone_offset;
+  cache->created = now.tv_sec;
+  cache->tv_sec = stamp->tv_sec;
+  cache->zone_offset = stamp->zone_offset;
+}
+
 static gboolean
 log_msg_parse_date(LogMessage *self, const guchar **data, gint *length, guint parse_flags, glong assume_timezone)
 {
+  const guchar *stamp_start = *data;
+  gint stamp_len = 0;
   struct tm tm;
 
   LogStamp *stamp = &self->timestamps[LM_TS_STAMP];
@@ -509,6 +632,13 @@ log_msg_parse_date(LogMessage *self, const guchar **data, gint *length, guint pa
   stamp->tv_usec = 0;
   stamp->zone_offset = -1;
 
+  if ((parse_flags & LP_NO_PARSE_DATE) == 0)
+    {
+      stamp_len = _get_cacheable_stamp_length(*data, *length, parse_flags);
+      if (stamp_len && _parse_date_cached(self, data, length, stamp_len, assume_timezone))
+        return TRUE;
+    }
+
   if (!log_msg_parse_date_unnormalized(self, data, length, parse_flags, &tm))
     {
       *stamp = self->timestamps[LM_TS_RECVD];
@@ -521,7 +651,11 @@ log_msg_parse_date(LogMessage *self, const guchar **data, gint *length, guint pa
     }
   else
     {
+      glong parsed_zone_offset = stamp->zone_offset;
+
       _normalize_time(stamp, &tm, assume_timezone);
+      if (stamp_len)
+        _store_date_cache(stamp_start, stamp_len, assume_timezone, parsed_zone_offset, stamp);
     }
 
   return TRUE;
@@ -565,7 +699,7 @@ log_msg_parse_legacy_program_name(LogMessage *self, const guchar **data, gint *l
   src = *data;
   left = *length;
   prog_start = src;
-  while (left && *src != ' ' && *src != '[' && *src != ':')
+  while (left && (syslog_char_classes[*src] & SYSLOG_CHAR_NAME_DELIM) == 0)
     {
       src++;
       left--;
@@ -574,7 +708,7 @@ log_msg_parse_legacy_program_name(LogMessage *self, const guchar **data, gint *l
   if (left > 0 && *src == '[')
     {
       const guchar *pid_start = src + 1;
-      while (left && *src != ' ' && *src != ']' && *src != ':')
+      while (left && (syslog_char_classes[*src] & SYSLOG_CHAR_PID_DELIM) == 0)
         {
           src++;
           left--;
@@ -608,31 +742,38 @@ log_msg_parse_legacy_program_name(LogMessage *self, const guchar **data, gint *l
   *length = left;
 }
 
-static guint8 invalid_chars[32];
-
 static void
-_init_parse_hostname_invalid_chars(void)
+_init_syslog_char_classes(void)
 {
-  if ((invalid_chars[0] & 0x1) == 0)
-    {
-      gint i;
-      /* we use a bit string to represent valid/invalid characters  when check_hostname is enabled */
+  gint i;
 
-      /* not yet initialized */
-      for (i = 0; i < 256; i++)
-        {
-          if (!((i >= 'A' && i <= 'Z') ||
-                (i >= 'a' && i <= 'z') ||
-                (i >= '0' && i <= '9') ||
-                i == '-' || i == '_' ||
-                i == '.' || i == ':' ||
-                i == '@' || i == '/'))
-            {
-              invalid_chars[i >> 8] |= 1 << (i % 8);
-            }
-        }
-      invalid_chars[0] |= 0x1;
+  for (i = 0; i < 256; i++)
+    {
+      if (!((i >= 'A' && i <= 'Z') ||
+            (i >= 'a' && i <= 'z') ||
+            (i >= '0' && i <= '9') ||
+            i == '-' || i == '_' ||
+            i == '.' || i == ':' ||
+            i == '@' || i == '/'))
+        syslog_char_classes[i] |= SYSLOG_CHAR_HOSTNAME_INVALID;
     }
+  syslog_char_classes[' '] |= SYSLOG_CHAR_NAME_DELIM | SYSLOG_CHAR_PID_DELIM;
+  syslog_char_classes[':'] |= SYSLOG_CHAR_NAME_DELIM | SYSLOG_CHAR_PID_DELIM;
+  syslog_char_classes['['] |= SYSLOG_CHAR_NAME_DELIM;
+  syslog_char_classes[']'] |= SYSLOG_CHAR_PID_DELIM;
+}
+
+static gboolean
+_is_bad_hostname(const guchar *hostname, gint hostname_len, regex_t *bad_hostname)
+{
+  gchar hostname_buf[256];
+
+  if (!bad_hostname)
+    return FALSE;
+
+  memcpy(hostname_buf, hostname, hostname_len);
+  hostname_buf[hostname_len] = 0;
+  return regexec(bad_hostname, hostname_buf, 0, NULL, 0) == 0;
 }
 
 static void
@@ -641,55 +782,42 @@ log_msg_parse_hostname(LogMessage *self, const guchar **data, gint *length,
                        guint flags, regex_t *bad_hostname)
 {
   /* FIXME: support nil value support  with new protocol*/
-  const guchar *src, *oldsrc;
-  gint left, oldleft;
-  gchar hostname_buf[256];
-  gint dst = 0;
+  const guchar *src;
+  gint left, len, max_len;
+  guint8 stop_chars = SYSLOG_CHAR_NAME_DELIM;
 
   src = *data;
   left = *length;
 
+  if (flags & LP_CHECK_HOSTNAME)
+    stop_chars |= SYSLOG_CHAR_HOSTNAME_INVALID;
+
   /* If we haven't already found the original hostname,
      look for it now. */
 
-  oldsrc = src;
-  oldleft = left;
-
-  while (left && *src != ' ' && *src != ':' && *src != '[' && dst < sizeof(hostname_buf) - 1)
-    {
-      if (G_UNLIKELY((flags & LP_CHECK_HOSTNAME) && (invalid_chars[((guint) *src) >> 8] & (1 << (((guint) *src) % 8)))))
-        {
-          break;
-        }
-      hostname_buf[dst++] = *src;
-      src++;
-      left--;
-    }
-  hostname_buf[dst] = 0;
+  max_len = MIN(left, 255);
+  for (len = 0; len < max_len && (syslog_char_classes[src[len]] & stop_chars) == 0; len++)
+    ;
 
-  if (left && *src == ' ' &&
-      (!bad_hostname || regexec(bad_hostname, hostname_buf, 0, NULL, 0)))
+  if (len < left && src[len] == ' ' &&
+      !_is_bad_hostname(src, len, bad_hostname))
     {
       /* This was a hostname. It came from a
          syslog-ng, since syslogd doesn't send
          hostnames. It's even better then the one
          we got from the AIX fwd message, if we
          did. */
-      *hostname_start = oldsrc;
-      *hostname_len = oldleft - left;
+      *hostname_start = src;
+      *hostname_len = len;
+      src += len;
+      left -= len;
     }
   else
     {
       *hostname_start = NULL;
       *hostname_len = 0;
-
-      src = oldsrc;
-      left = oldleft;
     }
 
-  if (*hostname_len > 255)
-    *hostname_len = 255;
-
   *data = src;
   *length = left;
 }
@@ -755,6 +883,7 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
     }
   else if (left && src[0] == '[')
     {
+      log_msg_reserve_sdata(self, sd_params_hint);
       sd_step(&src, &left);
       open_sd++;
       do
@@ -795,7 +924,7 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
           strncpy(sd_value_name + logmsg_sd_prefix_len, sd_id_name, sizeof(sd_value_name) - logmsg_sd_prefix_len);
           if (*src == ']')
             {
-              log_msg_set_value_by_name(self, sd_value_name, "", 0);
+              log_msg_set_value(self, log_msg_get_value_handle_cached(sd_value_name, strlen(sd_value_name)), "", 0);
             }
           else
             {
@@ -891,7 +1020,8 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
                   goto error;
                 }
 
-              log_msg_set_value_by_name(self, sd_value_name, sd_param_value, sd_param_value_len);
+              log_msg_set_value(self, log_msg_get_value_handle_cached(sd_value_name, strlen(sd_value_name)),
+                                sd_param_value, sd_param_value_len);
             }
 
           if (left && *src == ']')
@@ -916,6 +1046,9 @@ log_msg_parse_sd(LogMessage *self, const guchar **data, gint *length, const MsgF
     }
   ret = TRUE;
 error:
+  if (self->num_sdata)
+    sd_params_hint = self->num_sdata;
+
   /* FIXME: what happens if an error occurs? there's no way to return a
    * failure from here, but nevertheless we should do something sane, e.g.
    * don't parse the SD string, but skip to the end so that the $MSG
@@ -1027,7 +1160,7 @@ log_msg_parse_legacy(const MsgFormatOptions *parse_options,
       self->timestamps[LM_TS_STAMP] = self->timestamps[LM_TS_RECVD];
     }
 
-  if (parse_options->flags & LP_SANITIZE_UTF8 && !g_utf8_validate((gchar *) src, left, NULL))
+  if (parse_options->flags & LP_SANITIZE_UTF8 && !utf8_validate((gchar *) src, left))
     {
       GString sanitized_message;
       gchar buf[left * 6 + 1];
@@ -1051,7 +1184,7 @@ log_msg_parse_legacy(const MsgFormatOptions *parse_options,
       /* we don't need revalidation if sanitize already said it was valid utf8 */
       if ((parse_options->flags & LP_VALIDATE_UTF8) &&
           ((parse_options->flags & LP_SANITIZE_UTF8) == 0) &&
-          g_utf8_validate((gchar *) src, left, NULL))
+          utf8_validate((gchar *) src, left))
         self->flags |= LF_UTF8;
     }
 
@@ -1162,7 +1295,7 @@ log_msg_parse_syslog_proto(const MsgFormatOptions *parse_options, const guchar *
       src += 3;
       left -= 3;
     }
-  else if ((parse_options->flags & LP_VALIDATE_UTF8) && g_utf8_validate((gchar *) src, left, NULL))
+  else if ((parse_options->flags & LP_VALIDATE_UTF8) && utf8_validate((gchar *) src, left))
     {
       self->flags |= LF_UTF8;
     }
@@ -1239,5 +1372,5 @@ syslog_format_init(void)
       handles_initialized = TRUE;
     }
 
-  _init_parse_hostname_invalid_chars();
+  _init_syslog_char_classes();
 }
@@ -238,3 +238,71 @@ Test(dnscache, test_lru_lists)
   _fill_dns_cache(cache, cache_size);
   dns_cache_free(cache);
 }
+
+/* criterion assertions are not usable outside of the test thread, the
+ * hostname found is returned to be checked after the thread is joined */
+static gpointer
+_lookup_in_shared_cache(gpointer user_data)
+{
+  const gchar *hn = NULL;
+  gsize hn_len;
+  gboolean positive = FALSE;
+  guint32 ni = htonl(1);
+  gchar *result = NULL;
+
+  dns_caching_thread_init();
+  if (dns_caching_lookup(AF_INET, (void *) &ni, &hn, &hn_len, &positive) && positive)
+    result = g_strndup(hn, hn_len);
+  dns_caching_thread_deinit();
+  return result;
+}
+
+Test(dnscache, test_shared_cache)
+{
+  DNSCacheOptions options =
+  {
+    .cache_size = 100,
+    .expire = 600,
+    .expire_failed = 300,
+    .hosts = NULL,
+    .shared = TRUE
+  };
+  const gchar *hn = NULL;
+  gsize hn_len;
+  gboolean positive;
+  gchar *found_hostname;
+  GThread *thread;
+  guint32 ni;
+  gint i;
+
+  dns_caching_update_options(&options);
+  ni = htonl(1);
+  dns_caching_store(AF_INET, (void *) &ni, positive_hostname, TRUE);
+
+  thread = g_thread_create(_lookup_in_shared_cache, NULL, TRUE, NULL);
+  cr_assert_not_null(thread, "error creating lookup thread");
+  found_hostname = (gchar *) g_thread_join(thread);
+  cr_assert_not_null(found_hostname, "shared cache entry is not visible from another thread");
+  cr_assert_str_eq(found_hostname, positive_hostname, "shared cache returned an invalid entry, hn=%s\n", found_hostname);
+  g_free(found_hostname);
+
+  for (i = 2; i < 1002; i++)
+    {
+      ni = htonl(i);
+      dns_caching_store(AF_INET, (void *) &ni, positive_hostname, TRUE);
+    }
+
+  /* the size limit applies to the whole cache, the oldest entries are evicted */
+  for (i = 1; i < 800; i++)
+    {
+      ni = htonl(i);
+      cr_assert_not(dns_caching_lookup(AF_INET, (void *) &ni, &hn, &hn_len, &positive),
+                    "shared cache did not evict old entries, i=%d\n", i);
+    }
+  ni = htonl(1001);
+  cr_assert(dns_caching_lookup(AF_INET, (void *) &ni, &hn, &hn_len, &positive),
+            "shared cache evicted the most recent entry\n");
+
+  options.shared = FALSE;
+  dns_caching_update_options(&options);
+}
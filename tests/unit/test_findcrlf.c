@@ -92,6 +92,13 @@ ParameterizedTestParameters(findcrlf, test)
     { "abcdefghijklmnopqrstuvwxy\rb\rc\r", 30, 25 },
     { "abcdefghijklmnopqrstuvwxyz\rb\rc\r", 31, 26 },
 
+    { "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\nb\nc\n", 57, 52 },
+    { "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\rb\rc\r", 57, 52 },
+    { "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklm\n", 66, 65 },
+    { "abcdefghijklmnopqrstuvwxyzabcdef\r\n", 34, 32 },
+    { "abcdefghijklmnop\0qrstuvwxyz\nb\nc\n", 31, -1 },
+    { "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz\0\n", 54, -1 },
+
     { "a",  1, -1 },
     { "ab",  2, -1 },
     { "abc",  3, -1 },
@@ -117,7 +124,8 @@ ParameterizedTestParameters(findcrlf, test)
     { "abcdefghijklmnopqrstuvw", 23, -1 },
     { "abcdefghijklmnopqrstuvwx", 24, -1 },
     { "abcdefghijklmnopqrstuvwxy", 25, -1 },
-    { "abcdefghijklmnopqrstuvwxyz", 26, -1 }
+    { "abcdefghijklmnopqrstuvwxyz", 26, -1 },
+    { "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklm", 65, -1 }
   };
 
   return cr_make_param_array(struct findcrlf_params, params, sizeof (params) / sizeof(struct findcrlf_params));
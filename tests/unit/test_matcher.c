@@ -23,6 +23,7 @@
 #include <criterion/criterion.h>
 
 #include "logmatcher.h"
+#include "pcre-utils.h"
 #include "apphook.h"
 #include "plugin.h"
 #include "cfg.h"
@@ -266,3 +267,63 @@ Test(matcher, pcre812_incompatibility, .description = "tests a pcre 8.12 incompa
   testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki",
                    "([[:digit:]]{1,3}\\.){3}[[:digit:]]{1,3}", "foo", "wikiwiki", _construct_matcher(LMF_GLOBAL, log_matcher_pcre_re_new));
 }
+
+static gboolean
+_pcre_jit_available(void)
+{
+  gint jit = 0;
+
+#ifdef PCRE_CONFIG_JIT
+  pcre_config(PCRE_CONFIG_JIT, &jit);
+#endif
+  return jit;
+}
+
+static gboolean
+_pcre_is_jit_compiled(const gchar *re)
+{
+  pcre *pattern;
+  pcre_extra *extra;
+  const gchar *errptr = NULL;
+  gint erroffset;
+  gint jit = 0;
+
+  pattern = pcre_compile(re, 0, &errptr, &erroffset, NULL);
+  cr_assert_not_null(pattern, "pattern=%s, error=%s", re, errptr);
+  extra = pcre_utils_study(pattern, &errptr);
+  cr_assert_null(errptr, "pattern=%s, error=%s", re, errptr);
+#ifdef PCRE_INFO_JIT
+  pcre_fullinfo(pattern, extra, PCRE_INFO_JIT, &jit);
+#endif
+  if (extra)
+    pcre_free_study(extra);
+  pcre_free(pattern);
+  return jit;
+}
+
+static void
+_assert_pcre_match_and_replace(void)
+{
+  testcase_match("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "(?<word>tűrő)",
+                 TRUE, _construct_matcher(0, log_matcher_pcre_re_new));
+  testcase_match("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "^tűrő",
+                 FALSE, _construct_matcher(0, log_matcher_pcre_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki", "(wiki).+", "#$1#", "#wiki#",
+                   _construct_matcher(0, log_matcher_pcre_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki", "wi", "kuku", "kukukikukuki",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre_re_new));
+}
+
+Test(matcher, pcre_jit, .description = "patterns are JIT compiled if PCRE supports it")
+{
+  cr_assert_eq(_pcre_is_jit_compiled("(wiki).+"), _pcre_jit_available());
+  _assert_pcre_match_and_replace();
+}
+
+Test(matcher, pcre_without_jit, .description = "patterns are interpreted if JIT is not available")
+{
+  pcre_utils_set_jit_enabled(FALSE);
+  cr_assert_not(_pcre_is_jit_compiled("(wiki).+"));
+  _assert_pcre_match_and_replace();
+  pcre_utils_set_jit_enabled(TRUE);
+}
@@ -459,6 +459,71 @@ Test(msgparse, test_hostname)
   run_parameterized_test(params);
 }
 
+Test(msgparse, test_hostname_is_checked)
+{
+  struct msgparse_params params[] =
+  {
+    {
+      "<7>2006-10-29T02:00:00.156+01:00 bzorp.example-1 openvpn[2499]: PTHREAD support initialized", LP_CHECK_HOSTNAME | LP_EXPECT_HOSTNAME, NULL,
+      7,             // pri
+      1162083600, 156000, 3600,    // timestamp (sec/usec/zone)
+      "bzorp.example-1",     // host
+      "openvpn",        // openvpn
+      "PTHREAD support initialized", // msg
+      NULL, "2499", NULL, ignore_sdata_pairs
+    },
+    {NULL}
+  };
+
+  run_parameterized_test(params);
+}
+
+Test(msgparse, test_timestamps_of_the_same_second)
+{
+  struct msgparse_params params[] =
+  {
+    {
+      "<7>2006-10-29T02:00:00.156+01:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+      7,             // pri
+      1162083600, 156000, 3600,    // timestamp (sec/usec/zone)
+      "bzorp",         // host
+      "openvpn",        // openvpn
+      "PTHREAD support initialized", // msg
+      NULL, NULL, NULL, ignore_sdata_pairs
+    },
+    {
+      "<7>2006-10-29T02:00:00.5+01:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+      7,             // pri
+      1162083600, 500000, 3600,    // timestamp (sec/usec/zone)
+      "bzorp",         // host
+      "openvpn",        // openvpn
+      "PTHREAD support initialized", // msg
+      NULL, NULL, NULL, ignore_sdata_pairs
+    },
+    {
+      "<7>2006-10-29T02:00:00+02:00 bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+      7,             // pri
+      1162080000, 0, 7200,    // timestamp (sec/usec/zone)
+      "bzorp",         // host
+      "openvpn",        // openvpn
+      "PTHREAD support initialized", // msg
+      NULL, NULL, NULL, ignore_sdata_pairs
+    },
+    {
+      "<7>2006-10-29T02:00:00Z bzorp openvpn[2499]: PTHREAD support initialized", LP_EXPECT_HOSTNAME, NULL,
+      7,             // pri
+      1162087200, 0, 0,    // timestamp (sec/usec/zone)
+      "bzorp",         // host
+      "openvpn",        // openvpn
+      "PTHREAD support initialized", // msg
+      NULL, NULL, NULL, ignore_sdata_pairs
+    },
+    {NULL}
+  };
+
+  run_parameterized_test(params);
+}
+
 Test(msgparse, test_timestamp_others)
 {
   struct msgparse_params params[] =
@@ -1067,6 +1132,70 @@ Test(msgparse, test_expected_sd_pairs_without_sd_param)
   run_parameterized_test(params);
 }
 
+Test(msgparse, test_expected_sd_pairs_many_sd_params)
+{
+  struct sdata_pair expected_sd_pairs_many_params[] =
+  {
+    { ".SDATA.many@0.p01", "1"},
+    { ".SDATA.many@0.p02", "2"},
+    { ".SDATA.many@0.p03", "3"},
+    { ".SDATA.many@0.p04", "4"},
+    { ".SDATA.many@0.p05", "5"},
+    { ".SDATA.many@0.p06", "6"},
+    { ".SDATA.many@0.p07", "7"},
+    { ".SDATA.many@0.p08", "8"},
+    { ".SDATA.many@0.p09", "9"},
+    { ".SDATA.many@0.p10", "10"},
+    { ".SDATA.many@0.p11", "11"},
+    { ".SDATA.many@0.p12", "12"},
+    { ".SDATA.many@0.p13", "13"},
+    { ".SDATA.many@0.p14", "14"},
+    { ".SDATA.many@0.p15", "15"},
+    { ".SDATA.many@0.p16", "16"},
+    { ".SDATA.many@0.p17", "17"},
+    { ".SDATA.many@0.p18", "18"},
+    { ".SDATA.many@0.p19", "19"},
+    { ".SDATA.many@0.p20", "20"},
+    { ".SDATA.other@0.a", "b"},
+    {  NULL , NULL}
+  };
+
+  struct msgparse_params params[] =
+  {
+    //Testing more SD-PARAMs than the initial sdata allocation, the same
+    //message is parsed twice so that the second run reuses cached name handles
+    {
+      "<134>1 2009-10-16T11:51:56+02:00 host prog 20208 - [many@0 p01=\"1\" p02=\"2\" p03=\"3\" p04=\"4\" p05=\"5\" p06=\"6\" p07=\"7\" p08=\"8\" p09=\"9\" p10=\"10\" p11=\"11\" p12=\"12\" p13=\"13\" p14=\"14\" p15=\"15\" p16=\"16\" p17=\"17\" p18=\"18\" p19=\"19\" p20=\"20\"][bare][other@0 a=\"b\"] An application event log entry...",
+      LP_SYSLOG_PROTOCOL, NULL,
+      134,                         // pri
+      1255686716, 0, 7200, // timestamp (sec/usec/zone)
+      "host",                // host
+      "prog", //app
+      "An application event log entry...", // msg
+      "[many@0 p01=\"1\" p02=\"2\" p03=\"3\" p04=\"4\" p05=\"5\" p06=\"6\" p07=\"7\" p08=\"8\" p09=\"9\" p10=\"10\" p11=\"11\" p12=\"12\" p13=\"13\" p14=\"14\" p15=\"15\" p16=\"16\" p17=\"17\" p18=\"18\" p19=\"19\" p20=\"20\"][bare][other@0 a=\"b\"]",//sd_str
+      "20208",//processid
+      "",//msgid
+      expected_sd_pairs_many_params
+    },
+    {
+      "<134>1 2009-10-16T11:51:56+02:00 host prog 20208 - [many@0 p01=\"1\" p02=\"2\" p03=\"3\" p04=\"4\" p05=\"5\" p06=\"6\" p07=\"7\" p08=\"8\" p09=\"9\" p10=\"10\" p11=\"11\" p12=\"12\" p13=\"13\" p14=\"14\" p15=\"15\" p16=\"16\" p17=\"17\" p18=\"18\" p19=\"19\" p20=\"20\"][bare][other@0 a=\"b\"] An application event log entry...",
+      LP_SYSLOG_PROTOCOL, NULL,
+      134,                         // pri
+      1255686716, 0, 7200, // timestamp (sec/usec/zone)
+      "host",                // host
+      "prog", //app
+      "An application event log entry...", // msg
+      "[many@0 p01=\"1\" p02=\"2\" p03=\"3\" p04=\"4\" p05=\"5\" p06=\"6\" p07=\"7\" p08=\"8\" p09=\"9\" p10=\"10\" p11=\"11\" p12=\"12\" p13=\"13\" p14=\"14\" p15=\"15\" p16=\"16\" p17=\"17\" p18=\"18\" p19=\"19\" p20=\"20\"][bare][other@0 a=\"b\"]",//sd_str
+      "20208",//processid
+      "",//msgid
+      expected_sd_pairs_many_params
+    },
+    {NULL}
+  };
+
+  run_parameterized_test(params);
+}
+
 Test(msgparse, test_simple_message)
 {
   struct msgparse_params params[] =
@@ -780,6 +780,49 @@ Test(zone, test_time_zones)
     assert_time_zone(test_cases[i]);
 }
 
+static void
+assert_cached_conversions_match_libc(const gchar *time_zone, time_t start, time_t end, time_t step)
+{
+  struct tm expected, actual;
+  time_t t, expected_t, actual_t;
+
+  set_time_zone(time_zone);
+  for (t = start; t < end; t += step)
+    {
+      localtime_r(&t, &expected);
+      cached_localtime(&t, &actual);
+      cr_assert(expected.tm_year == actual.tm_year && expected.tm_mon == actual.tm_mon &&
+                expected.tm_mday == actual.tm_mday && expected.tm_hour == actual.tm_hour &&
+                expected.tm_min == actual.tm_min && expected.tm_sec == actual.tm_sec &&
+                expected.tm_wday == actual.tm_wday && expected.tm_yday == actual.tm_yday &&
+                expected.tm_isdst == actual.tm_isdst,
+                "cached_localtime() mismatch, zone: %s, time: %ld", time_zone, (glong) t);
+
+      /* shift the broken down time so that it doesn't match the previous call */
+      expected.tm_min += 7;
+      expected.tm_isdst = -1;
+      actual = expected;
+      expected_t = mktime(&expected);
+      actual_t = cached_mktime(&actual);
+      cr_assert_eq(actual_t, expected_t, "cached_mktime() mismatch, zone: %s, time: %ld", time_zone, (glong) t);
+      cr_assert_eq(actual.tm_hour, expected.tm_hour, "cached_mktime() mismatch, zone: %s, time: %ld", time_zone,
+                   (glong) t);
+    }
+}
+
+Test(zone, test_cached_conversions_match_libc)
+{
+  /* around the DST changes of 2010 in Europe and the US, both with zone
+   * files and POSIX rules in TZ */
+  assert_cached_conversions_match_libc("Europe/Budapest", 1269737000 - 3 * 86400, 1269737000 + 3 * 86400, 997);
+  assert_cached_conversions_match_libc("Europe/Budapest", 1288486800 - 3 * 86400, 1288486800 + 3 * 86400, 997);
+  assert_cached_conversions_match_libc("America/New_York", 1289109600 - 3 * 86400, 1289109600 + 3 * 86400, 997);
+  assert_cached_conversions_match_libc("MET-1METDST", 1288486800 - 3 * 86400, 1288486800 + 3 * 86400, 997);
+  assert_cached_conversions_match_libc("EST5EDT", 1289109600 - 3 * 86400, 1289109600 + 3 * 86400, 997);
+  /* a whole year in larger steps */
+  assert_cached_conversions_match_libc("Australia/Victoria", 1262304000, 1293840000, 7 * 3607);
+}
+
 Test(zone, test_logstamp_format)
 {
   LogStamp stamp;